@@ -153,6 +153,7 @@ class BenchmarkCore:
             - success: Whether test completed successfully
             - total_time: Total execution time in seconds
             - tokens_per_second: Calculated throughput
+            - decode_tokens_per_second: Server-side generation rate
             - response: Generated response text
 
         Raises:
@@ -193,6 +194,10 @@ class BenchmarkCore:
 
             tokens_per_second = completion_tokens / total_time if total_time > 0 else 0
 
+            # Decode rate as measured by the server (excludes prompt processing)
+            timings = data.get("timings", {})
+            decode_tokens_per_second = timings.get("predicted_per_second", tokens_per_second)
+
             response_content = data.get("choices", [{}])[0].get("message", {}).get("content", "")
 
             return {
@@ -203,6 +208,7 @@ class BenchmarkCore:
                 "prompt_tokens": prompt_tokens,
                 "completion_tokens": completion_tokens,
                 "tokens_per_second": round(tokens_per_second, 2),
+                "decode_tokens_per_second": round(decode_tokens_per_second, 2),
                 "response_length": len(response_content),
                 "response": response_content
             }
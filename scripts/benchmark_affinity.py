@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""
+Decode throughput for each compute thread pinning policy.
+
+Recreates the llama.cpp container once per ZEN5_AFFINITY policy (off,
+compact, spread, physical), waits for the model to load and measures
+decode tokens per second with the standard benchmark prompts. Results
+are compared against the unpinned baseline.
+
+Usage (run from repo root):
+    python scripts/benchmark_affinity.py
+    python scripts/benchmark_affinity.py --policies off,spread --runs 10
+    python scripts/benchmark_affinity.py --service-cpus 11
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+from datetime import datetime
+from pathlib import Path
+from typing import Dict, Any, List, Optional
+
+# Add repo root to Python path for benchmark package import
+sys.path.insert(0, str(Path(__file__).parent.parent))
+
+from benchmark.core import BenchmarkCore, BenchmarkError, APIConnectionError
+from benchmark.constants import EXIT_SUCCESS, EXIT_FAILURE, STATUS_OK, STATUS_ERROR
+from benchmark.collectors import CPUInfoCollector
+
+POLICIES = ["off", "compact", "spread", "physical"]
+
+
+def restart_server(service: str, policy: str, service_cpus: Optional[str]) -> bool:
+    """
+    Recreate the server container with the given pinning policy.
+
+    Args:
+        service: docker compose service name
+        policy: ZEN5_AFFINITY value
+        service_cpus: ZEN5_SERVICE_CPUS value (None leaves it unset)
+
+    Returns:
+        True if docker compose succeeded
+    """
+    env = dict(os.environ)
+    env["ZEN5_AFFINITY"] = policy
+    env["ZEN5_SERVICE_CPUS"] = service_cpus or ""
+
+    print(f"Restarting {service} with ZEN5_AFFINITY={policy}")
+    result = subprocess.run(
+        ["docker", "compose", "up", "-d", "--force-recreate", service],
+        env=env, capture_output=True, text=True
+    )
+    if result.returncode != 0:
+        print(f"Container restart: {STATUS_ERROR}\n{result.stderr}", file=sys.stderr)
+        return False
+    return True
+
+
+def decode_stats(results: Dict[str, Any]) -> Dict[str, float]:
+    """
+    Aggregate decode and end-to-end tokens per second over all prompts.
+
+    Args:
+        results: Output of BenchmarkCore.run_benchmark()
+
+    Returns:
+        Dictionary with decode_avg, decode_median, overall_avg
+    """
+    decode: List[float] = []
+    overall: List[float] = []
+    for prompt in results["prompts"].values():
+        for run in prompt.get("results", []):
+            if run.get("success"):
+                decode.append(run["decode_tokens_per_second"])
+                overall.append(run["tokens_per_second"])
+
+    if not decode:
+        return {}
+    return {
+        "decode_avg": round(statistics.mean(decode), 2),
+        "decode_median": round(statistics.median(decode), 2),
+        "overall_avg": round(statistics.mean(overall), 2)
+    }
+
+
+def print_comparison(summary: Dict[str, Dict[str, float]]) -> None:
+    """Print decode throughput per policy relative to the unpinned run."""
+    print()
+    print("=" * 60)
+    print("Decode Throughput by Pinning Policy")
+    print("=" * 60)
+    print(f"{'Policy':<12} {'Decode tok/s':>14} {'Median':>10} {'End-to-end':>12} {'vs off':>8}")
+    print("-" * 60)
+
+    baseline = summary.get("off", {}).get("decode_avg")
+    for policy, stats in summary.items():
+        if not stats:
+            print(f"{policy:<12} {'failed':>14}")
+            continue
+        delta = ""
+        if baseline:
+            delta = f"{(stats['decode_avg'] / baseline - 1) * 100:+.1f}%"
+        print(f"{policy:<12} {stats['decode_avg']:>14.2f} {stats['decode_median']:>10.2f} "
+              f"{stats['overall_avg']:>12.2f} {delta:>8}")
+    print("=" * 60)
+
+
+def create_parser() -> argparse.ArgumentParser:
+    """Create command line argument parser."""
+    parser = argparse.ArgumentParser(
+        description="Decode tok/s for each ZEN5_AFFINITY thread pinning policy",
+        formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("--policies", default=",".join(POLICIES),
+                        help="Comma-separated policies to compare (default: all)")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="Number of test runs per prompt (default: 5)")
+    parser.add_argument("--prompts",
+                        help="Comma-separated list of prompts to test (default: all)")
+    parser.add_argument("--host", default="localhost", help="API host address")
+    parser.add_argument("--port", type=int, default=8001, help="API port number")
+    parser.add_argument("--timeout", type=int, default=30,
+                        help="Request timeout in seconds (default: 30)")
+    parser.add_argument("--service", default="llama-zen5",
+                        help="docker compose service to restart (default: llama-zen5)")
+    parser.add_argument("--service-cpus",
+                        help="ZEN5_SERVICE_CPUS for the HTTP threads (default: library choice)")
+    parser.add_argument("--load-attempts", type=int, default=150,
+                        help="API checks (2s apart) while the model loads (default: 150)")
+    parser.add_argument("--output",
+                        help="Output JSON filename (default: results/affinity_<timestamp>.json)")
+    return parser
+
+
+def main() -> int:
+    """
+    Main function to compare pinning policies.
+
+    Returns:
+        Exit code: 0 for success, 1 for failure.
+    """
+    args = create_parser().parse_args()
+    policies = [p.strip() for p in args.policies.split(",") if p.strip()]
+    prompts = [p.strip() for p in args.prompts.split(",")] if args.prompts else None
+
+    summary: Dict[str, Dict[str, float]] = {}
+    runs: Dict[str, Any] = {}
+    try:
+        for policy in policies:
+            if policy not in POLICIES:
+                print(f"Policy validation: {STATUS_ERROR} (unknown policy: {policy})",
+                      file=sys.stderr)
+                return EXIT_FAILURE
+            if not restart_server(args.service, policy, args.service_cpus):
+                return EXIT_FAILURE
+
+            benchmark = BenchmarkCore(host=args.host, port=args.port,
+                                      timeout=args.timeout, label=f"affinity_{policy}")
+            if not benchmark.wait_for_api(max_attempts=args.load_attempts):
+                print("ERROR: API not responding after restart", file=sys.stderr)
+                summary[policy] = {}
+                continue
+
+            results = benchmark.run_benchmark(num_runs=args.runs, prompts=prompts,
+                                              collectors=[CPUInfoCollector()])
+            summary[policy] = decode_stats(results)
+            runs[policy] = results
+            print(f"Policy {policy}: {STATUS_OK} ({summary[policy].get('decode_avg', 0)} decode tok/s)")
+            print()
+
+        print_comparison(summary)
+
+        filename = args.output or f"results/affinity_{datetime.now().strftime('%Y%m%d_%H%M%S')}.json"
+        path = Path(filename)
+        path.parent.mkdir(parents=True, exist_ok=True)
+        with open(path, "w") as f:
+            json.dump({"summary": summary, "runs": runs}, f, indent=2)
+        print(f"\nResults saved: {filename}")
+        return EXIT_SUCCESS
+
+    except (BenchmarkError, APIConnectionError) as e:
+        print(f"ERROR: Benchmark execution failed: {e}", file=sys.stderr)
+        return EXIT_FAILURE
+    except KeyboardInterrupt:
+        print("\nBenchmark interrupted by user", file=sys.stderr)
+        return EXIT_FAILURE
+    finally:
+        # Leave the server running unpinned, as configured by default
+        if policies and policies[-1] != "off":
+            restart_server(args.service, "off", None)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
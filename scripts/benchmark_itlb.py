@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""
+iTLB misses and throughput with and without code on huge pages.
+
+Recreates the llama.cpp container with ZEN5_TEXT_HUGEPAGES=0 and then 1,
+waits for the model to load and runs the standard benchmark prompts
+under perf stat. Reports iTLB miss counts and rates, IPC and tokens per
+second for both, and the change caused by the remap.
+
+Usage (run from repo root):
+    python scripts/benchmark_itlb.py
+    python scripts/benchmark_itlb.py --runs 10 --text-match llama,ggml
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+from datetime import datetime
+from pathlib import Path
+from typing import Dict, Any, List, Optional
+
+# Add repo root to Python path for benchmark package import
+sys.path.insert(0, str(Path(__file__).parent.parent))
+
+from benchmark.core import BenchmarkCore, BenchmarkError, APIConnectionError
+from benchmark.constants import EXIT_SUCCESS, EXIT_FAILURE, STATUS_OK, STATUS_ERROR
+from benchmark.collectors import PerfCollector, CPUInfoCollector
+
+SETTINGS = {"before": "0", "after": "1"}
+
+
+def restart_server(service: str, text_hugepages: str, text_match: Optional[str]) -> bool:
+    """
+    Recreate the server container with code on huge pages on or off.
+
+    Args:
+        service: docker compose service name
+        text_hugepages: ZEN5_TEXT_HUGEPAGES value
+        text_match: ZEN5_TEXT_MATCH value (None leaves the default)
+
+    Returns:
+        True if docker compose succeeded
+    """
+    env = dict(os.environ)
+    env["ZEN5_TEXT_HUGEPAGES"] = text_hugepages
+    if text_match:
+        env["ZEN5_TEXT_MATCH"] = text_match
+
+    print(f"Restarting {service} with ZEN5_TEXT_HUGEPAGES={text_hugepages}")
+    result = subprocess.run(
+        ["docker", "compose", "up", "-d", "--force-recreate", service],
+        env=env, capture_output=True, text=True
+    )
+    if result.returncode != 0:
+        print(f"Container restart: {STATUS_ERROR}\n{result.stderr}", file=sys.stderr)
+        return False
+    return True
+
+
+def itlb_stats(results: Dict[str, Any]) -> Dict[str, float]:
+    """
+    Extract iTLB counters and throughput from one benchmark run.
+
+    Args:
+        results: Output of BenchmarkCore.run_benchmark()
+
+    Returns:
+        Dictionary with itlb_misses, itlb_miss_rate, ipc, decode_avg, overall_avg
+    """
+    decode: List[float] = []
+    overall: List[float] = []
+    for prompt in results["prompts"].values():
+        for run in prompt.get("results", []):
+            if run.get("success"):
+                decode.append(run["decode_tokens_per_second"])
+                overall.append(run["tokens_per_second"])
+
+    perf = results.get("summary", {}).get("perf", {})
+    stats: Dict[str, float] = {}
+    if "iTLB-load-misses" in perf:
+        stats["itlb_misses"] = perf["iTLB-load-misses"]
+    if "iTLB_miss_rate" in perf:
+        stats["itlb_miss_rate"] = perf["iTLB_miss_rate"]
+    if "ipc" in perf:
+        stats["ipc"] = perf["ipc"]
+    if decode:
+        stats["decode_avg"] = round(statistics.mean(decode), 2)
+        stats["overall_avg"] = round(statistics.mean(overall), 2)
+    return stats
+
+
+def change(before: Dict[str, float], after: Dict[str, float], key: str) -> str:
+    """Relative change of one metric, or an empty string if unavailable."""
+    if before.get(key) and key in after:
+        return f"{(after[key] / before[key] - 1) * 100:+.1f}%"
+    return ""
+
+
+def print_comparison(summary: Dict[str, Dict[str, float]]) -> None:
+    """Print iTLB counters and throughput before and after the remap."""
+    before = summary.get("before", {})
+    after = summary.get("after", {})
+    rows = [
+        ("iTLB misses", "itlb_misses", "{:,.0f}"),
+        ("iTLB miss rate (%)", "itlb_miss_rate", "{:.3f}"),
+        ("IPC", "ipc", "{:.2f}"),
+        ("Decode tok/s", "decode_avg", "{:.2f}"),
+        ("End-to-end tok/s", "overall_avg", "{:.2f}"),
+    ]
+
+    print()
+    print("=" * 64)
+    print("Code on Huge Pages (ZEN5_TEXT_HUGEPAGES)")
+    print("=" * 64)
+    print(f"{'Metric':<20} {'Before':>14} {'After':>14} {'Change':>10}")
+    print("-" * 64)
+    for label, key, fmt in rows:
+        b = fmt.format(before[key]) if key in before else "n/a"
+        a = fmt.format(after[key]) if key in after else "n/a"
+        print(f"{label:<20} {b:>14} {a:>14} {change(before, after, key):>10}")
+    print("=" * 64)
+    if "itlb_misses" not in before:
+        print("iTLB events unavailable: check perf permissions (perf_event_paranoid)")
+
+
+def create_parser() -> argparse.ArgumentParser:
+    """Create command line argument parser."""
+    parser = argparse.ArgumentParser(
+        description="iTLB misses and tok/s with ZEN5_TEXT_HUGEPAGES off and on",
+        formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("--runs", type=int, default=5,
+                        help="Number of test runs per prompt (default: 5)")
+    parser.add_argument("--prompts",
+                        help="Comma-separated list of prompts to test (default: all)")
+    parser.add_argument("--host", default="localhost", help="API host address")
+    parser.add_argument("--port", type=int, default=8001, help="API port number")
+    parser.add_argument("--timeout", type=int, default=30,
+                        help="Request timeout in seconds (default: 30)")
+    parser.add_argument("--service", default="llama-zen5",
+                        help="docker compose service to restart (default: llama-zen5)")
+    parser.add_argument("--container", default="llama-zen5",
+                        help="Container name for perf stat (default: llama-zen5)")
+    parser.add_argument("--text-match",
+                        help="ZEN5_TEXT_MATCH for the remapped libraries (default: library choice)")
+    parser.add_argument("--load-attempts", type=int, default=150,
+                        help="API checks (2s apart) while the model loads (default: 150)")
+    parser.add_argument("--output",
+                        help="Output JSON filename (default: results/itlb_<timestamp>.json)")
+    return parser
+
+
+def main() -> int:
+    """
+    Main function to compare iTLB behaviour before and after the remap.
+
+    Returns:
+        Exit code: 0 for success, 1 for failure.
+    """
+    args = create_parser().parse_args()
+    prompts = [p.strip() for p in args.prompts.split(",")] if args.prompts else None
+
+    summary: Dict[str, Dict[str, float]] = {}
+    runs: Dict[str, Any] = {}
+    try:
+        for name, setting in SETTINGS.items():
+            if not restart_server(args.service, setting, args.text_match):
+                return EXIT_FAILURE
+
+            benchmark = BenchmarkCore(host=args.host, port=args.port,
+                                      timeout=args.timeout, label=f"itlb_{name}")
+            if not benchmark.wait_for_api(max_attempts=args.load_attempts):
+                print("ERROR: API not responding after restart", file=sys.stderr)
+                summary[name] = {}
+                continue
+
+            results = benchmark.run_benchmark(
+                num_runs=args.runs, prompts=prompts,
+                collectors=[PerfCollector(container_name=args.container), CPUInfoCollector()])
+            summary[name] = itlb_stats(results)
+            runs[name] = results
+            print(f"Text remap {name}: {STATUS_OK} "
+                  f"(iTLB miss rate {summary[name].get('itlb_miss_rate', 'n/a')}%)")
+            print()
+
+        print_comparison(summary)
+
+        filename = args.output or f"results/itlb_{datetime.now().strftime('%Y%m%d_%H%M%S')}.json"
+        path = Path(filename)
+        path.parent.mkdir(parents=True, exist_ok=True)
+        with open(path, "w") as f:
+            json.dump({"summary": summary, "runs": runs}, f, indent=2)
+        print(f"\nResults saved: {filename}")
+        return EXIT_SUCCESS
+
+    except (BenchmarkError, APIConnectionError) as e:
+        print(f"ERROR: Benchmark execution failed: {e}", file=sys.stderr)
+        return EXIT_FAILURE
+    except KeyboardInterrupt:
+        print("\nBenchmark interrupted by user", file=sys.stderr)
+        return EXIT_FAILURE
+    finally:
+        # Leave the server as configured by default
+        restart_server(args.service, "0", None)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,390 @@
+/*
+ * bf16.cpp
+ *
+ * Activations are converted once per call into a zero-padded BF16
+ * buffer. The GEMM tile is 4 weight rows x 4 activation rows (16 zmm
+ * accumulators of 32 products each). Columns are taken in passes whose
+ * activation tile fits half of L1 and weight rows in blocks that fill
+ * half of L2, so a block is read from memory once and reused from L2
+ * for every group of activation rows. GEMV is the same tile with one
+ * activation row. Rows are split across the compute pool
+ * above the SGEMV / SGEMM parallel thresholds.
+ */
+
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf16.h"
+#include "../threads/compute_pool.h"
+#include "../threads/kernel_tasks.h"
+#include "../topology.h"
+#include "../cpu_validator.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+const int BF16_STEP = 32;               // BF16 values per zmm
+const int F16_STEP = 16;                // F16 values per ymm
+const int TILE_ROWS = 4;                // Weight rows per tile
+const int TILE_COLS = 4;                // Activation rows per tile
+const size_t CONVERT_CHUNK = 64 * 1024; // Values per conversion task
+
+static bool native = false;
+
+void bf16_init() {
+    bool supported = cpu_has_avx512_bf16();
+    native = supported && env_flag("ZEN5_BF16_NATIVE", true);
+    if (native) {
+        DEBUG_PRINT("BF16: vdpbf16ps (AVX512_BF16)");
+    } else {
+        DEBUG_PRINT("BF16: FMA path (%s)", supported ? "ZEN5_BF16_NATIVE=0" : "no AVX512_BF16");
+    }
+}
+
+bool bf16_native() {
+    return native;
+}
+
+// 16 FP32 values to BF16 as vcvtne2ps2bf16 does it: nearest even,
+// NaNs quieted, denormals to signed zero
+static inline __m256i round_bf16(__m512 v) {
+    __m512i u = _mm512_castps_si512(v);
+    __m512i high = _mm512_srli_epi32(u, 16);
+    __m512i lsb = _mm512_and_si512(high, _mm512_set1_epi32(1));
+    __m512i r = _mm512_srli_epi32(_mm512_add_epi32(u, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7FFF))), 16);
+    __m512i magnitude = _mm512_and_si512(u, _mm512_set1_epi32(0x7FFFFFFF));
+    __mmask16 nan = _mm512_cmpgt_epu32_mask(magnitude, _mm512_set1_epi32(0x7F800000));
+    __mmask16 tiny = _mm512_testn_epi32_mask(u, _mm512_set1_epi32(0x7F800000));
+    r = _mm512_mask_or_epi32(r, nan, high, _mm512_set1_epi32(0x40));
+    r = _mm512_mask_and_epi32(r, tiny, high, _mm512_set1_epi32(0x8000));
+    return _mm512_cvtepi32_epi16(r);
+}
+
+// 32 FP32 values (lo then hi) to BF16
+template <bool NATIVE>
+static inline __m512i to_bf16(__m512 lo, __m512 hi) {
+    if (NATIVE) {
+        return (__m512i)_mm512_cvtne2ps_pbh(hi, lo);
+    }
+    return _mm512_inserti64x4(_mm512_castsi256_si512(round_bf16(lo)), round_bf16(hi), 1);
+}
+
+static inline __m512 widen(__m256i v) {
+    return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(v), 16));
+}
+
+template <bool NATIVE>
+static void convert_to_bf16(const float* x, uint16_t* y, size_t n) {
+    size_t i = 0;
+    for (; i + BF16_STEP <= n; i += BF16_STEP) {
+        __m512i v = to_bf16<NATIVE>(_mm512_loadu_ps(x + i), _mm512_loadu_ps(x + i + 16));
+        _mm512_storeu_si512((void*)(y + i), v);
+    }
+    if (i < n) {
+        size_t left = n - i;
+        __mmask16 lo = left >= 16 ? 0xFFFF : (__mmask16)((1u << left) - 1);
+        __mmask16 hi = left > 16 ? (__mmask16)((1u << (left - 16)) - 1) : 0;
+        __m512i v = to_bf16<NATIVE>(_mm512_maskz_loadu_ps(lo, x + i), _mm512_maskz_loadu_ps(hi, x + i + 16));
+        _mm512_mask_storeu_epi16(y + i, (__mmask32)((1ULL << left) - 1), v);
+    }
+}
+
+static void convert_to_fp32(const uint16_t* x, float* y, size_t n) {
+    size_t i = 0;
+    for (; i + F16_STEP <= n; i += F16_STEP) {
+        _mm512_storeu_ps(y + i, widen(_mm256_loadu_si256((const __m256i*)(x + i))));
+    }
+    if (i < n) {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(y + i, mask, widen(_mm256_maskz_loadu_epi16(mask, x + i)));
+    }
+}
+
+struct ConvertJob {
+    const void* in;
+    void* out;
+    size_t n;
+    bool to_bf16;
+};
+
+static void convert_task(void* arg, int task) {
+    const ConvertJob* job = (const ConvertJob*)arg;
+    size_t first = (size_t)task * CONVERT_CHUNK;
+    size_t count = job->n - first < CONVERT_CHUNK ? job->n - first : CONVERT_CHUNK;
+    if (!job->to_bf16) {
+        convert_to_fp32((const uint16_t*)job->in + first, (float*)job->out + first, count);
+    } else if (native) {
+        convert_to_bf16<true>((const float*)job->in + first, (uint16_t*)job->out + first, count);
+    } else {
+        convert_to_bf16<false>((const float*)job->in + first, (uint16_t*)job->out + first, count);
+    }
+}
+
+static void convert(const void* in, void* out, size_t n, bool to_bf16) {
+    ConvertJob job = {in, out, n, to_bf16};
+    int tasks = (int)((n + CONVERT_CHUNK - 1) / CONVERT_CHUNK);
+    if (n >= SGEMV_PARALLEL_WORK) {
+        compute_pool_run(convert_task, &job, tasks);
+    } else {
+        for (int task = 0; task < tasks; task++) {
+            convert_task(&job, task);
+        }
+    }
+}
+
+void fp32_to_bf16(const float* x, uint16_t* y, size_t n) {
+    convert(x, y, n, true);
+}
+
+void bf16_to_fp32(const uint16_t* x, float* y, size_t n) {
+    convert(x, y, n, false);
+}
+
+// acc += w . x over 32 BF16 pairs
+template <bool NATIVE>
+static inline __m512 dot_step(__m512 acc, __m512i w, __m512i x) {
+    if (NATIVE) {
+        return _mm512_dpbf16_ps(acc, (__m512bh)w, (__m512bh)x);
+    }
+    acc = _mm512_fmadd_ps(widen(_mm512_castsi512_si256(w)), widen(_mm512_castsi512_si256(x)), acc);
+    return _mm512_fmadd_ps(widen(_mm512_extracti64x4_epi64(w, 1)), widen(_mm512_extracti64x4_epi64(x, 1)), acc);
+}
+
+struct Bf16Job {
+    const uint16_t* w;
+    size_t ldw;
+    int rows;
+    int cols;
+    const uint16_t* x;      // BF16 activations, rows zero padded to ldxb
+    const float* xf;        // FP32 activation (F16 GEMV)
+    size_t ldxb;
+    int n;
+    float* c;
+    size_t ldc;
+    int chunk;              // Weight rows per task
+    int block;              // Weight rows per L2 block
+    int depth;              // Columns per pass (L1)
+};
+
+// c[t * ldc + r] (+)= the products over k0 .. k1 for R weight rows from
+// r0 and T activation rows from t0
+template <bool NATIVE, int R, int T>
+static void tile(const Bf16Job* job, int r0, int t0, int k0, int k1) {
+    const uint16_t* w = job->w + (size_t)r0 * job->ldw;
+    const uint16_t* x = job->x + (size_t)t0 * job->ldxb;
+    __m512 acc[R][T];
+    for (int r = 0; r < R; r++) {
+        for (int t = 0; t < T; t++) {
+            acc[r][t] = _mm512_setzero_ps();
+        }
+    }
+
+    int k = k0;
+    for (; k + BF16_STEP <= k1; k += BF16_STEP) {
+        __m512i xv[T];
+        for (int t = 0; t < T; t++) {
+            xv[t] = _mm512_load_si512((const void*)(x + t * job->ldxb + k));
+        }
+        for (int r = 0; r < R; r++) {
+            __m512i wv = _mm512_loadu_si512((const void*)(w + r * job->ldw + k));
+            for (int t = 0; t < T; t++) {
+                acc[r][t] = dot_step<NATIVE>(acc[r][t], wv, xv[t]);
+            }
+        }
+    }
+    if (k < k1) {
+        __mmask32 tail = (__mmask32)((1ULL << (k1 - k)) - 1);
+        __m512i xv[T];
+        for (int t = 0; t < T; t++) {
+            xv[t] = _mm512_load_si512((const void*)(x + t * job->ldxb + k));
+        }
+        for (int r = 0; r < R; r++) {
+            __m512i wv = _mm512_maskz_loadu_epi16(tail, w + r * job->ldw + k);
+            for (int t = 0; t < T; t++) {
+                acc[r][t] = dot_step<NATIVE>(acc[r][t], wv, xv[t]);
+            }
+        }
+    }
+
+    for (int r = 0; r < R; r++) {
+        for (int t = 0; t < T; t++) {
+            float* out = &job->c[(size_t)(t0 + t) * job->ldc + r0 + r];
+            float sum = _mm512_reduce_add_ps(acc[r][t]);
+            *out = k0 > 0 ? *out + sum : sum;
+        }
+    }
+}
+
+template <bool NATIVE, int T>
+static void tile_rows(const Bf16Job* job, int r0, int rows, int t0, int k0, int k1) {
+    switch (rows) {
+        case 4: tile<NATIVE, 4, T>(job, r0, t0, k0, k1); break;
+        case 3: tile<NATIVE, 3, T>(job, r0, t0, k0, k1); break;
+        case 2: tile<NATIVE, 2, T>(job, r0, t0, k0, k1); break;
+        default: tile<NATIVE, 1, T>(job, r0, t0, k0, k1); break;
+    }
+}
+
+template <bool NATIVE>
+static void bf16_task(void* arg, int task) {
+    const Bf16Job* job = (const Bf16Job*)arg;
+    int r_first = task * job->chunk;
+    int r_last = min_int(r_first + job->chunk, job->rows);
+    for (int k0 = 0; k0 < job->cols || k0 == 0; k0 += job->depth) {
+        int k1 = min_int(k0 + job->depth, job->cols);
+        for (int rb = r_first; rb < r_last; rb += job->block) {
+            int rb_end = min_int(rb + job->block, r_last);
+            for (int t = 0; t < job->n; t += TILE_COLS) {
+                int cols = min_int(TILE_COLS, job->n - t);
+                for (int r = rb; r < rb_end; r += TILE_ROWS) {
+                    int rows = min_int(TILE_ROWS, rb_end - r);
+                    switch (cols) {
+                        case 4: tile_rows<NATIVE, 4>(job, r, rows, t, k0, k1); break;
+                        case 3: tile_rows<NATIVE, 3>(job, r, rows, t, k0, k1); break;
+                        case 2: tile_rows<NATIVE, 2>(job, r, rows, t, k0, k1); break;
+                        default: tile_rows<NATIVE, 1>(job, r, rows, t, k0, k1); break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// y[r0 .. r0 + R) for F16 weights
+template <int R>
+static void f16_tile(const Bf16Job* job, int r0) {
+    const uint16_t* w = job->w + (size_t)r0 * job->ldw;
+    __m512 acc[R];
+    for (int r = 0; r < R; r++) {
+        acc[r] = _mm512_setzero_ps();
+    }
+    int k = 0;
+    for (; k + F16_STEP <= job->cols; k += F16_STEP) {
+        __m512 xv = _mm512_loadu_ps(job->xf + k);
+        for (int r = 0; r < R; r++) {
+            __m256i wv = _mm256_loadu_si256((const __m256i*)(w + r * job->ldw + k));
+            acc[r] = _mm512_fmadd_ps(_mm512_cvtph_ps(wv), xv, acc[r]);
+        }
+    }
+    if (k < job->cols) {
+        __mmask16 tail = (__mmask16)((1u << (job->cols - k)) - 1);
+        __m512 xv = _mm512_maskz_loadu_ps(tail, job->xf + k);
+        for (int r = 0; r < R; r++) {
+            __m256i wv = _mm256_maskz_loadu_epi16(tail, w + r * job->ldw + k);
+            acc[r] = _mm512_fmadd_ps(_mm512_cvtph_ps(wv), xv, acc[r]);
+        }
+    }
+    for (int r = 0; r < R; r++) {
+        job->c[r0 + r] = _mm512_reduce_add_ps(acc[r]);
+    }
+}
+
+static void f16_task(void* arg, int task) {
+    const Bf16Job* job = (const Bf16Job*)arg;
+    int r = task * job->chunk;
+    int r_last = min_int(r + job->chunk, job->rows);
+    for (; r + TILE_ROWS <= r_last; r += TILE_ROWS) {
+        f16_tile<TILE_ROWS>(job, r);
+    }
+    for (; r < r_last; r++) {
+        f16_tile<1>(job, r);
+    }
+}
+
+// Split rows into per-task chunks (whole tiles) and L2-sized blocks
+static void run_rows(Bf16Job* job, PoolTask fn, size_t work, size_t parallel_work) {
+    int threads = work >= parallel_work ? compute_pool_threads() : 1;
+    job->chunk = task_chunk(job->rows, threads, TILE_ROWS);
+
+    // Half of L1 holds the activation tile of one pass, half of L2 the
+    // weight rows it meets
+    const Topology* topology = topology_get();
+    size_t l1 = topology->l1d_size ? topology->l1d_size : 48 * 1024;
+    size_t l2 = topology->l2_size ? topology->l2_size : 1024 * 1024;
+    int depth = (int)(l1 / 2 / (TILE_COLS * sizeof(uint16_t))) / BF16_STEP * BF16_STEP;
+    job->depth = depth < BF16_STEP ? BF16_STEP : depth;
+    int block = (int)(l2 / 2 / ((size_t)min_int(job->depth, job->cols) * sizeof(uint16_t) + 1));
+    block = block / TILE_ROWS * TILE_ROWS;
+    job->block = block < TILE_ROWS ? TILE_ROWS : block;
+
+    int tasks = (job->rows + job->chunk - 1) / job->chunk;
+    if (threads > 1) {
+        compute_pool_run(fn, job, tasks);
+    } else {
+        for (int task = 0; task < tasks; task++) {
+            fn(job, task);
+        }
+    }
+}
+
+void bf16_gemm(const uint16_t* w, size_t ldw, int rows, int cols,
+               const float* x, size_t ldx, int n, float* c, size_t ldc) {
+    if (rows <= 0 || n <= 0) {
+        return;
+    }
+    size_t ldxb = ((size_t)(cols > 0 ? cols : 0) + BF16_STEP - 1) / BF16_STEP * BF16_STEP;
+    uint16_t* xb = (uint16_t*)scratch_get((ldxb > 0 ? ldxb : 1) * n * sizeof(uint16_t));
+    if (!xb) {
+        fprintf(stderr, "[%s] ERROR: bf16_gemm: cannot allocate %zu bytes\n",
+                ZEN5_OPTIMIZER_NAME, ldxb * n * sizeof(uint16_t));
+        return;
+    }
+    for (int t = 0; t < n; t++) {
+        uint16_t* row = xb + (size_t)t * ldxb;
+        if (native) {
+            convert_to_bf16<true>(x + (size_t)t * ldx, row, cols);
+        } else {
+            convert_to_bf16<false>(x + (size_t)t * ldx, row, cols);
+        }
+        memset(row + cols, 0, (ldxb - cols) * sizeof(uint16_t));
+    }
+
+    Bf16Job job = {w, ldw, rows, cols, xb, nullptr, ldxb, n, c, ldc, 0, 0, 0};
+    size_t work = (size_t)rows * cols * n;
+    run_rows(&job, native ? bf16_task<true> : bf16_task<false>, work,
+             n > 1 ? SGEMM_PARALLEL_WORK : SGEMV_PARALLEL_WORK);
+}
+
+void bf16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y) {
+    bf16_gemm(w, ldw, rows, cols, x, cols, 1, y, rows);
+}
+
+void f16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y) {
+    if (rows <= 0) {
+        return;
+    }
+    Bf16Job job = {w, ldw, rows, cols, nullptr, x, 0, 1, y, (size_t)rows, 0, 0, 0};
+    run_rows(&job, f16_task, (size_t)rows * cols, SGEMV_PARALLEL_WORK);
+}
+
+} // namespace zen5_turbo
+
+using namespace zen5_turbo;
+
+extern "C" int zen5_bf16_native() {
+    return bf16_native() ? 1 : 0;
+}
+
+extern "C" void zen5_fp32_to_bf16(const float* x, uint16_t* y, size_t n) {
+    fp32_to_bf16(x, y, n);
+}
+
+extern "C" void zen5_bf16_to_fp32(const uint16_t* x, float* y, size_t n) {
+    bf16_to_fp32(x, y, n);
+}
+
+extern "C" void zen5_bf16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y) {
+    bf16_gemv(w, ldw, rows, cols, x, y);
+}
+
+extern "C" void zen5_bf16_gemm(const uint16_t* w, size_t ldw, int rows, int cols,
+                               const float* x, size_t ldx, int n, float* c, size_t ldc) {
+    bf16_gemm(w, ldw, rows, cols, x, ldx, n, c, ldc);
+}
+
+extern "C" void zen5_f16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y) {
+    f16_gemv(w, ldw, rows, cols, x, y);
+}
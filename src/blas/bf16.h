@@ -0,0 +1,58 @@
+/*
+ * bf16.h
+ *
+ * BF16 weights: FP32 <-> BF16 row conversion and GEMV / GEMM on
+ * AVX512_BF16 (vdpbf16ps), plus an F16 GEMV (F16C) to compare against
+ * at the same weight size. BF16 keeps the FP32 exponent range with an
+ * 8-bit mantissa, so models that do not quantize well still stream
+ * half the bytes of FP32, without integer scales.
+ *
+ * Activations are rounded to BF16 and the products summed in FP32, as
+ * vdpbf16ps does. Conversion to BF16 rounds to nearest even, quiets
+ * NaNs and flushes FP32 denormals to zero, like vcvtne2ps2bf16. The
+ * instruction set is checked at startup: without AVX512_BF16 (or with
+ * ZEN5_BF16_NATIVE=0) the same functions widen BF16 to FP32 and use
+ * FMA; the conversions give identical bits, the products differ only
+ * in FP32 rounding.
+ *
+ * Weights are row-major, rows x cols with a leading dimension of ldw
+ * elements.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zen5_turbo {
+
+// Detect AVX512_BF16, read ZEN5_BF16_NATIVE and log the path. Called
+// once from the library constructor.
+void bf16_init();
+
+// True when the vdpbf16ps path is in use
+bool bf16_native();
+
+void fp32_to_bf16(const float* x, uint16_t* y, size_t n);
+void bf16_to_fp32(const uint16_t* x, float* y, size_t n);
+
+// y[r] = dot(row r, x)
+void bf16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y);
+
+// c[t * ldc + r] = dot(row r, x + t * ldx) for n activation rows
+void bf16_gemm(const uint16_t* w, size_t ldw, int rows, int cols,
+               const float* x, size_t ldx, int n, float* c, size_t ldc);
+
+// y[r] = dot(row r, x) with IEEE half weights, FP32 activations
+void f16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y);
+
+} // namespace zen5_turbo
+
+// C entry points for tests and tools (dlsym)
+extern "C" int zen5_bf16_native();
+extern "C" void zen5_fp32_to_bf16(const float* x, uint16_t* y, size_t n);
+extern "C" void zen5_bf16_to_fp32(const uint16_t* x, float* y, size_t n);
+extern "C" void zen5_bf16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y);
+extern "C" void zen5_bf16_gemm(const uint16_t* w, size_t ldw, int rows, int cols,
+                               const float* x, size_t ldx, int n, float* c, size_t ldc);
+extern "C" void zen5_f16_gemv(const uint16_t* w, size_t ldw, int rows, int cols, const float* x, float* y);
@@ -0,0 +1,234 @@
+/*
+ * cblas_interpose.cpp
+ *
+ * Exported CBLAS functions. Arguments are checked as the reference
+ * CBLAS does; column-major calls are turned into row-major ones by
+ * swapping the operands (C^T = op(B)^T op(A)^T), so the kernels only
+ * see row-major data. The next library is looked up on the first call,
+ * when a BLAS loaded with a dlopen()ed backend is in place.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cblas_interpose.h"
+#include "sgemm.h"
+#include "../threads/compute_pool.h"
+#include "../config.h"
+#include "../env.h"
+
+// CBLAS enumerations (cblas.h values; the header is not needed)
+enum {
+    CBLAS_ROW_MAJOR = 101,
+    CBLAS_COL_MAJOR = 102,
+    CBLAS_NO_TRANS = 111,
+    CBLAS_TRANS = 112,
+    CBLAS_CONJ_TRANS = 113
+};
+
+typedef void (*sgemm_fn)(int, int, int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+typedef void (*sgemv_fn)(int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+typedef void (*sgemm_batch_fn)(int, const int*, const int*, const int*, const int*, const int*,
+                               const float*, const float**, const int*, const float**, const int*,
+                               const float*, float**, const int*, int, const int*);
+
+namespace zen5_turbo {
+
+static bool blas_enabled = true;
+static size_t blas_min = BLAS_MIN_WORK;
+
+static pthread_once_t next_once = PTHREAD_ONCE_INIT;
+static sgemm_fn next_sgemm = nullptr;
+static sgemv_fn next_sgemv = nullptr;
+static sgemm_batch_fn next_sgemm_batch = nullptr;
+
+// Definition of symbol in the next library: RTLD_NEXT, else an already
+// loaded library from ZEN5_BLAS_NEXT (dlopen()ed with RTLD_LOCAL, so
+// outside the global scope)
+static void* find_next(const char* symbol) {
+    void* fn = dlsym(RTLD_NEXT, symbol);
+    if (fn) {
+        return fn;
+    }
+    char names[256];
+    snprintf(names, sizeof(names), "%s",
+             env_str("ZEN5_BLAS_NEXT", "libopenblas.so.0,libblis.so.4,libmkl_rt.so.2,libcblas.so.3"));
+    char* save = nullptr;
+    for (char* name = strtok_r(names, ",", &save); name && !fn; name = strtok_r(nullptr, ",", &save)) {
+        void* handle = dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+        if (handle) {
+            fn = dlsym(handle, symbol);
+            dlclose(handle);
+        }
+    }
+    return fn;
+}
+
+static void resolve_next() {
+    next_sgemm = (sgemm_fn)find_next("cblas_sgemm");
+    next_sgemv = (sgemv_fn)find_next("cblas_sgemv");
+    next_sgemm_batch = (sgemm_batch_fn)find_next("cblas_sgemm_batch");
+
+    Dl_info info;
+    if (next_sgemm && dladdr((void*)next_sgemm, &info) && info.dli_fname) {
+        DEBUG_PRINT("BLAS: calls not taken go to %s", info.dli_fname);
+    } else {
+        DEBUG_PRINT("BLAS: no other BLAS loaded, all calls served in-tree");
+    }
+}
+
+void blas_init() {
+    blas_enabled = env_flag("ZEN5_BLAS", true);
+    long min_work = env_long("ZEN5_BLAS_MIN", (long)BLAS_MIN_WORK);
+    blas_min = min_work > 0 ? (size_t)min_work : 0;
+    if (!blas_enabled) {
+        DEBUG_PRINT("BLAS: OFF (cblas calls go to the linked BLAS)");
+        return;
+    }
+    const SgemmBlocking* blocking = sgemm_blocking();
+    DEBUG_PRINT("BLAS: cblas_sgemm/sgemv in-tree (MC %d, NC %d, KC %d), "
+                "products under %zu multiply-adds forwarded",
+                blocking->mc, blocking->nc, blocking->kc, blas_min);
+}
+
+static bool valid_trans(int trans) {
+    return trans == CBLAS_NO_TRANS || trans == CBLAS_TRANS || trans == CBLAS_CONJ_TRANS;
+}
+
+static bool sgemm_args_valid(int layout, int trans_a, int trans_b, int m, int n, int k,
+                             int lda, int ldb, int ldc) {
+    if ((layout != CBLAS_ROW_MAJOR && layout != CBLAS_COL_MAJOR) ||
+        !valid_trans(trans_a) || !valid_trans(trans_b) || m < 0 || n < 0 || k < 0) {
+        return false;
+    }
+    bool row = layout == CBLAS_ROW_MAJOR;
+    bool ta = trans_a != CBLAS_NO_TRANS;
+    bool tb = trans_b != CBLAS_NO_TRANS;
+    // Leading dimension: row length (row-major) or column length of the stored matrix
+    int a_min = row ? (ta ? m : k) : (ta ? k : m);
+    int b_min = row ? (tb ? k : n) : (tb ? n : k);
+    int c_min = row ? n : m;
+    return lda >= (a_min > 1 ? a_min : 1) && ldb >= (b_min > 1 ? b_min : 1) &&
+           ldc >= (c_min > 1 ? c_min : 1);
+}
+
+static void sgemm_dispatch(int layout, int trans_a, int trans_b, int m, int n, int k,
+                           float alpha, const float* a, int lda, const float* b, int ldb,
+                           float beta, float* c, int ldc) {
+    pthread_once(&next_once, resolve_next);
+    bool valid = sgemm_args_valid(layout, trans_a, trans_b, m, n, k, lda, ldb, ldc);
+    if (next_sgemm && (!valid || !blas_enabled || (size_t)m * n * k < blas_min)) {
+        next_sgemm(layout, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+        return;
+    }
+    if (!valid) {
+        fprintf(stderr, "[%s] ERROR: cblas_sgemm: invalid arguments (m %d, n %d, k %d, "
+                "lda %d, ldb %d, ldc %d)\n", ZEN5_OPTIMIZER_NAME, m, n, k, lda, ldb, ldc);
+        return;
+    }
+
+    bool ta = trans_a != CBLAS_NO_TRANS;
+    bool tb = trans_b != CBLAS_NO_TRANS;
+    if (layout == CBLAS_ROW_MAJOR) {
+        sgemm_run(ta, tb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+    } else {
+        sgemm_run(tb, ta, n, m, k, alpha, b, ldb, a, lda, beta, c, ldc);
+    }
+}
+
+struct BatchGroup {
+    int layout;
+    int trans_a;
+    int trans_b;
+    int m;
+    int n;
+    int k;
+    float alpha;
+    const float** a;
+    int lda;
+    const float** b;
+    int ldb;
+    float beta;
+    float** c;
+    int ldc;
+};
+
+static void batch_member(void* arg, int task) {
+    const BatchGroup* g = (const BatchGroup*)arg;
+    sgemm_dispatch(g->layout, g->trans_a, g->trans_b, g->m, g->n, g->k, g->alpha,
+                   g->a[task], g->lda, g->b[task], g->ldb, g->beta, g->c[task], g->ldc);
+}
+
+} // namespace zen5_turbo
+
+using namespace zen5_turbo;
+
+extern "C" void cblas_sgemm(int layout, int trans_a, int trans_b, int m, int n, int k,
+                            float alpha, const float* a, int lda, const float* b, int ldb,
+                            float beta, float* c, int ldc) {
+    sgemm_dispatch(layout, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+extern "C" void cblas_sgemv(int layout, int trans, int m, int n, float alpha,
+                            const float* a, int lda, const float* x, int incx,
+                            float beta, float* y, int incy) {
+    pthread_once(&next_once, resolve_next);
+    bool row = layout == CBLAS_ROW_MAJOR;
+    bool valid = (row || layout == CBLAS_COL_MAJOR) && valid_trans(trans) && m >= 0 && n >= 0 &&
+                 lda >= ((row ? n : m) > 1 ? (row ? n : m) : 1) && incx != 0 && incy != 0;
+    if (next_sgemv && (!valid || !blas_enabled || (size_t)m * n < blas_min || incx != 1 || incy != 1)) {
+        next_sgemv(layout, trans, m, n, alpha, a, lda, x, incx, beta, y, incy);
+        return;
+    }
+    if (!valid) {
+        fprintf(stderr, "[%s] ERROR: cblas_sgemv: invalid arguments (m %d, n %d, lda %d, "
+                "incx %d, incy %d)\n", ZEN5_OPTIMIZER_NAME, m, n, lda, incx, incy);
+        return;
+    }
+
+    // A column-major m x n matrix is the row-major n x m matrix A^T
+    bool t = trans != CBLAS_NO_TRANS;
+    if (row) {
+        sgemv_run(t, m, n, alpha, a, lda, x, incx, beta, y, incy);
+    } else {
+        sgemv_run(!t, n, m, alpha, a, lda, x, incx, beta, y, incy);
+    }
+}
+
+extern "C" void cblas_sgemm_batch(int layout, const int* trans_a, const int* trans_b,
+                                  const int* m, const int* n, const int* k, const float* alpha,
+                                  const float** a, const int* lda, const float** b, const int* ldb,
+                                  const float* beta, float** c, const int* ldc,
+                                  int group_count, const int* group_size) {
+    pthread_once(&next_once, resolve_next);
+    if (!blas_enabled && next_sgemm_batch) {
+        next_sgemm_batch(layout, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb,
+                         beta, c, ldc, group_count, group_size);
+        return;
+    }
+
+    // Members of a group run side by side on the pool when they are
+    // small or outnumber the threads; otherwise one at a time, each
+    // split across the pool
+    size_t first = 0;
+    for (int g = 0; g < group_count; g++) {
+        BatchGroup group = {layout, trans_a[g], trans_b[g], m[g], n[g], k[g], alpha[g],
+                            a + first, lda[g], b + first, ldb[g], beta[g], c + first, ldc[g]};
+        size_t work = (size_t)m[g] * n[g] * k[g];
+        if (work < SGEMM_PARALLEL_WORK || group_size[g] >= compute_pool_threads()) {
+            compute_pool_run(batch_member, &group, group_size[g]);
+        } else {
+            for (int i = 0; i < group_size[g]; i++) {
+                batch_member(&group, i);
+            }
+        }
+        first += group_size[g] > 0 ? group_size[g] : 0;
+    }
+}
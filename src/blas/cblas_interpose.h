@@ -0,0 +1,23 @@
+/*
+ * cblas_interpose.h
+ *
+ * CBLAS entry points served by the in-tree kernels. ggml's BLAS backend
+ * runs prefill matrix products through cblas_sgemm; exporting it from
+ * the preload puts the Zen 5 blocked GEMM in front of whatever BLAS the
+ * binary links. cblas_sgemm, cblas_sgemv and cblas_sgemm_batch (MKL
+ * signature) are exported. Calls the kernels do not take (small
+ * products, strided vectors, invalid arguments, or everything with
+ * ZEN5_BLAS=0) go to the next library defining the symbol: RTLD_NEXT,
+ * else a loaded library named in ZEN5_BLAS_NEXT, for BLAS opened by a
+ * dlopen()ed backend. Without one the kernels take every call.
+ */
+
+#pragma once
+
+namespace zen5_turbo {
+
+// Read ZEN5_BLAS / ZEN5_BLAS_MIN and log the blocking. Called once from
+// the library constructor.
+void blas_init();
+
+} // namespace zen5_turbo
@@ -0,0 +1,522 @@
+/*
+ * sgemm.cpp
+ *
+ * A GEMM call is cut into tiles of C of up to MC x NC; each tile is one
+ * pool task that walks K in KC steps, packing its slice of op(B) into
+ * NR-wide panels and its slice of op(A) into MR-tall panels (zero padded,
+ * so the micro-kernel never branches inside the K loop) and running the
+ * micro-kernel over every MR x NR block. Packing buffers are per thread.
+ * Tiles shrink until every thread has at least two, so prefill shapes
+ * with a few hundred rows still use the whole pool.
+ */
+
+#include <immintrin.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgemm.h"
+#include "../threads/compute_pool.h"
+#include "../threads/kernel_tasks.h"
+#include "../topology.h"
+#include "../config.h"
+
+namespace zen5_turbo {
+
+// Micro-kernel shape: 12 x 2 accumulators, two B vectors and a
+// broadcast of A use 27 of the 32 zmm registers
+const int MR = 12;
+const int NR = 32;
+
+static SgemmBlocking blocking;
+static pthread_once_t blocking_once = PTHREAD_ONCE_INIT;
+
+struct PackBuffers {
+    float* a = nullptr;
+    float* b = nullptr;
+    ~PackBuffers() {
+        free(a);
+        free(b);
+    }
+};
+
+static thread_local PackBuffers pack;
+
+static inline int round_up(int value, int unit) {
+    return (value + unit - 1) / unit * unit;
+}
+
+// value rounded down to a multiple of unit, within [lo, hi]
+static int block_size(size_t value, int unit, int lo, int hi) {
+    int size = value > (size_t)hi ? hi : (int)value;
+    size = size / unit * unit;
+    return size < lo ? lo : size;
+}
+
+// Half of each cache level holds the operand that stays there, the rest
+// the data streaming through: a KC x NR sliver of B in L1d, an MC x KC
+// block of A in L2, a KC x NC panel of B in the core's share of L3
+static void compute_blocking() {
+    const Topology* topology = topology_get();
+    size_t l1 = topology->l1d_size ? topology->l1d_size : 48 * 1024;
+    size_t l2 = topology->l2_size ? topology->l2_size : 1024 * 1024;
+    size_t l3 = 0;
+    for (int d = 0; d < topology->ccd_count && l3 == 0; d++) {
+        const TopologyCcd* ccd = &topology->ccds[d];
+        if (ccd->allowed_cores > 0 && ccd->cores > 0) {
+            l3 = ccd->l3_size / ccd->cores;
+        }
+    }
+    if (l3 == 0) {
+        l3 = 4 * 1024 * 1024;
+    }
+
+    blocking.kc = block_size(l1 / 2 / (NR * sizeof(float)), 16, 64, 1024);
+    blocking.mc = block_size(l2 / 2 / (blocking.kc * sizeof(float)), MR, 4 * MR, 4096);
+    blocking.nc = block_size(l3 / 2 / (blocking.kc * sizeof(float)), NR, 4 * NR, 8192);
+}
+
+const SgemmBlocking* sgemm_blocking() {
+    pthread_once(&blocking_once, compute_blocking);
+    return &blocking;
+}
+
+static bool pack_buffers() {
+    if (pack.a && pack.b) {
+        return true;
+    }
+    void* a = nullptr;
+    void* b = nullptr;
+    if (posix_memalign(&a, 64, (size_t)blocking.mc * blocking.kc * sizeof(float)) != 0 ||
+        posix_memalign(&b, 64, (size_t)blocking.nc * blocking.kc * sizeof(float)) != 0) {
+        free(a);
+        return false;
+    }
+    pack.a = (float*)a;
+    pack.b = (float*)b;
+    return true;
+}
+
+// Masks selecting the first n (0 .. 32) lanes of two vectors
+static inline __mmask16 lane_mask(int n) {
+    return n >= 16 ? (__mmask16)0xFFFF : n <= 0 ? (__mmask16)0 : (__mmask16)((1u << n) - 1);
+}
+
+// Transpose a 16 x 16 block: row i of src becomes column i of dst
+static inline void transpose16(const float* src, size_t lds, float* dst, size_t ldd) {
+    __m512 r[16];
+    __m512 t[16];
+    for (int i = 0; i < 16; i++) {
+        r[i] = _mm512_loadu_ps(src + i * lds);
+    }
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 16; i += 4) {
+        r[i] = _mm512_castpd_ps(_mm512_unpacklo_pd(_mm512_castps_pd(t[i]), _mm512_castps_pd(t[i + 2])));
+        r[i + 1] = _mm512_castpd_ps(_mm512_unpackhi_pd(_mm512_castps_pd(t[i]), _mm512_castps_pd(t[i + 2])));
+        r[i + 2] = _mm512_castpd_ps(_mm512_unpacklo_pd(_mm512_castps_pd(t[i + 1]), _mm512_castps_pd(t[i + 3])));
+        r[i + 3] = _mm512_castpd_ps(_mm512_unpackhi_pd(_mm512_castps_pd(t[i + 1]), _mm512_castps_pd(t[i + 3])));
+    }
+    for (int i = 0; i < 16; i += 8) {
+        for (int j = 0; j < 4; j++) {
+            t[i + j] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0x88);
+            t[i + j + 4] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0xdd);
+        }
+    }
+    for (int j = 0; j < 8; j++) {
+        r[j] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0x88);
+        r[j + 8] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0xdd);
+    }
+    for (int i = 0; i < 16; i++) {
+        _mm512_store_ps(dst + i * ldd, r[i]);
+    }
+}
+
+// Pack rows [i0, i0 + mb) x depth [p0, p0 + kb) of op(A) into MR-row
+// panels, each stored depth-major: panel[p * MR + r]
+static void pack_a(bool trans, const float* a, int lda, int i0, int mb, int p0, int kb, float* dst) {
+    for (int ir = 0; ir < mb; ir += MR, dst += MR * kb) {
+        int mr = min_int(MR, mb - ir);
+        if (trans) {
+            // op(A)(i, p) = a[p * lda + i]: each depth step is contiguous
+            for (int p = 0; p < kb; p++) {
+                const float* src = a + (size_t)(p0 + p) * lda + i0 + ir;
+                float* out = dst + p * MR;
+                for (int r = 0; r < MR; r++) {
+                    out[r] = r < mr ? src[r] : 0.0f;
+                }
+            }
+        } else {
+            for (int r = 0; r < MR; r++) {
+                if (r < mr) {
+                    const float* src = a + (size_t)(i0 + ir + r) * lda + p0;
+                    for (int p = 0; p < kb; p++) {
+                        dst[p * MR + r] = src[p];
+                    }
+                } else {
+                    for (int p = 0; p < kb; p++) {
+                        dst[p * MR + r] = 0.0f;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Pack depth [p0, p0 + kb) x columns [j0, j0 + nb) of op(B) into NR-column
+// panels, each stored depth-major: panel[p * NR + c]
+static void pack_b(bool trans, const float* b, int ldb, int j0, int nb, int p0, int kb, float* dst) {
+    for (int jr = 0; jr < nb; jr += NR, dst += NR * kb) {
+        int nr = min_int(NR, nb - jr);
+        if (!trans) {
+            // op(B)(p, j) = b[p * ldb + j]: panel rows are contiguous
+            __mmask16 m0 = lane_mask(nr);
+            __mmask16 m1 = lane_mask(nr - 16);
+            for (int p = 0; p < kb; p++) {
+                const float* src = b + (size_t)(p0 + p) * ldb + j0 + jr;
+                _mm512_store_ps(dst + p * NR, _mm512_maskz_loadu_ps(m0, src));
+                _mm512_store_ps(dst + p * NR + 16, _mm512_maskz_loadu_ps(m1, src + 16));
+            }
+            continue;
+        }
+
+        // op(B)(p, j) = b[j * ldb + p]: weights stored one output per row
+        // (ggml's layout); whole 16 x 16 blocks go through registers
+        int c = 0;
+        int p_full = kb / 16 * 16;
+        for (; c + 16 <= nr; c += 16) {
+            const float* src = b + (size_t)(j0 + jr + c) * ldb + p0;
+            for (int p = 0; p < p_full; p += 16) {
+                transpose16(src + p, ldb, dst + p * NR + c, NR);
+            }
+            for (int p = p_full; p < kb; p++) {
+                for (int x = 0; x < 16; x++) {
+                    dst[p * NR + c + x] = src[(size_t)x * ldb + p];
+                }
+            }
+        }
+        for (; c < NR; c++) {
+            if (c < nr) {
+                const float* src = b + (size_t)(j0 + jr + c) * ldb + p0;
+                for (int p = 0; p < kb; p++) {
+                    dst[p * NR + c] = src[p];
+                }
+            } else {
+                for (int p = 0; p < kb; p++) {
+                    dst[p * NR + c] = 0.0f;
+                }
+            }
+        }
+    }
+}
+
+// C[0 .. mr, 0 .. nr) = alpha * A panel * B panel + beta * C
+static inline void micro_kernel(int kb, const float* a, const float* b, float* c, int ldc,
+                                float alpha, float beta, int mr, int nr) {
+    __m512 acc[MR][2];
+#pragma GCC unroll 12
+    for (int r = 0; r < MR; r++) {
+        acc[r][0] = _mm512_setzero_ps();
+        acc[r][1] = _mm512_setzero_ps();
+    }
+#pragma GCC unroll 12
+    for (int r = 0; r < MR; r++) {
+        if (r < mr) {
+            _mm_prefetch((const char*)(c + (size_t)r * ldc), _MM_HINT_T0);
+            _mm_prefetch((const char*)(c + (size_t)r * ldc + 16), _MM_HINT_T0);
+        }
+    }
+
+    for (int p = 0; p < kb; p++) {
+        __m512 b0 = _mm512_load_ps(b);
+        __m512 b1 = _mm512_load_ps(b + 16);
+#pragma GCC unroll 12
+        for (int r = 0; r < MR; r++) {
+            __m512 av = _mm512_set1_ps(a[r]);
+            acc[r][0] = _mm512_fmadd_ps(av, b0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_ps(av, b1, acc[r][1]);
+        }
+        a += MR;
+        b += NR;
+    }
+
+    __mmask16 m0 = lane_mask(nr);
+    __mmask16 m1 = lane_mask(nr - 16);
+    __m512 va = _mm512_set1_ps(alpha);
+    __m512 vb = _mm512_set1_ps(beta);
+#pragma GCC unroll 12
+    for (int r = 0; r < MR; r++) {
+        if (r < mr) {
+            float* row = c + (size_t)r * ldc;
+            __m512 v0 = _mm512_mul_ps(acc[r][0], va);
+            __m512 v1 = _mm512_mul_ps(acc[r][1], va);
+            if (beta != 0.0f) {
+                v0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m0, row), vb, v0);
+                v1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m1, row + 16), vb, v1);
+            }
+            _mm512_mask_storeu_ps(row, m0, v0);
+            _mm512_mask_storeu_ps(row + 16, m1, v1);
+        }
+    }
+}
+
+struct GemmJob {
+    bool trans_a;
+    bool trans_b;
+    int m;
+    int n;
+    int k;
+    float alpha;
+    const float* a;
+    int lda;
+    const float* b;
+    int ldb;
+    float beta;
+    float* c;
+    int ldc;
+    int mc;             // Tile size, may be below the blocking
+    int nc;
+    int tiles_n;
+};
+
+// Unpacked fallback for a tile when no packing buffers can be had
+static void scalar_tile(const GemmJob* job, int i0, int mb, int j0, int nb) {
+    for (int i = i0; i < i0 + mb; i++) {
+        for (int j = j0; j < j0 + nb; j++) {
+            float sum = 0.0f;
+            for (int p = 0; p < job->k; p++) {
+                float av = job->trans_a ? job->a[(size_t)p * job->lda + i] : job->a[(size_t)i * job->lda + p];
+                float bv = job->trans_b ? job->b[(size_t)j * job->ldb + p] : job->b[(size_t)p * job->ldb + j];
+                sum += av * bv;
+            }
+            float* out = job->c + (size_t)i * job->ldc + j;
+            *out = job->alpha * sum + (job->beta != 0.0f ? job->beta * *out : 0.0f);
+        }
+    }
+}
+
+static void gemm_tile(void* arg, int task) {
+    const GemmJob* job = (const GemmJob*)arg;
+    int i0 = task / job->tiles_n * job->mc;
+    int j0 = task % job->tiles_n * job->nc;
+    int mb = min_int(job->mc, job->m - i0);
+    int nb = min_int(job->nc, job->n - j0);
+    if (!pack_buffers()) {
+        scalar_tile(job, i0, mb, j0, nb);
+        return;
+    }
+
+    for (int p0 = 0; p0 < job->k; p0 += blocking.kc) {
+        int kb = min_int(blocking.kc, job->k - p0);
+        pack_b(job->trans_b, job->b, job->ldb, j0, nb, p0, kb, pack.b);
+        pack_a(job->trans_a, job->a, job->lda, i0, mb, p0, kb, pack.a);
+        float beta = p0 == 0 ? job->beta : 1.0f;
+
+        for (int jr = 0; jr < nb; jr += NR) {
+            const float* panel_b = pack.b + (size_t)jr * kb;
+            int nr = min_int(NR, nb - jr);
+            for (int ir = 0; ir < mb; ir += MR) {
+                micro_kernel(kb, pack.a + (size_t)ir * kb, panel_b,
+                             job->c + (size_t)(i0 + ir) * job->ldc + j0 + jr, job->ldc,
+                             job->alpha, beta, min_int(MR, mb - ir), nr);
+            }
+        }
+    }
+}
+
+// C = beta * C, for products that contribute nothing
+static void scale_c(int m, int n, float beta, float* c, int ldc) {
+    if (beta == 1.0f) {
+        return;
+    }
+    for (int i = 0; i < m; i++) {
+        float* row = c + (size_t)i * ldc;
+        for (int j = 0; j < n; j++) {
+            row[j] = beta == 0.0f ? 0.0f : beta * row[j];
+        }
+    }
+}
+
+void sgemm_run(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+               const float* a, int lda, const float* b, int ldb,
+               float beta, float* c, int ldc) {
+    if (m <= 0 || n <= 0) {
+        return;
+    }
+    if (k <= 0 || alpha == 0.0f) {
+        scale_c(m, n, beta, c, ldc);
+        return;
+    }
+    sgemm_blocking();
+
+    GemmJob job = {trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, 0, 0, 0};
+    int threads = (size_t)m * n * k >= SGEMM_PARALLEL_WORK ? compute_pool_threads() : 1;
+    job.mc = min_int(blocking.mc, round_up(m, MR));
+    job.nc = min_int(blocking.nc, round_up(n, NR));
+
+    // At least two tiles per thread, keeping tiles four panels wide
+    while (threads > 1 && ((m + job.mc - 1) / job.mc) * ((n + job.nc - 1) / job.nc) < 2 * threads) {
+        if (job.nc >= job.mc && job.nc > 4 * NR) {
+            job.nc = round_up(job.nc / 2, NR);
+        } else if (job.mc > 4 * MR) {
+            job.mc = round_up(job.mc / 2, MR);
+        } else if (job.nc > 4 * NR) {
+            job.nc = round_up(job.nc / 2, NR);
+        } else {
+            break;
+        }
+    }
+    job.tiles_n = (n + job.nc - 1) / job.nc;
+    int tiles = ((m + job.mc - 1) / job.mc) * job.tiles_n;
+
+    if (threads > 1) {
+        compute_pool_run(gemm_tile, &job, tiles);
+    } else {
+        for (int task = 0; task < tiles; task++) {
+            gemm_tile(&job, task);
+        }
+    }
+}
+
+struct GemvJob {
+    int rows;
+    int cols;
+    float alpha;
+    const float* a;
+    int lda;
+    const float* x;
+    float beta;
+    float* y;
+    int chunk;          // Rows (no transpose) or columns (transpose) per task
+};
+
+static inline float store_y(float sum, float alpha, float beta, const float* y) {
+    return alpha * sum + (beta != 0.0f ? beta * *y : 0.0f);
+}
+
+// y[i] for rows [r0, r1): one dot product per row, four rows at a time
+static void gemv_rows(void* arg, int task) {
+    const GemvJob* job = (const GemvJob*)arg;
+    int r0 = task * job->chunk;
+    int r1 = min_int(r0 + job->chunk, job->rows);
+    int cols = job->cols;
+    int i = r0;
+    for (; i + 4 <= r1; i += 4) {
+        const float* row = job->a + (size_t)i * job->lda;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for (int j = 0; j < cols; j += 16) {
+            __mmask16 mask = lane_mask(cols - j);
+            __m512 xv = _mm512_maskz_loadu_ps(mask, job->x + j);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + j), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + job->lda + j), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + 2 * (size_t)job->lda + j), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + 3 * (size_t)job->lda + j), xv, acc3);
+        }
+        job->y[i] = store_y(_mm512_reduce_add_ps(acc0), job->alpha, job->beta, job->y + i);
+        job->y[i + 1] = store_y(_mm512_reduce_add_ps(acc1), job->alpha, job->beta, job->y + i + 1);
+        job->y[i + 2] = store_y(_mm512_reduce_add_ps(acc2), job->alpha, job->beta, job->y + i + 2);
+        job->y[i + 3] = store_y(_mm512_reduce_add_ps(acc3), job->alpha, job->beta, job->y + i + 3);
+    }
+    for (; i < r1; i++) {
+        const float* row = job->a + (size_t)i * job->lda;
+        __m512 acc = _mm512_setzero_ps();
+        for (int j = 0; j < cols; j += 16) {
+            __mmask16 mask = lane_mask(cols - j);
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + j),
+                                  _mm512_maskz_loadu_ps(mask, job->x + j), acc);
+        }
+        job->y[i] = store_y(_mm512_reduce_add_ps(acc), job->alpha, job->beta, job->y + i);
+    }
+}
+
+// Columns per task of the transposed product: 8 vectors of accumulators
+const int GEMV_STRIP = 128;
+
+// y[j] for a strip of columns: every row of A scaled by x[i] and summed
+static void gemv_cols(void* arg, int task) {
+    const GemvJob* job = (const GemvJob*)arg;
+    for (int s0 = task * job->chunk; s0 < min_int((task + 1) * job->chunk, job->cols); s0 += GEMV_STRIP) {
+        int width = min_int(GEMV_STRIP, job->cols - s0);
+        __m512 acc[GEMV_STRIP / 16];
+        __mmask16 masks[GEMV_STRIP / 16];
+        for (int v = 0; v < GEMV_STRIP / 16; v++) {
+            acc[v] = _mm512_setzero_ps();
+            masks[v] = lane_mask(width - v * 16);
+        }
+        for (int i = 0; i < job->rows; i++) {
+            const float* row = job->a + (size_t)i * job->lda + s0;
+            __m512 xv = _mm512_set1_ps(job->x[i]);
+#pragma GCC unroll 8
+            for (int v = 0; v < GEMV_STRIP / 16; v++) {
+                acc[v] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(masks[v], row + v * 16), xv, acc[v]);
+            }
+        }
+        __m512 va = _mm512_set1_ps(job->alpha);
+        __m512 vb = _mm512_set1_ps(job->beta);
+        for (int v = 0; v < GEMV_STRIP / 16; v++) {
+            float* out = job->y + s0 + v * 16;
+            __m512 result = _mm512_mul_ps(acc[v], va);
+            if (job->beta != 0.0f) {
+                result = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(masks[v], out), vb, result);
+            }
+            _mm512_mask_storeu_ps(out, masks[v], result);
+        }
+    }
+}
+
+// Any strides, including negative ones (vectors walked from the end)
+static void gemv_strided(bool trans, int rows, int cols, float alpha, const float* a, int lda,
+                         const float* x, int incx, float beta, float* y, int incy) {
+    int len_x = trans ? rows : cols;
+    int len_y = trans ? cols : rows;
+    const float* xs = incx < 0 ? x - (ptrdiff_t)(len_x - 1) * incx : x;
+    float* ys = incy < 0 ? y - (ptrdiff_t)(len_y - 1) * incy : y;
+    for (int o = 0; o < len_y; o++) {
+        float sum = 0.0f;
+        if (alpha != 0.0f) {
+            for (int q = 0; q < len_x; q++) {
+                float av = trans ? a[(size_t)q * lda + o] : a[(size_t)o * lda + q];
+                sum += av * xs[(ptrdiff_t)q * incx];
+            }
+        }
+        float* out = ys + (ptrdiff_t)o * incy;
+        *out = store_y(sum, alpha, beta, out);
+    }
+}
+
+void sgemv_run(bool trans, int rows, int cols, float alpha, const float* a, int lda,
+               const float* x, int incx, float beta, float* y, int incy) {
+    if (rows <= 0 || cols <= 0) {
+        return;
+    }
+    if (incx != 1 || incy != 1 || alpha == 0.0f) {
+        gemv_strided(trans, rows, cols, alpha, a, lda, x, incx, beta, y, incy);
+        return;
+    }
+
+    GemvJob job = {rows, cols, alpha, a, lda, x, beta, y, 0};
+    int threads = (size_t)rows * cols >= SGEMV_PARALLEL_WORK ? compute_pool_threads() : 1;
+    int outputs = trans ? cols : rows;
+    int unit = trans ? GEMV_STRIP : 4;
+
+    // Whole strips or groups of four rows
+    job.chunk = task_chunk(outputs, threads, unit);
+    int tasks = (outputs + job.chunk - 1) / job.chunk;
+    PoolTask fn = trans ? gemv_cols : gemv_rows;
+    if (threads > 1) {
+        compute_pool_run(fn, &job, tasks);
+    } else {
+        for (int task = 0; task < tasks; task++) {
+            fn(&job, task);
+        }
+    }
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,39 @@
+/*
+ * sgemm.h
+ *
+ * Single precision GEMM and GEMV kernels for Zen 5. GEMM follows the
+ * BLIS layering: op(B) is packed into KC x NC panels sized for a core's
+ * share of L3, op(A) into MC x KC blocks sized for L2, and a 12 x 32
+ * AVX-512 micro-kernel keeps a KC x 32 sliver of B in L1 while it walks
+ * the A block. The blocking is derived once from the L1d/L2/L3 sizes of
+ * the topology. Large products are split into tiles of C across the
+ * compute pool.
+ *
+ * Everything here is row-major; column-major callers swap operands.
+ */
+
+#pragma once
+
+namespace zen5_turbo {
+
+struct SgemmBlocking {
+    int mc;     // Rows of op(A) per packed block (L2)
+    int nc;     // Columns of op(B) per packed panel (L3)
+    int kc;     // Depth of both (L1)
+};
+
+// Blocking in use, computed on first call
+const SgemmBlocking* sgemm_blocking();
+
+// C = alpha * op(A) * op(B) + beta * C with op(A) m x k, op(B) k x n and
+// C m x n, all row-major. With beta == 0, C is not read.
+void sgemm_run(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+               const float* a, int lda, const float* b, int ldb,
+               float beta, float* c, int ldc);
+
+// y = alpha * op(A) * x + beta * y with A rows x cols, row-major. With
+// beta == 0, y is not read. Strides other than 1 take a scalar path.
+void sgemv_run(bool trans, int rows, int cols, float alpha, const float* a, int lda,
+               const float* x, int incx, float beta, float* y, int incy);
+
+} // namespace zen5_turbo
@@ -15,6 +15,105 @@
 
 // Memory thresholds
 const size_t MIN_SIZE_FOR_HUGEPAGES = 1ULL * 1024 * 1024 * 1024; // 1GB
+const size_t HUGEPAGE_SIZE = 2ULL * 1024 * 1024;                 // 2MB
+const size_t HUGEPAGE_1G_SIZE = 1ULL * 1024 * 1024 * 1024;       // 1GB
+
+// Parallel model loading
+// Extents are a multiple of HUGEPAGE_SIZE so no hugepage is shared by two workers.
+// ZEN5_LOAD_THREADS overrides the worker count (default: one per CPU in the cpuset).
+const size_t LOAD_EXTENT_SIZE = 64ULL * 1024 * 1024;             // 64MB
+// Smaller loads (single tensors in --no-mmap mode) are not reported
+const size_t LOAD_REPORT_MIN = LOAD_EXTENT_SIZE;
+const int MAX_LOAD_THREADS = 64;
+
+// io_uring + O_DIRECT loading
+// ZEN5_LOAD_ENGINE selects "auto" (io_uring, falling back to pread), "uring"
+// (io_uring only, a failed load is an error) or "pread".
+// ZEN5_URING_QD overrides the number of reads kept in flight.
+const size_t DIRECT_IO_ALIGN = 4096;                             // Logical block alignment
+const size_t URING_CHUNK_SIZE = HUGEPAGE_SIZE;                   // One hugepage per read
+const int URING_QUEUE_DEPTH = 32;
+const int URING_MAX_QUEUE_DEPTH = 256;
+
+// Lazy (userfaultfd) population
+// ZEN5_MAP_MODE=lazy returns intercepted mappings before they are loaded.
+const size_t LAZY_CHUNK_SIZE = HUGEPAGE_SIZE;                    // Unit of population
+
+// Intercepted region tracking (fixed array, no malloc inside mmap)
+const size_t MAX_TRACKED_REGIONS = 1024;
+
+// In-process deduplication of repeated read-only mappings (ZEN5_DEDUP)
+// Each user's munmap() is accounted per granule; a granule is released
+// once no user maps any of it. Entries are a fixed pool (no malloc inside mmap).
+const size_t DEDUP_GRANULE = HUGEPAGE_SIZE;
+const size_t MAX_DEDUP_ENTRIES = 64;
+
+// Large anonymous mappings (ZEN5_ANON)
+// Private anonymous mmaps of at least ZEN5_ANON_THRESHOLD MB (KV cache,
+// compute buffers) are backed by 2MB pages and tracked like intercepted
+// file mappings. ZEN5_ANON_PREFAULT (or MAP_POPULATE) faults them in
+// with the loader's worker pool before mmap() returns.
+const size_t ANON_THRESHOLD = 32ULL * 1024 * 1024;               // 32MB
+
+// Large reads of GGUF files into memory (llama.cpp --no-mmap, ZEN5_READ)
+// read()/fread() calls of at least ZEN5_READ_THRESHOLD MB from a GGUF
+// file are served by the model loaders (O_DIRECT where the buffer and
+// file offset share DIRECT_IO_ALIGN alignment, parallel pread otherwise).
+const size_t READ_THRESHOLD = 8ULL * 1024 * 1024;                // 8MB
+
+// Code on huge pages (ZEN5_TEXT_HUGEPAGES)
+// The whole 2MB pages of the executable's text segment and of libraries
+// whose name contains an entry of ZEN5_TEXT_MATCH are copied onto 2MB
+// pages at startup to cut iTLB misses.
+const int MAX_TEXT_SEGMENTS = 64;
+
+// BLAS interposition (ZEN5_BLAS)
+// cblas_sgemm, cblas_sgemv and cblas_sgemm_batch run on the in-tree
+// AVX-512 kernels, blocked for the L1d/L2/L3 sizes of the topology.
+// Products of fewer than ZEN5_BLAS_MIN multiply-adds (m*n*k, m*n for
+// sgemv) and strided vectors go to the next BLAS library. Larger ones
+// are split across the compute pool (ZEN5_COMPUTE_THREADS workers).
+const size_t BLAS_MIN_WORK = 32ULL * 1024;
+const size_t SGEMM_PARALLEL_WORK = 2ULL * 1024 * 1024;          // Below: calling thread only
+const size_t SGEMV_PARALLEL_WORK = 1ULL * 1024 * 1024;
+const int MAX_COMPUTE_THREADS = 256;
+
+// Quantized kernels (ZEN5_QUANT)
+// ggml's Q8_0, IQ4_XS, Q4_K and Q5_K dot products run on the in-tree
+// VBMI/VNNI kernels.
+// GEMV / GEMM calls streaming at least QUANT_PARALLEL_BYTES of weights
+// (times the batch) are split by rows across the compute pool.
+const size_t QUANT_PARALLEL_BYTES = 1ULL * 1024 * 1024;          // 1MB
+
+// memcpy / memmove (ZEN5_MEMCPY)
+// Up to MEMCPY_INLINE_MAX bytes go through zmm registers without a loop,
+// then an unrolled zmm loop up to the rep threshold (ERMS; lower with
+// FSRM), rep movsb up to the streaming threshold, non-temporal
+// stores above it. The streaming threshold is a quarter of the smallest
+// CCD L3 (ZEN5_MEMCPY_STREAM overrides it in KB); MEMCPY_STREAM_MIN is
+// used before startup and when the L3 size is unknown.
+const size_t MEMCPY_INLINE_MAX = 512;
+const size_t MEMCPY_REP_MIN = 8ULL * 1024;                       // ERMS
+const size_t MEMCPY_REP_MIN_FSRM = 2ULL * 1024;                  // ERMS + FSRM
+const size_t MEMCPY_STREAM_MIN = 8ULL * 1024 * 1024;             // 8MB
+
+// Hugepage arena for large heap allocations (ZEN5_ARENA)
+// malloc/calloc/realloc/posix_memalign requests of at least
+// ZEN5_ARENA_THRESHOLD MB come from per-node 2MB-page arenas; freed
+// blocks are kept for reuse. Sizes are rounded to ARENA_STEP up to
+// ARENA_LINEAR_LIMIT, then to quarter powers of two.
+const size_t ARENA_THRESHOLD = 16ULL * 1024 * 1024;              // 16MB
+const size_t ARENA_STEP = HUGEPAGE_SIZE;
+const size_t ARENA_LINEAR_LIMIT = 32ULL * 1024 * 1024;           // 32MB
+const int ARENA_CLASSES = 192;
+const int MAX_ARENA_NODES = 8;
+
+// Shared / persistent hugetlbfs model cache
+// ZEN5_MAP_MODE=shared maps read-only models from ZEN5_HUGETLBFS_DIR;
+// ZEN5_CACHE_PERSIST keeps entries after the last user exits.
+// Entries are validated by a hash of evenly spaced samples of the model.
+const int CACHE_HASH_SAMPLES = 64;
+const size_t CACHE_HASH_SAMPLE_SIZE = 4096;
 
 // Version information
 #define ZEN5_OPTIMIZER_VERSION "0.1.0"
@@ -76,6 +76,48 @@ bool is_zen5_cpu() {
 #endif
 }
 
+// Check for AVX512_BF16
+bool cpu_has_avx512_bf16() {
+#ifdef __x86_64__
+    unsigned int eax, ebx, ecx, edx;
+
+    // Leaf 7 sub-leaf 1 must exist (sub-leaf count in leaf 7.0 EAX)
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0 || eax < 1) {
+        return false;
+    }
+    __get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx);
+    return (eax >> 5) & 1;
+#else
+    return false;
+#endif
+}
+
+// Check for enhanced rep movsb / stosb
+bool cpu_has_erms() {
+#ifdef __x86_64__
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (ebx >> 9) & 1;
+#else
+    return false;
+#endif
+}
+
+// Check for fast short rep mov
+bool cpu_has_fsrm() {
+#ifdef __x86_64__
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (edx >> 4) & 1;
+#else
+    return false;
+#endif
+}
+
 // Validate CPU and exit if not Zen 5
 void validate_zen5_or_exit() {
     if (!is_zen5_cpu()) {
@@ -12,6 +12,14 @@ namespace zen5_turbo {
 // Check if current CPU is AMD Zen 5 (Family 25h)
 bool is_zen5_cpu();
 
+// Check for AVX512_BF16 (vdpbf16ps, vcvtne2ps2bf16; CPUID 7.1 EAX bit 5)
+bool cpu_has_avx512_bf16();
+
+// Check for fast rep movsb / stosb: ERMS (CPUID 7.0 EBX bit 9) and fast
+// short rep mov, FSRM (CPUID 7.0 EDX bit 4)
+bool cpu_has_erms();
+bool cpu_has_fsrm();
+
 // Validate CPU and exit if not Zen 5
 void validate_zen5_or_exit();
 
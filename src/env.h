@@ -0,0 +1,48 @@
+/*
+ * env.h
+ *
+ * Runtime overrides for config.h defaults.
+ * Values are read from ZEN5_* environment variables so the
+ * preload can be tuned per container without rebuilding.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace zen5_turbo {
+
+// Read an integer setting, returning def when unset or malformed
+static inline long env_long(const char* name, long def) {
+    const char* value = getenv(name);
+    if (!value || !*value) {
+        return def;
+    }
+
+    char* end = nullptr;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0') {
+        return def;
+    }
+    return parsed;
+}
+
+// Read a string setting, returning def when unset or empty
+static inline const char* env_str(const char* name, const char* def) {
+    const char* value = getenv(name);
+    return (value && *value) ? value : def;
+}
+
+// Read a boolean setting ("1", "on", "yes", "true" enable it)
+static inline bool env_flag(const char* name, bool def) {
+    const char* value = getenv(name);
+    if (!value || !*value) {
+        return def;
+    }
+    return strcmp(value, "1") == 0 || strcasecmp(value, "on") == 0 ||
+           strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0;
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,110 @@
+/*
+ * file_thp.cpp
+ *
+ * In-place file THP mapping.
+ *
+ * A file THP can only be mapped by a PMD when the virtual address and
+ * the file offset agree modulo 2MB, so the mapping is placed inside an
+ * over-sized PROT_NONE reservation at a congruent address. After that:
+ *   MADV_HUGEPAGE       opts the range into THP (khugepaged included)
+ *   MADV_POPULATE_READ  faults the whole file in up front (Linux 5.14+)
+ *   MADV_COLLAPSE       synchronously collapses what is still mapped
+ *                       by 4KB pages into THPs (Linux 6.1+)
+ * Read-only file THPs also need CONFIG_READ_ONLY_THP_FOR_FS or a
+ * filesystem with large folio support, and no writer on the file.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "file_thp.h"
+#include "hugepage_wrapper.h"
+#include "../config.h"
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+namespace zen5_turbo {
+
+static double elapsed_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void* file_thp_map(size_t length, int prot, int flags, int fd, off_t offset) {
+    // Reserve room to slide the mapping to a congruent address
+    size_t span = length + HUGEPAGE_SIZE;
+    char* raw = (char*)sys_mmap(nullptr, span, PROT_NONE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    uintptr_t phase = (uintptr_t)offset & (HUGEPAGE_SIZE - 1);
+    uintptr_t aligned = ((uintptr_t)raw + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+    char* base = (char*)(aligned + phase);
+    if (base >= raw + HUGEPAGE_SIZE) {
+        base -= HUGEPAGE_SIZE;
+    }
+
+    void* mem = sys_mmap(base, length, prot, (flags & ~MAP_HUGETLB) | MAP_FIXED, fd, offset);
+    if (mem == MAP_FAILED) {
+        int saved_errno = errno;
+        sys_munmap(raw, span);
+        errno = saved_errno;
+        return MAP_FAILED;
+    }
+
+    // Drop the unused ends of the reservation
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* end = (char*)(((uintptr_t)base + length + page - 1) & ~(uintptr_t)(page - 1));
+    if (base > raw) {
+        sys_munmap(raw, base - raw);
+    }
+    if (raw + span > end) {
+        sys_munmap(end, (raw + span) - end);
+    }
+
+    if (madvise(mem, length, MADV_HUGEPAGE) != 0) {
+        DEBUG_PRINT("MADV_HUGEPAGE failed (%s), file stays on 4KB pages", strerror(errno));
+        return mem;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (madvise(mem, length, MADV_POPULATE_READ) == 0) {
+        DEBUG_PRINT("Populated %.2f GB from the page cache in %.2f s",
+                length / (1024.0 * 1024.0 * 1024.0), elapsed_since(&start));
+    } else {
+        DEBUG_PRINT("MADV_POPULATE_READ unavailable (%s), pages fault in on access",
+                strerror(errno));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (madvise(mem, length, MADV_COLLAPSE) == 0) {
+        DEBUG_PRINT("Collapsed %.2f GB into file THPs in %.2f s",
+                length / (1024.0 * 1024.0 * 1024.0), elapsed_since(&start));
+    } else if (errno == EINVAL) {
+        DEBUG_PRINT("MADV_COLLAPSE not supported, relying on khugepaged");
+    } else {
+        // EAGAIN/ENOMEM: some ranges could not be collapsed right now
+        DEBUG_PRINT("MADV_COLLAPSE incomplete (%s), khugepaged will retry", strerror(errno));
+    }
+
+    return mem;
+}
+
+} // namespace zen5_turbo
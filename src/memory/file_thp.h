@@ -0,0 +1,23 @@
+/*
+ * file_thp.h
+ *
+ * Zero-copy alternative to loading models into anonymous memory:
+ * the file stays mapped from the page cache and the kernel is asked to
+ * back it with read-only file THPs, so processes on the same host share
+ * one copy of the model while still getting 2MB TLB entries.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+// Map [offset, offset + length) of fd at a 2MB-congruent address and
+// apply MADV_HUGEPAGE, MADV_POPULATE_READ and MADV_COLLAPSE where the
+// kernel supports them. Returns MAP_FAILED (errno set) only if the
+// mapping itself fails; missing THP support just leaves 4KB pages.
+void* file_thp_map(size_t length, int prot, int flags, int fd, off_t offset);
+
+} // namespace zen5_turbo
@@ -0,0 +1,505 @@
+/*
+ * hugepage_arena.cpp
+ *
+ * Per-node hugepage arenas and the malloc family interposers.
+ *
+ * Each arena reserves a PROT_NONE range as large as physical memory and
+ * hands out blocks from its start, mapping each new block with MAP_FIXED
+ * 2MB hugetlb pages (THP-advised memory if the pool is short) preferred
+ * on the arena's node. A byte per 2MB page records the size class of
+ * the block starting there, so free() finds the class of a pointer from
+ * its address alone; free blocks are marked as such, and the pages
+ * inside a block are 0. Free blocks are kept on per-class lists linked
+ * through their first two words. free() merges a block with the free
+ * blocks on either side (the nearest marks below and above it) and
+ * puts the span back as the largest classes that fit, so memory freed
+ * in pieces serves a large request again. A request no free block of
+ * its class (or the next) can serve is cut from the smallest larger
+ * free block before new memory is mapped; the rest of that block goes
+ * back on the free lists.
+ *
+ * The real allocator is glibc's __libc_* entry points; dlsym() would
+ * itself allocate while the interposers are being resolved.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include "hugepage_arena.h"
+#include "hugepage_wrapper.h"
+#include "numa_policy.h"
+#include "../topology.h"
+#include "../config.h"
+#include "../env.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+size_t malloc_usable_size(void* ptr);
+}
+
+namespace zen5_turbo {
+
+struct Arena {
+    uintptr_t base;
+    uintptr_t end;
+    uintptr_t next;             // Start of the never-used part
+    int node;                   // Kernel node id
+    pthread_mutex_t lock;
+    void* free_list[ARENA_CLASSES];
+    unsigned char* classes;     // Class + 1 of the block at each page, FREE_MARK, or 0
+    size_t cached;              // Bytes on the free lists
+};
+
+// classes[] entry of the first page of a free block
+const unsigned char FREE_MARK = 0xff;
+static_assert(ARENA_CLASSES < FREE_MARK, "class + 1 must fit below FREE_MARK");
+
+static Arena arenas[MAX_ARENA_NODES];
+static int arena_count = 0;
+static bool arena_ready = false;
+static size_t arena_threshold = ARENA_THRESHOLD;
+static pthread_mutex_t arena_setup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Class of a request: multiples of ARENA_STEP up to ARENA_LINEAR_LIMIT,
+// then four classes per power of two (at most 25% rounding)
+static int size_class(size_t size) {
+    size_t steps = (size + ARENA_STEP - 1) / ARENA_STEP;
+    if (steps * ARENA_STEP <= ARENA_LINEAR_LIMIT) {
+        return (int)steps - 1;
+    }
+    int log = 63 - __builtin_clzll(size - 1);       // 2^log < size <= 2^(log + 1)
+    size_t quarter = (1ULL << log) / 4;
+    size_t quarters = (size + quarter - 1) / quarter;   // 5..8
+    int linear = (int)(ARENA_LINEAR_LIMIT / ARENA_STEP);
+    int first_log = __builtin_ctzll(ARENA_LINEAR_LIMIT);
+    return linear + (log - first_log) * 4 + (int)quarters - 5;
+}
+
+static size_t class_size(int cls) {
+    int linear = (int)(ARENA_LINEAR_LIMIT / ARENA_STEP);
+    if (cls < linear) {
+        return (size_t)(cls + 1) * ARENA_STEP;
+    }
+    int first_log = __builtin_ctzll(ARENA_LINEAR_LIMIT);
+    int log = first_log + (cls - linear) / 4;
+    size_t quarters = (size_t)((cls - linear) % 4) + 5;
+    return ((1ULL << log) / 4) * quarters;
+}
+
+// Keep the locks consistent across fork() in threaded callers
+static void fork_prepare() {
+    for (int i = 0; i < arena_count; i++) {
+        pthread_mutex_lock(&arenas[i].lock);
+    }
+}
+static void fork_release() {
+    for (int i = arena_count; i > 0; i--) {
+        pthread_mutex_unlock(&arenas[i - 1].lock);
+    }
+}
+
+// Arena of the calling thread's node, reserving it on first use
+static Arena* local_arena() {
+    const Topology* topology = topology_get();
+    int index = 0;
+    int cpu = sched_getcpu();
+    int slot = (cpu >= 0) ? topology_cpu_index(topology, cpu) : -1;
+    if (slot >= 0) {
+        index = topology->cpus[slot].node;
+    }
+    if (index >= MAX_ARENA_NODES) {
+        index = 0;
+    }
+    int node = topology->nodes[index].id;
+
+    int count = __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        if (arenas[i].node == node) {
+            return &arenas[i];
+        }
+    }
+
+    pthread_mutex_lock(&arena_setup_lock);
+    Arena* arena = nullptr;
+    for (int i = 0; i < arena_count; i++) {
+        if (arenas[i].node == node) {
+            arena = &arenas[i];
+        }
+    }
+    if (!arena && arena_count < MAX_ARENA_NODES) {
+        size_t reserve = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+        reserve &= ~(ARENA_STEP - 1);
+        size_t pages = reserve / ARENA_STEP;
+        char* raw = (char*)sys_mmap(nullptr, reserve + ARENA_STEP, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        void* classes = sys_mmap(nullptr, pages, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED && classes != MAP_FAILED) {
+            uintptr_t base = ((uintptr_t)raw + ARENA_STEP - 1) & ~(uintptr_t)(ARENA_STEP - 1);
+            arena = &arenas[arena_count];
+            memset(arena, 0, sizeof(*arena));
+            arena->base = base;
+            arena->end = base + reserve;
+            arena->next = base;
+            arena->node = node;
+            arena->classes = (unsigned char*)classes;
+            pthread_mutex_init(&arena->lock, nullptr);
+            __atomic_store_n(&arena_count, arena_count + 1, __ATOMIC_RELEASE);
+            DEBUG_PRINT("Hugepage arena for node %d: %.1f GB reserved at %p",
+                        node, reserve / (1024.0 * 1024.0 * 1024.0), (void*)base);
+        } else {
+            if (raw != MAP_FAILED) {
+                sys_munmap(raw, reserve + ARENA_STEP);
+            }
+            if (classes != MAP_FAILED) {
+                sys_munmap(classes, pages);
+            }
+            DEBUG_PRINT("Cannot reserve a hugepage arena: %s", strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&arena_setup_lock);
+    return arena;
+}
+
+// Arena holding ptr, or nullptr
+static Arena* owner(const void* ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    int count = __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        if (addr >= arenas[i].base && addr < arenas[i].end) {
+            return &arenas[i];
+        }
+    }
+    return nullptr;
+}
+
+static inline size_t page_of(const Arena* arena, const void* mem) {
+    return ((uintptr_t)mem - arena->base) / ARENA_STEP;
+}
+
+// Push a free block onto the list of its class and mark it (lock held).
+// Word 0 of a free block is the next block of the list, word 1 the
+// previous one.
+static void push_free(Arena* arena, void* mem, int cls) {
+    void** links = (void**)mem;
+    links[0] = arena->free_list[cls];
+    links[1] = nullptr;
+    if (links[0]) {
+        ((void**)links[0])[1] = mem;
+    }
+    arena->free_list[cls] = mem;
+    arena->classes[page_of(arena, mem)] = FREE_MARK;
+    arena->cached += class_size(cls);
+}
+
+// Take a free block off its list and clear its mark (lock held)
+static void unlink_free(Arena* arena, void* mem, int cls) {
+    void** links = (void**)mem;
+    if (links[1]) {
+        ((void**)links[1])[0] = links[0];
+    } else {
+        arena->free_list[cls] = links[0];
+    }
+    if (links[0]) {
+        ((void**)links[0])[1] = links[1];
+    }
+    arena->classes[page_of(arena, mem)] = 0;
+    arena->cached -= class_size(cls);
+}
+
+static void* pop_free(Arena* arena, int cls) {
+    void* mem = arena->free_list[cls];
+    unlink_free(arena, mem, cls);
+    return mem;
+}
+
+// Put [mem, mem + size) on the free lists as the largest classes that
+// fit it (lock held). Class sizes are multiples of ARENA_STEP, so any
+// span decomposes; every piece after the first is at most a fifth of
+// the one before.
+static void push_span(Arena* arena, char* mem, size_t size) {
+    while (size > 0) {
+        int c = size_class(size);
+        if (c >= ARENA_CLASSES) {
+            c = ARENA_CLASSES - 1;
+        } else if (class_size(c) > size) {
+            c--;
+        }
+        push_free(arena, mem, c);
+        mem += class_size(c);
+        size -= class_size(c);
+    }
+}
+
+// Cut a block of class cls from the smallest larger free block and put
+// the remainder back on the free lists (lock held)
+static void* split_free(Arena* arena, int cls) {
+    size_t block = class_size(cls);
+    if (arena->cached < block) {
+        return nullptr;
+    }
+    int from = cls + 2;
+    while (from < ARENA_CLASSES && !arena->free_list[from]) {
+        from++;
+    }
+    if (from == ARENA_CLASSES) {
+        return nullptr;
+    }
+    char* mem = (char*)pop_free(arena, from);
+    push_span(arena, mem + block, class_size(from) - block);
+    DEBUG_PRINT("Arena block of %.1f MB split from a free %.1f MB block",
+                block / (1024.0 * 1024.0), class_size(from) / (1024.0 * 1024.0));
+    return mem;
+}
+
+// Free the block of class cls at mem together with the free blocks
+// next to it (lock held). A block reaches up to the next marked page or
+// the bump pointer.
+static void merge_free(Arena* arena, char* mem, int cls) {
+    size_t first = page_of(arena, mem);
+    size_t last = first + class_size(cls) / ARENA_STEP;    // One past
+    size_t used = page_of(arena, (void*)arena->next);
+    while (last < used && arena->classes[last] == FREE_MARK) {
+        size_t end = last + 1;
+        while (end < used && arena->classes[end] == 0) {
+            end++;
+        }
+        unlink_free(arena, (void*)(arena->base + last * ARENA_STEP),
+                    size_class((end - last) * ARENA_STEP));
+        last = end;
+    }
+    while (first > 0) {
+        size_t start = first - 1;
+        while (start > 0 && arena->classes[start] == 0) {
+            start--;
+        }
+        if (arena->classes[start] != FREE_MARK) {
+            break;
+        }
+        unlink_free(arena, (void*)(arena->base + start * ARENA_STEP),
+                    size_class((first - start) * ARENA_STEP));
+        first = start;
+    }
+    size_t size = (last - first) * ARENA_STEP;
+    if (size > class_size(cls)) {
+        DEBUG_PRINT("Arena block of %.1f MB freed into a free %.1f MB span",
+                    class_size(cls) / (1024.0 * 1024.0), size / (1024.0 * 1024.0));
+    }
+    push_span(arena, (char*)(arena->base + first * ARENA_STEP), size);
+}
+
+// Map a new block at the arena's bump pointer (lock held)
+static void* carve(Arena* arena, size_t size) {
+    if (arena->end - arena->next < size) {
+        return nullptr;
+    }
+    void* addr = (void*)arena->next;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+    const char* kind = "2MB";
+    void* mem = sys_mmap(addr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (mem == MAP_FAILED) {
+        mem = sys_mmap(addr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mem == MAP_FAILED) {
+            return nullptr;
+        }
+        madvise(mem, size, MADV_HUGEPAGE);
+        kind = "THP";
+    }
+    numa_prefer(mem, size, arena->node);
+
+    arena->next += size;
+    DEBUG_PRINT("Arena block of %.1f MB on node %d (%s pages)",
+                size / (1024.0 * 1024.0), arena->node, kind);
+    return mem;
+}
+
+void arena_init() {
+    if (!env_flag("ZEN5_ARENA", true)) {
+        return;
+    }
+    long threshold_mb = env_long("ZEN5_ARENA_THRESHOLD", (long)(ARENA_THRESHOLD >> 20));
+    if (threshold_mb > 0) {
+        arena_threshold = (size_t)threshold_mb << 20;
+    }
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+    __atomic_store_n(&arena_ready, true, __ATOMIC_RELEASE);
+    DEBUG_PRINT("Hugepage arena: ON for allocations of %zu MB and more", arena_threshold >> 20);
+}
+
+void* arena_alloc(size_t size, bool zero) {
+    if (size < arena_threshold || !__atomic_load_n(&arena_ready, __ATOMIC_ACQUIRE) ||
+        size > (1ULL << 62)) {
+        return nullptr;
+    }
+    Arena* arena = local_arena();
+    if (!arena) {
+        return nullptr;
+    }
+
+    int cls = size_class(size);
+    size_t block = class_size(cls);
+    void* mem = nullptr;
+    bool fresh = false;
+
+    pthread_mutex_lock(&arena->lock);
+    // A freed block of this class, or of the next one (at most 25% more)
+    for (int c = cls; c <= cls + 1 && c < ARENA_CLASSES && !mem; c++) {
+        if (arena->free_list[c]) {
+            mem = pop_free(arena, c);
+            cls = c;
+        }
+    }
+    if (!mem) {
+        mem = split_free(arena, cls);
+    }
+    if (!mem) {
+        mem = carve(arena, block);
+        fresh = true;
+    }
+    if (mem) {
+        arena->classes[page_of(arena, mem)] = (unsigned char)(cls + 1);
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    if (mem && zero && !fresh) {
+        memset(mem, 0, size);
+    }
+    return mem;
+}
+
+size_t arena_block_size(const void* ptr) {
+    Arena* arena = owner(ptr);
+    if (!arena) {
+        return 0;
+    }
+    unsigned char cls = arena->classes[page_of(arena, ptr)];
+    return (cls && cls != FREE_MARK) ? class_size(cls - 1) : 0;
+}
+
+bool arena_free(void* ptr) {
+    Arena* arena = owner(ptr);
+    if (!arena) {
+        return false;
+    }
+    size_t page = page_of(arena, ptr);
+    pthread_mutex_lock(&arena->lock);
+    unsigned char cls = arena->classes[page];
+    if (cls == 0 || cls == FREE_MARK || ((uintptr_t)ptr & (ARENA_STEP - 1)) != 0) {
+        pthread_mutex_unlock(&arena->lock);
+        fprintf(stderr, "[%s] ERROR: free() of %p inside the hugepage arena\n",
+                ZEN5_OPTIMIZER_NAME, ptr);
+        return true;
+    }
+    arena->classes[page] = 0;
+    merge_free(arena, (char*)ptr, cls - 1);
+    pthread_mutex_unlock(&arena->lock);
+    return true;
+}
+
+} // namespace zen5_turbo
+
+// Our intercepted allocation functions: large requests come from the arena
+
+extern "C" void* malloc(size_t size) {
+    void* mem = zen5_turbo::arena_alloc(size, false);
+    return mem ? mem : __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(count, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void* mem = zen5_turbo::arena_alloc(total, true);
+    return mem ? mem : __libc_calloc(count, size);
+}
+
+extern "C" void free(void* ptr) {
+    if (ptr && !zen5_turbo::arena_free(ptr)) {
+        __libc_free(ptr);
+    }
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    using namespace zen5_turbo;
+
+    size_t old_size = ptr ? arena_block_size(ptr) : 0;
+    if (old_size == 0 && (size < arena_threshold || !ptr)) {
+        // Neither side involves the arena (a null ptr is a malloc)
+        return ptr ? __libc_realloc(ptr, size) : malloc(size);
+    }
+    if (old_size >= size && size > 0) {
+        return ptr;         // Shrinks stay in the block
+    }
+    if (size == 0) {
+        free(ptr);
+        return nullptr;
+    }
+
+    void* mem = malloc(size);
+    if (!mem) {
+        return nullptr;
+    }
+    size_t copy = old_size ? old_size : malloc_usable_size(ptr);
+    memcpy(mem, ptr, copy < size ? copy : size);
+    free(ptr);
+    return mem;
+}
+
+extern "C" int posix_memalign(void** out, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* mem = (alignment <= ARENA_STEP) ? zen5_turbo::arena_alloc(size, false) : nullptr;
+    if (!mem) {
+        mem = __libc_memalign(alignment, size);
+        if (!mem) {
+            return ENOMEM;
+        }
+    }
+    *out = mem;
+    return 0;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+    void* mem = (alignment <= ARENA_STEP) ? zen5_turbo::arena_alloc(size, false) : nullptr;
+    return mem ? mem : __libc_memalign(alignment, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+extern "C" size_t malloc_usable_size(void* ptr) {
+    size_t size = ptr ? zen5_turbo::arena_block_size(ptr) : 0;
+    if (size) {
+        return size;
+    }
+    static size_t (*real_usable_size)(void*) = nullptr;
+    if (!real_usable_size) {
+        real_usable_size = (size_t (*)(void*))dlsym(RTLD_NEXT, "malloc_usable_size");
+    }
+    return real_usable_size ? real_usable_size(ptr) : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * hugepage_arena.h
+ *
+ * 2MB-page arena for large heap allocations. ggml compute buffers, the
+ * KV cache and work buffers come from malloc()/posix_memalign() and are
+ * touched on every token; served from 4KB pages they miss the TLB as
+ * often as the weights would. Requests of at least ZEN5_ARENA_THRESHOLD
+ * MB are carved from a per-NUMA-node arena backed by hugetlb pages (THP
+ * when the pool is empty) on the calling thread's node. Freed blocks go
+ * to per-size-class free lists and are reused, whole or split for a
+ * smaller request, without returning memory to the kernel. Smaller
+ * requests go to the real allocator.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace zen5_turbo {
+
+// Enable the arena unless ZEN5_ARENA is off. Called once from the
+// library constructor; allocations before it go to the real allocator.
+void arena_init();
+
+// Block of at least size bytes aligned to ARENA_STEP, or nullptr if the
+// request is below the threshold or the arena cannot serve it. zero
+// asks for zeroed memory.
+void* arena_alloc(size_t size, bool zero);
+
+// Usable size of an arena block, or 0 if ptr is not one
+size_t arena_block_size(const void* ptr);
+
+// Put an arena block back on its free list; false if ptr is not one
+bool arena_free(void* ptr);
+
+} // namespace zen5_turbo
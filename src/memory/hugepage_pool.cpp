@@ -0,0 +1,229 @@
+/*
+ * hugepage_pool.cpp
+ *
+ * Hugetlb pool inspection and growth via sysfs.
+ *
+ * Free pages minus reserved pages is what a new MAP_HUGETLB mapping can
+ * get. When that is short and growth is permitted, memory is compacted
+ * on every node first (so the kernel can find contiguous 2MB/1GB
+ * blocks) and nr_hugepages is raised by the deficit. The pool is not
+ * shrunk again afterwards; the pages stay available for restarts.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hugepage_pool.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+static const char HUGEPAGES_DIR[] = "/sys/kernel/mm/hugepages";
+static const char NODE_DIR[] = "/sys/devices/system/node";
+
+static long read_counter(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    long value;
+    if (fscanf(f, "%ld", &value) != 1) {
+        value = -1;
+    }
+    fclose(f);
+    return value;
+}
+
+static bool write_value(const char* path, long value) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = fprintf(f, "%ld\n", value) > 0;
+    // sysfs reports write errors on close
+    return (fclose(f) == 0) && ok;
+}
+
+static long pool_counter(size_t page_size, const char* name) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/hugepages-%zukB/%s", HUGEPAGES_DIR, page_size / 1024, name);
+    return read_counter(path);
+}
+
+size_t hugepage_pool_available(size_t page_size) {
+    long free_pages = pool_counter(page_size, "free_hugepages");
+    long resv_pages = pool_counter(page_size, "resv_hugepages");
+    if (free_pages < 0 || resv_pages < 0 || free_pages <= resv_pages) {
+        return 0;
+    }
+    return (size_t)(free_pages - resv_pages);
+}
+
+// Log per-node counters for one page size
+static void log_nodes(size_t page_size) {
+    DIR* d = opendir(NODE_DIR);
+    if (!d) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        int node;
+        if (sscanf(entry->d_name, "node%d", &node) != 1) {
+            continue;
+        }
+        char path[160];
+        snprintf(path, sizeof(path), "%s/node%d/hugepages/hugepages-%zukB/nr_hugepages",
+                 NODE_DIR, node, page_size / 1024);
+        long total = read_counter(path);
+        snprintf(path, sizeof(path), "%s/node%d/hugepages/hugepages-%zukB/free_hugepages",
+                 NODE_DIR, node, page_size / 1024);
+        long free_pages = read_counter(path);
+        if (total >= 0) {
+            DEBUG_PRINT("  node %d: %ld total, %ld free", node, total, free_pages);
+        }
+    }
+    closedir(d);
+}
+
+// Compact memory on every node so larger contiguous blocks are free
+static void compact_nodes() {
+    bool compacted = false;
+    DIR* d = opendir(NODE_DIR);
+    if (d) {
+        struct dirent* entry;
+        while ((entry = readdir(d)) != nullptr) {
+            int node;
+            if (sscanf(entry->d_name, "node%d", &node) != 1) {
+                continue;
+            }
+            char path[128];
+            snprintf(path, sizeof(path), "%s/node%d/compact", NODE_DIR, node);
+            compacted |= write_value(path, 1);
+        }
+        closedir(d);
+    }
+    if (!compacted) {
+        write_value("/proc/sys/vm/compact_memory", 1);
+    }
+}
+
+// Raise nr_hugepages until at least pages are available
+static bool grow_pool(size_t page_size, size_t pages) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/hugepages-%zukB/nr_hugepages", HUGEPAGES_DIR, page_size / 1024);
+
+    // Second attempt after another compaction pass: the first one may
+    // have been undone by concurrent allocations
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t available = hugepage_pool_available(page_size);
+        if (available >= pages) {
+            return true;
+        }
+        long total = pool_counter(page_size, "nr_hugepages");
+        long target = total + (long)(pages - available);
+
+        compact_nodes();
+        if (!write_value(path, target)) {
+            DEBUG_PRINT("Cannot grow %zukB pool to %ld pages: %s",
+                    page_size / 1024, target, strerror(errno));
+            return false;
+        }
+        DEBUG_PRINT("Resized %zukB pool: %ld -> %ld pages (requested %ld)",
+                page_size / 1024, total, pool_counter(page_size, "nr_hugepages"), target);
+    }
+
+    size_t available = hugepage_pool_available(page_size);
+    if (available < pages) {
+        DEBUG_PRINT("Kernel could only provide %zu of %zu %zukB pages (memory fragmented or exhausted)",
+                available, pages, page_size / 1024);
+        return false;
+    }
+    return true;
+}
+
+// What is known about the pool of one page size, so a mapping does not
+// re-read sysfs for answers that cannot change
+struct PoolState {
+    int supported;          // -1 not checked yet
+    bool short_logged;      // Shortage reported while growth is disabled
+};
+
+static PoolState pool_1g = {-1, false};
+static PoolState pool_2m = {-1, false};
+
+bool hugepage_pool_ensure(size_t page_size, size_t pages) {
+    PoolState* state = (page_size == HUGEPAGE_1G_SIZE) ? &pool_1g : &pool_2m;
+    int supported = __atomic_load_n(&state->supported, __ATOMIC_RELAXED);
+    if (supported < 0) {
+        supported = pool_counter(page_size, "nr_hugepages") >= 0;
+        if (!supported) {
+            DEBUG_PRINT("Hugetlb pool for %zukB pages not supported by this kernel", page_size / 1024);
+        }
+        __atomic_store_n(&state->supported, supported, __ATOMIC_RELAXED);
+    }
+    if (!supported) {
+        return false;
+    }
+
+    // Without growth there is nothing to do about a short pool but say
+    // so, once; the mapping attempt finds out for itself afterwards
+    bool topup = env_flag("ZEN5_HUGEPAGE_TOPUP", false);
+    if (!topup && __atomic_load_n(&state->short_logged, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    size_t available = hugepage_pool_available(page_size);
+    if (available >= pages) {
+        return true;
+    }
+    if (!topup) {
+        if (!__atomic_exchange_n(&state->short_logged, true, __ATOMIC_RELAXED)) {
+            DEBUG_PRINT("Hugetlb pool short: %zu %zukB pages needed, %zu available",
+                    pages, page_size / 1024, available);
+            DEBUG_PRINT("Pool growth disabled (set ZEN5_HUGEPAGE_TOPUP=1 to allow it)");
+        }
+        return false;
+    }
+
+    DEBUG_PRINT("Hugetlb pool short: %zu %zukB pages needed, %zu available",
+            pages, page_size / 1024, available);
+    return grow_pool(page_size, pages);
+}
+
+void hugepage_pool_init() {
+    DIR* d = opendir(HUGEPAGES_DIR);
+    if (!d) {
+        DEBUG_PRINT("No hugetlb support (%s missing)", HUGEPAGES_DIR);
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        size_t kb;
+        if (sscanf(entry->d_name, "hugepages-%zukB", &kb) != 1) {
+            continue;
+        }
+        size_t page_size = kb * 1024;
+        DEBUG_PRINT("Hugetlb pool %zukB: %ld total, %zu available, %ld surplus",
+                kb, pool_counter(page_size, "nr_hugepages"),
+                hugepage_pool_available(page_size),
+                pool_counter(page_size, "surplus_hugepages"));
+        log_nodes(page_size);
+    }
+    closedir(d);
+
+    long reserve_mb = env_long("ZEN5_HUGEPAGE_RESERVE", 0);
+    if (reserve_mb > 0) {
+        size_t pages = ((size_t)reserve_mb * 1024 * 1024 + HUGEPAGE_SIZE - 1) / HUGEPAGE_SIZE;
+        if (grow_pool(HUGEPAGE_SIZE, pages)) {
+            DEBUG_PRINT("Reserved %ld MB of 2MB hugepages", reserve_mb);
+        }
+    }
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,30 @@
+/*
+ * hugepage_pool.h
+ *
+ * Hugetlb pool manager. Reads the global and per-node pool counters,
+ * grows the pool (after compacting memory) when a mapping needs more
+ * pages than are free and growth is permitted, and logs why a mapping
+ * could not be given hugepages.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace zen5_turbo {
+
+// Log the pool state and pre-grow it to ZEN5_HUGEPAGE_RESERVE MB.
+// Called once from the library constructor.
+void hugepage_pool_init();
+
+// Pages of page_size a new mapping can reserve right now
+size_t hugepage_pool_available(size_t page_size);
+
+// Make pages of page_size (1GB or 2MB) available for an upcoming
+// mapping, growing the pool when ZEN5_HUGEPAGE_TOPUP allows it. Returns
+// false (after logging the reason) if the pool still falls short.
+// Without growth a shortage is logged once per page size, and from then
+// on the pool is not read again and false is returned.
+bool hugepage_pool_ensure(size_t page_size, size_t pages);
+
+} // namespace zen5_turbo
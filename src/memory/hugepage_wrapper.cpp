@@ -3,13 +3,21 @@
  *
  * Intercepts mmap() calls to provide transparent huge page support.
  * Allocates anonymous huge page memory for large file mappings
- * to reduce TLB pressure during model inference.
+ * to reduce TLB pressure during model inference. Large private
+ * anonymous mappings (KV cache, compute buffers) get huge pages too.
+ *
+ * munmap(), mremap(), mprotect(), madvise() and posix_madvise() are
+ * intercepted too, so the memory behaves like the file mapping it
+ * replaces: a range that covers part of a region splits it, and
+ * operations the kernel refuses inside a hugetlb page are widened (or,
+ * for munmap, narrowed) to whole hugepages.
  */
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif
 #include <dlfcn.h>
+#include <stdarg.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -18,45 +26,76 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include "../config.h"
+#include "../env.h"
+#include "hugepage_wrapper.h"
+#include "parallel_loader.h"
+#include "uring_loader.h"
+#include "lazy_loader.h"
+#include "shared_cache.h"
+#include "page_policy.h"
+#include "file_thp.h"
+#include "region_tracker.h"
+#include "mapping_dedup.h"
+#include "numa_policy.h"
 
 namespace zen5_turbo {
 
-// Function pointer to the real mmap
+// Function pointers to the real functions
 typedef void* (*mmap_fn)(void*, size_t, int, int, int, off_t);
-static mmap_fn real_mmap = nullptr;
-
-// Function pointer to the real munmap
 typedef int (*munmap_fn)(void*, size_t);
+typedef void* (*mremap_fn)(void*, size_t, size_t, int, ...);
+typedef int (*mprotect_fn)(void*, size_t, int);
+typedef int (*madvise_fn)(void*, size_t, int);
+static mmap_fn real_mmap = nullptr;
 static munmap_fn real_munmap = nullptr;
+static mremap_fn real_mremap = nullptr;
+static mprotect_fn real_mprotect = nullptr;
+static madvise_fn real_madvise = nullptr;
+static madvise_fn real_posix_madvise = nullptr;
 
-// Track our anonymous huge page allocations
-struct HugePageAllocation {
-    void* addr;
-    size_t size;
-    HugePageAllocation* next;
-};
-static HugePageAllocation* allocations = nullptr;
+static void* find_real(const char* name) {
+    void* fn = dlsym(RTLD_NEXT, name);
+    if (!fn) {
+        fprintf(stderr, "[%s] ERROR: Failed to find real %s: %s\n",
+                ZEN5_OPTIMIZER_NAME, name, dlerror());
+        exit(1);
+    }
+    return fn;
+}
 
 // Initialize function pointers to real functions
 static void init_functions() {
     if (!real_mmap) {
-        real_mmap = (mmap_fn)dlsym(RTLD_NEXT, "mmap");
-        if (!real_mmap) {
-            fprintf(stderr, "[%s] ERROR: Failed to find real mmap: %s\n",
-                    ZEN5_OPTIMIZER_NAME, dlerror());
-            exit(1);
-        }
+        real_mmap = (mmap_fn)find_real("mmap");
     }
     if (!real_munmap) {
-        real_munmap = (munmap_fn)dlsym(RTLD_NEXT, "munmap");
-        if (!real_munmap) {
-            fprintf(stderr, "[%s] ERROR: Failed to find real munmap: %s\n",
-                    ZEN5_OPTIMIZER_NAME, dlerror());
-            exit(1);
-        }
+        real_munmap = (munmap_fn)find_real("munmap");
     }
+    if (!real_mremap) {
+        real_mremap = (mremap_fn)find_real("mremap");
+    }
+    if (!real_mprotect) {
+        real_mprotect = (mprotect_fn)find_real("mprotect");
+    }
+    if (!real_madvise) {
+        real_madvise = (madvise_fn)find_real("madvise");
+    }
+    if (!real_posix_madvise) {
+        real_posix_madvise = (madvise_fn)find_real("posix_madvise");
+    }
+}
+
+void* sys_mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    init_functions();
+    return real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+int sys_munmap(void* addr, size_t length) {
+    init_functions();
+    return real_munmap(addr, length);
 }
 
 // Check if we should use huge pages for this file
@@ -68,40 +107,698 @@ static bool should_use_hugepages(int /*fd*/, size_t length) {
 #endif
 }
 
-// Track an allocation so we can handle munmap properly
-static void track_allocation(void* addr, size_t size) {
-    HugePageAllocation* alloc = (HugePageAllocation*)malloc(sizeof(HugePageAllocation));
-    alloc->addr = addr;
-    alloc->size = size;
-    alloc->next = allocations;
-    allocations = alloc;
+// Read file contents into the destination using the configured engine
+// (ZEN5_LOAD_ENGINE). "auto" tries io_uring + O_DIRECT first and falls
+// back to the parallel pread loader when io_uring or O_DIRECT is
+// unavailable; "uring" fails the load instead; "pread" never uses io_uring.
+bool load_file_contents(int fd, void* dst, size_t length, off_t offset) {
+    const char* engine = env_str("ZEN5_LOAD_ENGINE", "auto");
+    if (strcmp(engine, "pread") == 0) {
+        return parallel_load(fd, dst, length, offset);
+    }
+    if (uring_load(fd, dst, length, offset)) {
+        return true;
+    }
+    if (strcmp(engine, "uring") == 0) {
+        int saved_errno = errno;
+        fprintf(stderr, "[%s] ERROR: io_uring load failed (%s), not falling back "
+                "(ZEN5_LOAD_ENGINE=uring)\n", ZEN5_OPTIMIZER_NAME, strerror(saved_errno));
+        errno = saved_errno;
+        return false;
+    }
+    DEBUG_PRINT("io_uring load not possible (%s), using pread loader", strerror(errno));
+    return parallel_load(fd, dst, length, offset);
 }
 
-// Find and remove a tracked allocation
-static size_t untrack_allocation(void* addr) {
-    HugePageAllocation** prev = &allocations;
-    HugePageAllocation* curr = allocations;
+// Track an allocation so we can handle munmap properly. The region keeps
+// its own descriptor for the file so mremap() can grow it later; fd -1
+// tracks an anonymous mapping.
+static bool track_allocation(void* addr, size_t size, size_t length, int fd, off_t offset,
+                             int prot, LazyRegion* lazy, SharedMapping* shared) {
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    TrackedRegion region = {addr, size, (length + base_page - 1) & ~(base_page - 1), 0, 0, 0, offset,
+                            (fd >= 0) ? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1, prot, lazy, shared,
+                            fd < 0};
+    if (!tracker_insert(&region)) {
+        DEBUG_PRINT("Region tracker full (%zu regions), not intercepting", MAX_TRACKED_REGIONS);
+        if (region.fd >= 0) {
+            close(region.fd);
+        }
+        return false;
+    }
+    return true;
+}
 
-    while (curr) {
-        if (curr->addr == addr) {
-            size_t size = curr->size;
-            *prev = curr->next;
-            free(curr);
-            return size;
+// Put back a region (or a piece of one) taken from the tracker
+static void retrack(const TrackedRegion* region) {
+    if (!tracker_insert(region)) {
+        DEBUG_PRINT("Region tracker full, %zu bytes at %p are no longer tracked",
+                region->size, region->addr);
+        if (region->fd >= 0) {
+            close(region->fd);
         }
-        prev = &curr->next;
-        curr = curr->next;
     }
-    return 0;
+}
+
+// Drop what a region holds once its memory is unmapped
+static void release_region(const TrackedRegion* region) {
+    if (region->fd >= 0) {
+        close(region->fd);
+    }
+    // A shared entry's lock is only dropped once its mapping is gone
+    shared_cache_release(region->shared);
 }
 
 // Cleanup function to be called on library unload
 void cleanup_hugepage_allocations() {
-    while (allocations) {
-        HugePageAllocation* next = allocations->next;
-        free(allocations);
-        allocations = next;
+    TrackedRegion region;
+    while (tracker_take(nullptr, SIZE_MAX, &region)) {
+        lazy_load_stop(region.lazy);
+        release_region(&region);
+    }
+}
+
+static uintptr_t align_down(uintptr_t value, size_t align) {
+    return value & ~(uintptr_t)(align - 1);
+}
+
+static uintptr_t align_up(uintptr_t value, size_t align) {
+    return (value + align - 1) & ~(uintptr_t)(align - 1);
+}
+
+// Granularities tried in turn for an operation on part of a region: the
+// base page, then each hugetlb page size. The kernel rejects a range
+// that would split a hugetlb page with EINVAL, so the first one it
+// accepts is the page size backing that part of the region.
+const int GRANULE_COUNT = 3;
+
+static size_t granule(int attempt) {
+    switch (attempt) {
+        case 0:  return (size_t)sysconf(_SC_PAGESIZE);
+        case 1:  return HUGEPAGE_SIZE;
+        default: return HUGEPAGE_1G_SIZE;
+    }
+}
+
+// Record that the caller unmapped [start, stop) of a region whose pages
+// could not be freed: the part it still uses, [addr + head, addr +
+// length), shrinks when the range takes off its head or its tail, and a
+// range strictly inside it becomes the region's hole. One hole is kept
+// per region (a range touching it has been widened to include it by
+// widen_by_hole()); a second, separate one is not recorded and keeps
+// its hugepage mapped until the rest of the region goes.
+static void release_caller_range(TrackedRegion* region, uintptr_t start, uintptr_t stop) {
+    uintptr_t addr = (uintptr_t)region->addr;
+    uintptr_t live_lo = addr + region->head;
+    uintptr_t live_hi = addr + region->length;
+    if (start <= live_lo && stop > live_lo && stop < live_hi) {
+        region->head = stop - addr;
+    } else if (stop >= live_hi && start < live_hi && start > live_lo) {
+        region->length = start - addr;
+    } else if (start > live_lo && stop < live_hi && region->hole == region->hole_end) {
+        region->hole = start - addr;
+        region->hole_end = stop - addr;
+    }
+    if (region->hole_end <= region->head || region->hole >= region->length) {
+        region->hole = region->hole_end = 0;
+    }
+}
+
+// Widen [*start, *stop) by the region's hole when they overlap or touch,
+// and forget the hole: unmapping both at once is what the caller's
+// calls add up to
+static void widen_by_hole(TrackedRegion* region, uintptr_t* start, uintptr_t* stop) {
+    if (region->hole == region->hole_end) {
+        return;
+    }
+    uintptr_t hole_lo = (uintptr_t)region->addr + region->hole;
+    uintptr_t hole_hi = (uintptr_t)region->addr + region->hole_end;
+    if (hole_lo <= *stop && hole_hi >= *start) {
+        *start = (hole_lo < *start) ? hole_lo : *start;
+        *stop = (hole_hi > *stop) ? hole_hi : *stop;
+        region->hole = region->hole_end = 0;
+    }
+}
+
+// The part of a region's hole inside piece, which starts delta bytes
+// into the region, relative to the piece
+static void clip_hole(const TrackedRegion* region, size_t delta, TrackedRegion* piece) {
+    piece->hole = piece->hole_end = 0;
+    if (region->hole != region->hole_end && region->hole > delta + piece->head &&
+        region->hole_end - delta < piece->length) {
+        piece->hole = region->hole - delta;
+        piece->hole_end = region->hole_end - delta;
+    }
+}
+
+// Unmap [start, end), which overlaps tracked regions. Regions inside the
+// range are released whole, hugepage rounding included. A region that
+// straddles either end is split and the piece outside the range stays
+// tracked; a cut inside a hugetlb page moves into the range, so the
+// pages still holding the caller's data past the cut stay mapped. A cut
+// that frees no whole page still shrinks the part the caller uses, or
+// leaves a hole in it that a later cut next to it is joined with, so
+// the page goes once its last byte has been unmapped.
+static int unmap_range(uintptr_t start, uintptr_t end) {
+    // Regions are unmapped with one call per batch so no address we give
+    // up can be reused by another thread before the rest is unmapped
+    const int BATCH = 16;
+    int result = 0;
+
+    while (start < end) {
+        TrackedRegion taken[BATCH];
+        int count = 0;
+        while (count < BATCH && tracker_take((void*)start, end - start, &taken[count])) {
+            count++;
+        }
+        if (count == 0) {
+            // Raced with another munmap: whatever is left is not ours
+            return real_munmap((void*)start, end - start) == 0 ? result : -1;
+        }
+
+        const TrackedRegion* first = &taken[0];
+        const TrackedRegion* last = &taken[count - 1];
+        uintptr_t first_end = (uintptr_t)first->addr + first->size;
+        uintptr_t last_end = (uintptr_t)last->addr + last->size;
+        // After a full batch, regions further up are handled next round
+        uintptr_t stop = (count == BATCH && last_end < end) ? last_end : end;
+        // With the hole the caller left next to it, if any
+        uintptr_t cut_lo = start;
+        uintptr_t cut_hi = stop;
+        widen_by_hole(&taken[0], &cut_lo, &cut_hi);
+        widen_by_hole(&taken[count - 1], &cut_lo, &cut_hi);
+        // Pages are kept for the part of a region the caller still uses
+        bool keep_left = (uintptr_t)first->addr + first->head < cut_lo;
+        bool keep_right = (uintptr_t)last->addr + last->length > cut_hi;
+
+        // Split regions must be complete first: userfaultfd cannot follow
+        // the pieces. Everything else just stops loading.
+        for (int i = 0; i < count; i++) {
+            bool split = (i == 0 && keep_left) || (i == count - 1 && keep_right);
+            if (split) {
+                lazy_load_finish(taken[i].lazy);
+            } else {
+                lazy_load_stop(taken[i].lazy);
+            }
+            taken[i].lazy = nullptr;
+        }
+
+        uintptr_t lo = cut_lo;
+        uintptr_t hi = cut_hi;
+        bool unmapped = false;
+        for (int attempt = 0; attempt < GRANULE_COUNT; attempt++) {
+            size_t page = granule(attempt);
+            lo = (keep_left || (uintptr_t)first->addr > cut_lo) ? cut_lo : (uintptr_t)first->addr;
+            hi = (cut_hi > last_end) ? cut_hi : last_end;
+            if (keep_left) {
+                lo = align_up(cut_lo, page);
+                if (count > 1 && lo > first_end) {
+                    lo = first_end;
+                }
+            }
+            if (keep_right) {
+                hi = align_down(cut_hi, page);
+                if (count > 1 && hi < (uintptr_t)last->addr) {
+                    hi = (uintptr_t)last->addr;
+                }
+            }
+            if (lo >= hi) {
+                break;
+            }
+            if (real_munmap((void*)lo, hi - lo) == 0) {
+                unmapped = true;
+                break;
+            }
+            if (errno != EINVAL) {
+                break;
+            }
+        }
+
+        if (!unmapped) {
+            // Nothing whole to give back, or the kernel refused
+            if (lo < hi) {
+                result = -1;
+            }
+            for (int i = 0; i < count; i++) {
+                release_caller_range(&taken[i], cut_lo, cut_hi);
+                retrack(&taken[i]);
+            }
+            start = stop;
+            continue;
+        }
+
+        DEBUG_PRINT("Unmapped %.2f GB of huge pages memory", (hi - lo) / (1024.0 * 1024.0 * 1024.0));
+
+        // Rebuild what is left of each region around [lo, hi)
+        for (int i = 0; i < count; i++) {
+            const TrackedRegion* region = &taken[i];
+            uintptr_t region_start = (uintptr_t)region->addr;
+            uintptr_t region_end = region_start + region->size;
+            bool kept = false;
+
+            if (region_start < lo) {
+                TrackedRegion piece = *region;
+                piece.size = ((region_end < lo) ? region_end : lo) - region_start;
+                // The caller's part ends at the cut, not at the kept hugepage
+                size_t cut = (cut_lo > region_start) ? cut_lo - region_start : piece.size;
+                if (piece.length > cut) {
+                    piece.length = cut;
+                }
+                if (piece.length > piece.size) {
+                    piece.length = piece.size;
+                }
+                clip_hole(region, 0, &piece);
+                retrack(&piece);
+                kept = true;
+            }
+            if (region_end > hi) {
+                TrackedRegion piece = *region;
+                uintptr_t piece_start = (hi > region_start) ? hi : region_start;
+                size_t delta = piece_start - region_start;
+                piece.addr = (void*)piece_start;
+                piece.size = region_end - piece_start;
+                piece.length = (region->length > delta) ? region->length - delta : 0;
+                uintptr_t live_lo = region_start + region->head;
+                live_lo = (cut_hi > live_lo) ? cut_hi : live_lo;
+                piece.head = (live_lo > piece_start) ? live_lo - piece_start : 0;
+                piece.offset = region->offset + (off_t)delta;
+                clip_hole(region, delta, &piece);
+                if (kept) {
+                    // Both pieces survive: each holds its own references
+                    piece.fd = (region->fd >= 0) ? fcntl(region->fd, F_DUPFD_CLOEXEC, 0) : -1;
+                    if (piece.shared) {
+                        shared_cache_retain(piece.shared);
+                    }
+                }
+                retrack(&piece);
+                kept = true;
+            }
+            if (!kept) {
+                release_region(region);
+            }
+        }
+        start = stop;
+    }
+    return result;
+}
+
+// Unmap whatever tracked memory is left in [start, end), skipping gaps:
+// they may already have been reused by other mappings
+static int unmap_tracked(uintptr_t start, uintptr_t end) {
+    int result = 0;
+    uintptr_t pos = start;
+    TrackedRegion region;
+    while (pos < end && tracker_next((void*)pos, &region) && (uintptr_t)region.addr < end) {
+        uintptr_t region_start = (uintptr_t)region.addr;
+        uintptr_t region_end = region_start + region.size;
+        uintptr_t from = (pos > region_start) ? pos : region_start;
+        uintptr_t to = (end < region_end) ? end : region_end;
+        if (unmap_range(from, to) != 0) {
+            result = -1;
+        }
+        pos = region_end;
+    }
+    return result;
+}
+
+// munmap() of [start, end) on behalf of one user: memory other users of
+// a deduplicated region still map is kept
+static int unmap_user_range(uintptr_t start, uintptr_t end) {
+    const size_t BATCH = 16;
+    int result = 0;
+    uintptr_t pos = start;
+    while (pos < end) {
+        DedupRange ranges[BATCH];
+        size_t count = dedup_unmap(&pos, end, ranges, BATCH);
+        for (size_t i = 0; i < count; i++) {
+            int ret = ranges[i].released ? unmap_tracked(ranges[i].start, ranges[i].end)
+                                         : unmap_range(ranges[i].start, ranges[i].end);
+            if (ret != 0) {
+                result = -1;
+            }
+        }
+    }
+    return result;
+}
+
+// Change the protection of [start, end), which overlaps tracked regions.
+// The range is widened to whole pages of the regions at either end (a
+// hugetlb page has a single protection) and recorded for mremap().
+static int protect_range(uintptr_t start, uintptr_t end, int prot) {
+    // Other users of a deduplicated region must not see the change
+    if (!dedup_detach(start, end)) {
+        errno = EACCES;
+        return -1;
+    }
+
+    TrackedRegion first, last;
+    bool has_first = tracker_find((void*)start, &first);
+    bool has_last = tracker_find((void*)(end - 1), &last);
+
+    uintptr_t lo = start;
+    uintptr_t hi = end;
+    int result = -1;
+    for (int attempt = 0; attempt < GRANULE_COUNT && result != 0; attempt++) {
+        size_t page = granule(attempt);
+        lo = start;
+        hi = end;
+        if (has_first) {
+            lo = align_down(start, page);
+            if (lo < (uintptr_t)first.addr) {
+                lo = (uintptr_t)first.addr;
+            }
+        }
+        if (has_last) {
+            // Covering the caller's part covers the hugepage rounding too
+            uintptr_t last_end = (uintptr_t)last.addr + last.size;
+            hi = (end >= (uintptr_t)last.addr + last.length) ? last_end : align_up(end, page);
+            if (hi > last_end) {
+                hi = last_end;
+            }
+        }
+        result = real_mprotect((void*)lo, hi - lo, prot);
+        if (result != 0 && errno != EINVAL) {
+            break;
+        }
+    }
+    if (result != 0) {
+        return -1;
+    }
+
+    TrackedRegion region;
+    uintptr_t pos = lo;
+    while (pos < hi && tracker_next((void*)pos, &region) && (uintptr_t)region.addr < hi) {
+        uintptr_t region_end = (uintptr_t)region.addr + region.size;
+        bool whole = lo <= (uintptr_t)region.addr && hi >= region_end;
+        int updated = (whole || region.prot == prot) ? prot : -1;
+        if (updated != region.prot) {
+            region.prot = updated;
+            tracker_update(&region);
+        }
+        pos = region_end;
     }
+    return 0;
+}
+
+// Advice that needs no action on a tracked region. Readahead hints mean
+// nothing for memory that is already resident, and advice that discards
+// pages must be ignored: a file mapping would read the file again where
+// the anonymous copy would read zeros (private writes are kept instead).
+static bool advice_is_noop(int advice) {
+    switch (advice) {
+        case MADV_NORMAL:
+        case MADV_RANDOM:
+        case MADV_SEQUENTIAL:
+        case MADV_WILLNEED:
+        case MADV_DONTNEED:
+        case MADV_FREE:
+        case MADV_REMOVE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Advice after which anonymous memory must read as zeros
+static bool advice_discards(int advice) {
+    return advice == MADV_DONTNEED || advice == MADV_REMOVE;
+}
+
+// Discard [from, to) of an anonymous region: whole 2MB pages (valid for
+// every page kind of the backing) are dropped, the rest is zeroed.
+// Memory the caller cannot write keeps its contents.
+static void discard_anonymous(const TrackedRegion* region, uintptr_t from, uintptr_t to, int advice) {
+    uintptr_t lo = align_up(from, HUGEPAGE_SIZE);
+    uintptr_t hi = align_down(to, HUGEPAGE_SIZE);
+    if (lo >= hi || real_madvise((void*)lo, hi - lo, advice) != 0) {
+        lo = hi = to;
+    }
+    if (region->prot >= 0 && (region->prot & PROT_WRITE)) {
+        memset((void*)from, 0, lo - from);
+        memset((void*)hi, 0, to - hi);
+    }
+}
+
+// Apply advice to [start, end), which overlaps tracked regions. Memory
+// between regions gets the advice unchanged; inside a region it is
+// widened to whole pages the same way as mprotect().
+static int advise_range(uintptr_t start, uintptr_t end, int advice) {
+    int result = 0;
+    uintptr_t pos = start;
+    TrackedRegion region;
+
+    while (pos < end) {
+        bool tracked = tracker_next((void*)pos, &region) && (uintptr_t)region.addr < end;
+        uintptr_t next = tracked ? (uintptr_t)region.addr : end;
+        if (next > pos && real_madvise((void*)pos, next - pos, advice) != 0) {
+            result = -1;
+        }
+        if (!tracked) {
+            break;
+        }
+
+        uintptr_t region_start = (uintptr_t)region.addr;
+        uintptr_t region_end = region_start + region.size;
+        uintptr_t from = (pos > region_start) ? pos : region_start;
+        uintptr_t to = (end < region_end) ? end : region_end;
+        if (to >= region_start + region.length) {
+            to = region_end;
+        }
+
+        if (region.anonymous && advice_discards(advice)) {
+            discard_anonymous(&region, from, to, advice);
+        } else if (!advice_is_noop(advice)) {
+            int ret = -1;
+            for (int attempt = 0; attempt < GRANULE_COUNT && ret != 0; attempt++) {
+                size_t page = granule(attempt);
+                uintptr_t lo = align_down(from, page);
+                uintptr_t hi = align_up(to, page);
+                lo = (lo < region_start) ? region_start : lo;
+                hi = (hi > region_end) ? region_end : hi;
+                ret = real_madvise((void*)lo, hi - lo, advice);
+                if (ret != 0 && errno != EINVAL) {
+                    break;
+                }
+            }
+            if (ret != 0) {
+                result = -1;
+            }
+        }
+        pos = region_end;
+    }
+    return result;
+}
+
+// Grow a region taken from the tracker to new_size bytes: in place when
+// its hugepage rounding already covers new_size, otherwise (if allowed)
+// by moving it to a new backing. The added part is read from the file,
+// or zeroed for an anonymous region.
+static void* grow_region(TrackedRegion* region, size_t new_size, bool may_move) {
+    size_t old_length = region->length;
+    size_t load_length = 0;
+    if (!region->anonymous) {
+        struct stat st;
+        if (region->fd < 0 || fstat(region->fd, &st) != 0) {
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        size_t data_end = (st.st_size > region->offset) ? (size_t)(st.st_size - region->offset) : 0;
+        if (data_end > new_size) {
+            data_end = new_size;
+        }
+        load_length = (data_end > old_length) ? data_end - old_length : 0;
+    }
+
+    if (new_size <= region->size) {
+        char* base = (char*)region->addr;
+        // An earlier shrink may have left data in the rounding
+        size_t zero_length = region->anonymous ? new_size - old_length : 0;
+        if (load_length || zero_length) {
+            if (!(region->prot & PROT_WRITE) &&
+                real_mprotect(region->addr, region->size, region->prot | PROT_WRITE) != 0) {
+                return MAP_FAILED;
+            }
+            memset(base + old_length, 0, zero_length);
+            bool loaded = !load_length ||
+                          load_file_contents(region->fd, base + old_length, load_length,
+                                             region->offset + (off_t)old_length);
+            int saved_errno = errno;
+            if (!(region->prot & PROT_WRITE)) {
+                real_mprotect(region->addr, region->size, region->prot);
+            }
+            if (!loaded) {
+                errno = saved_errno;
+                return MAP_FAILED;
+            }
+        }
+        region->length = new_size;
+        retrack(region);
+        return region->addr;
+    }
+
+    if (!may_move) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    Backing backing;
+    if (!backing_alloc(new_size, region->anonymous ? PAGE_2M : PAGE_1G, &backing)) {
+        return MAP_FAILED;
+    }
+    numa_place(backing.addr, backing.size, backing_largest_page(&backing));
+    if (!(region->prot & PROT_READ) &&
+        real_mprotect(region->addr, region->size, region->prot | PROT_READ) != 0) {
+        int saved_errno = errno;
+        backing_free(&backing);
+        errno = saved_errno;
+        return MAP_FAILED;
+    }
+    memcpy(backing.addr, region->addr, old_length);
+    if (load_length && !load_file_contents(region->fd, (char*)backing.addr + old_length,
+                                           load_length, region->offset + (off_t)old_length)) {
+        int saved_errno = errno;
+        backing_free(&backing);
+        real_mprotect(region->addr, region->size, region->prot);
+        errno = saved_errno;
+        return MAP_FAILED;
+    }
+    if (region->prot != (PROT_READ | PROT_WRITE)) {
+        real_mprotect(backing.addr, backing.size, region->prot);
+    }
+
+    DEBUG_PRINT("Moved %.2f GB region to grow it to %.2f GB",
+            old_length / (1024.0 * 1024.0 * 1024.0), new_size / (1024.0 * 1024.0 * 1024.0));
+    real_munmap(region->addr, region->size);
+    shared_cache_release(region->shared);
+
+    region->addr = backing.addr;
+    region->size = backing.size;
+    region->length = new_size;
+    region->shared = nullptr;
+    retrack(region);
+    return backing.addr;
+}
+
+// mremap() of a range inside a tracked region. Shrinking unmaps the
+// tail; growing needs the whole region, which must still have a single
+// protection (as the kernel needs a single mapping). MREMAP_FIXED and
+// MREMAP_DONTUNMAP are not supported.
+static void* remap_region(void* old_address, size_t old_size, size_t new_size, int flags) {
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t old_start = (uintptr_t)old_address;
+    old_size = align_up(old_size, base_page);
+    new_size = align_up(new_size, base_page);
+
+    if ((old_start % base_page) != 0 || old_size == 0 || new_size == 0 ||
+        (flags & (MREMAP_FIXED | MREMAP_DONTUNMAP))) {
+        DEBUG_PRINT("mremap of an intercepted region not supported with these arguments");
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    TrackedRegion region;
+    if (!tracker_find(old_address, &region) ||
+        old_start + old_size > (uintptr_t)region.addr + region.length) {
+        errno = EFAULT;
+        return MAP_FAILED;
+    }
+
+    if (new_size <= old_size) {
+        if (new_size < old_size &&
+            unmap_user_range(old_start + new_size, old_start + old_size) != 0) {
+            return MAP_FAILED;
+        }
+        return old_address;
+    }
+
+    if (old_address != region.addr || old_size != region.length || region.prot < 0) {
+        errno = EFAULT;
+        return MAP_FAILED;
+    }
+    if (!dedup_detach(old_start, old_start + old_size)) {
+        DEBUG_PRINT("mremap of a region shared by several mappings not supported");
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    if (!tracker_take(old_address, 1, &region)) {
+        errno = EFAULT;
+        return MAP_FAILED;
+    }
+    if (region.addr != old_address) {
+        // Split by another thread since the lookup
+        retrack(&region);
+        errno = EFAULT;
+        return MAP_FAILED;
+    }
+    lazy_load_finish(region.lazy);
+    region.lazy = nullptr;
+
+    void* result = grow_region(&region, new_size, (flags & MREMAP_MAYMOVE) != 0);
+    if (result == MAP_FAILED) {
+        int saved_errno = errno;
+        retrack(&region);
+        errno = saved_errno;
+    }
+    return result;
+}
+
+// Whether an mmap() call is a large private anonymous mapping to back
+// with huge pages. Reservations (PROT_NONE, MAP_NORESERVE), stacks and
+// mappings that already ask for hugetlb pages are left alone.
+static bool is_anonymous_candidate(size_t length, int prot, int flags, int fd) {
+#if ENABLE_HUGEPAGES
+    static long threshold_mb = -1;
+    if (threshold_mb < 0) {
+        threshold_mb = env_flag("ZEN5_ANON", true) ?
+                       env_long("ZEN5_ANON_THRESHOLD", (long)(ANON_THRESHOLD >> 20)) : 0;
+    }
+    const int excluded = MAP_FIXED | MAP_FIXED_NOREPLACE | MAP_NORESERVE | MAP_HUGETLB |
+                         MAP_GROWSDOWN | MAP_STACK;
+    return threshold_mb > 0 && fd < 0 && (flags & MAP_ANONYMOUS) &&
+           (flags & MAP_TYPE) == MAP_PRIVATE && !(flags & excluded) && prot != PROT_NONE && length >= ((size_t)threshold_mb << 20);
+#else
+    (void)length; (void)prot; (void)flags; (void)fd;
+    return false;
+#endif
+}
+
+// Back a private anonymous mapping with 2MB pages (THP where the pool is
+// short). Returns MAP_FAILED if the caller should get the real mapping.
+static void* map_anonymous(size_t length, int prot, int flags) {
+    Backing backing;
+    if (!backing_alloc(length, PAGE_2M, &backing)) {
+        return MAP_FAILED;
+    }
+    bool huge = false;
+    for (int i = 0; i < backing.count; i++) {
+        huge |= (backing.regions[i].kind != PAGE_4K);
+    }
+    if (!huge) {
+        // Nothing gained over the kernel's own mapping
+        backing_free(&backing);
+        return MAP_FAILED;
+    }
+    void* mem = backing.addr;
+    DEBUG_PRINT("Intercepting anonymous mmap of %.1f MB (%s pages)",
+            length / (1024.0 * 1024.0), page_kind_name(backing.regions[0].kind));
+
+    numa_place(mem, backing.size, backing_largest_page(&backing));
+
+    if ((flags & MAP_POPULATE) || env_flag("ZEN5_ANON_PREFAULT", false)) {
+        if (!parallel_prefault(mem, backing.size)) {
+            DEBUG_PRINT("WARNING: Prefault failed, pages fault in on access");
+        }
+    }
+
+    int region_prot = PROT_READ | PROT_WRITE;
+    if (prot != region_prot && real_mprotect(mem, backing.size, prot) == 0) {
+        region_prot = prot;
+    }
+    if (!track_allocation(mem, backing.size, length, -1, 0, region_prot, nullptr, nullptr)) {
+        backing_free(&backing);
+        return MAP_FAILED;
+    }
+    return mem;
 }
 
 } // namespace zen5_turbo
@@ -112,96 +809,154 @@ extern "C" void* mmap(void* addr, size_t length, int prot, int flags, int fd, of
 
     init_functions();
 
-    // Check if this is a file-backed mmap that could benefit from huge pages
-    if (fd >= 0 && should_use_hugepages(fd, length)) {
-        // Get file size to verify we're mapping the whole file
+    // Check if this is a file-backed mmap that could benefit from huge pages.
+    // MAP_FIXED callers own the address, so they always get the real mapping.
+    if (fd >= 0 && !(flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) && should_use_hugepages(fd, length)) {
+        // Get file size to verify the window lies inside the file
         struct stat st;
         if (fstat(fd, &st) != 0) {
             DEBUG_PRINT("WARNING: Failed to stat fd %d: %s", fd, strerror(errno));
             return real_mmap(addr, length, prot, flags, fd, offset);
         }
 
-        // Only intercept if mapping the whole file from offset 0 (typical for model loading)
-        if (offset == 0 && length == (size_t)st.st_size) {
-            DEBUG_PRINT("Intercepting mmap for %.2f GB file (using huge pages)",
-                    length / (1024.0 * 1024.0 * 1024.0));
-
-            // Allocate anonymous huge pages memory
-            void* huge_mem = real_mmap(nullptr, length,
-                                       PROT_READ | PROT_WRITE,
-                                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
-                                       -1, 0);
-
-            if (huge_mem == MAP_FAILED) {
-                // Try without MAP_HUGETLB as fallback
-                DEBUG_PRINT("MAP_HUGETLB failed, trying regular anonymous mmap");
-                huge_mem = real_mmap(nullptr, length,
-                                    PROT_READ | PROT_WRITE,
-                                    MAP_PRIVATE | MAP_ANONYMOUS,
-                                    -1, 0);
-
-                if (huge_mem == MAP_FAILED) {
-                    fprintf(stderr, "[%s] ERROR: Anonymous mmap failed: %s\n",
-                            ZEN5_OPTIMIZER_NAME, strerror(errno));
-                    return MAP_FAILED;
-                }
-            } else {
-                DEBUG_PRINT("Allocated %.2f GB with MAP_HUGETLB",
-                        length / (1024.0 * 1024.0 * 1024.0));
+        // Intercept any page-aligned window of a regular file: whole files,
+        // GGUF shards, the tensor-data region or one piece of a split load.
+        // A window may run into the last partial page (bytes past EOF read
+        // as zero, as with the real mapping) but not beyond it.
+        size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t file_span = ((size_t)st.st_size + base_page - 1) & ~(base_page - 1);
+        if (S_ISREG(st.st_mode) && offset >= 0 && ((size_t)offset % base_page) == 0 &&
+            (size_t)offset < (size_t)st.st_size && length <= file_span - (size_t)offset) {
+            // Bytes of the window backed by file data
+            size_t data_length = (size_t)st.st_size - (size_t)offset;
+            if (data_length > length) {
+                data_length = length;
             }
 
-            // Read the file contents into huge pages memory
-            DEBUG_PRINT("Loading file contents into huge pages memory...");
+            DEBUG_PRINT("Intercepting mmap for %.2f GB window at offset %.2f GB (using huge pages)",
+                    length / (1024.0 * 1024.0 * 1024.0),
+                    offset / (1024.0 * 1024.0 * 1024.0));
 
-            size_t total_read = 0;
-            const size_t chunk_size = 256 * 1024 * 1024; // 256MB chunks
+            const char* mode = env_str("ZEN5_MAP_MODE", "copy");
 
-            while (total_read < length) {
-                size_t to_read = (length - total_read < chunk_size) ? (length - total_read) : chunk_size;
-                ssize_t bytes_read = pread(fd, (char*)huge_mem + total_read, to_read, offset + total_read);
+            // A read-only window that is already loaded is shared rather
+            // than copied again (repeated contexts, draft models, reloads)
+            size_t map_length = align_up(length, base_page);
+            bool dedup = !(prot & PROT_WRITE) && strcmp(mode, "filethp") != 0 &&
+                         env_flag("ZEN5_DEDUP", true);
+            if (dedup) {
+                void* existing = dedup_attach(&st, offset, map_length, prot);
+                if (existing) {
+                    return existing;
+                }
+            }
 
-                if (bytes_read < 0) {
-                    fprintf(stderr, "[%s] ERROR: Failed to read file: %s\n",
-                            ZEN5_OPTIMIZER_NAME, strerror(errno));
-                    real_munmap(huge_mem, length);
-                    return MAP_FAILED;
+            // In shared mode read-only mappings come from the cross-process
+            // hugetlbfs cache so concurrent servers share one copy
+            if (strcmp(mode, "shared") == 0 && !(prot & PROT_WRITE)) {
+                SharedMapping* shared = shared_cache_map(fd, &st, data_length, offset);
+                if (shared) {
+                    if (track_allocation(shared->addr, shared->size, length, fd, offset,
+                                         PROT_READ, nullptr, shared)) {
+                        if (dedup) {
+                            dedup_register(&st, offset, map_length, prot, shared->addr,
+                                           shared->size);
+                        }
+                        return shared->addr;
+                    }
+                    sys_munmap(shared->addr, shared->size);
+                    shared_cache_release(shared);
                 }
+                DEBUG_PRINT("Shared cache unavailable, using a private copy");
+            }
 
-                if (bytes_read == 0) {
-                    fprintf(stderr, "[%s] ERROR: Unexpected EOF at offset %zu\n",
-                            ZEN5_OPTIMIZER_NAME, total_read);
-                    real_munmap(huge_mem, length);
-                    return MAP_FAILED;
+            // In filethp mode the file stays mapped from the page cache
+            // and is backed by read-only file THPs instead of being copied
+            if (strcmp(mode, "filethp") == 0 && !(prot & PROT_WRITE)) {
+                void* mem = file_thp_map(length, prot, flags, fd, offset);
+                if (mem != MAP_FAILED) {
+                    return mem;
                 }
+                DEBUG_PRINT("File THP mapping failed (%s), using a private copy", strerror(errno));
+            }
+
+            // Back the mapping with the largest pages available, region by
+            // region. Lazy mode stays at 2MB: a 1GB page would have to be
+            // staged and copied whole on the first fault.
+            bool lazy_mode = strcmp(mode, "lazy") == 0;
+            Backing backing;
+            if (!backing_alloc(length, lazy_mode ? PAGE_2M : PAGE_1G, &backing)) {
+                fprintf(stderr, "[%s] ERROR: Anonymous mmap failed: %s\n",
+                        ZEN5_OPTIMIZER_NAME, strerror(errno));
+                return MAP_FAILED;
+            }
+            void* huge_mem = backing.addr;
 
-                total_read += bytes_read;
+            // Spread the pages over the cpuset's nodes before anything
+            // touches them (ZEN5_NUMA)
+            numa_place(huge_mem, backing.size, backing_largest_page(&backing));
 
-                // Progress indicator for large files
-                if (total_read % (1024 * 1024 * 1024) == 0) {
-                    DEBUG_PRINT("Loaded %.1f GB / %.1f GB",
-                            total_read / (1024.0 * 1024.0 * 1024.0),
-                            length / (1024.0 * 1024.0 * 1024.0));
+            // In lazy mode the region is populated in the background and
+            // returned immediately; faults on unloaded pages are served first
+            LazyRegion* lazy = nullptr;
+            if (lazy_mode) {
+                size_t page_size = backing_page_size(&backing);
+                if (page_size) {
+                    lazy = lazy_load_start(fd, huge_mem, data_length, offset, page_size);
+                }
+                if (!lazy) {
+                    DEBUG_PRINT("Lazy mode unavailable, loading eagerly");
                 }
             }
 
-            DEBUG_PRINT("Successfully loaded %.2f GB file into huge pages memory",
-                    length / (1024.0 * 1024.0 * 1024.0));
+            if (!lazy) {
+                // Read the file contents into huge pages memory
+                DEBUG_PRINT("Loading file contents into huge pages memory...");
+
+                if (!load_file_contents(fd, huge_mem, data_length, offset)) {
+                    int saved_errno = errno;
+                    backing_free(&backing);
+                    errno = saved_errno;
+                    return MAP_FAILED;
+                }
+
+                DEBUG_PRINT("Successfully loaded %.2f GB file into huge pages memory",
+                        length / (1024.0 * 1024.0 * 1024.0));
+                numa_report(huge_mem, backing.size, backing_largest_page(&backing));
+            }
 
             // Set memory protection to match requested (usually PROT_READ for model files)
             // Note: mprotect on huge pages often fails with EINVAL, but this is non-fatal
+            int region_prot = PROT_READ | PROT_WRITE;
             if (!(prot & PROT_WRITE)) {
-                if (mprotect(huge_mem, length, prot) != 0) {
-                    // Silently ignore - this is expected with huge pages
+                if (real_mprotect(huge_mem, backing.size, prot) == 0) {
+                    region_prot = prot;
                 }
             }
 
             // Track this allocation so we can handle munmap properly
-            track_allocation(huge_mem, length);
+            if (!track_allocation(huge_mem, backing.size, length, fd, offset, region_prot,
+                                  lazy, nullptr)) {
+                lazy_load_stop(lazy);
+                backing_free(&backing);
+                return real_mmap(addr, length, prot, flags, fd, offset);
+            }
 
+            if (dedup) {
+                dedup_register(&st, offset, map_length, prot, huge_mem, backing.size);
+            }
             return huge_mem;
         }
     }
 
+    // KV cache and compute buffers: large private anonymous mappings
+    if (is_anonymous_candidate(length, prot, flags, fd)) {
+        void* mem = map_anonymous(length, prot, flags);
+        if (mem != MAP_FAILED) {
+            return mem;
+        }
+    }
+
     // Not a candidate for huge pages, use regular mmap
     return real_mmap(addr, length, prot, flags, fd, offset);
 }
@@ -212,15 +967,95 @@ extern "C" int munmap(void* addr, size_t length) {
 
     init_functions();
 
-    // Check if this is one of our tracked allocations
-    size_t tracked_size = untrack_allocation(addr);
-    if (tracked_size > 0) {
-        DEBUG_PRINT("Unmapping %.2f GB huge pages allocation",
-                tracked_size / (1024.0 * 1024.0 * 1024.0));
-        // Use the tracked size, not the provided length (which might be wrong)
-        return real_munmap(addr, tracked_size);
+    // Fast path: almost every munmap in the process is for memory we
+    // never intercepted, and this check takes no lock
+    if (!tracker_overlaps(addr, length)) {
+        return real_munmap(addr, length);
     }
 
-    // Regular munmap
-    return real_munmap(addr, length);
-}
\ No newline at end of file
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    if (((uintptr_t)addr % base_page) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return unmap_user_range((uintptr_t)addr, align_up((uintptr_t)addr + length, base_page));
+}
+
+// Our intercepted mremap function
+extern "C" void* mremap(void* old_address, size_t old_size, size_t new_size, int flags, ...) {
+    using namespace zen5_turbo;
+
+    init_functions();
+
+    void* new_address = nullptr;
+    if (flags & MREMAP_FIXED) {
+        va_list args;
+        va_start(args, flags);
+        new_address = va_arg(args, void*);
+        va_end(args);
+    }
+
+    if (!tracker_overlaps(old_address, old_size ? old_size : 1)) {
+        return real_mremap(old_address, old_size, new_size, flags, new_address);
+    }
+    return remap_region(old_address, old_size, new_size, flags);
+}
+
+// Our intercepted mprotect function
+extern "C" int mprotect(void* addr, size_t len, int prot) {
+    using namespace zen5_turbo;
+
+    init_functions();
+
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    if (len == 0 || ((uintptr_t)addr % base_page) != 0 || !tracker_overlaps(addr, len)) {
+        return real_mprotect(addr, len, prot);
+    }
+    return protect_range((uintptr_t)addr, align_up((uintptr_t)addr + len, base_page), prot);
+}
+
+// Our intercepted madvise function
+extern "C" int madvise(void* addr, size_t length, int advice) {
+    using namespace zen5_turbo;
+
+    init_functions();
+
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    if (length == 0 || ((uintptr_t)addr % base_page) != 0 || !tracker_overlaps(addr, length)) {
+        return real_madvise(addr, length, advice);
+    }
+    return advise_range((uintptr_t)addr, align_up((uintptr_t)addr + length, base_page), advice);
+}
+
+// Our intercepted posix_madvise function. glibc issues the syscall
+// itself rather than calling madvise(), so llama.cpp's WILLNEED/RANDOM
+// hints need their own entry point. Returns an error number.
+extern "C" int posix_madvise(void* addr, size_t len, int advice) {
+    using namespace zen5_turbo;
+
+    init_functions();
+
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    if (len == 0 || ((uintptr_t)addr % base_page) != 0 || !tracker_overlaps(addr, len)) {
+        return real_posix_madvise(addr, len, advice);
+    }
+
+    int linux_advice;
+    switch (advice) {
+        case POSIX_MADV_NORMAL:     linux_advice = MADV_NORMAL; break;
+        case POSIX_MADV_RANDOM:     linux_advice = MADV_RANDOM; break;
+        case POSIX_MADV_SEQUENTIAL: linux_advice = MADV_SEQUENTIAL; break;
+        case POSIX_MADV_WILLNEED:   linux_advice = MADV_WILLNEED; break;
+        // Never discards data (glibc treats it as a no-op too)
+        case POSIX_MADV_DONTNEED:   return 0;
+        default:                    return EINVAL;
+    }
+
+    int saved_errno = errno;
+    int error = 0;
+    if (advise_range((uintptr_t)addr, align_up((uintptr_t)addr + len, base_page), linux_advice) != 0) {
+        error = errno;
+    }
+    errno = saved_errno;
+    return error;
+}
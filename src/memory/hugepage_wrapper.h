@@ -0,0 +1,23 @@
+/*
+ * hugepage_wrapper.h
+ *
+ * Helpers exported by the mmap() interception layer to the other
+ * memory modules (shared cache, loaders).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+// Call the next mmap/munmap in the chain, bypassing interception
+void* sys_mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
+int sys_munmap(void* addr, size_t length);
+
+// Read [offset, offset + length) of fd into dst with the configured
+// engine (io_uring + O_DIRECT, falling back to the parallel pread loader)
+bool load_file_contents(int fd, void* dst, size_t length, off_t offset);
+
+} // namespace zen5_turbo
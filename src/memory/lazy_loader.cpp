@@ -0,0 +1,401 @@
+/*
+ * lazy_loader.cpp
+ *
+ * userfaultfd-backed lazy population for intercepted model mappings.
+ *
+ * The region is split into LAZY_CHUNK_SIZE chunks, each with a small
+ * state machine (pending -> loading -> done). Two threads compete for
+ * pending chunks:
+ *   - the streamer walks the file in order, so the whole model ends up
+ *     resident shortly after startup;
+ *   - the fault thread serves userfaultfd page faults, so a chunk the
+ *     application is waiting on is loaded next regardless of where the
+ *     streamer is.
+ * Whoever claims a chunk reads it into a private staging buffer and
+ * installs it with UFFDIO_COPY, which also wakes any faulting threads.
+ *
+ * Read errors abort the process: the faulting thread cannot be given a
+ * meaningful page, mirroring the SIGBUS a real file mapping would raise.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <linux/userfaultfd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <atomic>
+
+#include "lazy_loader.h"
+#include "../config.h"
+
+namespace zen5_turbo {
+
+// Per-chunk population state
+enum : uint8_t {
+    CHUNK_PENDING = 0,
+    CHUNK_LOADING = 1,
+    CHUNK_DONE = 2,
+};
+
+struct LazyRegion {
+    int uffd;
+    int fd;             // dup() of the model fd (callers may close theirs)
+    int stop_fd;        // eventfd that wakes the fault thread on shutdown
+    char* base;
+    size_t length;      // Bytes of file content
+    size_t span;        // Registered length (rounded to page_size)
+    off_t offset;
+    size_t page_size;
+    size_t chunks;
+    uint8_t* state;     // CHUNK_* per chunk, accessed with __atomic builtins
+    std::atomic<size_t> remaining;
+    std::atomic<bool> stop;
+    pthread_t streamer;
+    pthread_t fault_thread;
+    bool streamer_running;
+    bool fault_running;
+    char* stream_buf;
+    char* fault_buf;
+    struct timespec start;
+};
+
+static int open_userfaultfd() {
+    int uffd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (uffd >= 0) {
+        return uffd;
+    }
+
+#ifdef USERFAULTFD_IOC_NEW
+    // Kernels >= 6.1 also hand out descriptors through /dev/userfaultfd,
+    // which containers can expose without CAP_SYS_PTRACE
+    int saved_errno = errno;
+    int dev = open("/dev/userfaultfd", O_RDWR | O_CLOEXEC);
+    if (dev >= 0) {
+        uffd = ioctl(dev, USERFAULTFD_IOC_NEW, O_CLOEXEC | O_NONBLOCK);
+        close(dev);
+        if (uffd >= 0) {
+            return uffd;
+        }
+    }
+    errno = saved_errno;
+#endif
+
+    return -1;
+}
+
+static bool claim_chunk(LazyRegion* region, size_t idx) {
+    uint8_t expected = CHUNK_PENDING;
+    return __atomic_compare_exchange_n(&region->state[idx], &expected, CHUNK_LOADING,
+                                       false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Read a claimed chunk from the file and install it in the region
+static void fill_chunk(LazyRegion* region, size_t idx, char* buf) {
+    size_t pos = idx * LAZY_CHUNK_SIZE;
+    size_t copy_len = (region->span - pos < LAZY_CHUNK_SIZE) ? (region->span - pos) : LAZY_CHUNK_SIZE;
+    size_t file_len = (region->length - pos < copy_len) ? (region->length - pos) : copy_len;
+
+    size_t done = 0;
+    while (done < file_len) {
+        ssize_t bytes_read = pread(region->fd, buf + done, file_len - done,
+                                   region->offset + (off_t)(pos + done));
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            fprintf(stderr, "[%s] ERROR: Lazy load failed at offset %zu: %s\n",
+                    ZEN5_OPTIMIZER_NAME, pos + done,
+                    bytes_read < 0 ? strerror(errno) : "unexpected EOF");
+            abort();
+        }
+        done += bytes_read;
+    }
+    memset(buf + file_len, 0, copy_len - file_len);
+
+    size_t copied = 0;
+    while (copied < copy_len) {
+        struct uffdio_copy copy;
+        copy.dst = (uintptr_t)(region->base + pos + copied);
+        copy.src = (uintptr_t)(buf + copied);
+        copy.len = copy_len - copied;
+        copy.mode = 0;
+        copy.copy = 0;
+
+        if (ioctl(region->uffd, UFFDIO_COPY, &copy) == 0) {
+            break;
+        }
+        if (copy.copy > 0) {
+            // Partial progress: retry the remainder
+            copied += copy.copy;
+            continue;
+        }
+        if (errno == EAGAIN) {
+            continue;
+        }
+        if (errno == EEXIST) {
+            // Page already present (e.g. written by the application): keep it
+            copied += region->page_size;
+            continue;
+        }
+        fprintf(stderr, "[%s] ERROR: UFFDIO_COPY failed at offset %zu: %s\n",
+                ZEN5_OPTIMIZER_NAME, pos + copied, strerror(errno));
+        abort();
+    }
+
+    __atomic_store_n(&region->state[idx], CHUNK_DONE, __ATOMIC_RELEASE);
+    region->remaining--;
+}
+
+// Background streamer: populate the region in file order
+static void* streamer_main(void* arg) {
+    LazyRegion* region = (LazyRegion*)arg;
+
+    for (size_t idx = 0; idx < region->chunks && !region->stop; idx++) {
+        if (claim_chunk(region, idx)) {
+            fill_chunk(region, idx, region->stream_buf);
+        }
+    }
+
+    // Wait for chunks still being served by the fault thread
+    while (region->remaining > 0 && !region->stop) {
+        usleep(1000);
+    }
+
+    if (!region->stop) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - region->start.tv_sec) +
+                         (end.tv_nsec - region->start.tv_nsec) / 1e9;
+        DEBUG_PRINT("Lazy load complete: %.2f GB in %.2f s",
+                region->length / (1024.0 * 1024.0 * 1024.0), elapsed);
+
+        // Fully resident: no more faults to serve, children may inherit it
+        struct uffdio_range range;
+        range.start = (uintptr_t)region->base;
+        range.len = region->span;
+        ioctl(region->uffd, UFFDIO_UNREGISTER, &range);
+        madvise(region->base, region->span, MADV_DOFORK);
+    }
+
+    uint64_t one = 1;
+    if (write(region->stop_fd, &one, sizeof(one)) < 0) {
+        // Fault thread also exits on region->stop
+    }
+    return nullptr;
+}
+
+// Fault service thread: load the chunk a faulting thread is waiting on
+static void* fault_main(void* arg) {
+    LazyRegion* region = (LazyRegion*)arg;
+
+    struct pollfd fds[2];
+    fds[0].fd = region->uffd;
+    fds[0].events = POLLIN;
+    fds[1].fd = region->stop_fd;
+    fds[1].events = POLLIN;
+
+    while (!region->stop) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        struct uffd_msg msgs[16];
+        ssize_t bytes = read(region->uffd, msgs, sizeof(msgs));
+        if (bytes <= 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < bytes / sizeof(struct uffd_msg); i++) {
+            if (msgs[i].event != UFFD_EVENT_PAGEFAULT) {
+                continue;
+            }
+
+            uintptr_t addr = (uintptr_t)msgs[i].arg.pagefault.address;
+            size_t idx = (addr - (uintptr_t)region->base) / LAZY_CHUNK_SIZE;
+            if (idx >= region->chunks) {
+                continue;
+            }
+
+            if (claim_chunk(region, idx)) {
+                fill_chunk(region, idx, region->fault_buf);
+            } else if (__atomic_load_n(&region->state[idx], __ATOMIC_ACQUIRE) == CHUNK_DONE) {
+                // Installed between the fault and now: make sure the waiter runs
+                size_t pos = idx * LAZY_CHUNK_SIZE;
+                struct uffdio_range range;
+                range.start = (uintptr_t)(region->base + pos);
+                range.len = (region->span - pos < LAZY_CHUNK_SIZE) ? (region->span - pos)
+                                                                    : LAZY_CHUNK_SIZE;
+                ioctl(region->uffd, UFFDIO_WAKE, &range);
+            }
+            // CHUNK_LOADING: the streamer's UFFDIO_COPY wakes the waiter
+        }
+    }
+
+    return nullptr;
+}
+
+static void release_region(LazyRegion* region) {
+    if (region->stream_buf) {
+        munmap(region->stream_buf, LAZY_CHUNK_SIZE);
+    }
+    if (region->fault_buf) {
+        munmap(region->fault_buf, LAZY_CHUNK_SIZE);
+    }
+    if (region->uffd >= 0) {
+        close(region->uffd);
+    }
+    if (region->stop_fd >= 0) {
+        close(region->stop_fd);
+    }
+    if (region->fd >= 0) {
+        close(region->fd);
+    }
+    free(region->state);
+    delete region;
+}
+
+LazyRegion* lazy_load_start(int fd, void* dst, size_t length, off_t offset, size_t page_size) {
+    int uffd = open_userfaultfd();
+    if (uffd < 0) {
+        DEBUG_PRINT("userfaultfd unavailable: %s", strerror(errno));
+        return nullptr;
+    }
+
+    struct uffdio_api api;
+    api.api = UFFD_API;
+    api.features = 0;
+    if (ioctl(uffd, UFFDIO_API, &api) != 0 ||
+        (page_size > (size_t)sysconf(_SC_PAGESIZE) && !(api.features & UFFD_FEATURE_MISSING_HUGETLBFS))) {
+        DEBUG_PRINT("userfaultfd does not support this mapping type");
+        close(uffd);
+        return nullptr;
+    }
+
+    LazyRegion* region = new LazyRegion();
+    region->uffd = uffd;
+    region->fd = -1;
+    region->stop_fd = -1;
+    region->base = (char*)dst;
+    region->length = length;
+    region->span = (length + page_size - 1) & ~(page_size - 1);
+    region->offset = offset;
+    region->page_size = page_size;
+    region->chunks = (region->span + LAZY_CHUNK_SIZE - 1) / LAZY_CHUNK_SIZE;
+    region->state = (uint8_t*)calloc(region->chunks, sizeof(uint8_t));
+    region->remaining = region->chunks;
+    region->stop = false;
+    region->streamer_running = false;
+    region->fault_running = false;
+    region->stream_buf = nullptr;
+    region->fault_buf = nullptr;
+
+    region->fd = dup(fd);
+    region->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    void* stream_buf = mmap(nullptr, LAZY_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* fault_buf = mmap(nullptr, LAZY_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    region->stream_buf = (stream_buf == MAP_FAILED) ? nullptr : (char*)stream_buf;
+    region->fault_buf = (fault_buf == MAP_FAILED) ? nullptr : (char*)fault_buf;
+
+    if (!region->state || region->fd < 0 || region->stop_fd < 0 ||
+        !region->stream_buf || !region->fault_buf) {
+        DEBUG_PRINT("WARNING: Lazy load setup failed: %s", strerror(errno));
+        release_region(region);
+        return nullptr;
+    }
+
+    struct uffdio_register reg;
+    reg.range.start = (uintptr_t)dst;
+    reg.range.len = region->span;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(uffd, UFFDIO_REGISTER, &reg) != 0 ||
+        !(reg.ioctls & ((uint64_t)1 << _UFFDIO_COPY))) {
+        DEBUG_PRINT("WARNING: userfaultfd register failed: %s", strerror(errno));
+        release_region(region);
+        return nullptr;
+    }
+
+    // A child forked mid-load would see unpopulated pages as zeros
+    madvise(dst, region->span, MADV_DONTFORK);
+    posix_fadvise(region->fd, offset, length, POSIX_FADV_SEQUENTIAL);
+    clock_gettime(CLOCK_MONOTONIC, &region->start);
+
+    if (pthread_create(&region->fault_thread, nullptr, fault_main, region) == 0) {
+        region->fault_running = true;
+    }
+    if (pthread_create(&region->streamer, nullptr, streamer_main, region) == 0) {
+        region->streamer_running = true;
+    }
+
+    if (!region->fault_running || !region->streamer_running) {
+        DEBUG_PRINT("WARNING: Failed to start lazy load threads");
+        madvise(dst, region->span, MADV_DOFORK);
+        lazy_load_stop(region);
+        return nullptr;
+    }
+
+    DEBUG_PRINT("Lazy load started: %.2f GB in %zu chunks of %zu MB",
+            length / (1024.0 * 1024.0 * 1024.0), region->chunks,
+            LAZY_CHUNK_SIZE / (1024 * 1024));
+    return region;
+}
+
+void lazy_load_stop(LazyRegion* region) {
+    if (!region) {
+        return;
+    }
+
+    region->stop = true;
+    uint64_t one = 1;
+    if (write(region->stop_fd, &one, sizeof(one)) < 0) {
+        // Threads also poll region->stop
+    }
+
+    if (region->streamer_running) {
+        pthread_join(region->streamer, nullptr);
+    }
+    if (region->fault_running) {
+        pthread_join(region->fault_thread, nullptr);
+    }
+
+    release_region(region);
+}
+
+void lazy_load_finish(LazyRegion* region) {
+    if (!region) {
+        return;
+    }
+
+    // The streamer only returns once the last chunk is installed
+    if (region->streamer_running) {
+        pthread_join(region->streamer, nullptr);
+        region->streamer_running = false;
+    }
+    lazy_load_stop(region);
+}
+
+} // namespace zen5_turbo
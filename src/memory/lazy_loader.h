@@ -0,0 +1,33 @@
+/*
+ * lazy_loader.h
+ *
+ * On-demand population of intercepted model mappings via userfaultfd.
+ * The mapping is returned to the caller immediately; a background
+ * streamer fills it in file order while faults on pages that are not
+ * loaded yet are served first by a dedicated fault thread.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+struct LazyRegion;
+
+// Register dst (length bytes backed by page_size pages) with userfaultfd
+// and start populating it from [offset, offset + length) of fd.
+// Returns nullptr when userfaultfd is unavailable; dst is untouched and
+// the caller should load it eagerly instead.
+LazyRegion* lazy_load_start(int fd, void* dst, size_t length, off_t offset, size_t page_size);
+
+// Stop background population and release the region's resources.
+// Must be called before dst is unmapped.
+void lazy_load_stop(LazyRegion* region);
+
+// Wait until every page of dst is loaded, then release the region.
+// Used before dst is split or moved, which userfaultfd cannot follow.
+void lazy_load_finish(LazyRegion* region);
+
+} // namespace zen5_turbo
@@ -0,0 +1,286 @@
+/*
+ * mapping_dedup.cpp
+ *
+ * Table of loaded read-only regions keyed by file window.
+ *
+ * Each entry keeps, per granule, the bytes still mapped summed over its
+ * users: attaching adds a full copy of the region, munmap() subtracts
+ * what it covers. A granule that drops to zero is handed back to the
+ * caller for unmapping together with any neighbours already at zero, so
+ * a run whose hugepages could not be cut on its own is released once
+ * the pages around it are free as well.
+ *
+ * The table is small (one entry per distinct model window) and guarded
+ * by a single mutex; a relaxed entry count lets munmap() skip the lock
+ * when nothing is deduplicated. Entries come from a fixed pool and the
+ * granule counters from the real mmap(), so registering from inside
+ * mmap() never calls malloc.
+ */
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mapping_dedup.h"
+#include "hugepage_wrapper.h"
+#include "../config.h"
+
+namespace zen5_turbo {
+
+struct DedupEntry {
+    // Key
+    dev_t dev;
+    ino_t ino;
+    off_t file_size;
+    struct timespec mtime;
+    off_t offset;
+    size_t length;          // Caller's length (page rounded)
+    int prot;
+
+    uintptr_t addr;
+    size_t size;            // Mapped size, including hugepage rounding
+    int users;              // Mappings handed out (whole-region munmaps drop one)
+    size_t granules;
+    size_t released;        // Granules no user maps any more
+    size_t* mapped;         // Bytes still mapped per granule, over all users
+    bool used;              // Pool slot taken
+};
+
+static DedupEntry entry_pool[MAX_DEDUP_ENTRIES];
+static DedupEntry* entries[MAX_DEDUP_ENTRIES];
+static size_t entry_count = 0;
+static pthread_mutex_t dedup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+// Keep the lock consistent across fork() in threaded callers
+static void fork_prepare() { pthread_mutex_lock(&dedup_lock); }
+static void fork_release() { pthread_mutex_unlock(&dedup_lock); }
+static void register_fork_handlers() {
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+static size_t granule_bytes(const DedupEntry* entry, size_t granule) {
+    size_t start = granule * DEDUP_GRANULE;
+    return (entry->length - start < DEDUP_GRANULE) ? entry->length - start : DEDUP_GRANULE;
+}
+
+static bool matches(const DedupEntry* entry, const struct stat* st, off_t offset,
+                    size_t length, int prot) {
+    return entry->dev == st->st_dev && entry->ino == st->st_ino &&
+           entry->file_size == st->st_size &&
+           entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+           entry->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+           entry->offset == offset && entry->length == length && entry->prot == prot;
+}
+
+// Granule counters of an entry, in whole pages of their own mapping
+static size_t counters_size(size_t granules) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (granules * sizeof(size_t) + page - 1) & ~(page - 1);
+}
+
+// Remove entries[index] (lock held)
+static void remove_entry(size_t index) {
+    sys_munmap(entries[index]->mapped, counters_size(entries[index]->granules));
+    entries[index]->used = false;
+    memmove(&entries[index], &entries[index + 1], (entry_count - index - 1) * sizeof(entries[0]));
+    __atomic_store_n(&entry_count, entry_count - 1, __ATOMIC_RELAXED);
+}
+
+// Lowest entry overlapping [start, end), or -1 (lock held)
+static long lowest_overlapping(uintptr_t start, uintptr_t end) {
+    long found = -1;
+    for (size_t i = 0; i < entry_count; i++) {
+        const DedupEntry* entry = entries[i];
+        if (entry->addr < end && entry->addr + entry->size > start &&
+            (found < 0 || entry->addr < entries[found]->addr)) {
+            found = (long)i;
+        }
+    }
+    return found;
+}
+
+void* dedup_attach(const struct stat* st, off_t offset, size_t length, int prot) {
+    if (__atomic_load_n(&entry_count, __ATOMIC_RELAXED) == 0) {
+        return nullptr;
+    }
+
+    void* addr = nullptr;
+    pthread_mutex_lock(&dedup_lock);
+    for (size_t i = 0; i < entry_count; i++) {
+        DedupEntry* entry = entries[i];
+        if (entry->released == 0 && matches(entry, st, offset, length, prot)) {
+            entry->users++;
+            for (size_t g = 0; g < entry->granules; g++) {
+                entry->mapped[g] += granule_bytes(entry, g);
+            }
+            addr = (void*)entry->addr;
+            DEBUG_PRINT("Repeated mapping shares the loaded region at %p (%d users)",
+                    addr, entry->users);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dedup_lock);
+    return addr;
+}
+
+void dedup_register(const struct stat* st, off_t offset, size_t length, int prot,
+                    void* addr, size_t size) {
+    pthread_once(&fork_once, register_fork_handlers);
+
+    size_t granules = (length + DEDUP_GRANULE - 1) / DEDUP_GRANULE;
+    size_t* mapped = (size_t*)sys_mmap(nullptr, counters_size(granules), PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return;
+    }
+
+    pthread_mutex_lock(&dedup_lock);
+    if (entry_count >= MAX_DEDUP_ENTRIES) {
+        pthread_mutex_unlock(&dedup_lock);
+        DEBUG_PRINT("Dedup table full (%zu regions), not sharing %p", MAX_DEDUP_ENTRIES, addr);
+        sys_munmap(mapped, counters_size(granules));
+        return;
+    }
+    // Fewer entries than slots, so a free one exists
+    DedupEntry* entry = entry_pool;
+    while (entry->used) {
+        entry++;
+    }
+    entry->used = true;
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->file_size = st->st_size;
+    entry->mtime = st->st_mtim;
+    entry->offset = offset;
+    entry->length = length;
+    entry->prot = prot;
+    entry->addr = (uintptr_t)addr;
+    entry->size = size;
+    entry->users = 1;
+    entry->granules = granules;
+    entry->released = 0;
+    entry->mapped = mapped;
+    for (size_t g = 0; g < granules; g++) {
+        mapped[g] = granule_bytes(entry, g);
+    }
+    entries[entry_count] = entry;
+    __atomic_store_n(&entry_count, entry_count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&dedup_lock);
+}
+
+size_t dedup_unmap(uintptr_t* pos, uintptr_t end, DedupRange* out, size_t max) {
+    if (__atomic_load_n(&entry_count, __ATOMIC_RELAXED) == 0) {
+        out[0].start = *pos;
+        out[0].end = end;
+        out[0].released = false;
+        *pos = end;
+        return 1;
+    }
+
+    size_t count = 0;
+    uintptr_t cur = *pos;
+    pthread_mutex_lock(&dedup_lock);
+
+    while (cur < end && count < max) {
+        long index = lowest_overlapping(cur, end);
+        if (index < 0 || entries[index]->addr > cur) {
+            // Memory below the next region is unmapped as asked
+            uintptr_t stop = (index < 0) ? end : entries[index]->addr;
+            out[count].start = cur;
+            out[count].end = stop;
+            out[count].released = false;
+            count++;
+            cur = stop;
+            continue;
+        }
+
+        DedupEntry* entry = entries[index];
+        uintptr_t visible_end = entry->addr + entry->length;
+        if (cur == entry->addr && end >= visible_end && entry->users > 0) {
+            entry->users--;
+        }
+
+        uintptr_t stop = (end < visible_end) ? end : visible_end;
+        while (cur < stop) {
+            size_t g = (cur - entry->addr) / DEDUP_GRANULE;
+            uintptr_t granule_start = entry->addr + g * DEDUP_GRANULE;
+            uintptr_t granule_end = granule_start + granule_bytes(entry, g);
+            uintptr_t upto = (stop < granule_end) ? stop : granule_end;
+            size_t bytes = upto - cur;
+
+            if (entry->mapped[g] > bytes) {
+                entry->mapped[g] -= bytes;
+            } else if (entry->mapped[g] > 0) {
+                if (count == max) {
+                    break;      // Resume at this granule next call
+                }
+                // Last user gone: release it with its released neighbours
+                entry->mapped[g] = 0;
+                entry->released++;
+                size_t first = g;
+                size_t last = g;
+                while (first > 0 && entry->mapped[first - 1] == 0) {
+                    first--;
+                }
+                while (last + 1 < entry->granules && entry->mapped[last + 1] == 0) {
+                    last++;
+                }
+                uintptr_t run_start = entry->addr + first * DEDUP_GRANULE;
+                uintptr_t run_end = entry->addr + last * DEDUP_GRANULE + granule_bytes(entry, last);
+                if (count > 0 && out[count - 1].released && out[count - 1].end >= run_start) {
+                    out[count - 1].end = run_end;
+                } else {
+                    out[count].start = run_start;
+                    out[count].end = run_end;
+                    out[count].released = true;
+                    count++;
+                }
+            }
+            cur = upto;
+        }
+        if (cur < stop) {
+            break;
+        }
+
+        // The hugepage rounding past the caller's part goes with the
+        // last granule; it is not the caller's to unmap
+        if (end > visible_end) {
+            cur = (end < entry->addr + entry->size) ? end : entry->addr + entry->size;
+        }
+        if (entry->released == entry->granules) {
+            remove_entry((size_t)index);
+        }
+    }
+
+    pthread_mutex_unlock(&dedup_lock);
+    *pos = cur;
+    return count;
+}
+
+bool dedup_detach(uintptr_t start, uintptr_t end) {
+    if (__atomic_load_n(&entry_count, __ATOMIC_RELAXED) == 0) {
+        return true;
+    }
+
+    pthread_mutex_lock(&dedup_lock);
+    for (size_t i = 0; i < entry_count; i++) {
+        const DedupEntry* entry = entries[i];
+        if (entry->addr < end && entry->addr + entry->size > start && entry->users > 1) {
+            pthread_mutex_unlock(&dedup_lock);
+            return false;
+        }
+    }
+    for (size_t i = entry_count; i > 0; i--) {
+        const DedupEntry* entry = entries[i - 1];
+        if (entry->addr < end && entry->addr + entry->size > start) {
+            remove_entry(i - 1);
+        }
+    }
+    pthread_mutex_unlock(&dedup_lock);
+    return true;
+}
+
+} // namespace zen5_turbo
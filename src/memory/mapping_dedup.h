@@ -0,0 +1,51 @@
+/*
+ * mapping_dedup.h
+ *
+ * In-process deduplication of read-only model mappings. Mapping the
+ * same window of the same file again (another context, a draft model
+ * sharing the target's GGUF, a reload) returns the region that is
+ * already loaded instead of filling a second hugepage copy.
+ *
+ * Every user maps the whole region, so munmap() calls are accounted per
+ * DEDUP_GRANULE: a granule is only released once no user maps any byte
+ * of it. Unmapping the same range twice counts twice, as the users
+ * cannot be told apart by address.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace zen5_turbo {
+
+struct DedupRange {
+    uintptr_t start;
+    uintptr_t end;
+    bool released;      // Inside a region: unmap only the tracked memory
+};
+
+// Address of the loaded region for this window of the file behind st
+// (same dev, inode, size, mtime, offset, length and prot) with the caller
+// added as a user, or nullptr if there is none or part of it is gone
+void* dedup_attach(const struct stat* st, off_t offset, size_t length, int prot);
+
+// Register a newly loaded region (size bytes mapped at addr, length
+// of them the caller's) so later mappings of the window can share it
+void dedup_register(const struct stat* st, off_t offset, size_t length, int prot,
+                    void* addr, size_t size);
+
+// Account a munmap() of [*pos, end) by one user, advancing *pos. Writes
+// up to max ranges to unmap: parts of the range outside deduplicated
+// regions as they are, and runs of granules no user maps any more.
+// Callers loop until *pos reaches end.
+size_t dedup_unmap(uintptr_t* pos, uintptr_t end, DedupRange* out, size_t max);
+
+// Stop deduplicating the regions overlapping [start, end) before the
+// caller changes them (mprotect, mremap growth). Returns false, and
+// changes nothing, if one of them has more than one user.
+bool dedup_detach(uintptr_t start, uintptr_t end);
+
+} // namespace zen5_turbo
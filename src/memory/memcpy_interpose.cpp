@@ -0,0 +1,286 @@
+/*
+ * memcpy_interpose.cpp
+ *
+ * Exported memcpy and memmove. Every path loads all of the
+ * source it has not yet stored before storing over it, so one routine
+ * serves memcpy and memmove: the register class loads everything
+ * first, the loops keep the head and the tail in registers and walk
+ * away from the overlap. rep movsb and streaming stores are only taken
+ * when the buffers do not overlap.
+ *
+ * These run before the constructor (ld.so and other libraries'
+ * initializers call them), so the thresholds start at the config.h
+ * defaults and nothing here allocates, locks or logs.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <immintrin.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memcpy_interpose.h"
+#include "../cpu_validator.h"
+#include "../topology.h"
+#include "../config.h"
+#include "../env.h"
+
+typedef void* (*memcpy_fn)(void*, const void*, size_t);
+
+namespace zen5_turbo {
+
+// Calls made before the constructor (which turns this off unless
+// ZEN5_MEMCPY=1) have no libc pointers to go to
+static bool memcpy_enabled = true;
+static size_t copy_rep_min = MEMCPY_REP_MIN;
+static size_t stream_min = MEMCPY_STREAM_MIN;
+
+static memcpy_fn next_memcpy = nullptr;
+static memcpy_fn next_memmove = nullptr;
+
+// Bytes moved per loop iteration (four zmm)
+const size_t LOOP_STEP = 256;
+
+static inline __m512i load(const uint8_t* p) {
+    return _mm512_loadu_si512((const void*)p);
+}
+
+static inline void store(uint8_t* p, __m512i v) {
+    _mm512_storeu_si512((void*)p, v);
+}
+
+// Unaligned scalar access without calling memcpy
+typedef uint64_t u64_any __attribute__((may_alias, aligned(1)));
+typedef uint32_t u32_any __attribute__((may_alias, aligned(1)));
+typedef uint16_t u16_any __attribute__((may_alias, aligned(1)));
+
+// Up to MEMCPY_INLINE_MAX bytes as two overlapping moves of the widest
+// register that fits: every load before the first store
+static inline __attribute__((always_inline)) void move_small(uint8_t* d, const uint8_t* s, size_t n) {
+    if (n <= 16) {
+        if (n >= 8) {
+            uint64_t a = *(const u64_any*)s, b = *(const u64_any*)(s + n - 8);
+            *(u64_any*)d = a;
+            *(u64_any*)(d + n - 8) = b;
+        } else if (n >= 4) {
+            uint32_t a = *(const u32_any*)s, b = *(const u32_any*)(s + n - 4);
+            *(u32_any*)d = a;
+            *(u32_any*)(d + n - 4) = b;
+        } else if (n >= 2) {
+            uint16_t a = *(const u16_any*)s, b = *(const u16_any*)(s + n - 2);
+            *(u16_any*)d = a;
+            *(u16_any*)(d + n - 2) = b;
+        } else if (n == 1) {
+            *d = *s;
+        }
+    } else if (n <= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + n - 16));
+        _mm_storeu_si128((__m128i*)d, a);
+        _mm_storeu_si128((__m128i*)(d + n - 16), b);
+    } else if (n <= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)s);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+        _mm256_storeu_si256((__m256i*)d, a);
+        _mm256_storeu_si256((__m256i*)(d + n - 32), b);
+    } else if (n <= 128) {
+        __m512i a = load(s), b = load(s + n - 64);
+        store(d, a);
+        store(d + n - 64, b);
+    } else if (n <= 256) {
+        __m512i a = load(s), b = load(s + 64);
+        __m512i c = load(s + n - 128), e = load(s + n - 64);
+        store(d, a);
+        store(d + 64, b);
+        store(d + n - 128, c);
+        store(d + n - 64, e);
+    } else {
+        __m512i a0 = load(s), a1 = load(s + 64), a2 = load(s + 128), a3 = load(s + 192);
+        __m512i b0 = load(s + n - 256), b1 = load(s + n - 192);
+        __m512i b2 = load(s + n - 128), b3 = load(s + n - 64);
+        store(d, a0);
+        store(d + 64, a1);
+        store(d + 128, a2);
+        store(d + 192, a3);
+        store(d + n - 256, b0);
+        store(d + n - 192, b1);
+        store(d + n - 128, b2);
+        store(d + n - 64, b3);
+    }
+}
+
+// Front to back with 64-byte aligned (or streaming) stores; safe when d
+// is below s. The first and last 256 bytes are loaded up front and
+// stored last.
+template <bool STREAM>
+static void move_forward(uint8_t* d, const uint8_t* s, size_t n) {
+    __m512i head = load(s);
+    __m512i t0 = load(s + n - 256), t1 = load(s + n - 192);
+    __m512i t2 = load(s + n - 128), t3 = load(s + n - 64);
+    uint8_t* end = d + n;
+    size_t skip = (size_t)(-(uintptr_t)d & 63);
+    uint8_t* dp = d + skip;
+    const uint8_t* sp = s + skip;
+    while ((size_t)(end - dp) > LOOP_STEP) {
+        __m512i v0 = load(sp), v1 = load(sp + 64), v2 = load(sp + 128), v3 = load(sp + 192);
+        if (STREAM) {
+            _mm512_stream_si512((__m512i*)dp, v0);
+            _mm512_stream_si512((__m512i*)(dp + 64), v1);
+            _mm512_stream_si512((__m512i*)(dp + 128), v2);
+            _mm512_stream_si512((__m512i*)(dp + 192), v3);
+        } else {
+            _mm512_store_si512((void*)dp, v0);
+            _mm512_store_si512((void*)(dp + 64), v1);
+            _mm512_store_si512((void*)(dp + 128), v2);
+            _mm512_store_si512((void*)(dp + 192), v3);
+        }
+        dp += LOOP_STEP;
+        sp += LOOP_STEP;
+    }
+    if (STREAM) {
+        _mm_sfence();
+    }
+    store(end - 256, t0);
+    store(end - 192, t1);
+    store(end - 128, t2);
+    store(end - 64, t3);
+    store(d, head);
+}
+
+// Back to front, for d above s within n bytes
+static void move_backward(uint8_t* d, const uint8_t* s, size_t n) {
+    __m512i h0 = load(s), h1 = load(s + 64), h2 = load(s + 128), h3 = load(s + 192);
+    __m512i tail = load(s + n - 64);
+    uint8_t* ep = d + n - ((uintptr_t)(d + n) & 63);
+    const uint8_t* sp = s + (ep - d);
+    while ((size_t)(ep - d) > LOOP_STEP) {
+        ep -= LOOP_STEP;
+        sp -= LOOP_STEP;
+        __m512i v0 = load(sp), v1 = load(sp + 64), v2 = load(sp + 128), v3 = load(sp + 192);
+        _mm512_store_si512((void*)(ep + 192), v3);
+        _mm512_store_si512((void*)(ep + 128), v2);
+        _mm512_store_si512((void*)(ep + 64), v1);
+        _mm512_store_si512((void*)ep, v0);
+    }
+    store(d + n - 64, tail);
+    store(d, h0);
+    store(d + 64, h1);
+    store(d + 128, h2);
+    store(d + 192, h3);
+}
+
+static inline void rep_movsb(uint8_t* d, const uint8_t* s, size_t n) {
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+// More than MEMCPY_INLINE_MAX bytes
+static __attribute__((noinline)) void move_large(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t ahead = (uintptr_t)d - (uintptr_t)s;     // Wraps when d is below s
+    if (ahead < n) {
+        if (ahead != 0) {
+            move_backward(d, s, n);
+        }
+    } else if ((uintptr_t)s - (uintptr_t)d < n) {
+        move_forward<false>(d, s, n);
+    } else if (n >= stream_min) {
+        move_forward<true>(d, s, n);
+    } else if (n >= copy_rep_min) {
+        rep_movsb(d, s, n);
+    } else {
+        move_forward<false>(d, s, n);
+    }
+}
+
+// Smallest L3 of a CCD in the topology, 0 if unknown
+static size_t smallest_l3(const Topology* topology) {
+    size_t l3 = 0;
+    for (int i = 0; i < topology->ccd_count; i++) {
+        size_t size = topology->ccds[i].l3_size;
+        if (size && (!l3 || size < l3)) {
+            l3 = size;
+        }
+    }
+    return l3;
+}
+
+static void format_size(size_t bytes, char* out, size_t len) {
+    if (bytes == SIZE_MAX) {
+        snprintf(out, len, "off");
+    } else if (bytes >= (1ULL << 20) && bytes % (1ULL << 20) == 0) {
+        snprintf(out, len, "%zu MB", bytes >> 20);
+    } else {
+        snprintf(out, len, "%zu KB", bytes >> 10);
+    }
+}
+
+void memcpy_init() {
+    if (!env_flag("ZEN5_MEMCPY", false)) {
+        next_memcpy = (memcpy_fn)dlsym(RTLD_NEXT, "memcpy");
+        next_memmove = (memcpy_fn)dlsym(RTLD_NEXT, "memmove");
+        if (next_memcpy && next_memmove) {
+            __atomic_store_n(&memcpy_enabled, false, __ATOMIC_RELEASE);
+            DEBUG_PRINT("memcpy: OFF (memcpy/memmove go to libc)");
+        } else {
+            fprintf(stderr, "[%s] ERROR: libc's memcpy was not found, keeping the in-tree one\n",
+                    ZEN5_OPTIMIZER_NAME);
+        }
+        return;
+    }
+
+    // Without ERMS the zmm loop runs up to the streaming threshold
+    bool erms = cpu_has_erms(), fsrm = cpu_has_fsrm();
+    copy_rep_min = erms ? (fsrm ? MEMCPY_REP_MIN_FSRM : MEMCPY_REP_MIN) : SIZE_MAX;
+
+    // Beyond a quarter of L3, source and destination together evict
+    // most of what the other threads of the CCD keep there
+    size_t l3 = smallest_l3(topology_get());
+    size_t stream = l3 ? l3 / 4 : MEMCPY_STREAM_MIN;
+    long stream_kb = env_long("ZEN5_MEMCPY_STREAM", -1);
+    if (stream_kb == 0) {
+        stream = SIZE_MAX;
+    } else if (stream_kb > 0) {
+        stream = (size_t)stream_kb << 10;
+    }
+    stream_min = stream > MEMCPY_INLINE_MAX ? stream : MEMCPY_INLINE_MAX + 1;
+
+    char rep_text[32], stream_text[32];
+    format_size(copy_rep_min, rep_text, sizeof(rep_text));
+    format_size(stream_min, stream_text, sizeof(stream_text));
+    DEBUG_PRINT("memcpy: zmm up to %zu B, rep movsb from %s%s, non-temporal from %s",
+                MEMCPY_INLINE_MAX, rep_text, fsrm ? " (FSRM)" : "", stream_text);
+}
+
+} // namespace zen5_turbo
+
+using namespace zen5_turbo;
+
+extern "C" void* memcpy(void* dst, const void* src, size_t n) {
+    if (__builtin_expect(!__atomic_load_n(&memcpy_enabled, __ATOMIC_RELAXED), 0)) {
+        return next_memcpy(dst, src, n);
+    }
+    if (n <= MEMCPY_INLINE_MAX) {
+        move_small((uint8_t*)dst, (const uint8_t*)src, n);
+    } else {
+        move_large((uint8_t*)dst, (const uint8_t*)src, n);
+    }
+    return dst;
+}
+
+extern "C" void* memmove(void* dst, const void* src, size_t n) {
+    if (__builtin_expect(!__atomic_load_n(&memcpy_enabled, __ATOMIC_RELAXED), 0)) {
+        return next_memmove(dst, src, n);
+    }
+    if (n <= MEMCPY_INLINE_MAX) {
+        move_small((uint8_t*)dst, (const uint8_t*)src, n);
+    } else {
+        move_large((uint8_t*)dst, (const uint8_t*)src, n);
+    }
+    return dst;
+}
+
+extern "C" void zen5_memcpy_thresholds(size_t* rep_min, size_t* stream) {
+    *rep_min = copy_rep_min;
+    *stream = stream_min;
+}
@@ -0,0 +1,37 @@
+/*
+ * memcpy_interpose.h
+ *
+ * memcpy and memmove by size class. ggml copies tensors and KV cache
+ * rows; most calls are a few hundred bytes, a few are whole tensors. Up
+ * to MEMCPY_INLINE_MAX bytes are moved as overlapping head and tail
+ * registers (scalar to zmm) without a loop, larger ones by an unrolled
+ * zmm loop with aligned stores, rep movsb once the CPU's ERMS/FSRM make
+ * it faster, and non-temporal stores once the destination would push
+ * the working set out of L3. The thresholds are set at startup from
+ * CPUID and the topology's cache sizes.
+ *
+ * Off unless ZEN5_MEMCPY=1: against glibc's AVX-512 routines it wins
+ * on small and mid-sized copies but not yet on copies of 64MB and more.
+ * memset is left to glibc, whose avx512 memset this could only match.
+ *
+ * memcpy is memmove, as in glibc on x86-64, so callers that overlap
+ * their memcpy() arguments keep working. Calls inside glibc (stdio,
+ * string functions) use glibc's internal copies and are not seen.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace zen5_turbo {
+
+// Read ZEN5_MEMCPY / ZEN5_MEMCPY_STREAM, set the thresholds from the CPU
+// and log them. Called once from the library constructor; calls before
+// it use the config.h defaults.
+void memcpy_init();
+
+} // namespace zen5_turbo
+
+// Smallest size moved by rep movsb and by non-temporal stores
+// (SIZE_MAX when the class is not used), for tests and tools (dlsym)
+extern "C" void zen5_memcpy_thresholds(size_t* rep_min, size_t* stream_min);
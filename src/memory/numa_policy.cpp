@@ -0,0 +1,282 @@
+/*
+ * numa_policy.cpp
+ *
+ * mbind()-based placement of intercepted regions over the NUMA nodes
+ * of the process cpuset (from the topology model), and move_pages()
+ * sampling to check where the pages actually went.
+ *
+ * Policies are set on the VMA before any page is touched, so they hold
+ * whichever thread populates the range: parallel loader workers, io_uring
+ * O_DIRECT reads and userfaultfd copies all allocate through the VMA.
+ * Interleave moves on to the other nodes when one runs out of hugepages;
+ * bind and split do not, and a hugetlb page the bound node cannot supply
+ * is a SIGBUS on first touch (the reservation made by mmap() is not per
+ * node). Their nodes' free hugepages are therefore checked first, and
+ * the range is interleaved instead when one of them is short.
+ */
+
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "numa_policy.h"
+#include "../topology.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+// Node ids up to 127 fit the mask
+const int NUMA_MASK_WORDS = 2;
+const int NUMA_MASK_BITS = NUMA_MASK_WORDS * 64;
+
+// Pages sampled per region by numa_report()
+const size_t NUMA_REPORT_SAMPLES = 1024;
+
+NumaPolicy numa_policy() {
+    const char* policy = env_str("ZEN5_NUMA", "default");
+    if (strcasecmp(policy, "interleave") == 0) {
+        return NUMA_INTERLEAVE;
+    }
+    if (strcasecmp(policy, "bind") == 0) {
+        return NUMA_BIND;
+    }
+    if (strcasecmp(policy, "split") == 0) {
+        return NUMA_SPLIT;
+    }
+    return NUMA_DEFAULT;
+}
+
+const char* numa_policy_name(NumaPolicy policy) {
+    switch (policy) {
+        case NUMA_INTERLEAVE: return "interleave";
+        case NUMA_BIND:       return "bind";
+        case NUMA_SPLIT:      return "split";
+        default:              return "first touch";
+    }
+}
+
+// Kernel ids of the nodes the policy places memory on: ZEN5_NUMA_NODE
+// for bind, otherwise every node with a CPU in the cpuset
+static int policy_nodes(NumaPolicy policy, int* nodes) {
+    const Topology* topology = topology_get();
+    int count = 0;
+    if (policy == NUMA_BIND) {
+        long node = env_long("ZEN5_NUMA_NODE", -1);
+        if (node >= 0 && node < NUMA_MASK_BITS) {
+            nodes[0] = (int)node;
+            return 1;
+        }
+    }
+    for (int i = 0; i < topology->node_count; i++) {
+        if (topology->nodes[i].allowed_cpus > 0 && topology->nodes[i].id < NUMA_MASK_BITS) {
+            nodes[count++] = topology->nodes[i].id;
+            if (policy == NUMA_BIND) {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+static long sys_mbind(void* addr, size_t len, int mode, const int* nodes, int count) {
+    unsigned long mask[NUMA_MASK_WORDS] = {};
+    for (int i = 0; i < count; i++) {
+        mask[nodes[i] / 64] |= 1UL << (nodes[i] % 64);
+    }
+    // The kernel reads maxnode - 1 bits
+    return syscall(SYS_mbind, addr, len, mode, mask, NUMA_MASK_BITS + 1, 0);
+}
+
+// Free hugepages of page_size on a node, -1 if the kernel does not say
+static long node_free_hugepages(int node, size_t page_size) {
+    char path[160];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/node/node%d/hugepages/hugepages-%zukB/free_hugepages",
+             node, page_size / 1024);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    long value;
+    if (fscanf(f, "%ld", &value) != 1) {
+        value = -1;
+    }
+    fclose(f);
+    return value;
+}
+
+// Whether node can supply the hugetlb pages of len bytes whose largest
+// page is align: align-sized pages for the body, 2MB pages for the rest
+// (THP and 4KB ranges, align below 2MB, always fit)
+static bool node_fits(int node, size_t len, size_t align) {
+    if (align < HUGEPAGE_SIZE) {
+        return true;
+    }
+    size_t sizes[2] = {align, HUGEPAGE_SIZE};
+    size_t needed[2] = {len / align, 0};
+    needed[1] = (len - needed[0] * align + HUGEPAGE_SIZE - 1) / HUGEPAGE_SIZE;
+    for (int i = 0; i < 2; i++) {
+        long free_pages = needed[i] ? node_free_hugepages(node, sizes[i]) : 0;
+        // No per-node counters: nothing to check against
+        if (free_pages >= 0 && (size_t)free_pages < needed[i]) {
+            DEBUG_PRINT("WARNING: Node %d has %ld free %zukB hugepages, %zu needed",
+                        node, free_pages, sizes[i] / 1024, needed[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Length of slice i of a split over count nodes; the last takes the
+// rounding. Zero once the slices have covered size.
+static size_t split_slice(size_t size, size_t align, int count, int i, size_t* start) {
+    size_t slice = (size / count + align - 1) & ~(align - 1);
+    *start = (size_t)i * slice;
+    if (*start >= size) {
+        return 0;
+    }
+    return (i == count - 1 || *start + slice > size) ? size - *start : slice;
+}
+
+void numa_policy_init() {
+    NumaPolicy policy = numa_policy();
+    int nodes[MAX_TOPOLOGY_NODES];
+    int count = policy_nodes(policy, nodes);
+
+    char list[128] = "";
+    size_t used = 0;
+    for (int i = 0; i < count && used < sizeof(list); i++) {
+        used += snprintf(list + used, sizeof(list) - used, i ? ",%d" : "%d", nodes[i]);
+    }
+    DEBUG_PRINT("NUMA placement: %s (nodes %s)", numa_policy_name(policy), list);
+}
+
+void numa_place(void* addr, size_t size, size_t align) {
+    NumaPolicy policy = numa_policy();
+    if (policy == NUMA_DEFAULT) {
+        return;
+    }
+
+    int nodes[MAX_TOPOLOGY_NODES];
+    int count = policy_nodes(policy, nodes);
+    if (count == 0 || (count == 1 && policy != NUMA_BIND)) {
+        return;     // Nothing to spread over
+    }
+
+    // A bound node short of hugepages would SIGBUS on first touch
+    bool fits = true;
+    if (policy == NUMA_BIND) {
+        fits = node_fits(nodes[0], size, align);
+    } else if (policy == NUMA_SPLIT) {
+        size_t start;
+        for (int i = 0; i < count && fits; i++) {
+            size_t len = split_slice(size, align, count, i, &start);
+            fits = len == 0 || node_fits(nodes[i], len, align);
+        }
+    }
+    if (!fits) {
+        count = policy_nodes(NUMA_INTERLEAVE, nodes);
+        DEBUG_PRINT("WARNING: NUMA %s placement of %p cannot get its hugepages, %s",
+                    numa_policy_name(policy), addr,
+                    count > 1 ? "interleaving instead" : "first touch used");
+        if (count < 2) {
+            return;
+        }
+        policy = NUMA_INTERLEAVE;
+    }
+
+    long rc = 0;
+    if (policy == NUMA_INTERLEAVE) {
+        rc = sys_mbind(addr, size, MPOL_INTERLEAVE, nodes, count);
+    } else if (policy == NUMA_BIND) {
+        rc = sys_mbind(addr, size, MPOL_BIND, nodes, 1);
+    } else {
+        // Equal slices in node order
+        for (int i = 0; i < count && rc == 0; i++) {
+            size_t start;
+            size_t len = split_slice(size, align, count, i, &start);
+            if (len == 0) {
+                break;
+            }
+            rc = sys_mbind((char*)addr + start, len, MPOL_BIND, &nodes[i], 1);
+        }
+    }
+
+    if (rc != 0) {
+        DEBUG_PRINT("WARNING: NUMA %s placement of %p failed: %s (first touch used)",
+                numa_policy_name(policy), addr, strerror(errno));
+    }
+}
+
+void numa_prefer(void* addr, size_t size, int node) {
+    if (topology_get()->node_count < 2 || node < 0 || node >= NUMA_MASK_BITS) {
+        return;
+    }
+    if (sys_mbind(addr, size, MPOL_PREFERRED, &node, 1) != 0) {
+        DEBUG_PRINT("WARNING: Cannot prefer node %d for %p: %s", node, addr, strerror(errno));
+    }
+}
+
+void numa_report(const void* addr, size_t size, size_t page_size) {
+    size_t pages = size / page_size;
+    if (pages == 0) {
+        return;
+    }
+    size_t samples = (pages < NUMA_REPORT_SAMPLES) ? pages : NUMA_REPORT_SAMPLES;
+    size_t stride = (pages / samples) * page_size;
+
+    void* addrs[NUMA_REPORT_SAMPLES];
+    int status[NUMA_REPORT_SAMPLES];
+    for (size_t i = 0; i < samples; i++) {
+        addrs[i] = (char*)addr + i * stride;
+    }
+    // With no target nodes move_pages() only reports where pages are
+    if (syscall(SYS_move_pages, 0, samples, addrs, nullptr, status, 0) != 0) {
+        DEBUG_PRINT("Cannot query NUMA placement: %s", strerror(errno));
+        return;
+    }
+
+    size_t on_node[NUMA_MASK_BITS] = {};
+    size_t absent = 0;
+    for (size_t i = 0; i < samples; i++) {
+        if (status[i] >= 0 && status[i] < NUMA_MASK_BITS) {
+            on_node[status[i]]++;
+        } else {
+            absent++;
+        }
+    }
+
+    char line[512] = "";
+    size_t used = 0;
+    for (int node = 0; node < NUMA_MASK_BITS && used < sizeof(line); node++) {
+        if (on_node[node]) {
+            used += snprintf(line + used, sizeof(line) - used, " node %d %.0f%%", node,
+                             100.0 * on_node[node] / samples);
+        }
+    }
+    NumaPolicy policy = numa_policy();
+    DEBUG_PRINT("NUMA placement of %.2f GB at %p (%s):%s%s", size / (1024.0 * 1024.0 * 1024.0),
+                addr, numa_policy_name(policy), line, absent ? " (some not present)" : "");
+
+    // Pages outside the policy's nodes mean it was not applied
+    if (policy != NUMA_DEFAULT) {
+        int nodes[MAX_TOPOLOGY_NODES];
+        int count = policy_nodes(policy, nodes);
+        size_t inside = 0;
+        for (int i = 0; i < count; i++) {
+            inside += on_node[nodes[i]];
+        }
+        if (inside + absent < samples) {
+            DEBUG_PRINT("WARNING: %.0f%% of the pages are outside the %s nodes",
+                        100.0 * (samples - absent - inside) / samples, numa_policy_name(policy));
+        }
+    }
+}
+
+} // namespace zen5_turbo
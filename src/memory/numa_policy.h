@@ -0,0 +1,57 @@
+/*
+ * numa_policy.h
+ *
+ * NUMA placement of intercepted model memory. Without a policy every
+ * page lands on the node of the thread that first touches it, leaving
+ * the other memory controllers idle during decode on NPS2/NPS4 systems.
+ * ZEN5_NUMA selects a policy, applied with mbind() between mapping a
+ * backing and populating it:
+ *
+ *   default     first touch (no policy)
+ *   interleave  page by page across the nodes of the cpuset
+ *   bind        every page on ZEN5_NUMA_NODE (default: the first node
+ *               of the cpuset)
+ *   split       one contiguous slice per node in file order, so each
+ *               node holds a consecutive run of the model's layers
+ *
+ * bind and split fall back to interleave when a node they would use has
+ * fewer free hugepages than its part of the range needs.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace zen5_turbo {
+
+enum NumaPolicy {
+    NUMA_DEFAULT,
+    NUMA_INTERLEAVE,
+    NUMA_BIND,
+    NUMA_SPLIT
+};
+
+// Policy selected by ZEN5_NUMA
+NumaPolicy numa_policy();
+
+const char* numa_policy_name(NumaPolicy policy);
+
+// Log the policy and the nodes it places memory on.
+// Called once from the library constructor.
+void numa_policy_init();
+
+// Apply the policy to [addr, addr + size) before it is populated.
+// Slice boundaries of the split policy are multiples of align (the
+// largest page size of the range). Failures are logged and leave the
+// range on first touch.
+void numa_place(void* addr, size_t size, size_t align);
+
+// Prefer node (kernel id) for the pages of [addr, addr + size) that are
+// not yet populated; a no-op on single-node systems
+void numa_prefer(void* addr, size_t size, int node);
+
+// Sample the pages of a populated range with move_pages() and log the
+// share on each node
+void numa_report(const void* addr, size_t size, size_t page_size);
+
+} // namespace zen5_turbo
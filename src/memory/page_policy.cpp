@@ -0,0 +1,256 @@
+/*
+ * page_policy.cpp
+ *
+ * Graded page-size fallback for intercepted mapping backings.
+ *
+ * A virtual range is reserved first (PROT_NONE, aligned to the largest
+ * page size in play) and each region is then mapped over it with
+ * MAP_FIXED. A failed attempt puts the reservation back so the next
+ * page size can be tried at the same address without racing other
+ * mappings for the range.
+ *
+ * With a short hugetlb pool a region is stitched together from as many
+ * hugepages as the pool has plus THP-advised memory for the rest, rather
+ * than giving up hugepages for the whole region.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "page_policy.h"
+#include "hugepage_wrapper.h"
+#include "hugepage_pool.h"
+#include "../config.h"
+#include "../env.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace zen5_turbo {
+
+const char* page_kind_name(PageKind kind) {
+    switch (kind) {
+        case PAGE_1G:  return "1GB";
+        case PAGE_2M:  return "2MB";
+        case PAGE_THP: return "THP";
+        default:       return "4KB";
+    }
+}
+
+// Largest page size allowed by ZEN5_PAGE_POLICY ("1g", "2m", "thp", "4k")
+static PageKind policy_limit() {
+    const char* policy = env_str("ZEN5_PAGE_POLICY", "1g");
+    if (strcasecmp(policy, "2m") == 0) {
+        return PAGE_2M;
+    }
+    if (strcasecmp(policy, "thp") == 0) {
+        return PAGE_THP;
+    }
+    if (strcasecmp(policy, "4k") == 0) {
+        return PAGE_4K;
+    }
+    return PAGE_1G;
+}
+
+// THP can be disabled system-wide, in which case MADV_HUGEPAGE succeeds
+// but has no effect
+static bool thp_enabled() {
+    FILE* f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (!f) {
+        return false;
+    }
+    char mode[128] = "";
+    char* line = fgets(mode, sizeof(mode), f);
+    fclose(f);
+    return line && !strstr(mode, "[never]");
+}
+
+// Put the PROT_NONE reservation back over [addr, addr + len)
+static void reserve_fixed(char* addr, size_t len) {
+    sys_mmap(addr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+}
+
+// Back [addr, addr + len) of the reservation with the given page kind
+static bool map_region(char* addr, size_t len, PageKind kind) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+    if (kind == PAGE_1G) {
+        flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+    } else if (kind == PAGE_2M) {
+        flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    } else if (kind == PAGE_THP && !thp_enabled()) {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    void* mem = sys_mmap(addr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mem == MAP_FAILED) {
+        int saved_errno = errno;
+        reserve_fixed(addr, len);
+        errno = saved_errno;
+        return false;
+    }
+
+    if (kind == PAGE_THP && madvise(mem, len, MADV_HUGEPAGE) != 0) {
+        // Left mapped; the 4KB attempt maps over it
+        return false;
+    }
+    return true;
+}
+
+static size_t page_kind_size(PageKind kind) {
+    switch (kind) {
+        case PAGE_1G: return HUGEPAGE_1G_SIZE;
+        case PAGE_2M: return HUGEPAGE_SIZE;
+        default:      return (size_t)sysconf(_SC_PAGESIZE);
+    }
+}
+
+static void add_region(Backing* out, size_t offset, size_t length, PageKind kind) {
+    BackingRegion* region = &out->regions[out->count++];
+    region->offset = offset;
+    region->length = length;
+    region->kind = kind;
+}
+
+// Map [offset, offset + length) of the reservation, walking down the
+// fallback chain from first. When the hugetlb pool cannot cover the
+// whole range and partial is set, the pages it does have back the start
+// of the range and only the rest moves down the chain.
+static bool fill_range(char* base, size_t offset, size_t length, PageKind first,
+                       bool partial, Backing* out) {
+    for (int kind = first; kind <= PAGE_4K; kind++) {
+        // Give the pool manager a chance to grow the pool first
+        if (kind <= PAGE_2M) {
+            size_t page_size = page_kind_size((PageKind)kind);
+            hugepage_pool_ensure(page_size, length / page_size);
+        }
+        if (map_region(base + offset, length, (PageKind)kind)) {
+            add_region(out, offset, length, (PageKind)kind);
+            return true;
+        }
+        if (kind == PAGE_4K) {
+            break;
+        }
+        DEBUG_PRINT("%s pages unavailable for %.2f GB region at +%.2f GB (%s), trying %s",
+                page_kind_name((PageKind)kind),
+                length / (1024.0 * 1024.0 * 1024.0),
+                offset / (1024.0 * 1024.0 * 1024.0),
+                strerror(errno), page_kind_name((PageKind)(kind + 1)));
+
+        if (partial && kind <= PAGE_2M) {
+            size_t page_size = page_kind_size((PageKind)kind);
+            size_t pages = hugepage_pool_available(page_size);
+            if (pages > length / page_size) {
+                pages = length / page_size;
+            }
+            size_t head = pages * page_size;
+            if (head > 0 && map_region(base + offset, head, (PageKind)kind)) {
+                DEBUG_PRINT("Partial %s coverage: %.2f of %.2f GB",
+                        page_kind_name((PageKind)kind),
+                        head / (1024.0 * 1024.0 * 1024.0),
+                        length / (1024.0 * 1024.0 * 1024.0));
+                add_region(out, offset, head, (PageKind)kind);
+                offset += head;
+                length -= head;
+            }
+        }
+    }
+    return false;
+}
+
+bool backing_alloc(size_t length, PageKind largest, Backing* out) {
+    PageKind limit = policy_limit();
+    if (limit < largest) {
+        limit = largest;
+    }
+
+    // 1GB pages cover the 1GB-aligned body, 2MB pages the remainder
+    size_t body = (limit == PAGE_1G) ? (length / HUGEPAGE_1G_SIZE) * HUGEPAGE_1G_SIZE : 0;
+    size_t tail = ((length - body) + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+    size_t align = body ? HUGEPAGE_1G_SIZE : HUGEPAGE_SIZE;
+
+    memset(out, 0, sizeof(*out));
+    out->size = body + tail;
+
+    // Reserve an aligned range so every region starts on its page boundary
+    char* raw = (char*)sys_mmap(nullptr, out->size + align, PROT_NONE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return false;
+    }
+    char* base = (char*)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if (base > raw) {
+        sys_munmap(raw, base - raw);
+    }
+    size_t slack = (raw + out->size + align) - (base + out->size);
+    if (slack > 0) {
+        sys_munmap(base + out->size, slack);
+    }
+    out->addr = base;
+
+    bool partial = env_flag("ZEN5_HUGEPAGE_PARTIAL", true);
+    bool ok = true;
+    if (body) {
+        ok = fill_range(base, 0, body, PAGE_1G, partial, out);
+    }
+    if (ok && tail) {
+        ok = fill_range(base, body, tail, (limit > PAGE_2M) ? limit : PAGE_2M, partial, out);
+    }
+    if (!ok) {
+        int saved_errno = errno;
+        sys_munmap(base, out->size);
+        errno = saved_errno;
+        return false;
+    }
+
+    for (int i = 0; i < out->count; i++) {
+        DEBUG_PRINT("Region %d: %.2f GB at +%.2f GB backed by %s pages", i,
+                out->regions[i].length / (1024.0 * 1024.0 * 1024.0),
+                out->regions[i].offset / (1024.0 * 1024.0 * 1024.0),
+                page_kind_name(out->regions[i].kind));
+    }
+    return true;
+}
+
+void backing_free(const Backing* backing) {
+    sys_munmap(backing->addr, backing->size);
+}
+
+size_t backing_page_size(const Backing* backing) {
+    size_t page_size = 0;
+    for (int i = 0; i < backing->count; i++) {
+        size_t size = page_kind_size(backing->regions[i].kind);
+        if (page_size && size != page_size) {
+            return 0;
+        }
+        page_size = size;
+    }
+    return page_size;
+}
+
+size_t backing_largest_page(const Backing* backing) {
+    size_t largest = page_kind_size(PAGE_4K);
+    for (int i = 0; i < backing->count; i++) {
+        size_t size = page_kind_size(backing->regions[i].kind);
+        if (size > largest) {
+            largest = size;
+        }
+    }
+    return largest;
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,60 @@
+/*
+ * page_policy.h
+ *
+ * Page-size policy for the anonymous memory that backs intercepted
+ * mappings. The range is split into regions and each region is backed
+ * by the largest page size available for it, falling back along the
+ * chain 1GB hugetlb -> 2MB hugetlb -> THP -> 4KB.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace zen5_turbo {
+
+enum PageKind {
+    PAGE_1G,    // MAP_HUGETLB | MAP_HUGE_1GB
+    PAGE_2M,    // MAP_HUGETLB | MAP_HUGE_2MB
+    PAGE_THP,   // Anonymous memory with MADV_HUGEPAGE
+    PAGE_4K     // Plain anonymous memory
+};
+
+struct BackingRegion {
+    size_t offset;      // Offset from the start of the backing
+    size_t length;
+    PageKind kind;
+};
+
+// Body and remainder, each split into at most hugetlb + hugetlb + THP/4KB
+const int MAX_BACKING_REGIONS = 6;
+
+struct Backing {
+    void* addr;
+    size_t size;        // Mapped size (length rounded up to the page size)
+    int count;
+    BackingRegion regions[MAX_BACKING_REGIONS];
+};
+
+// Map length bytes of read-write anonymous memory, using no page size
+// larger than largest (ZEN5_PAGE_POLICY can lower it further). The
+// 1GB-aligned body is tried with 1GB pages and the remainder with 2MB
+// pages; each region falls back independently and is reported. With a
+// short pool (and ZEN5_HUGEPAGE_PARTIAL not disabled) a region is split:
+// the hugepages that are free back its start, the rest falls back.
+// Returns false with errno set if even 4KB pages cannot be mapped.
+bool backing_alloc(size_t length, PageKind largest, Backing* out);
+
+// Unmap all regions of a backing
+void backing_free(const Backing* backing);
+
+// Mapping granularity shared by every region (THP regions count as
+// base pages), or 0 if the regions differ
+size_t backing_page_size(const Backing* backing);
+
+// Largest page size among the regions (base page for THP and 4KB)
+size_t backing_largest_page(const Backing* backing);
+
+const char* page_kind_name(PageKind kind);
+
+} // namespace zen5_turbo
@@ -0,0 +1,291 @@
+/*
+ * parallel_loader.cpp
+ *
+ * Parallel pread loader for the mmap() interception path.
+ *
+ * Each worker is pinned to its own CPU from the cpuset and owns a
+ * contiguous run of extents. The worker that reads an extent is also
+ * the first to touch its hugepages, so pages are faulted in on the
+ * worker's CPU (and NUMA node) instead of all landing on the caller's.
+ * Prefaulting anonymous memory runs the same workers without a file.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <atomic>
+
+#include "parallel_loader.h"
+#include "../config.h"
+#include "../env.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+namespace zen5_turbo {
+
+// Shared state for one load (or prefault) operation
+struct LoadJob {
+    int fd;                 // -1 to prefault instead of reading
+    char* dst;
+    size_t length;
+    off_t offset;
+    std::atomic<size_t> bytes_done;
+    std::atomic<bool> failed;
+    std::atomic<int> error;
+};
+
+// Per-worker slice of the file
+struct LoadWorker {
+    LoadJob* job;
+    size_t begin;   // Byte offset into the mapping (extent aligned)
+    size_t end;
+    pthread_t thread;
+    bool running;
+};
+
+int load_thread_count() {
+    cpu_set_t set;
+    int cpus = 1;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        cpus = CPU_COUNT(&set);
+    }
+
+    long threads = env_long("ZEN5_LOAD_THREADS", cpus);
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_LOAD_THREADS) {
+        threads = MAX_LOAD_THREADS;
+    }
+    return (int)threads;
+}
+
+// Read one extent, retrying short reads and EINTR
+static bool read_extent(LoadJob* job, size_t start, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t bytes_read = pread(job->fd, job->dst + start + done, len - done,
+                                   job->offset + (off_t)(start + done));
+
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            job->error = errno;
+            fprintf(stderr, "[%s] ERROR: Failed to read file: %s\n",
+                    ZEN5_OPTIMIZER_NAME, strerror(errno));
+            return false;
+        }
+
+        if (bytes_read == 0) {
+            job->error = EIO;
+            fprintf(stderr, "[%s] ERROR: Unexpected EOF at offset %zu\n",
+                    ZEN5_OPTIMIZER_NAME, start + done);
+            return false;
+        }
+
+        done += bytes_read;
+    }
+
+    // Progress indicator for large files (once per GB crossed)
+    const size_t gb = 1024ULL * 1024 * 1024;
+    size_t before = job->bytes_done.fetch_add(len);
+    if ((before + len) / gb != before / gb) {
+        DEBUG_PRINT("Loaded %.1f GB / %.1f GB",
+                (before + len) / (1024.0 * 1024.0 * 1024.0),
+                job->length / (1024.0 * 1024.0 * 1024.0));
+    }
+
+    return true;
+}
+
+// Fault in one extent: MADV_POPULATE_WRITE (Linux 5.14+), or a write
+// to every base page on older kernels
+static bool touch_extent(LoadJob* job, size_t start, size_t len) {
+    if (madvise(job->dst + start, len, MADV_POPULATE_WRITE) == 0) {
+        return true;
+    }
+    if (errno != EINVAL) {
+        job->error = errno;
+        fprintf(stderr, "[%s] ERROR: Failed to prefault memory: %s\n",
+                ZEN5_OPTIMIZER_NAME, strerror(errno));
+        return false;
+    }
+
+    size_t base_page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile char* mem = job->dst + start;
+    for (size_t pos = 0; pos < len; pos += base_page) {
+        mem[pos] = mem[pos];
+    }
+    return true;
+}
+
+static void* load_worker(void* arg) {
+    LoadWorker* worker = (LoadWorker*)arg;
+    LoadJob* job = worker->job;
+
+    for (size_t pos = worker->begin; pos < worker->end && !job->failed; pos += LOAD_EXTENT_SIZE) {
+        size_t len = (worker->end - pos < LOAD_EXTENT_SIZE) ? (worker->end - pos) : LOAD_EXTENT_SIZE;
+        bool done = (job->fd >= 0) ? read_extent(job, pos, len) : touch_extent(job, pos, len);
+        if (!done) {
+            job->failed = true;
+        }
+    }
+
+    return nullptr;
+}
+
+// Workers for a job of the given number of extents
+static int worker_count(size_t extents) {
+    int threads = load_thread_count();
+    if ((size_t)threads > extents) {
+        threads = (int)extents;
+    }
+    return threads;
+}
+
+// Run threads workers over the job, each pinned to its own CPU of the
+// cpuset and owning a contiguous run of extents. Returns the number of
+// threads started (slices that cannot get one run inline).
+static int run_workers(LoadJob* job, int threads) {
+    size_t extents = (job->length + LOAD_EXTENT_SIZE - 1) / LOAD_EXTENT_SIZE;
+
+    // CPUs available to this process, one per worker
+    cpu_set_t allowed;
+    int cpus[MAX_LOAD_THREADS];
+    int num_cpus = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && num_cpus < MAX_LOAD_THREADS; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus[num_cpus++] = cpu;
+            }
+        }
+    }
+
+    LoadWorker workers[MAX_LOAD_THREADS];
+    size_t per_worker = (extents + threads - 1) / threads;
+    int started = 0;
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].job = job;
+        workers[i].begin = (size_t)i * per_worker * LOAD_EXTENT_SIZE;
+        workers[i].end = (size_t)(i + 1) * per_worker * LOAD_EXTENT_SIZE;
+        if (workers[i].begin > job->length) {
+            workers[i].begin = job->length;
+        }
+        if (workers[i].end > job->length) {
+            workers[i].end = job->length;
+        }
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (num_cpus > 0) {
+            cpu_set_t pin;
+            CPU_ZERO(&pin);
+            CPU_SET(cpus[i % num_cpus], &pin);
+            pthread_attr_setaffinity_np(&attr, sizeof(pin), &pin);
+        }
+
+        if (pthread_create(&workers[i].thread, &attr, load_worker, &workers[i]) != 0) {
+            // Could not spawn: run this slice on the calling thread
+            DEBUG_PRINT("WARNING: Failed to start loader thread %d, running inline", i);
+            workers[i].running = false;
+            load_worker(&workers[i]);
+        } else {
+            workers[i].running = true;
+            started++;
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        if (workers[i].running) {
+            pthread_join(workers[i].thread, nullptr);
+        }
+    }
+    return started;
+}
+
+bool parallel_load(int fd, void* dst, size_t length, off_t offset) {
+    LoadJob job;
+    job.fd = fd;
+    job.dst = (char*)dst;
+    job.length = length;
+    job.offset = offset;
+    job.bytes_done = 0;
+    job.failed = false;
+    job.error = 0;
+
+    size_t extents = (length + LOAD_EXTENT_SIZE - 1) / LOAD_EXTENT_SIZE;
+    int threads = worker_count(extents);
+
+    // Each worker streams sequentially through its own slice
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    if (length >= LOAD_REPORT_MIN) {
+        DEBUG_PRINT("Loading %.2f GB with %d threads (%zu extents of %zu MB)",
+                length / (1024.0 * 1024.0 * 1024.0), threads, extents,
+                LOAD_EXTENT_SIZE / (1024 * 1024));
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int started = run_workers(&job, threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (job.failed) {
+        errno = job.error ? job.error.load() : EIO;
+        return false;
+    }
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (length >= LOAD_REPORT_MIN) {
+        DEBUG_PRINT("Parallel load: %.2f GB in %.2f s (%.2f GB/s, %d threads)",
+                length / (1024.0 * 1024.0 * 1024.0), elapsed,
+                elapsed > 0 ? (length / (1024.0 * 1024.0 * 1024.0)) / elapsed : 0.0,
+                started);
+    }
+
+    return true;
+}
+
+bool parallel_prefault(void* dst, size_t length) {
+    LoadJob job;
+    job.fd = -1;
+    job.dst = (char*)dst;
+    job.length = length;
+    job.offset = 0;
+    job.bytes_done = 0;
+    job.failed = false;
+    job.error = 0;
+
+    size_t extents = (length + LOAD_EXTENT_SIZE - 1) / LOAD_EXTENT_SIZE;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int started = run_workers(&job, worker_count(extents));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (job.failed) {
+        errno = job.error ? job.error.load() : ENOMEM;
+        return false;
+    }
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    DEBUG_PRINT("Prefaulted %.1f MB in %.3f s (%d threads)",
+            length / (1024.0 * 1024.0), elapsed, started);
+    return true;
+}
+
+} // namespace zen5_turbo
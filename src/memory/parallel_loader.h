@@ -0,0 +1,28 @@
+/*
+ * parallel_loader.h
+ *
+ * Multi-threaded file loader for intercepted model mappings.
+ * Splits the file into hugepage-aligned extents and reads them
+ * concurrently from a worker pool sized to the process cpuset.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+// Number of loader workers (ZEN5_LOAD_THREADS or CPUs in the cpuset)
+int load_thread_count();
+
+// Read [offset, offset + length) of fd into dst.
+// Returns false (with errno set) if any extent fails to load.
+bool parallel_load(int fd, void* dst, size_t length, off_t offset);
+
+// Fault in [dst, dst + length) of writable anonymous memory with the same
+// worker pool, so each extent's pages are touched from its worker's CPU.
+// Returns false (with errno set) if the pages cannot be populated.
+bool parallel_prefault(void* dst, size_t length);
+
+} // namespace zen5_turbo
@@ -0,0 +1,180 @@
+/*
+ * read_loader.cpp
+ *
+ * read() and fread() interposers for llama.cpp's --no-mmap loading.
+ *
+ * A read of at least ZEN5_READ_THRESHOLD MB from a regular file that
+ * starts with the GGUF magic is served with positional reads by the
+ * model loaders, then the file position (or the stdio stream, through
+ * fseeko) is moved past it as the real call would have. The
+ * destination's 2MB-aligned interior is advised for THP first; buffers
+ * from the hugepage arena or an intercepted anonymous mapping are
+ * hugetlb-backed already and ignore the advice. Any failure falls back
+ * to the real call at the unchanged position.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "read_loader.h"
+#include "hugepage_wrapper.h"
+#include "parallel_loader.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+typedef ssize_t (*read_fn)(int, void*, size_t);
+typedef size_t (*fread_fn)(void*, size_t, size_t, FILE*);
+static read_fn real_read = nullptr;
+static fread_fn real_fread = nullptr;
+
+static void init_functions() {
+    if (!real_read) {
+        real_read = (read_fn)dlsym(RTLD_NEXT, "read");
+    }
+    if (!real_fread) {
+        real_fread = (fread_fn)dlsym(RTLD_NEXT, "fread");
+    }
+    if (!real_read || !real_fread) {
+        fprintf(stderr, "[%s] ERROR: Failed to find real read/fread: %s\n",
+                ZEN5_OPTIMIZER_NAME, dlerror());
+        exit(1);
+    }
+}
+
+// Smallest read served by the loaders, or 0 if ZEN5_READ is off
+static size_t read_threshold() {
+    static long threshold_mb = -1;
+    if (threshold_mb < 0) {
+        threshold_mb = env_flag("ZEN5_READ", true) ?
+                       env_long("ZEN5_READ_THRESHOLD", (long)(READ_THRESHOLD >> 20)) : 0;
+        if (threshold_mb < 0) {
+            threshold_mb = 0;
+        }
+    }
+    return (size_t)threshold_mb << 20;
+}
+
+// Bytes a read of count bytes at offset would return, or 0 if fd is not
+// a regular GGUF file
+static size_t gguf_span(int fd, off_t offset, size_t count) {
+    struct stat st;
+    if (offset < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || offset >= st.st_size) {
+        return 0;
+    }
+    char magic[4];
+    if (pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+        memcmp(magic, "GGUF", sizeof(magic)) != 0) {
+        return 0;
+    }
+
+    // Report each file once, on its first large read
+    static ino_t last_inode = 0;
+    if (__atomic_exchange_n(&last_inode, st.st_ino, __ATOMIC_RELAXED) != st.st_ino) {
+        DEBUG_PRINT("Serving large reads of GGUF fd %d (%.2f GB) with the model loaders",
+                fd, st.st_size / (1024.0 * 1024.0 * 1024.0));
+    }
+
+    size_t left = (size_t)(st.st_size - offset);
+    return (count < left) ? count : left;
+}
+
+// Ask for THP on the whole 2MB pages of a buffer before it is filled
+static void advise_buffer(void* buf, size_t length) {
+    uintptr_t lo = ((uintptr_t)buf + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+    uintptr_t hi = ((uintptr_t)buf + length) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+    if (lo < hi) {
+        madvise((void*)lo, hi - lo, MADV_HUGEPAGE);
+    }
+}
+
+bool buffer_load(int fd, void* dst, size_t length, off_t offset) {
+    char* out = (char*)dst;
+    size_t head = (DIRECT_IO_ALIGN - ((uintptr_t)out % DIRECT_IO_ALIGN)) % DIRECT_IO_ALIGN;
+    bool same_alignment = ((uintptr_t)out % DIRECT_IO_ALIGN) == ((size_t)offset % DIRECT_IO_ALIGN);
+    if (!same_alignment || length < head + DIRECT_IO_ALIGN) {
+        return parallel_load(fd, dst, length, offset);
+    }
+
+    // O_DIRECT body in whole blocks, unaligned edges with pread
+    size_t body = (length - head) & ~(DIRECT_IO_ALIGN - 1);
+    size_t tail = length - head - body;
+    return (head == 0 || parallel_load(fd, out, head, offset)) &&
+           load_file_contents(fd, out + head, body, offset + (off_t)head) &&
+           (tail == 0 || parallel_load(fd, out + head + body, tail, offset + (off_t)(head + body)));
+}
+
+} // namespace zen5_turbo
+
+// Our intercepted read function
+extern "C" ssize_t read(int fd, void* buf, size_t count) {
+    using namespace zen5_turbo;
+
+    init_functions();
+
+    size_t threshold = read_threshold();
+    if (threshold == 0 || count < threshold) {
+        return real_read(fd, buf, count);
+    }
+
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    size_t span = gguf_span(fd, pos, count);
+    if (span < threshold) {
+        return real_read(fd, buf, count);
+    }
+
+    advise_buffer(buf, span);
+    if (!buffer_load(fd, buf, span, pos) || lseek(fd, pos + (off_t)span, SEEK_SET) < 0) {
+        DEBUG_PRINT("WARNING: Loader read failed (%s), using read()", strerror(errno));
+        lseek(fd, pos, SEEK_SET);
+        return real_read(fd, buf, count);
+    }
+    return (ssize_t)span;
+}
+
+// Our intercepted fread function. Data still in the stream's buffer is
+// accounted for by ftello(); fseeko() drops it after the load.
+extern "C" size_t fread(void* ptr, size_t size, size_t nmemb, FILE* stream) {
+    using namespace zen5_turbo;
+
+    init_functions();
+
+    size_t total;
+    size_t threshold = read_threshold();
+    if (threshold == 0 || size == 0 || __builtin_mul_overflow(size, nmemb, &total) ||
+        total < threshold) {
+        return real_fread(ptr, size, nmemb, stream);
+    }
+
+    flockfile(stream);
+    int fd = fileno(stream);
+    off_t pos = (fd >= 0) ? ftello(stream) : -1;
+    size_t span = (pos >= 0) ? gguf_span(fd, pos, total) : 0;
+    size_t done = 0;
+    if (span >= threshold) {
+        advise_buffer(ptr, span);
+        if (buffer_load(fd, ptr, span, pos) && fseeko(stream, pos + (off_t)span, SEEK_SET) == 0) {
+            done = span;
+        } else {
+            DEBUG_PRINT("WARNING: Loader read failed (%s), using fread()", strerror(errno));
+        }
+    }
+
+    // Whatever is left goes through stdio, which also records EOF
+    if (done < total) {
+        done += real_fread((char*)ptr + done, 1, total - done, stream);
+    }
+    funlockfile(stream);
+    return done / size;
+}
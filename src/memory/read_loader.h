@@ -0,0 +1,26 @@
+/*
+ * read_loader.h
+ *
+ * Loading path for llama.cpp's --no-mmap mode (and filesystems without
+ * mmap), where tensors are read with fread()/read() into heap buffers
+ * instead of being mapped. Large reads from a GGUF file are served by
+ * the model loaders straight into the buffer, which the hugepage arena
+ * already backs with 2MB pages (other buffers get MADV_HUGEPAGE).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+// Read exactly [offset, offset + length) of fd into dst, which may have
+// any alignment. The part of dst that shares DIRECT_IO_ALIGN alignment
+// with the file goes through load_file_contents() (io_uring + O_DIRECT);
+// the rest, or all of it when the alignments differ, is read with the
+// parallel pread loader. Nothing outside dst is written. Returns false
+// (with errno set) if any part fails.
+bool buffer_load(int fd, void* dst, size_t length, off_t offset);
+
+} // namespace zen5_turbo
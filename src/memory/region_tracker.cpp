@@ -0,0 +1,240 @@
+/*
+ * region_tracker.cpp
+ *
+ * Sorted-array interval index with seqlock reads.
+ *
+ * Regions never overlap, so a binary search on the start address finds
+ * the only candidate for any address in O(log n). Writers hold a mutex,
+ * make the sequence counter odd, edit the array in place and make it
+ * even again. Readers copy what they need and retry if the counter was
+ * odd or moved underneath them. Every field is accessed with relaxed
+ * atomics so a concurrent edit can produce a stale copy (discarded by
+ * the retry) but never undefined behaviour, and the count is clamped so
+ * a torn read cannot index past the array.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "region_tracker.h"
+#include "../config.h"
+
+namespace zen5_turbo {
+
+static TrackedRegion regions[MAX_TRACKED_REGIONS];
+static size_t region_count = 0;
+static unsigned long sequence = 0;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+// Keep the writer lock consistent across fork() in threaded callers
+static void fork_prepare() { pthread_mutex_lock(&writer_lock); }
+static void fork_release() { pthread_mutex_unlock(&writer_lock); }
+static void register_fork_handlers() {
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+static void load_region(const TrackedRegion* src, TrackedRegion* dst) {
+    dst->addr = __atomic_load_n(&src->addr, __ATOMIC_RELAXED);
+    dst->size = __atomic_load_n(&src->size, __ATOMIC_RELAXED);
+    dst->length = __atomic_load_n(&src->length, __ATOMIC_RELAXED);
+    dst->head = __atomic_load_n(&src->head, __ATOMIC_RELAXED);
+    dst->hole = __atomic_load_n(&src->hole, __ATOMIC_RELAXED);
+    dst->hole_end = __atomic_load_n(&src->hole_end, __ATOMIC_RELAXED);
+    dst->offset = __atomic_load_n(&src->offset, __ATOMIC_RELAXED);
+    dst->fd = __atomic_load_n(&src->fd, __ATOMIC_RELAXED);
+    dst->prot = __atomic_load_n(&src->prot, __ATOMIC_RELAXED);
+    dst->lazy = __atomic_load_n(&src->lazy, __ATOMIC_RELAXED);
+    dst->shared = __atomic_load_n(&src->shared, __ATOMIC_RELAXED);
+    dst->anonymous = __atomic_load_n(&src->anonymous, __ATOMIC_RELAXED);
+}
+
+static void store_region(TrackedRegion* dst, const TrackedRegion* src) {
+    __atomic_store_n(&dst->addr, src->addr, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->size, src->size, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->length, src->length, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->head, src->head, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->hole, src->hole, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->hole_end, src->hole_end, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->offset, src->offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->fd, src->fd, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->prot, src->prot, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->lazy, src->lazy, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->shared, src->shared, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->anonymous, src->anonymous, __ATOMIC_RELAXED);
+}
+
+static void write_begin() {
+    pthread_mutex_lock(&writer_lock);
+    __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end() {
+    __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+// Index of the last region starting at or below addr, or -1.
+// Safe to call while a writer is active (result is then discarded).
+static long search(uintptr_t addr) {
+    size_t count = __atomic_load_n(&region_count, __ATOMIC_RELAXED);
+    if (count > MAX_TRACKED_REGIONS) {
+        count = MAX_TRACKED_REGIONS;
+    }
+    long lo = 0;
+    long hi = (long)count - 1;
+    long found = -1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        uintptr_t start = (uintptr_t)__atomic_load_n(&regions[mid].addr, __ATOMIC_RELAXED);
+        if (start <= addr) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// Move entries [from, count) by delta slots (writer only)
+static void shift(size_t from, long delta) {
+    TrackedRegion tmp;
+    if (delta > 0) {
+        for (size_t i = region_count; i > from; i--) {
+            load_region(&regions[i - 1], &tmp);
+            store_region(&regions[i - 1 + delta], &tmp);
+        }
+    } else {
+        for (size_t i = from; i < region_count; i++) {
+            load_region(&regions[i], &tmp);
+            store_region(&regions[i + delta], &tmp);
+        }
+    }
+}
+
+bool tracker_insert(const TrackedRegion* region) {
+    pthread_once(&fork_once, register_fork_handlers);
+
+    write_begin();
+    if (region_count >= MAX_TRACKED_REGIONS) {
+        write_end();
+        return false;
+    }
+    size_t index = (size_t)(search((uintptr_t)region->addr) + 1);
+    shift(index, 1);
+    store_region(&regions[index], region);
+    __atomic_store_n(&region_count, region_count + 1, __ATOMIC_RELAXED);
+    write_end();
+    return true;
+}
+
+bool tracker_find(const void* addr, TrackedRegion* out) {
+    for (;;) {
+        unsigned long begin = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            continue;
+        }
+
+        bool found = false;
+        long index = search((uintptr_t)addr);
+        if (index >= 0) {
+            load_region(&regions[index], out);
+            found = (uintptr_t)addr - (uintptr_t)out->addr < out->size;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sequence, __ATOMIC_RELAXED) == begin) {
+            return found;
+        }
+    }
+}
+
+bool tracker_next(const void* addr, TrackedRegion* out) {
+    for (;;) {
+        unsigned long begin = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            continue;
+        }
+
+        bool found = false;
+        size_t count = __atomic_load_n(&region_count, __ATOMIC_RELAXED);
+        long index = search((uintptr_t)addr);
+        if (index >= 0) {
+            load_region(&regions[index], out);
+            found = (uintptr_t)addr - (uintptr_t)out->addr < out->size;
+        }
+        if (!found && (size_t)(index + 1) < count && (size_t)(index + 1) < MAX_TRACKED_REGIONS) {
+            load_region(&regions[index + 1], out);
+            found = true;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sequence, __ATOMIC_RELAXED) == begin) {
+            return found;
+        }
+    }
+}
+
+bool tracker_overlaps(const void* addr, size_t length) {
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end = start + length;
+
+    for (;;) {
+        unsigned long begin = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            continue;
+        }
+
+        // Only the last region starting before end can overlap
+        bool overlaps = false;
+        long index = search(end - 1);
+        if (index >= 0 && length > 0) {
+            TrackedRegion region;
+            load_region(&regions[index], &region);
+            overlaps = (uintptr_t)region.addr + region.size > start;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sequence, __ATOMIC_RELAXED) == begin) {
+            return overlaps;
+        }
+    }
+}
+
+bool tracker_update(const TrackedRegion* region) {
+    write_begin();
+    long index = search((uintptr_t)region->addr);
+    bool found = index >= 0 && regions[index].addr == region->addr;
+    if (found) {
+        store_region(&regions[index], region);
+    }
+    write_end();
+    return found;
+}
+
+bool tracker_take(const void* addr, size_t length, TrackedRegion* out) {
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end = (start + length < start) ? UINTPTR_MAX : start + length;
+
+    write_begin();
+    // The region containing start (if any), otherwise the next one up
+    long below = search(start);
+    size_t index = (size_t)(below + 1);
+    if (below >= 0 && start - (uintptr_t)regions[below].addr < regions[below].size) {
+        index = (size_t)below;
+    }
+    if (index >= region_count || (uintptr_t)regions[index].addr >= end) {
+        write_end();
+        return false;
+    }
+    *out = regions[index];
+    shift(index + 1, -1);
+    __atomic_store_n(&region_count, region_count - 1, __ATOMIC_RELAXED);
+    write_end();
+    return true;
+}
+
+} // namespace zen5_turbo
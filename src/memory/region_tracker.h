@@ -0,0 +1,59 @@
+/*
+ * region_tracker.h
+ *
+ * Concurrent index of intercepted regions, keyed by address range.
+ * Lookups are lock-free (seqlock-validated binary search over a sorted
+ * array) so the munmap() fast path for untracked memory never blocks;
+ * updates are serialised by a mutex. Entries live in a fixed array
+ * sized at build time, so mmap() never calls malloc to track a region.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+struct LazyRegion;
+struct SharedMapping;
+
+struct TrackedRegion {
+    void* addr;
+    size_t size;            // Mapped size, including hugepage rounding
+    size_t length;          // Size the caller mapped (page rounded)
+    size_t head;            // Bytes at addr the caller has unmapped, kept
+                            // for the hugepage they share with the rest
+    size_t hole;            // [addr + hole, addr + hole_end): a range inside
+    size_t hole_end;        // the caller's part it has unmapped, kept the
+                            // same way; hole == hole_end if none
+    off_t offset;           // File offset of addr
+    int fd;                 // Private dup() of the source file, or -1
+    int prot;               // Protection of the whole region, or -1 if mixed
+    LazyRegion* lazy;       // Background population state (lazy mode only)
+    SharedMapping* shared;  // Cross-process cache entry (shared mode only)
+    bool anonymous;         // Replaces an anonymous mapping (no file contents)
+};
+
+// Add a region. Returns false if the tracker is full.
+bool tracker_insert(const TrackedRegion* region);
+
+// Lock-free: copy of the region containing addr
+bool tracker_find(const void* addr, TrackedRegion* out);
+
+// Lock-free: copy of the lowest region ending above addr (the one
+// containing addr, or else the next one up)
+bool tracker_next(const void* addr, TrackedRegion* out);
+
+// Lock-free: whether any tracked region overlaps [addr, addr + length)
+bool tracker_overlaps(const void* addr, size_t length);
+
+// Replace the region starting at region->addr. Returns false if it is
+// no longer tracked.
+bool tracker_update(const TrackedRegion* region);
+
+// Remove the lowest region overlapping [addr, addr + length), copying
+// it to out. Returns false if there is none.
+bool tracker_take(const void* addr, size_t length, TrackedRegion* out);
+
+} // namespace zen5_turbo
@@ -0,0 +1,417 @@
+/*
+ * shared_cache.cpp
+ *
+ * Cross-process hugepage cache on hugetlbfs.
+ *
+ * Each cached model is a file named after its identity key in the
+ * hugetlbfs directory (ZEN5_HUGETLBFS_DIR or the first hugetlbfs mount).
+ * The key is (dev, ino, size, mtime, offset, length) plus a hash of
+ * evenly spaced samples of the model, so an entry is only reused for
+ * the same file contents. A per-entry lock file serialises creation
+ * so only one process reads the model from disk; it is unlinked along
+ * with its entry, under the lock.
+ *
+ * Every process mapping an entry holds LOCK_SH on it; that shared lock
+ * is the reference count. The kernel drops it when a process exits, so
+ * a crashed user never pins an entry forever. An entry whose data file
+ * can be locked exclusively is unused.
+ *
+ * Transient entries ("zen5-...") are removed on last release or by the
+ * sweep run before creating a new entry. Persistent entries
+ * ("zen5-warm-...", ZEN5_CACHE_PERSIST) outlive their users so a
+ * restarted server maps the already loaded hugepages; they are only
+ * swept once superseded by a newer version of the same source file.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <mntent.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "shared_cache.h"
+#include "hugepage_wrapper.h"
+#include "numa_policy.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+static const char CACHE_PREFIX[] = "zen5-";
+static const char WARM_PREFIX[] = "zen5-warm-";
+
+// Locate a hugetlbfs mount and its page size
+static bool find_hugetlbfs(char* dir, size_t dir_size, size_t* page_size) {
+    const char* configured = env_str("ZEN5_HUGETLBFS_DIR", nullptr);
+    if (configured && *configured) {
+        snprintf(dir, dir_size, "%s", configured);
+    } else {
+        FILE* mounts = setmntent("/proc/mounts", "r");
+        if (!mounts) {
+            return false;
+        }
+        bool found = false;
+        struct mntent* entry;
+        while ((entry = getmntent(mounts)) != nullptr) {
+            if (strcmp(entry->mnt_type, "hugetlbfs") == 0) {
+                snprintf(dir, dir_size, "%s", entry->mnt_dir);
+                found = true;
+                break;
+            }
+        }
+        endmntent(mounts);
+        if (!found) {
+            return false;
+        }
+    }
+
+    struct statfs fs;
+    if (statfs(dir, &fs) != 0 || fs.f_type != HUGETLBFS_MAGIC) {
+        DEBUG_PRINT("%s is not a hugetlbfs mount", dir);
+        return false;
+    }
+    *page_size = (size_t)fs.f_bsize;
+    return true;
+}
+
+// Offset of hash sample i within a model of the given length
+static size_t sample_offset(int i, size_t length) {
+    if (length <= CACHE_HASH_SAMPLE_SIZE) {
+        return 0;
+    }
+    size_t span = length - CACHE_HASH_SAMPLE_SIZE;
+    return (i == CACHE_HASH_SAMPLES - 1) ? span : (span / (CACHE_HASH_SAMPLES - 1)) * i;
+}
+
+// FNV-1a, continuing from hash
+static uint64_t hash_bytes(uint64_t hash, const unsigned char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static const uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+
+// Hash the samples of [offset, offset + length) of a file.
+// Returns false if the file cannot be read.
+static bool hash_file(int fd, size_t length, off_t offset, uint64_t* out) {
+    unsigned char buffer[CACHE_HASH_SAMPLE_SIZE];
+    uint64_t hash = hash_bytes(HASH_SEED, (const unsigned char*)&length, sizeof(length));
+
+    for (int i = 0; i < CACHE_HASH_SAMPLES; i++) {
+        size_t pos = sample_offset(i, length);
+        size_t want = (length - pos < sizeof(buffer)) ? (length - pos) : sizeof(buffer);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = pread(fd, buffer + got, want - got, offset + (off_t)(pos + got));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            got += n;
+        }
+        hash = hash_bytes(hash, buffer, want);
+    }
+
+    *out = hash;
+    return true;
+}
+
+// Hash the same samples of a loaded image
+static uint64_t hash_image(const void* image, size_t length) {
+    const unsigned char* data = (const unsigned char*)image;
+    uint64_t hash = hash_bytes(HASH_SEED, (const unsigned char*)&length, sizeof(length));
+
+    for (int i = 0; i < CACHE_HASH_SAMPLES; i++) {
+        size_t pos = sample_offset(i, length);
+        size_t want = (length - pos < CACHE_HASH_SAMPLE_SIZE) ? (length - pos)
+                                                              : CACHE_HASH_SAMPLE_SIZE;
+        hash = hash_bytes(hash, data + pos, want);
+    }
+    return hash;
+}
+
+// Take a lock on path, creating the lock file if needed. Lock files are
+// unlinked by whoever removes their entry, so a lock won on a file that
+// has been unlinked (or replaced) meanwhile is dropped and taken again.
+static int lock_file(const char* path, int operation) {
+    for (;;) {
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            return -1;
+        }
+        while (flock(fd, operation) != 0) {
+            if (errno != EINTR) {
+                close(fd);
+                return -1;
+            }
+        }
+        struct stat held, current;
+        if (fstat(fd, &held) == 0 && stat(path, &current) == 0 &&
+            held.st_dev == current.st_dev && held.st_ino == current.st_ino) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+// Remove the entry at data_path if no process holds it, and its lock
+// file with it (or alone, if the entry is already gone). The caller
+// holds the lock.
+static void remove_if_unused(const char* data_path, const char* lock_path) {
+    int fd = open(data_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            unlink(lock_path);
+        }
+        return;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+        DEBUG_PRINT("Removing unused shared cache entry %s", data_path);
+        unlink(data_path);
+        unlink(lock_path);
+    }
+    close(fd);
+}
+
+static bool has_suffix(const char* name, const char* suffix) {
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return len > suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+// Return unused hugepages to the pool: transient entries left behind by
+// processes that exited without releasing them (e.g. crashes), and
+// persistent entries for older versions of source (the "<dev>-<ino>-"
+// key prefix of the entry being created), and lock files whose entry is
+// gone
+static void sweep_unused(const char* dir, const char* source) {
+    DIR* d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        const char* name = entry->d_name;
+        if (strncmp(name, CACHE_PREFIX, sizeof(CACHE_PREFIX) - 1) != 0 ||
+            has_suffix(name, ".tmp")) {
+            continue;
+        }
+
+        char data_path[PATH_MAX];
+        char lock_path[PATH_MAX];
+        bool orphan = has_suffix(name, ".lock");
+        if (orphan) {
+            // A lock left without its entry (creation failed, or removed
+            // before lock files were cleaned up)
+            snprintf(lock_path, sizeof(lock_path), "%s/%s", dir, name);
+            snprintf(data_path, sizeof(data_path), "%.*s", (int)(strlen(lock_path) - 5), lock_path);
+            if (access(data_path, F_OK) == 0 || errno != ENOENT) {
+                continue;
+            }
+        } else {
+            if (strncmp(name, WARM_PREFIX, sizeof(WARM_PREFIX) - 1) == 0 &&
+                strncmp(name + sizeof(WARM_PREFIX) - 1, source, strlen(source)) != 0) {
+                continue;
+            }
+            snprintf(data_path, sizeof(data_path), "%s/%s", dir, name);
+            snprintf(lock_path, sizeof(lock_path), "%s.lock", data_path);
+        }
+
+        // Skip entries another process is creating or releasing right now
+        int lock_fd = lock_file(lock_path, LOCK_EX | LOCK_NB);
+        if (lock_fd < 0) {
+            continue;
+        }
+        if (!orphan) {
+            remove_if_unused(data_path, lock_path);
+        } else if (access(data_path, F_OK) != 0 && errno == ENOENT) {
+            unlink(lock_path);
+        }
+        close(lock_fd);
+    }
+    closedir(d);
+}
+
+// Create the entry: load the model into <path>.tmp, check it against
+// the source hash and rename it into place
+static int create_entry(const char* path, int src_fd, size_t length, off_t offset,
+                        size_t size, size_t page_size, uint64_t hash) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        DEBUG_PRINT("Cannot create %s: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    void* mem = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        mem = sys_mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        DEBUG_PRINT("Cannot reserve %.2f GB of shared hugepages: %s",
+                size / (1024.0 * 1024.0 * 1024.0), strerror(errno));
+        unlink(tmp_path);
+        close(fd);
+        return -1;
+    }
+
+    numa_place(mem, size, page_size);
+    bool loaded = load_file_contents(src_fd, mem, length, offset);
+    if (loaded) {
+        numa_report(mem, size, page_size);
+    }
+    if (loaded && hash_image(mem, length) != hash) {
+        // The source changed while it was being read
+        DEBUG_PRINT("Loaded image does not match the source file");
+        loaded = false;
+    }
+    sys_munmap(mem, size);
+
+    if (!loaded || rename(tmp_path, path) != 0) {
+        DEBUG_PRINT("Cannot populate %s", path);
+        unlink(tmp_path);
+        close(fd);
+        return -1;
+    }
+
+    // Reopen read-only so no process can map the entry writable
+    close(fd);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+SharedMapping* shared_cache_map(int fd, const struct stat* st, size_t length, off_t offset) {
+    char dir[PATH_MAX];
+    size_t page_size;
+    if (!find_hugetlbfs(dir, sizeof(dir), &page_size)) {
+        DEBUG_PRINT("No usable hugetlbfs mount for the shared cache");
+        return nullptr;
+    }
+
+    uint64_t hash;
+    if (!hash_file(fd, length, offset, &hash)) {
+        DEBUG_PRINT("Cannot sample source file for the shared cache: %s", strerror(errno));
+        return nullptr;
+    }
+
+    SharedMapping* mapping = (SharedMapping*)malloc(sizeof(SharedMapping));
+    if (!mapping) {
+        return nullptr;
+    }
+    mapping->persistent = env_flag("ZEN5_CACHE_PERSIST", false);
+    mapping->refs = 1;
+    mapping->size = (length + page_size - 1) & ~(page_size - 1);
+
+    char source[64];
+    snprintf(source, sizeof(source), "%lx-%lx-",
+             (unsigned long)st->st_dev, (unsigned long)st->st_ino);
+    snprintf(mapping->path, sizeof(mapping->path),
+             "%s/%s%s%lx-%lx.%lx-%lx-%zx-%016llx", dir,
+             mapping->persistent ? WARM_PREFIX : CACHE_PREFIX, source,
+             (unsigned long)st->st_size, (unsigned long)st->st_mtim.tv_sec,
+             (unsigned long)st->st_mtim.tv_nsec, (unsigned long)offset, length,
+             (unsigned long long)hash);
+
+    char lock_path[PATH_MAX];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", mapping->path);
+    int lock_fd = lock_file(lock_path, LOCK_EX);
+    if (lock_fd < 0) {
+        DEBUG_PRINT("Cannot lock %s: %s", lock_path, strerror(errno));
+        free(mapping);
+        return nullptr;
+    }
+
+    bool created = false;
+    mapping->fd = open(mapping->path, O_RDONLY | O_CLOEXEC);
+    if (mapping->fd < 0 && errno == ENOENT) {
+        DEBUG_PRINT("Populating shared cache entry %s", mapping->path);
+        sweep_unused(dir, source);
+        mapping->fd = create_entry(mapping->path, fd, length, offset, mapping->size, page_size,
+                                   hash);
+        created = true;
+    }
+
+    // Take our reference before anyone else can see the entry as unused
+    if (mapping->fd >= 0 && flock(mapping->fd, LOCK_SH) != 0) {
+        close(mapping->fd);
+        mapping->fd = -1;
+    }
+
+    mapping->addr = MAP_FAILED;
+    if (mapping->fd >= 0) {
+        mapping->addr = sys_mmap(nullptr, mapping->size, PROT_READ, MAP_SHARED, mapping->fd, 0);
+        if (mapping->addr == MAP_FAILED) {
+            DEBUG_PRINT("Cannot map shared cache entry: %s", strerror(errno));
+        } else if (!created && hash_image(mapping->addr, length) != hash) {
+            DEBUG_PRINT("Shared cache entry %s is corrupt, discarding it", mapping->path);
+            sys_munmap(mapping->addr, mapping->size);
+            mapping->addr = MAP_FAILED;
+        }
+        if (mapping->addr == MAP_FAILED) {
+            close(mapping->fd);
+            mapping->fd = -1;
+            remove_if_unused(mapping->path, lock_path);
+        }
+    } else if (created) {
+        // Nothing was created: the lock file is the only trace
+        unlink(lock_path);
+    }
+    close(lock_fd);
+
+    if (mapping->fd < 0) {
+        free(mapping);
+        return nullptr;
+    }
+
+    DEBUG_PRINT("%s %.2f GB %s hugepage mapping",
+            created ? "Created" : "Attached to",
+            length / (1024.0 * 1024.0 * 1024.0),
+            mapping->persistent ? "persistent" : "shared");
+    return mapping;
+}
+
+void shared_cache_retain(SharedMapping* mapping) {
+    __atomic_add_fetch(&mapping->refs, 1, __ATOMIC_RELAXED);
+}
+
+void shared_cache_release(SharedMapping* mapping) {
+    if (!mapping || __atomic_sub_fetch(&mapping->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+
+    close(mapping->fd);
+
+    // Serialise with creators of the same entry, then drop the file if
+    // we were the last user
+    if (!mapping->persistent) {
+        char lock_path[PATH_MAX];
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", mapping->path);
+        int lock_fd = lock_file(lock_path, LOCK_EX);
+        if (lock_fd >= 0) {
+            remove_if_unused(mapping->path, lock_path);
+            close(lock_fd);
+        }
+    }
+
+    free(mapping);
+}
+
+} // namespace zen5_turbo
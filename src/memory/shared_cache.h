@@ -0,0 +1,46 @@
+/*
+ * shared_cache.h
+ *
+ * Cross-process hugepage cache for read-only model mappings.
+ * The first process to map a model loads it into a file on hugetlbfs;
+ * later processes (and concurrent servers) map the same hugepages
+ * instead of each holding a private copy.
+ */
+
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace zen5_turbo {
+
+struct SharedMapping {
+    void* addr;             // Start of the shared mapping
+    size_t size;            // Mapped size (rounded up to the hugepage size)
+    int fd;                 // Cache file, held with LOCK_SH while mapped
+    bool persistent;        // Kept after the last release (ZEN5_CACHE_PERSIST)
+    int refs;               // Pieces of the mapping still in use (see shared_cache_retain)
+    char path[PATH_MAX];
+};
+
+// Map [offset, offset + length) of the file behind fd (st is its fstat
+// result) from the shared cache, loading it on first use. Entries are
+// keyed by (dev, ino, size, mtime, offset, length) and a sampled content
+// hash so a modified model gets a fresh entry. Returns nullptr when no hugetlbfs mount is usable
+// or the hugepage pool is exhausted; the caller should use a private copy.
+SharedMapping* shared_cache_map(int fd, const struct stat* st, size_t length, off_t offset);
+
+// Take another reference, for a piece of the mapping that has been
+// split off (a partial munmap leaves the pieces on either side)
+void shared_cache_retain(SharedMapping* mapping);
+
+// Drop a reference. The last one ends this process's use of the entry;
+// the caller unmaps every piece first, as the mapping pins the file's
+// LOCK_SH until it is gone. A transient cache file is removed when the
+// last process using it releases it; a persistent one is kept for the
+// next process that maps the same model.
+void shared_cache_release(SharedMapping* mapping);
+
+} // namespace zen5_turbo
@@ -0,0 +1,217 @@
+/*
+ * text_remap.cpp
+ *
+ * Text segments are found in /proc/self/maps (r-xp file mappings). For
+ * each, the 2MB-aligned interior is copied aside, replaced with a
+ * MAP_FIXED hugetlb mapping (anonymous memory with MADV_HUGEPAGE when
+ * the pool is short), filled back and made r-x again. The partial
+ * pages at either end stay file-backed. Text the move itself runs
+ * (this library, the C library and the dynamic loader) is never moved.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "text_remap.h"
+#include "hugepage_wrapper.h"
+#include "../config.h"
+#include "../env.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+namespace zen5_turbo {
+
+struct TextSegment {
+    uintptr_t start;
+    uintptr_t end;
+    unsigned long offset;   // File offset of start
+    char path[512];
+    char name[64];
+};
+
+// Threads in the process, from /proc/self/status
+static int thread_count() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) {
+        return -1;
+    }
+    char line[256];
+    int threads = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Threads: %d", &threads) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return threads;
+}
+
+// Whether an object's file name contains an entry of the match list
+static bool name_matches(const char* name, const char* match) {
+    char patterns[256];
+    snprintf(patterns, sizeof(patterns), "%s", match);
+    char* save = nullptr;
+    for (char* p = strtok_r(patterns, ",", &save); p; p = strtok_r(nullptr, ",", &save)) {
+        if (*p && strstr(name, p)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether [start, end) holds code the remap calls into
+static bool in_use(uintptr_t start, uintptr_t end) {
+    const void* used[] = {
+        (const void*)&text_remap_init,
+        (const void*)&memcpy,
+        dlsym(RTLD_NEXT, "mmap"),
+        dlsym(RTLD_NEXT, "mprotect"),
+        (const void*)&dlsym,
+    };
+    for (size_t i = 0; i < sizeof(used) / sizeof(used[0]); i++) {
+        if ((uintptr_t)used[i] >= start && (uintptr_t)used[i] < end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Executable text segments of the executable and the matching libraries
+static int find_segments(const char* match, TextSegment* out, int max) {
+    char exe[512];
+    ssize_t exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    exe[exe_len > 0 ? exe_len : 0] = '\0';
+
+    FILE* f = fopen("/proc/self/maps", "r");
+    if (!f) {
+        return 0;
+    }
+    char line[768];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), f)) {
+        unsigned long start, end, offset;
+        char perms[8];
+        int path_at = 0;
+        if (sscanf(line, "%lx-%lx %7s %lx %*s %*s %n", &start, &end, perms, &offset, &path_at) < 4 ||
+            path_at == 0 || strcmp(perms, "r-xp") != 0 || line[path_at] != '/') {
+            continue;
+        }
+        char* path = line + path_at;
+        path[strcspn(path, "\n")] = '\0';
+        const char* name = strrchr(path, '/') + 1;
+        if ((strcmp(path, exe) != 0 && !name_matches(name, match)) || in_use(start, end) ||
+            strncmp(name, "ld-", 3) == 0) {
+            continue;
+        }
+        out[count].start = start;
+        out[count].end = end;
+        out[count].offset = offset;
+        snprintf(out[count].path, sizeof(out[count].path), "%s", path);
+        snprintf(out[count].name, sizeof(out[count].name), "%s", name);
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+// Map [start, end) of the segment back from its file after a failed move
+static void restore_range(const TextSegment& segment, uintptr_t start, uintptr_t end) {
+    int fd = open(segment.path, O_RDONLY | O_CLOEXEC);
+    void* mem = MAP_FAILED;
+    if (fd >= 0) {
+        mem = sys_mmap((void*)start, end - start, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_FIXED,
+                       fd, segment.offset + (start - segment.start));
+        close(fd);
+    }
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "[%s] ERROR: Lost text at %p while restoring it from %s: %s\n",
+                ZEN5_OPTIMIZER_NAME, (void*)start, segment.path, strerror(errno));
+        abort();
+    }
+}
+
+// Move [start, end) of the segment onto 2MB pages; returns the page kind
+// used, or nullptr if the range was left as (or put back to) what it was
+static const char* remap_range(const TextSegment& segment, uintptr_t start, uintptr_t end) {
+    size_t length = end - start;
+    void* copy = sys_mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED) {
+        return nullptr;
+    }
+    memcpy(copy, (void*)start, length);
+
+    // A hugetlb mapping that cannot get its pages fails before the old
+    // mapping is touched
+    const char* kind = "2MB";
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+    void* mem = sys_mmap((void*)start, length, PROT_READ | PROT_WRITE,
+                         flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (mem == MAP_FAILED) {
+        mem = sys_mmap((void*)start, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mem == MAP_FAILED) {
+            fprintf(stderr, "[%s] ERROR: Lost text at %p while remapping it: %s\n",
+                    ZEN5_OPTIMIZER_NAME, (void*)start, strerror(errno));
+            abort();
+        }
+        madvise(mem, length, MADV_HUGEPAGE);
+        kind = "THP";
+    }
+    memcpy(mem, copy, length);
+    sys_munmap(copy, length);
+    if (mprotect(mem, length, PROT_READ | PROT_EXEC) != 0) {
+        // Writable, non-executable text faults on the next call into it
+        DEBUG_PRINT("Cannot make moved text at %p executable (%s), restoring it from %s",
+                    mem, strerror(errno), segment.path);
+        restore_range(segment, start, end);
+        return nullptr;
+    }
+    return kind;
+}
+
+void text_remap_init() {
+    if (!env_flag("ZEN5_TEXT_HUGEPAGES", false)) {
+        return;
+    }
+    int threads = thread_count();
+    if (threads != 1) {
+        DEBUG_PRINT("Text on huge pages: skipped (%d threads running)", threads);
+        return;
+    }
+
+    TextSegment segments[MAX_TEXT_SEGMENTS];
+    int count = find_segments(env_str("ZEN5_TEXT_MATCH", "llama,ggml"), segments, MAX_TEXT_SEGMENTS);
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        uintptr_t lo = (segments[i].start + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+        uintptr_t hi = segments[i].end & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+        double mb = (segments[i].end - segments[i].start) / (1024.0 * 1024.0);
+        if (lo >= hi) {
+            DEBUG_PRINT("Text of %s: %.1f MB, no whole 2MB page", segments[i].name, mb);
+            continue;
+        }
+        const char* kind = remap_range(segments[i], lo, hi);
+        if (kind) {
+            total += hi - lo;
+            DEBUG_PRINT("Text of %s: %.1f of %.1f MB on %s pages",
+                    segments[i].name, (hi - lo) / (1024.0 * 1024.0), mb, kind);
+        }
+    }
+    DEBUG_PRINT("Text on huge pages: %.1f MB in %d segments", total / (1024.0 * 1024.0), count);
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,24 @@
+/*
+ * text_remap.h
+ *
+ * Code on huge pages. The ggml kernels, the llama.cpp graph code and
+ * the server spread over tens of MB of text; on 4KB pages mixed
+ * prefill/decode work misses the iTLB constantly. With
+ * ZEN5_TEXT_HUGEPAGES=1 the whole 2MB pages of the executable's text
+ * and of the libraries named by ZEN5_TEXT_MATCH are copied onto 2MB
+ * pages (hugetlb, or THP) at the same addresses, keeping r-x.
+ *
+ * The remapped code is anonymous memory afterwards: profilers that
+ * resolve symbols through /proc/<pid>/maps no longer see the file.
+ */
+
+#pragma once
+
+namespace zen5_turbo {
+
+// Remap the selected text segments. Called once from the library
+// constructor; does nothing if other threads are already running, as
+// they could execute code while it is being moved.
+void text_remap_init();
+
+} // namespace zen5_turbo
@@ -0,0 +1,337 @@
+/*
+ * uring_loader.cpp
+ *
+ * Asynchronous O_DIRECT loader built on raw io_uring syscalls.
+ *
+ * The file is reopened with O_DIRECT through /proc/self/fd so the
+ * caller's file description is left untouched. Reads of
+ * URING_CHUNK_SIZE bytes are kept in flight up to the configured
+ * queue depth and land directly in the (2MB aligned) destination.
+ * No liburing dependency: the rings are set up by hand.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "uring_loader.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+// Mapped submission and completion rings
+struct Ring {
+    int fd;
+    unsigned entries;
+
+    void* sq_ptr;
+    size_t sq_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    void* cq_ptr;
+    size_t cq_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+// One outstanding (or to-be-resubmitted) read
+struct ReadSlot {
+    size_t pos;     // Byte offset into the mapping
+    size_t len;
+    bool busy;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static void ring_close(Ring* ring) {
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+}
+
+static bool ring_open(Ring* ring, unsigned entries) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = nullptr;
+        ring_close(ring);
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = nullptr;
+            ring_close(ring);
+            return false;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = nullptr;
+        ring_close(ring);
+        return false;
+    }
+
+    char* sq = (char*)ring->sq_ptr;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+
+    char* cq = (char*)ring->cq_ptr;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+// Queue a read SQE (caller guarantees a free submission entry)
+static void ring_queue_read(Ring* ring, int fd, void* buf, unsigned len, off_t off, uint64_t tag) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = (uint64_t)off;
+    sqe->user_data = tag;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+bool uring_load(int fd, void* dst, size_t length, off_t offset) {
+    // O_DIRECT needs block-aligned buffers and file offsets
+    if (((uintptr_t)dst % DIRECT_IO_ALIGN) != 0 || (offset % DIRECT_IO_ALIGN) != 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    int dfd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+    if (dfd < 0) {
+        DEBUG_PRINT("O_DIRECT unavailable for fd %d: %s", fd, strerror(errno));
+        return false;
+    }
+
+    long depth = env_long("ZEN5_URING_QD", URING_QUEUE_DEPTH);
+    if (depth < 1) {
+        depth = 1;
+    }
+    if (depth > URING_MAX_QUEUE_DEPTH) {
+        depth = URING_MAX_QUEUE_DEPTH;
+    }
+
+    Ring ring;
+    if (!ring_open(&ring, (unsigned)depth)) {
+        int saved_errno = errno;
+        DEBUG_PRINT("io_uring unavailable: %s", strerror(saved_errno));
+        close(dfd);
+        errno = saved_errno;
+        return false;
+    }
+    if (depth > (long)ring.entries) {
+        depth = ring.entries;
+    }
+
+    ReadSlot slots[URING_MAX_QUEUE_DEPTH];
+    for (long i = 0; i < depth; i++) {
+        slots[i].busy = false;
+    }
+
+    // The final read is rounded up to the block size; the mapping is
+    // page granular so the extra bytes stay inside it, and the kernel
+    // stops the read at EOF anyway.
+    const size_t aligned_length = (length + DIRECT_IO_ALIGN - 1) & ~(DIRECT_IO_ALIGN - 1);
+    const size_t gb = 1024ULL * 1024 * 1024;
+    char* base = (char*)dst;
+    size_t next = 0;
+    size_t loaded = 0;
+    int inflight = 0;
+    int error = 0;
+
+    if (length >= LOAD_REPORT_MIN) {
+        DEBUG_PRINT("Loading %.2f GB with io_uring + O_DIRECT (queue depth %ld)",
+                length / (1024.0 * 1024.0 * 1024.0), depth);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!error && (next < aligned_length || inflight > 0)) {
+        // Fill the queue with new chunks
+        for (long i = 0; i < depth && !error; i++) {
+            ReadSlot* slot = &slots[i];
+            if (slot->busy) {
+                continue;
+            }
+            if (next >= aligned_length) {
+                break;
+            }
+            slot->pos = next;
+            slot->len = (aligned_length - next < URING_CHUNK_SIZE) ? (aligned_length - next)
+                                                                   : URING_CHUNK_SIZE;
+            slot->busy = true;
+            next += slot->len;
+
+            ring_queue_read(&ring, dfd, base + slot->pos, (unsigned)slot->len,
+                            offset + (off_t)slot->pos, (uint64_t)i);
+            inflight++;
+        }
+
+        // Submit everything the kernel has not consumed yet (covers
+        // resubmitted short reads and entries left over after EINTR)
+        unsigned to_submit = *ring.sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        int ret = sys_io_uring_enter(ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            error = errno;
+            break;
+        }
+
+        // Reap completions
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+            ReadSlot* slot = &slots[cqe->user_data];
+            int res = cqe->res;
+            head++;
+            inflight--;
+
+            if (res < 0) {
+                error = -res;
+                continue;
+            }
+
+            size_t before = loaded;
+            loaded += res;
+            if (loaded / gb != before / gb) {
+                DEBUG_PRINT("Loaded %.1f GB / %.1f GB",
+                        loaded / (1024.0 * 1024.0 * 1024.0),
+                        length / (1024.0 * 1024.0 * 1024.0));
+            }
+
+            if ((size_t)res < slot->len && slot->pos + res < length) {
+                // Short read before EOF: resubmit the aligned remainder
+                if (res == 0 || (res % DIRECT_IO_ALIGN) != 0) {
+                    error = EIO;
+                    continue;
+                }
+                slot->pos += res;
+                slot->len -= res;
+                ring_queue_read(&ring, dfd, base + slot->pos, (unsigned)slot->len,
+                                offset + (off_t)slot->pos, cqe->user_data);
+                inflight++;
+                continue;
+            }
+
+            slot->busy = false;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Drain anything still in flight before the buffer is reused
+    while (inflight > 0) {
+        if (sys_io_uring_enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            break;
+        }
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        inflight -= (int)(tail - head);
+        __atomic_store_n(ring.cq_head, tail, __ATOMIC_RELEASE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ring_close(&ring);
+    close(dfd);
+
+    if (error) {
+        DEBUG_PRINT("io_uring load failed: %s", strerror(error));
+        errno = error;
+        return false;
+    }
+
+    if (loaded < length) {
+        DEBUG_PRINT("io_uring load stopped early (%zu of %zu bytes)", loaded, length);
+        errno = EIO;
+        return false;
+    }
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (length >= LOAD_REPORT_MIN) {
+        DEBUG_PRINT("io_uring load: %.2f GB in %.2f s (%.2f GB/s)",
+                length / (1024.0 * 1024.0 * 1024.0), elapsed,
+                elapsed > 0 ? (length / (1024.0 * 1024.0 * 1024.0)) / elapsed : 0.0);
+    }
+
+    return true;
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,23 @@
+/*
+ * uring_loader.h
+ *
+ * io_uring + O_DIRECT loader for intercepted model mappings.
+ * Reads go straight from the device into the hugepage destination,
+ * bypassing the page cache so the model is not held in RAM twice.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace zen5_turbo {
+
+// Read [offset, offset + length) of fd into dst with O_DIRECT reads
+// submitted through io_uring (ZEN5_URING_QD requests in flight).
+// dst must be page aligned. Returns false (with errno set) when
+// io_uring or O_DIRECT is unavailable or a read fails; the caller
+// is expected to fall back to parallel_load().
+bool uring_load(int fd, void* dst, size_t length, off_t offset);
+
+} // namespace zen5_turbo
@@ -0,0 +1,84 @@
+/*
+ * ggml_blocks.h
+ *
+ * Block layouts of ggml's quantized tensor types, byte-compatible with
+ * ggml-common.h so weights can be used in place, and the half precision
+ * scale conversion (F16C).
+ */
+
+#pragma once
+
+#include <immintrin.h>
+#include <stdint.h>
+
+namespace zen5_turbo {
+
+const int QK8_0 = 32;
+const int QK_K = 256;               // Values per K-quant super-block
+const int K_SCALE_SIZE = 12;
+
+// Q8_0: 32 signed bytes sharing one fp16 scale (34 bytes)
+struct block_q8_0 {
+    uint16_t d;
+    int8_t qs[QK8_0];
+};
+
+static_assert(sizeof(block_q8_0) == 34, "block_q8_0 must match ggml");
+
+// Q8_K: activations for the K-quants and IQ4_XS; bsums[j] is the sum of
+// qs[16 * j .. 16 * j + 15]
+struct block_q8_K {
+    float d;
+    int8_t qs[QK_K];
+    int16_t bsums[QK_K / 16];
+};
+
+// Q4_K: 8 sub-blocks of 32 4-bit values, 6-bit scales and minimums
+// packed in scales[], value = d * scale * q - dmin * min
+struct block_q4_K {
+    uint16_t d;
+    uint16_t dmin;
+    uint8_t scales[K_SCALE_SIZE];
+    uint8_t qs[QK_K / 2];
+};
+
+// Q5_K: Q4_K plus the fifth bit of every value in qh[]
+struct block_q5_K {
+    uint16_t d;
+    uint16_t dmin;
+    uint8_t scales[K_SCALE_SIZE];
+    uint8_t qh[QK_K / 8];
+    uint8_t qs[QK_K / 2];
+};
+
+// IQ4_XS: 8 sub-blocks of 32 4-bit indexes into the IQ4_NL codebook,
+// 6-bit sub-block scales (low bits in scales_l, high in scales_h)
+struct block_iq4_xs {
+    uint16_t d;
+    uint16_t scales_h;
+    uint8_t scales_l[QK_K / 64];
+    uint8_t qs[QK_K / 2];
+};
+
+static_assert(sizeof(block_q8_K) == 292, "block_q8_K must match ggml");
+static_assert(sizeof(block_q4_K) == 144, "block_q4_K must match ggml");
+static_assert(sizeof(block_q5_K) == 176, "block_q5_K must match ggml");
+static_assert(sizeof(block_iq4_xs) == 136, "block_iq4_xs must match ggml");
+
+// Non-linear IQ4_NL / IQ4_XS codebook (kvalues_iq4nl)
+static const int8_t IQ4_VALUES[16] = {
+    -127, -104, -83, -65, -49, -35, -22, -10, 1, 13, 25, 38, 53, 69, 89, 113
+};
+
+// ggml_type values of the formats served here
+enum GgmlQuantType {
+    GGML_QUANT_Q4_K = 12,
+    GGML_QUANT_Q5_K = 13,
+    GGML_QUANT_IQ4_XS = 23
+};
+
+static inline float fp16_to_fp32(uint16_t h) {
+    return _cvtsh_ss(h);
+}
+
+} // namespace zen5_turbo
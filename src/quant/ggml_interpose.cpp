@@ -0,0 +1,110 @@
+/*
+ * ggml_interpose.cpp
+ *
+ * Exported ggml vec_dot kernels. Signatures follow ggml-cpu/quants.h:
+ * n values (n / 32 blocks for Q8_0, n / 256 super-blocks for the
+ * K-quants and IQ4_XS), result in s, and for nrc > 1 (the ARM
+ * matrix-multiply path) the strides bs / bx / by of a 2 x 2 tile.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "ggml_interpose.h"
+#include "q8_0.h"
+#include "kquants.h"
+#include "../config.h"
+#include "../env.h"
+
+typedef void (*vec_dot_fn)(int n, float* s, size_t bs, const void* vx, size_t bx,
+                           const void* vy, size_t by, int nrc);
+
+namespace zen5_turbo {
+
+// Dot product of nb blocks of weights vx and activations vy
+typedef float (*BlockDot)(const void* vx, const void* vy, int nb);
+
+static bool quant_enabled = true;
+
+static pthread_once_t next_once = PTHREAD_ONCE_INIT;
+static vec_dot_fn next_vec_dot_q8_0 = nullptr;
+static vec_dot_fn next_vec_dot_iq4_xs = nullptr;
+static vec_dot_fn next_vec_dot_q4_K = nullptr;
+static vec_dot_fn next_vec_dot_q5_K = nullptr;
+
+static void resolve_next() {
+    next_vec_dot_q8_0 = (vec_dot_fn)dlsym(RTLD_NEXT, "ggml_vec_dot_q8_0_q8_0");
+    next_vec_dot_iq4_xs = (vec_dot_fn)dlsym(RTLD_NEXT, "ggml_vec_dot_iq4_xs_q8_K");
+    next_vec_dot_q4_K = (vec_dot_fn)dlsym(RTLD_NEXT, "ggml_vec_dot_q4_K_q8_K");
+    next_vec_dot_q5_K = (vec_dot_fn)dlsym(RTLD_NEXT, "ggml_vec_dot_q5_K_q8_K");
+}
+
+void quant_init() {
+    quant_enabled = env_flag("ZEN5_QUANT", true);
+    if (!quant_enabled) {
+        DEBUG_PRINT("Quant kernels: OFF (ggml keeps its own)");
+        return;
+    }
+    DEBUG_PRINT("Quant kernels: Q8_0, IQ4_XS, Q4_K and Q5_K vec_dot on AVX-512 VBMI/VNNI");
+}
+
+// Common body of the exports: take nrc == 1 calls over whole blocks,
+// forward the rest to next when there is one
+static void vec_dot(const char* name, vec_dot_fn next, BlockDot dot, int block_values,
+                    int n, float* s, size_t bs, const void* vx, size_t bx,
+                    const void* vy, size_t by, int nrc) {
+    bool take = quant_enabled && n % block_values == 0 && nrc == 1;
+    if (next && !take) {
+        next(n, s, bs, vx, bx, vy, by, nrc);
+        return;
+    }
+    if (n % block_values != 0) {
+        fprintf(stderr, "[%s] ERROR: %s: n %d is not a multiple of %d\n",
+                ZEN5_OPTIMIZER_NAME, name, n, block_values);
+        return;
+    }
+
+    int nb = n / block_values;
+    // s[i * bs + j] = row j of x . row i of y
+    for (int i = 0; i < nrc; i++) {
+        for (int j = 0; j < nrc; j++) {
+            s[i * bs + j] = dot((const char*)vx + j * bx, (const char*)vy + i * by, nb);
+        }
+    }
+}
+
+} // namespace zen5_turbo
+
+using namespace zen5_turbo;
+
+extern "C" void ggml_vec_dot_q8_0_q8_0(int n, float* s, size_t bs, const void* vx, size_t bx,
+                                       const void* vy, size_t by, int nrc) {
+    pthread_once(&next_once, resolve_next);
+    vec_dot("ggml_vec_dot_q8_0_q8_0", next_vec_dot_q8_0, zen5_q8_0_dot, QK8_0,
+            n, s, bs, vx, bx, vy, by, nrc);
+}
+
+extern "C" void ggml_vec_dot_iq4_xs_q8_K(int n, float* s, size_t bs, const void* vx, size_t bx,
+                                         const void* vy, size_t by, int nrc) {
+    pthread_once(&next_once, resolve_next);
+    vec_dot("ggml_vec_dot_iq4_xs_q8_K", next_vec_dot_iq4_xs, zen5_iq4_xs_dot, QK_K,
+            n, s, bs, vx, bx, vy, by, nrc);
+}
+
+extern "C" void ggml_vec_dot_q4_K_q8_K(int n, float* s, size_t bs, const void* vx, size_t bx,
+                                       const void* vy, size_t by, int nrc) {
+    pthread_once(&next_once, resolve_next);
+    vec_dot("ggml_vec_dot_q4_K_q8_K", next_vec_dot_q4_K, zen5_q4_K_dot, QK_K,
+            n, s, bs, vx, bx, vy, by, nrc);
+}
+
+extern "C" void ggml_vec_dot_q5_K_q8_K(int n, float* s, size_t bs, const void* vx, size_t bx,
+                                       const void* vy, size_t by, int nrc) {
+    pthread_once(&next_once, resolve_next);
+    vec_dot("ggml_vec_dot_q5_K_q8_K", next_vec_dot_q5_K, zen5_q5_K_dot, QK_K,
+            n, s, bs, vx, bx, vy, by, nrc);
+}
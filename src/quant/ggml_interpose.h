@@ -0,0 +1,23 @@
+/*
+ * ggml_interpose.h
+ *
+ * ggml CPU kernels served by the in-tree quantized kernels. ggml-cpu
+ * reaches its vec_dot kernels (ggml_vec_dot_q8_0_q8_0, _iq4_xs_q8_K,
+ * _q4_K_q8_K, _q5_K_q8_K) through its type traits table, i.e. through
+ * the GOT, so definitions exported from the preload take their place
+ * when libggml-cpu is built with default symbol visibility (the
+ * upstream default; builds with -fvisibility=hidden or static linking
+ * keep their own, as do weights ggml repacks for its own GEMM). Calls
+ * the kernels do not take (nrc > 1, n not a multiple of the block, or
+ * everything with ZEN5_QUANT=0) go to the next definition.
+ */
+
+#pragma once
+
+namespace zen5_turbo {
+
+// Read ZEN5_QUANT and log the state. Called once from the library
+// constructor.
+void quant_init();
+
+} // namespace zen5_turbo
@@ -0,0 +1,298 @@
+/*
+ * kquants.cpp
+ *
+ * Each super-block gives four vpdpbusd results, one per 64 values (two
+ * sub-blocks). They are folded into one vector laid out as
+ *   lanes 0-3: sub-blocks 0, 2, 4, 6    lanes 8-11: sub-blocks 1, 3, 5, 7
+ * with the activation sums of the same sub-blocks in lanes 4-7 / 12-15,
+ * so one vpmulld against [scales | mins] and a short reduction yield
+ * isum (lanes 0-3 + 8-11) and msum (4-7 + 12-15). GEMV runs four
+ * weight rows per activation super-block.
+ */
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kquants.h"
+#include "simd_sums.h"
+#include "../threads/compute_pool.h"
+#include "../threads/kernel_tasks.h"
+#include "../config.h"
+
+namespace zen5_turbo {
+
+const int GEMV_ROWS = 4;    // Weight rows per activation super-block
+
+// Activation super-block in registers
+struct QuantY {
+    __m512i q[4];           // Values 64 * v .. 64 * v + 63
+    __m512i sums;           // Sub-block sums in the layout above
+    float d;
+};
+
+static inline QuantY load_y(const block_q8_K* y) {
+    const __m512i layout = _mm512_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6, 1, 3, 5, 7, 1, 3, 5, 7);
+    QuantY qy;
+    for (int v = 0; v < 4; v++) {
+        qy.q[v] = _mm512_loadu_si512((const void*)(y->qs + 64 * v));
+    }
+    __m256i sums = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)y->bsums), _mm256_set1_epi16(1));
+    qy.sums = _mm512_permutexvar_epi32(layout, _mm512_castsi256_si512(sums));
+    qy.d = y->d;
+    return qy;
+}
+
+// Q4_K / Q5_K scales and minimums as [scales 0, 2, 4, 6 | mins 0, 2, 4, 6 |
+// scales 1, 3, 5, 7 | mins 1, 3, 5, 7]. The 12 packed bytes are three
+// words u0..u2 (ggml's get_scale_min_k4 unpacking, done on all four
+// result words at once): scales 0-3 = u0 & 0x3f, scales 4-7 = u2 & 0x0f
+// with bits 6-7 of u0 on top, mins 0-3 = u1 & 0x3f, mins 4-7 = u2 >> 4
+// with bits 6-7 of u1 on top. Reads 4 bytes past scales[], which the
+// block always holds.
+static inline __m512i kquant_coefficients(const uint8_t* scales) {
+    const __m512i layout = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    __m128i u = _mm_loadu_si128((const __m128i*)scales);
+    __m128i low = _mm_shuffle_epi32(u, _MM_SHUFFLE(2, 1, 2, 0));     // u0, u2, u1, u2
+    __m128i top = _mm_shuffle_epi32(u, _MM_SHUFFLE(1, 1, 0, 0));     // u0, u0, u1, u1
+    __m128i even = _mm_and_si128(low, _mm_set1_epi8(0x3f));
+    __m128i odd = _mm_or_si128(
+        _mm_and_si128(_mm_srlv_epi32(low, _mm_setr_epi32(0, 0, 0, 4)), _mm_set1_epi8(0x0f)),
+        _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(top, 6), _mm_set1_epi8(0x03)), 4));
+    __m128i words = _mm_blend_epi32(even, odd, 0xA);
+    return _mm512_permutexvar_epi32(layout, _mm512_cvtepu8_epi32(words));
+}
+
+// Nibbles of 32 bytes as 64 values: low nibbles, then high nibbles
+static inline __m512i split_nibbles(const uint8_t* qs) {
+    __m512i both = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i*)qs));
+    __m512i nibbles = _mm512_mask_blend_epi64(0xF0, both, _mm512_srli_epi16(both, 4));
+    return _mm512_and_si512(nibbles, _mm512_set1_epi8(0x0F));
+}
+
+struct Q4K {
+    typedef block_q4_K Block;
+    static const bool HAS_MINS = true;
+
+    static inline void weights(const Block* x, __m512i (&w)[4]) {
+        for (int v = 0; v < 4; v++) {
+            w[v] = split_nibbles(x->qs + 32 * v);
+        }
+    }
+    static inline __m512i coefficients(const Block* x) {
+        return kquant_coefficients(x->scales);
+    }
+    static inline float dmin(const Block* x) {
+        return fp16_to_fp32(x->dmin);
+    }
+};
+
+struct Q5K {
+    typedef block_q5_K Block;
+    static const bool HAS_MINS = true;
+
+    // Value 64 * v + l takes bit 2 * v of qh[l], value 64 * v + 32 + l bit 2 * v + 1
+    static inline void weights(const Block* x, __m512i (&w)[4]) {
+        __m512i high = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i*)x->qh));
+        __m512i bit = _mm512_mask_blend_epi64(0xF0, _mm512_set1_epi8(1), _mm512_set1_epi8(2));
+        for (int v = 0; v < 4; v++) {
+            __mmask64 set = _mm512_test_epi8_mask(high, bit);
+            __m512i low = split_nibbles(x->qs + 32 * v);
+            w[v] = _mm512_mask_add_epi8(low, set, low, _mm512_set1_epi8(16));
+            bit = _mm512_slli_epi16(bit, 2);
+        }
+    }
+    static inline __m512i coefficients(const Block* x) {
+        return kquant_coefficients(x->scales);
+    }
+    static inline float dmin(const Block* x) {
+        return fp16_to_fp32(x->dmin);
+    }
+};
+
+struct IQ4XS {
+    typedef block_iq4_xs Block;
+    static const bool HAS_MINS = false;
+
+    // Sub-block b holds its first 16 values in the low nibbles of
+    // qs[16 * b ..], the last 16 in the high ones. vpermb reads six index
+    // bits, so with the codebook repeated four times the bits above the
+    // nibble need no masking.
+    static inline void weights(const Block* x, __m512i (&w)[4]) {
+        const __m512i codebook = _mm512_broadcast_i32x4(
+            _mm_xor_si128(_mm_loadu_si128((const __m128i*)IQ4_VALUES), _mm_set1_epi8((char)0x80)));
+        for (int v = 0; v < 4; v++) {
+            __m512i q = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i*)(x->qs + 32 * v)));
+            q = _mm512_shuffle_i64x2(q, q, _MM_SHUFFLE(1, 1, 0, 0));
+            __m512i index = _mm512_mask_blend_epi64(0xCC, q, _mm512_srli_epi16(q, 4));
+            w[v] = _mm512_permutexvar_epi8(index, codebook);
+        }
+    }
+    // Sub-block scales minus 32 in the sub-block lanes
+    static inline __m512i coefficients(const Block* x) {
+        const __m512i low_shift = _mm512_setr_epi32(0, 8, 16, 24, 0, 8, 16, 24, 4, 12, 20, 28, 4, 12, 20, 28);
+        const __m512i high_shift = _mm512_setr_epi32(0, 4, 8, 12, 0, 4, 8, 12, 2, 6, 10, 14, 2, 6, 10, 14);
+        uint32_t scales_l;
+        memcpy(&scales_l, x->scales_l, sizeof(scales_l));
+        __m512i low = _mm512_and_si512(_mm512_srlv_epi32(_mm512_set1_epi32((int)scales_l), low_shift),
+                                       _mm512_set1_epi32(0x0F));
+        __m512i high = _mm512_and_si512(_mm512_srlv_epi32(_mm512_set1_epi32(x->scales_h), high_shift),
+                                        _mm512_set1_epi32(3));
+        return _mm512_sub_epi32(_mm512_or_si512(low, _mm512_slli_epi32(high, 4)), _mm512_set1_epi32(32));
+    }
+    static inline float dmin(const Block*) {
+        return 0.0f;
+    }
+};
+
+// One super-block: integer scale-weighted dot (isum) and, for Q4_K /
+// Q5_K, the minimum-weighted activation sum (msum)
+template <typename F>
+static inline void superblock(const typename F::Block* x, const QuantY& y, int& isum, int& msum) {
+    __m512i w[4];
+    F::weights(x, w);
+    __m512i dots[4];
+    for (int v = 0; v < 4; v++) {
+        dots[v] = _mm512_dpbusd_epi32(_mm512_setzero_si512(), w[v], y.q[v]);
+    }
+    __m512i h = fold64(fold32(dots[0], dots[1]), fold32(dots[2], dots[3]));
+    __m512i subs = _mm512_add_epi32(h, _mm512_shuffle_i32x4(h, h, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m512i data = F::HAS_MINS ? _mm512_mask_blend_epi32(0xF0F0, subs, y.sums)
+                               : _mm512_sub_epi32(subs, _mm512_slli_epi32(y.sums, 7));
+    __m512i prod = _mm512_mullo_epi32(data, F::coefficients(x));
+    __m512i pairs = _mm512_add_epi32(prod, _mm512_shuffle_i32x4(prod, prod, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m256i sums = _mm512_castsi512_si256(pairs);
+    sums = _mm256_hadd_epi32(sums, sums);
+    sums = _mm256_hadd_epi32(sums, sums);
+    isum = _mm256_cvtsi256_si32(sums);
+    msum = _mm256_extract_epi32(sums, 4);
+}
+
+template <typename F>
+static inline float accumulate(const typename F::Block* x, float yd, int isum, int msum, float sum) {
+    sum = fmaf((float)isum, fp16_to_fp32(x->d) * yd, sum);
+    if (F::HAS_MINS) {
+        sum = fmaf((float)-msum, F::dmin(x) * yd, sum);
+    }
+    return sum;
+}
+
+template <typename F>
+static float dot(const typename F::Block* x, const block_q8_K* y, int nb) {
+    float sum = 0.0f;
+    for (int i = 0; i < nb; i++) {
+        QuantY qy = load_y(y + i);
+        int isum, msum;
+        superblock<F>(x + i, qy, isum, msum);
+        sum = accumulate<F>(x + i, qy.d, isum, msum, sum);
+    }
+    return sum;
+}
+
+// Rows r0 .. r1 - 1, GEMV_ROWS at a time against each activation super-block
+template <typename F>
+static void gemv_rows(const char* w, size_t row_bytes, int r0, int r1,
+                      const block_q8_K* y, int nb, float* out) {
+    typedef typename F::Block Block;
+    int r = r0;
+    for (; r + GEMV_ROWS <= r1; r += GEMV_ROWS) {
+        float sum[GEMV_ROWS] = {};
+        for (int i = 0; i < nb; i++) {
+            QuantY qy = load_y(y + i);
+#pragma GCC unroll 4
+            for (int j = 0; j < GEMV_ROWS; j++) {
+                const Block* x = (const Block*)(w + (size_t)(r + j) * row_bytes) + i;
+                int isum, msum;
+                superblock<F>(x, qy, isum, msum);
+                sum[j] = accumulate<F>(x, qy.d, isum, msum, sum[j]);
+            }
+        }
+        for (int j = 0; j < GEMV_ROWS; j++) {
+            out[r + j] = sum[j];
+        }
+    }
+    for (; r < r1; r++) {
+        out[r] = dot<F>((const Block*)(w + (size_t)r * row_bytes), y, nb);
+    }
+}
+
+typedef void (*GemvRows)(const char* w, size_t row_bytes, int r0, int r1,
+                         const block_q8_K* y, int nb, float* out);
+
+struct KQuantJob {
+    GemvRows fn;
+    const char* w;
+    size_t row_bytes;
+    int rows;
+    const block_q8_K* y;
+    int nb;
+    float* out;
+    int chunk;          // Rows per task
+};
+
+static void gemv_task(void* arg, int task) {
+    const KQuantJob* job = (const KQuantJob*)arg;
+    int r0 = task * job->chunk;
+    int r1 = min_int(r0 + job->chunk, job->rows);
+    job->fn(job->w, job->row_bytes, r0, r1, job->y, job->nb, job->out);
+}
+
+float iq4_xs_dot(const block_iq4_xs* x, const block_q8_K* y, int nb) {
+    return dot<IQ4XS>(x, y, nb);
+}
+
+float q4_K_dot(const block_q4_K* x, const block_q8_K* y, int nb) {
+    return dot<Q4K>(x, y, nb);
+}
+
+float q5_K_dot(const block_q5_K* x, const block_q8_K* y, int nb) {
+    return dot<Q5K>(x, y, nb);
+}
+
+bool kquant_gemv(int type, const void* w, size_t row_bytes, int rows,
+                 const block_q8_K* y, int nb, float* out) {
+    GemvRows fn;
+    switch (type) {
+        case GGML_QUANT_IQ4_XS: fn = gemv_rows<IQ4XS>; break;
+        case GGML_QUANT_Q4_K: fn = gemv_rows<Q4K>; break;
+        case GGML_QUANT_Q5_K: fn = gemv_rows<Q5K>; break;
+        default: return false;
+    }
+    if (rows <= 0) {
+        return true;
+    }
+
+    size_t bytes = (size_t)rows * row_bytes;
+    int threads = bytes >= QUANT_PARALLEL_BYTES ? compute_pool_threads() : 1;
+    int chunk = task_chunk(rows, threads, GEMV_ROWS);
+    KQuantJob job = {fn, (const char*)w, row_bytes, rows, y, nb, out, chunk};
+    int tasks = (rows + chunk - 1) / chunk;
+    if (threads > 1) {
+        compute_pool_run(gemv_task, &job, tasks);
+    } else {
+        fn(job.w, row_bytes, 0, rows, y, nb, out);
+    }
+    return true;
+}
+
+} // namespace zen5_turbo
+
+using namespace zen5_turbo;
+
+extern "C" float zen5_iq4_xs_dot(const void* x, const void* y, int nb) {
+    return iq4_xs_dot((const block_iq4_xs*)x, (const block_q8_K*)y, nb);
+}
+
+extern "C" float zen5_q4_K_dot(const void* x, const void* y, int nb) {
+    return q4_K_dot((const block_q4_K*)x, (const block_q8_K*)y, nb);
+}
+
+extern "C" float zen5_q5_K_dot(const void* x, const void* y, int nb) {
+    return q5_K_dot((const block_q5_K*)x, (const block_q8_K*)y, nb);
+}
+
+extern "C" int zen5_kquant_gemv(int type, const void* w, size_t row_bytes, int rows,
+                                const void* y, int nb, float* out) {
+    return kquant_gemv(type, w, row_bytes, rows, (const block_q8_K*)y, nb, out) ? 1 : 0;
+}
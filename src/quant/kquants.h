@@ -0,0 +1,46 @@
+/*
+ * kquants.h
+ *
+ * Fused dequantize-and-dot kernels for IQ4_XS, Q4_K and Q5_K weights
+ * against Q8_K activations (AVX-512 VBMI + VNNI). A 256-value
+ * super-block is expanded to bytes in four zmm registers, never to
+ * floats: Q4_K/Q5_K values are 0..31 and feed vpdpbusd directly,
+ * IQ4_XS indexes are looked up in the codebook with vpermb, offset by
+ * +128 to unsigned and corrected with Q8_K's block sums. The eight
+ * sub-block dots are multiplied by their 6-bit scales (and the
+ * activation sums by the Q4_K/Q5_K minimums) as integers, so each
+ * super-block contributes exact integers isum and msum.
+ *
+ * Results are bit-identical to a scalar reference: per super-block,
+ *   sum = fmaf(isum, fp32(d) * y.d, sum)
+ *   sum = fmaf(-msum, fp32(dmin) * y.d, sum)     (Q4_K, Q5_K)
+ * in super-block order. Q8_K bsums must be the sums of their 16 values,
+ * as ggml's quantize_row_q8_K writes them.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "ggml_blocks.h"
+
+namespace zen5_turbo {
+
+// Dot product of nb super-blocks of weights x and activations y
+float iq4_xs_dot(const block_iq4_xs* x, const block_q8_K* y, int nb);
+float q4_K_dot(const block_q4_K* x, const block_q8_K* y, int nb);
+float q5_K_dot(const block_q5_K* x, const block_q8_K* y, int nb);
+
+// out[r] = dot(row r, y) for rows of nb super-blocks of type (a
+// GgmlQuantType), row r at w + r * row_bytes. Returns false for an
+// unsupported type.
+bool kquant_gemv(int type, const void* w, size_t row_bytes, int rows,
+                 const block_q8_K* y, int nb, float* out);
+
+} // namespace zen5_turbo
+
+// C entry points for tests and tools (dlsym)
+extern "C" float zen5_iq4_xs_dot(const void* x, const void* y, int nb);
+extern "C" float zen5_q4_K_dot(const void* x, const void* y, int nb);
+extern "C" float zen5_q5_K_dot(const void* x, const void* y, int nb);
+extern "C" int zen5_kquant_gemv(int type, const void* w, size_t row_bytes, int rows,
+                                const void* y, int nb, float* out);
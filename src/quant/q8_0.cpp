@@ -0,0 +1,412 @@
+/*
+ * q8_0.cpp
+ *
+ * A step covers one group of 16 blocks. Each pair of blocks fills one
+ * zmm (eight dword lanes per block); vpdpbusd leaves in every lane the
+ * exact dot of four bytes. The eight vectors of a group are folded with
+ * 32/64-bit unpacks and a 128-bit lane shuffle into one vector holding
+ * the 16 block sums, put in block order with one permute, converted to
+ * float and FMA'd with the 16 scale products. A group that runs past
+ * the end of a row is served from a zero-padded copy, which adds +0 to
+ * every lane and so leaves the result unchanged.
+ */
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "q8_0.h"
+#include "simd_sums.h"
+#include "../threads/compute_pool.h"
+#include "../threads/kernel_tasks.h"
+#include "../config.h"
+
+namespace zen5_turbo {
+
+const int GROUP = 16;                   // Blocks per step
+const int GROUP_BYTES = GROUP * QK8_0;  // Activation bytes per step
+const int GEMV_ROWS = 4;                // Weight rows per GEMV tile
+const int GEMM_COLS = 4;                // Activation vectors per GEMM tile
+
+// Activation vector laid out for the kernels: quants contiguous and
+// zero padded to whole groups, scales as floats, and the starting
+// accumulator (-128 * sum of each four bytes) of every block pair
+struct Q8Activation {
+    const int8_t* qs;       // groups * GROUP_BYTES
+    const float* d;         // groups * GROUP
+    const __m512i* bias;    // groups * GROUP / 2
+};
+
+static inline int groups_of(int nb) {
+    return (nb + GROUP - 1) / GROUP;
+}
+
+static size_t prepared_size(int nb) {
+    return (size_t)groups_of(nb) * (GROUP_BYTES + GROUP * sizeof(float) + GROUP / 2 * sizeof(__m512i));
+}
+
+static inline __m512i pair_bias(__m512i qs) {
+    __m512i sums = _mm512_dpbusd_epi32(_mm512_setzero_si512(), _mm512_set1_epi8((char)0x80), qs);
+    return _mm512_sub_epi32(_mm512_setzero_si512(), sums);
+}
+
+// Quants of blocks b and b + 1 in one vector
+static inline __m512i load_pair(const block_q8_0* b) {
+    __m256i lo = _mm256_loadu_si256((const __m256i*)b[0].qs);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)b[1].qs);
+    return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+}
+
+// Scales of 16 consecutive blocks
+static inline __m512 load_scales(const block_q8_0* b) {
+    const __m512i offsets = _mm512_setr_epi32(0, 34, 68, 102, 136, 170, 204, 238,
+                                              272, 306, 340, 374, 408, 442, 476, 510);
+    __m512i words = _mm512_i32gather_epi32(offsets, (const void*)b, 1);
+    return _mm512_cvtph_ps(_mm512_cvtepi32_epi16(words));
+}
+
+// Lay out nb blocks of y in buffer (prepared_size(nb) bytes, 64-aligned)
+static Q8Activation prepare(const block_q8_0* y, int nb, void* buffer) {
+    int groups = groups_of(nb);
+    int8_t* qs = (int8_t*)buffer;
+    __m512i* bias = (__m512i*)(qs + (size_t)groups * GROUP_BYTES);
+    float* d = (float*)(bias + (size_t)groups * GROUP / 2);
+
+    for (int b = 0; b < groups * GROUP; b += 2) {
+        __m512i pair;
+        if (b + 1 < nb) {
+            pair = load_pair(y + b);
+        } else {
+            __m256i lo = b < nb ? _mm256_loadu_si256((const __m256i*)y[b].qs) : _mm256_setzero_si256();
+            pair = _mm512_castsi256_si512(lo);
+            pair = _mm512_inserti64x4(pair, _mm256_setzero_si256(), 1);
+        }
+        _mm512_store_si512((void*)(qs + (size_t)b * QK8_0), pair);
+        bias[b / 2] = pair_bias(pair);
+        d[b] = b < nb ? fp16_to_fp32(y[b].d) : 0.0f;
+        d[b + 1] = b + 1 < nb ? fp16_to_fp32(y[b + 1].d) : 0.0f;
+    }
+    Q8Activation act = {qs, d, bias};
+    return act;
+}
+
+// Sum of the 16 lanes in the documented order
+static inline float reduce_lanes(__m512 v) {
+    __m256 s8 = _mm256_add_ps(_mm512_castps512_ps256(v), _mm512_extractf32x8_ps(v, 1));
+    __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1));
+    __m128 s2 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+    __m128 s1 = _mm_add_ss(s2, _mm_movehdup_ps(s2));
+    return _mm_cvtss_f32(s1);
+}
+
+// Fold the two half-group sums (see the file comment) into block order
+static inline __m512i block_sums(__m512i half0, __m512i half1) {
+    const __m512i order = _mm512_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    __m512i sums = _mm512_add_epi32(_mm512_shuffle_i32x4(half0, half1, 0x88),
+                                    _mm512_shuffle_i32x4(half0, half1, 0xDD));
+    return _mm512_permutexvar_epi32(order, sums);
+}
+
+// Activation taken as prepared by prepare()
+struct PreparedY {
+    const Q8Activation* act;
+    int group;
+
+    inline __m512i qs(int pair) const {
+        return _mm512_load_si512((const void*)(act->qs + (size_t)group * GROUP_BYTES + pair * 64));
+    }
+    inline __m512i bias(int pair, __m512i) const {
+        return act->bias[(size_t)group * GROUP / 2 + pair];
+    }
+    inline __m512 d() const {
+        return _mm512_loadu_ps(act->d + (size_t)group * GROUP);
+    }
+};
+
+// Activation read straight from ggml blocks (single dot products)
+struct RawY {
+    const block_q8_0* y;     // First block of the group
+
+    inline __m512i qs(int pair) const {
+        return load_pair(y + 2 * pair);
+    }
+    inline __m512i bias(int, __m512i qs) const {
+        return pair_bias(qs);
+    }
+    inline __m512 d() const {
+        return load_scales(y);
+    }
+};
+
+// One group of R weight rows against C activations: acc[r][c] gets the
+// 16 scaled block dots of row r and activation c
+template <int R, int C, typename Y>
+static inline void q8_group(const block_q8_0* const* x, const Y* y, __m512 (&acc)[R][C]) {
+    const __m512i flip = _mm512_set1_epi8((char)0x80);
+    __m512i half[R][C][2];
+#pragma GCC unroll 2
+    for (int h = 0; h < 2; h++) {
+        __m512i quad[R][C][2];
+#pragma GCC unroll 2
+        for (int q = 0; q < 2; q++) {
+            __m512i dots[R][C][2];
+#pragma GCC unroll 2
+            for (int s = 0; s < 2; s++) {
+                int pair = 4 * h + 2 * q + s;
+                __m512i w[R];
+#pragma GCC unroll 4
+                for (int r = 0; r < R; r++) {
+                    w[r] = _mm512_xor_si512(load_pair(x[r] + 2 * pair), flip);
+                }
+#pragma GCC unroll 4
+                for (int c = 0; c < C; c++) {
+                    __m512i yv = y[c].qs(pair);
+                    __m512i start = y[c].bias(pair, yv);
+#pragma GCC unroll 4
+                    for (int r = 0; r < R; r++) {
+                        dots[r][c][s] = _mm512_dpbusd_epi32(start, w[r], yv);
+                    }
+                }
+            }
+#pragma GCC unroll 4
+            for (int r = 0; r < R; r++) {
+#pragma GCC unroll 4
+                for (int c = 0; c < C; c++) {
+                    quad[r][c][q] = fold32(dots[r][c][0], dots[r][c][1]);
+                }
+            }
+        }
+#pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+#pragma GCC unroll 4
+            for (int c = 0; c < C; c++) {
+                half[r][c][h] = fold64(quad[r][c][0], quad[r][c][1]);
+            }
+        }
+    }
+
+    __m512 dy[C];
+#pragma GCC unroll 4
+    for (int c = 0; c < C; c++) {
+        dy[c] = y[c].d();
+    }
+#pragma GCC unroll 4
+    for (int r = 0; r < R; r++) {
+        __m512 dx = load_scales(x[r]);
+#pragma GCC unroll 4
+        for (int c = 0; c < C; c++) {
+            __m512i sums = block_sums(half[r][c][0], half[r][c][1]);
+            acc[r][c] = _mm512_fmadd_ps(_mm512_cvtepi32_ps(sums), _mm512_mul_ps(dx, dy[c]), acc[r][c]);
+        }
+    }
+}
+
+// Rows rows[0 .. R) of nb blocks against prepared activations act[0 .. C):
+// out[r][c] = dot
+template <int R, int C>
+static void q8_tile(const block_q8_0* const* rows, const Q8Activation* act, int nb, float (&out)[R][C]) {
+    __m512 acc[R][C];
+    for (int r = 0; r < R; r++) {
+        for (int c = 0; c < C; c++) {
+            acc[r][c] = _mm512_setzero_ps();
+        }
+    }
+
+    int full = nb / GROUP;
+    PreparedY y[C];
+    for (int c = 0; c < C; c++) {
+        y[c].act = &act[c];
+    }
+    const block_q8_0* x[R];
+    for (int g = 0; g < full; g++) {
+        for (int r = 0; r < R; r++) {
+            x[r] = rows[r] + (size_t)g * GROUP;
+        }
+        for (int c = 0; c < C; c++) {
+            y[c].group = g;
+        }
+        q8_group<R, C>(x, y, acc);
+    }
+
+    if (nb > full * GROUP) {
+        block_q8_0 padded[R][GROUP];
+        memset(padded, 0, sizeof(padded));
+        for (int r = 0; r < R; r++) {
+            memcpy(padded[r], rows[r] + (size_t)full * GROUP, (nb - full * GROUP) * sizeof(block_q8_0));
+            x[r] = padded[r];
+        }
+        for (int c = 0; c < C; c++) {
+            y[c].group = full;
+        }
+        q8_group<R, C>(x, y, acc);
+    }
+
+    for (int r = 0; r < R; r++) {
+        for (int c = 0; c < C; c++) {
+            out[r][c] = reduce_lanes(acc[r][c]);
+        }
+    }
+}
+
+float q8_0_dot(const block_q8_0* x, const block_q8_0* y, int nb) {
+    __m512 acc[1][1] = {{_mm512_setzero_ps()}};
+    int full = nb / GROUP;
+    for (int g = 0; g < full; g++) {
+        const block_q8_0* xg = x + (size_t)g * GROUP;
+        RawY yg = {y + (size_t)g * GROUP};
+        q8_group<1, 1>(&xg, &yg, acc);
+    }
+    int tail = nb - full * GROUP;
+    if (tail > 0) {
+        block_q8_0 px[GROUP];
+        block_q8_0 py[GROUP];
+        memset(px, 0, sizeof(px));
+        memset(py, 0, sizeof(py));
+        memcpy(px, x + (size_t)full * GROUP, tail * sizeof(block_q8_0));
+        memcpy(py, y + (size_t)full * GROUP, tail * sizeof(block_q8_0));
+        const block_q8_0* xg = px;
+        RawY yg = {py};
+        q8_group<1, 1>(&xg, &yg, acc);
+    }
+    return reduce_lanes(acc[0][0]);
+}
+
+struct Q8Job {
+    const char* w;
+    size_t row_bytes;
+    int rows;
+    const Q8Activation* act;
+    int cols;
+    int nb;
+    float* out;
+    int ldo;
+    int chunk;          // Rows per task
+};
+
+static inline const block_q8_0* row_at(const Q8Job* job, int r) {
+    return (const block_q8_0*)(job->w + (size_t)r * job->row_bytes);
+}
+
+static void gemv_task(void* arg, int task) {
+    const Q8Job* job = (const Q8Job*)arg;
+    int r0 = task * job->chunk;
+    int r1 = min_int(r0 + job->chunk, job->rows);
+    int r = r0;
+    for (; r + GEMV_ROWS <= r1; r += GEMV_ROWS) {
+        const block_q8_0* rows[GEMV_ROWS];
+        for (int i = 0; i < GEMV_ROWS; i++) {
+            rows[i] = row_at(job, r + i);
+        }
+        float out[GEMV_ROWS][1];
+        q8_tile<GEMV_ROWS, 1>(rows, job->act, job->nb, out);
+        for (int i = 0; i < GEMV_ROWS; i++) {
+            job->out[r + i] = out[i][0];
+        }
+    }
+    for (; r < r1; r++) {
+        const block_q8_0* rows[1] = {row_at(job, r)};
+        float out[1][1];
+        q8_tile<1, 1>(rows, job->act, job->nb, out);
+        job->out[r] = out[0][0];
+    }
+}
+
+template <int C>
+static inline void gemm_cols(const Q8Job* job, int r, int c) {
+    const block_q8_0* rows[1] = {row_at(job, r)};
+    float out[1][C];
+    q8_tile<1, C>(rows, job->act + c, job->nb, out);
+    for (int i = 0; i < C; i++) {
+        job->out[(size_t)(c + i) * job->ldo + r] = out[0][i];
+    }
+}
+
+// Each weight row is read from memory once and kept in L1 while it
+// meets every activation vector, GEMM_COLS at a time
+static void gemm_task(void* arg, int task) {
+    const Q8Job* job = (const Q8Job*)arg;
+    int r0 = task * job->chunk;
+    int r1 = min_int(r0 + job->chunk, job->rows);
+    for (int r = r0; r < r1; r++) {
+        int c = 0;
+        for (; c + GEMM_COLS <= job->cols; c += GEMM_COLS) {
+            gemm_cols<GEMM_COLS>(job, r, c);
+        }
+        switch (job->cols - c) {
+            case 3: gemm_cols<3>(job, r, c); break;
+            case 2: gemm_cols<2>(job, r, c); break;
+            case 1: gemm_cols<1>(job, r, c); break;
+            default: break;
+        }
+    }
+}
+
+static void run_rows(Q8Job* job, PoolTask fn) {
+    size_t bytes = (size_t)job->rows * job->nb * sizeof(block_q8_0) * (job->cols > 1 ? job->cols : 1);
+    int threads = bytes >= QUANT_PARALLEL_BYTES ? compute_pool_threads() : 1;
+    job->chunk = task_chunk(job->rows, threads, GEMV_ROWS);
+    int tasks = (job->rows + job->chunk - 1) / job->chunk;
+    if (threads > 1) {
+        compute_pool_run(fn, job, tasks);
+    } else {
+        for (int task = 0; task < tasks; task++) {
+            fn(job, task);
+        }
+    }
+}
+
+void q8_0_gemv(const void* w, size_t row_bytes, int rows, const block_q8_0* y, int nb, float* out) {
+    if (rows <= 0) {
+        return;
+    }
+    void* buffer = scratch_get(prepared_size(nb));
+    if (!buffer || nb <= 0) {
+        for (int r = 0; r < rows; r++) {
+            out[r] = q8_0_dot((const block_q8_0*)((const char*)w + (size_t)r * row_bytes), y, nb);
+        }
+        return;
+    }
+    Q8Activation act = prepare(y, nb, buffer);
+    Q8Job job = {(const char*)w, row_bytes, rows, &act, 1, nb, out, rows, 0};
+    run_rows(&job, gemv_task);
+}
+
+void q8_0_gemm(const void* w, size_t row_bytes, int rows, const void* y, size_t y_bytes,
+               int cols, int nb, float* out, int ldo) {
+    if (rows <= 0 || cols <= 0) {
+        return;
+    }
+    size_t per_col = prepared_size(nb);
+    char* buffer = (char*)scratch_get(per_col * cols + cols * sizeof(Q8Activation));
+    if (!buffer || nb <= 0) {
+        for (int c = 0; c < cols; c++) {
+            for (int r = 0; r < rows; r++) {
+                out[(size_t)c * ldo + r] = q8_0_dot((const block_q8_0*)((const char*)w + (size_t)r * row_bytes),
+                                                    (const block_q8_0*)((const char*)y + (size_t)c * y_bytes), nb);
+            }
+        }
+        return;
+    }
+    Q8Activation* act = (Q8Activation*)(buffer + per_col * cols);
+    for (int c = 0; c < cols; c++) {
+        act[c] = prepare((const block_q8_0*)((const char*)y + (size_t)c * y_bytes), nb, buffer + per_col * c);
+    }
+    Q8Job job = {(const char*)w, row_bytes, rows, act, cols, nb, out, ldo, 0};
+    run_rows(&job, gemm_task);
+}
+
+} // namespace zen5_turbo
+
+extern "C" float zen5_q8_0_dot(const void* x, const void* y, int nb) {
+    return zen5_turbo::q8_0_dot((const zen5_turbo::block_q8_0*)x, (const zen5_turbo::block_q8_0*)y, nb);
+}
+
+extern "C" void zen5_q8_0_gemv(const void* w, size_t row_bytes, int rows, const void* y, int nb, float* out) {
+    zen5_turbo::q8_0_gemv(w, row_bytes, rows, (const zen5_turbo::block_q8_0*)y, nb, out);
+}
+
+extern "C" void zen5_q8_0_gemm(const void* w, size_t row_bytes, int rows, const void* y, size_t y_bytes,
+                               int cols, int nb, float* out, int ldo) {
+    zen5_turbo::q8_0_gemm(w, row_bytes, rows, y, y_bytes, cols, nb, out, ldo);
+}
@@ -0,0 +1,43 @@
+/*
+ * q8_0.h
+ *
+ * Q8_0 x Q8_0 kernels on AVX-512 VNNI. vpdpbusd multiplies unsigned by
+ * signed bytes, so weights are offset to unsigned (x + 128) and the
+ * excess, 128 * sum(y), is cancelled by starting each accumulator at
+ * -128 * sum(y) for its four bytes: the integer dot of every block is
+ * exact, including -128. GEMV and small-batch GEMM precompute those
+ * starting values once per activation vector and share them across
+ * all weight rows; weight rows are streamed 16 blocks (544 bytes) per
+ * step, several rows (GEMV) or activation vectors (GEMM) at a time.
+ *
+ * Results are bit-identical between the three entry points and to a
+ * scalar reference: block b's integer dot, times fp32(dx_b) * fp32(dy_b),
+ * is accumulated with FMA into lane b % 16, and the 16 lanes are summed
+ * as (i, i + 8), then (i, i + 4), (i, i + 2), (0, 1).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "ggml_blocks.h"
+
+namespace zen5_turbo {
+
+// Dot product of nb blocks of x (weights) and y (activations)
+float q8_0_dot(const block_q8_0* x, const block_q8_0* y, int nb);
+
+// out[r] = dot(row r, y) for rows of nb blocks, row r at w + r * row_bytes
+void q8_0_gemv(const void* w, size_t row_bytes, int rows, const block_q8_0* y, int nb, float* out);
+
+// out[c * ldo + r] = dot(row r, activation c) for cols activation
+// vectors, vector c at y + c * y_bytes
+void q8_0_gemm(const void* w, size_t row_bytes, int rows, const void* y, size_t y_bytes,
+               int cols, int nb, float* out, int ldo);
+
+} // namespace zen5_turbo
+
+// C entry points for tests and tools (dlsym)
+extern "C" float zen5_q8_0_dot(const void* x, const void* y, int nb);
+extern "C" void zen5_q8_0_gemv(const void* w, size_t row_bytes, int rows, const void* y, int nb, float* out);
+extern "C" void zen5_q8_0_gemm(const void* w, size_t row_bytes, int rows, const void* y, size_t y_bytes,
+                               int cols, int nb, float* out, int ldo);
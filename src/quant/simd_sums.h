@@ -0,0 +1,27 @@
+/*
+ * simd_sums.h
+ *
+ * Horizontal int32 sums shared by the quantized kernels. Each fold adds
+ * the low and high halves of every 128-bit lane of two vectors and
+ * interleaves the results, so folding the partial dot products of
+ * several blocks leaves one lane per block without a reduction per
+ * block.
+ */
+
+#pragma once
+
+#include <immintrin.h>
+
+namespace zen5_turbo {
+
+// Within each 128-bit lane: [a0+a2, b0+b2, a1+a3, b1+b3]
+static inline __m512i fold32(__m512i a, __m512i b) {
+    return _mm512_add_epi32(_mm512_unpacklo_epi32(a, b), _mm512_unpackhi_epi32(a, b));
+}
+
+// Within each 128-bit lane: [a0+a2, a1+a3, b0+b2, b1+b3]
+static inline __m512i fold64(__m512i a, __m512i b) {
+    return _mm512_add_epi32(_mm512_unpacklo_epi64(a, b), _mm512_unpackhi_epi64(a, b));
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,138 @@
+/*
+ * compute_pool.cpp
+ *
+ * Persistent worker pool. A run publishes the job under state_lock and
+ * bumps the generation; every worker wakes, takes tasks from a shared
+ * counter until none are left and checks out, the last one waking the
+ * caller. Workers are started by this library, so thread_pinning leaves
+ * them on the affinity the process started with.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <atomic>
+
+#include "compute_pool.h"
+#include "../topology.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static int pool_threads = 1;
+static int workers = 0;                 // Started workers (pool_threads - 1 if all started)
+
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;    // Held for a whole run
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long generation = 0;
+static int active = 0;                  // Workers still in the current run
+
+static PoolTask job_fn;
+static void* job_arg;
+static int job_tasks;
+static std::atomic<int> next_task;
+
+static void run_tasks() {
+    for (;;) {
+        int task = next_task.fetch_add(1, std::memory_order_relaxed);
+        if (task >= job_tasks) {
+            return;
+        }
+        job_fn(job_arg, task);
+    }
+}
+
+static void* worker_main(void*) {
+    unsigned long seen = 0;
+    pthread_mutex_lock(&state_lock);
+    for (;;) {
+        while (generation == seen) {
+            pthread_cond_wait(&start_cond, &state_lock);
+        }
+        seen = generation;
+        pthread_mutex_unlock(&state_lock);
+
+        run_tasks();
+
+        pthread_mutex_lock(&state_lock);
+        if (--active == 0) {
+            pthread_cond_signal(&done_cond);
+        }
+    }
+    return nullptr;
+}
+
+// The workers are not copied into a forked child: it runs inline
+static void pool_forked() {
+    workers = 0;
+}
+
+static void pool_start() {
+    const Topology* topology = topology_get();
+    int cores = 0;
+    for (int d = 0; d < topology->ccd_count; d++) {
+        cores += topology->ccds[d].allowed_cores;
+    }
+    long threads = env_long("ZEN5_COMPUTE_THREADS", cores > 0 ? cores : 1);
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_COMPUTE_THREADS) {
+        threads = MAX_COMPUTE_THREADS;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 1; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, worker_main, nullptr) != 0) {
+            DEBUG_PRINT("Compute pool: only %d of %ld threads started", i, threads);
+            break;
+        }
+        workers++;
+    }
+    pthread_attr_destroy(&attr);
+    pool_threads = workers + 1;
+    pthread_atfork(nullptr, nullptr, pool_forked);
+    DEBUG_PRINT("Compute pool: %d threads", pool_threads);
+}
+
+int compute_pool_threads() {
+    pthread_once(&pool_once, pool_start);
+    return workers + 1;
+}
+
+void compute_pool_run(PoolTask fn, void* arg, int tasks) {
+    pthread_once(&pool_once, pool_start);
+    if (workers == 0 || tasks < 2 || pthread_mutex_trylock(&run_lock) != 0) {
+        for (int task = 0; task < tasks; task++) {
+            fn(arg, task);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&state_lock);
+    job_fn = fn;
+    job_arg = arg;
+    job_tasks = tasks;
+    next_task.store(0, std::memory_order_relaxed);
+    active = workers;
+    generation++;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&state_lock);
+
+    run_tasks();
+
+    pthread_mutex_lock(&state_lock);
+    while (active > 0) {
+        pthread_cond_wait(&done_cond, &state_lock);
+    }
+    pthread_mutex_unlock(&state_lock);
+    pthread_mutex_unlock(&run_lock);
+}
+
+} // namespace zen5_turbo
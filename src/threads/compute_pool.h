@@ -0,0 +1,26 @@
+/*
+ * compute_pool.h
+ *
+ * Worker threads for the library's own kernels (BLAS). Created on first
+ * use, one per allowed physical core by default (ZEN5_COMPUTE_THREADS
+ * overrides), and kept asleep between calls so a prefill that issues
+ * hundreds of GEMMs pays the thread start-up once. The calling thread
+ * runs tasks too.
+ */
+
+#pragma once
+
+namespace zen5_turbo {
+
+// Called once per task, on any thread of the pool
+typedef void (*PoolTask)(void* arg, int task);
+
+// Threads taking part in compute_pool_run(), the caller included
+int compute_pool_threads();
+
+// Run task 0 .. tasks - 1 of fn across the pool and return when all
+// are done. One run at a time: a call made while the pool is busy
+// (another thread, or from inside a task) runs its tasks inline.
+void compute_pool_run(PoolTask fn, void* arg, int tasks);
+
+} // namespace zen5_turbo
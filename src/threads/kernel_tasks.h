@@ -0,0 +1,49 @@
+/*
+ * kernel_tasks.h
+ *
+ * Pieces shared by the kernels that run on the compute pool: the split
+ * of rows into pool tasks and a per-thread scratch buffer for inputs
+ * converted or repacked before the tasks start.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+
+namespace zen5_turbo {
+
+static inline int min_int(int a, int b) {
+    return a < b ? a : b;
+}
+
+// Rows per task when rows are split across threads: four tasks per
+// thread so a slow core does not hold up the others, rounded up to
+// whole units (the kernel's tile)
+static inline int task_chunk(int rows, int threads, int unit) {
+    int chunk = (rows + 4 * threads - 1) / (4 * threads);
+    return (chunk + unit - 1) / unit * unit;
+}
+
+// Per-thread scratch, 64-byte aligned, grown on demand and freed when
+// the thread exits; nullptr when it cannot grow. Each file including
+// this header has its own buffer, so one kernel's scratch is never
+// overwritten by another's.
+struct ScratchBuffer {
+    void* data = nullptr;
+    size_t size = 0;
+    ~ScratchBuffer() {
+        free(data);
+    }
+};
+
+static inline void* scratch_get(size_t size) {
+    static thread_local ScratchBuffer scratch;
+    if (scratch.size < size) {
+        free(scratch.data);
+        scratch.data = aligned_alloc(64, (size + 63) / 64 * 64);
+        scratch.size = scratch.data ? size : 0;
+    }
+    return scratch.data;
+}
+
+} // namespace zen5_turbo
@@ -0,0 +1,330 @@
+/*
+ * thread_pinning.cpp
+ *
+ * pthread_create() interposition for compute thread placement.
+ *
+ * A new thread is classified by the object its start routine lives in
+ * (dladdr): ggml's thread pool and libgomp/libomp workers are compute
+ * threads, threads started by this library (loaders) keep the affinity
+ * the process started with, the rest are service threads. Compute
+ * threads take the lowest free slot of the compute order and give it
+ * back when they exit, so a thread pool that is torn down and recreated
+ * lands on the same cores again. Pinning is done by the new thread
+ * itself before it runs the caller's routine. Forked children start
+ * over with the affinity the process started with.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "thread_pinning.h"
+#include "../config.h"
+#include "../env.h"
+
+namespace zen5_turbo {
+
+typedef int (*pthread_create_fn)(pthread_t*, const pthread_attr_t*, void* (*)(void*), void*);
+
+static pthread_create_fn real_pthread_create = nullptr;
+static bool pinning_ready = false;
+static int compute_order[MAX_TOPOLOGY_CPUS];
+static int compute_count = 0;
+static unsigned char slot_used[MAX_TOPOLOGY_CPUS];
+static cpu_set_t service_mask;
+static cpu_set_t process_mask;      // Affinity before the main thread was pinned
+static char compute_match[256];
+
+struct PinnedStart {
+    void* (*start)(void*);
+    void* arg;
+    int slot;               // Compute slot to release on exit, or -1
+    cpu_set_t mask;
+};
+
+PinPolicy pin_policy() {
+    const char* policy = env_str("ZEN5_AFFINITY", "off");
+    if (strcasecmp(policy, "compact") == 0) {
+        return PIN_COMPACT;
+    }
+    if (strcasecmp(policy, "spread") == 0) {
+        return PIN_SPREAD;
+    }
+    if (strcasecmp(policy, "physical") == 0) {
+        return PIN_PHYSICAL;
+    }
+    return PIN_OFF;
+}
+
+const char* pin_policy_name(PinPolicy policy) {
+    switch (policy) {
+        case PIN_COMPACT:  return "compact";
+        case PIN_SPREAD:   return "spread";
+        case PIN_PHYSICAL: return "physical";
+        default:           return "off";
+    }
+}
+
+int pin_order(const Topology* topology, PinPolicy policy, const bool* exclude,
+              int* order, int max) {
+    // Rank of each core within its CCD, for spread
+    static int core_rank[MAX_TOPOLOGY_CPUS];
+    int ccd_cores[MAX_TOPOLOGY_CCDS] = {};
+    for (int i = 0; i < topology->core_count; i++) {
+        core_rank[i] = -1;
+    }
+    for (int i = 0; i < topology->cpu_count; i++) {
+        const TopologyCpu* c = &topology->cpus[i];
+        if (core_rank[c->core] < 0) {
+            core_rank[c->core] = ccd_cores[c->ccd]++;
+        }
+    }
+
+    // Sort keys, most significant first
+    static long keys[MAX_TOPOLOGY_CPUS];
+    int count = 0;
+    for (int i = 0; i < topology->cpu_count && count < max; i++) {
+        const TopologyCpu* c = &topology->cpus[i];
+        if (!c->allowed || (exclude && exclude[c->id])) {
+            continue;
+        }
+        long key;
+        if (policy == PIN_COMPACT) {
+            key = ((long)c->ccd << 40) | ((long)c->smt << 30) | ((long)c->core << 12);
+        } else if (policy == PIN_SPREAD) {
+            key = ((long)c->smt << 40) | ((long)core_rank[c->core] << 24) | ((long)c->ccd << 12);
+        } else {
+            key = ((long)c->smt << 40) | ((long)c->core << 12);
+        }
+        key |= c->id;
+
+        // Insertion sort: a few dozen CPUs, once per process
+        int pos = count++;
+        while (pos > 0 && keys[pos - 1] > key) {
+            keys[pos] = keys[pos - 1];
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        keys[pos] = key;
+        order[pos] = c->id;
+    }
+    return count;
+}
+
+// Lowest free compute slot; once every slot is taken the threads share
+// them round-robin (*owned false: the slot is not released on exit)
+static int take_slot(bool* owned) {
+    *owned = true;
+    for (int slot = 0; slot < compute_count; slot++) {
+        unsigned char expected = 0;
+        if (__atomic_compare_exchange_n(&slot_used[slot], &expected, 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return slot;
+        }
+    }
+    static int overflow = 0;
+    *owned = false;
+    return __atomic_fetch_add(&overflow, 1, __ATOMIC_RELAXED) % compute_count;
+}
+
+static void release_slot(void* slot) {
+    __atomic_store_n(&slot_used[(long)slot], 0, __ATOMIC_RELEASE);
+}
+
+// A child runs on whatever thread forked it, usually the pinned main
+// thread: give it back the original mask (kept across exec) and free
+// the slots of the threads that did not follow it
+static void restore_child_affinity() {
+    sched_setaffinity(0, sizeof(process_mask), &process_mask);
+    memset(slot_used, 0, sizeof(slot_used));
+}
+
+// Start routine in ggml or an OpenMP runtime (ZEN5_COMPUTE_MATCH);
+// sets *own for threads of this library
+static bool is_compute_thread(void* (*start)(void*), bool* own) {
+    Dl_info info;
+    Dl_info self;
+    *own = false;
+    if (dladdr((void*)start, &info) == 0) {
+        return false;
+    }
+    if (dladdr((void*)&is_compute_thread, &self) != 0 && info.dli_fbase == self.dli_fbase) {
+        *own = true;
+        return false;
+    }
+
+    const char* object = info.dli_fname ? strrchr(info.dli_fname, '/') : nullptr;
+    object = object ? object + 1 : (info.dli_fname ? info.dli_fname : "");
+    const char* symbol = info.dli_sname ? info.dli_sname : "";
+
+    char patterns[sizeof(compute_match)];
+    memcpy(patterns, compute_match, sizeof(patterns));
+    char* save = nullptr;
+    for (char* p = strtok_r(patterns, ",", &save); p; p = strtok_r(nullptr, ",", &save)) {
+        if (*p && (strstr(object, p) || strstr(symbol, p))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* pinned_thread_start(void* param) {
+    PinnedStart start = *(PinnedStart*)param;
+    free(param);
+
+    sched_setaffinity(0, sizeof(start.mask), &start.mask);
+    if (start.slot < 0) {
+        return start.start(start.arg);
+    }
+
+    void* result;
+    pthread_cleanup_push(release_slot, (void*)(long)start.slot);
+    result = start.start(start.arg);
+    pthread_cleanup_pop(1);
+    return result;
+}
+
+static void log_cpus(const char* what, const int* cpus, int count) {
+    char line[512] = "";
+    size_t used = 0;
+    for (int i = 0; i < count && used < sizeof(line); i++) {
+        used += snprintf(line + used, sizeof(line) - used, i ? ",%d" : "%d", cpus[i]);
+    }
+    DEBUG_PRINT("%s: %s", what, line);
+}
+
+void thread_pinning_init() {
+    real_pthread_create = (pthread_create_fn)dlsym(RTLD_NEXT, "pthread_create");
+    PinPolicy policy = pin_policy();
+    if (policy == PIN_OFF || !real_pthread_create) {
+        return;
+    }
+
+    const Topology* topology = topology_get();
+    static bool service[MAX_TOPOLOGY_CPUS];
+    int service_cpus[MAX_TOPOLOGY_CPUS];
+    int service_count = 0;
+
+    // Service CPUs: ZEN5_SERVICE_CPUS (taken out of the compute order),
+    // else the SMT siblings, else the last compute CPU
+    const char* list = env_str("ZEN5_SERVICE_CPUS", nullptr);
+    bool reserved = list && parse_cpulist(list, service, MAX_TOPOLOGY_CPUS) > 0;
+    if (list && !reserved) {
+        fprintf(stderr, "[%s] ERROR: Invalid ZEN5_SERVICE_CPUS '%s'\n", ZEN5_OPTIMIZER_NAME, list);
+        memset(service, 0, sizeof(service));
+    }
+    compute_count = pin_order(topology, policy, reserved ? service : nullptr,
+                              compute_order, MAX_TOPOLOGY_CPUS);
+    if (compute_count == 0) {
+        fprintf(stderr, "[%s] ERROR: No CPUs left for compute threads, pinning disabled\n",
+                ZEN5_OPTIMIZER_NAME);
+        return;
+    }
+    if (!reserved) {
+        for (int i = 0; i < topology->cpu_count; i++) {
+            const TopologyCpu* c = &topology->cpus[i];
+            if (c->allowed && c->smt > 0) {
+                service[c->id] = true;
+            }
+        }
+    }
+
+    CPU_ZERO(&service_mask);
+    for (int cpu = 0; cpu < MAX_TOPOLOGY_CPUS && cpu < CPU_SETSIZE; cpu++) {
+        if (service[cpu]) {
+            CPU_SET(cpu, &service_mask);
+            service_cpus[service_count++] = cpu;
+        }
+    }
+    if (service_count == 0) {
+        service_cpus[service_count++] = compute_order[compute_count - 1];
+        CPU_SET(service_cpus[0], &service_mask);
+    }
+
+    const char* match = env_str("ZEN5_COMPUTE_MATCH", "ggml,gomp,omp");
+    snprintf(compute_match, sizeof(compute_match), "%s", match);
+
+    // ggml runs compute thread 0 on the thread that calls into it
+    sched_getaffinity(0, sizeof(process_mask), &process_mask);
+    if (env_flag("ZEN5_PIN_MAIN", true)) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        bool owned;
+        CPU_SET(compute_order[take_slot(&owned)], &mask);
+        sched_setaffinity(0, sizeof(mask), &mask);
+    }
+    pthread_atfork(nullptr, nullptr, restore_child_affinity);
+
+    fprintf(stderr, "[%s] Thread pinning: %s, %d compute CPUs, %d service CPUs\n",
+            ZEN5_OPTIMIZER_NAME, pin_policy_name(policy), compute_count, service_count);
+    log_cpus("Compute CPU order", compute_order, compute_count);
+    log_cpus("Service CPUs", service_cpus, service_count);
+    __atomic_store_n(&pinning_ready, true, __ATOMIC_RELEASE);
+}
+
+} // namespace zen5_turbo
+
+extern "C" int zen5_pin_order(const zen5_turbo::Topology* topology, const char* policy,
+                              int* order, int max) {
+    using namespace zen5_turbo;
+    PinPolicy kind = PIN_PHYSICAL;
+    if (strcasecmp(policy, "compact") == 0) {
+        kind = PIN_COMPACT;
+    } else if (strcasecmp(policy, "spread") == 0) {
+        kind = PIN_SPREAD;
+    }
+    return pin_order(topology, kind, nullptr, order, max);
+}
+
+// Our intercepted pthread_create: compute threads get their own CPU
+extern "C" int pthread_create(pthread_t* thread, const pthread_attr_t* attr,
+                              void* (*start_routine)(void*), void* arg) {
+    using namespace zen5_turbo;
+
+    if (!real_pthread_create) {
+        real_pthread_create = (pthread_create_fn)dlsym(RTLD_NEXT, "pthread_create");
+    }
+    if (!__atomic_load_n(&pinning_ready, __ATOMIC_ACQUIRE)) {
+        return real_pthread_create(thread, attr, start_routine, arg);
+    }
+
+    bool own;
+    bool compute = is_compute_thread(start_routine, &own);
+
+    PinnedStart* start = (PinnedStart*)malloc(sizeof(PinnedStart));
+    if (!start) {
+        return real_pthread_create(thread, attr, start_routine, arg);
+    }
+    start->start = start_routine;
+    start->arg = arg;
+    start->slot = -1;
+    if (compute) {
+        bool owned;
+        int slot = take_slot(&owned);
+        if (owned) {
+            start->slot = slot;
+        }
+        CPU_ZERO(&start->mask);
+        CPU_SET(compute_order[slot], &start->mask);
+        DEBUG_PRINT("Compute thread pinned to CPU %d", compute_order[slot]);
+    } else {
+        // Our loaders must not inherit the main thread's single CPU
+        start->mask = own ? process_mask : service_mask;
+    }
+
+    int rc = real_pthread_create(thread, attr, pinned_thread_start, start);
+    if (rc != 0) {
+        if (start->slot >= 0) {
+            release_slot((void*)(long)start->slot);
+        }
+        free(start);
+    }
+    return rc;
+}
@@ -0,0 +1,51 @@
+/*
+ * thread_pinning.h
+ *
+ * CCD-aware placement of compute threads. pthread_create() is
+ * intercepted; threads whose start routine belongs to ggml or an OpenMP
+ * runtime (ZEN5_COMPUTE_MATCH) get a CPU of their own, in an order set
+ * by ZEN5_AFFINITY:
+ *
+ *   off       no pinning (default)
+ *   compact   fill one CCD (cores, then their SMT siblings) before the next
+ *   spread    alternate CCDs core by core, SMT siblings last
+ *   physical  every physical core in CPU order, SMT siblings last
+ *
+ * The main thread, which ggml uses as compute thread 0, takes the first
+ * CPU. Every other thread (HTTP, loaders of the application) is kept on
+ * the service CPUs: ZEN5_SERVICE_CPUS, else the SMT siblings in the
+ * cpuset, else the last CPU of the compute order.
+ */
+
+#pragma once
+
+#include "../topology.h"
+
+namespace zen5_turbo {
+
+enum PinPolicy {
+    PIN_OFF,
+    PIN_COMPACT,
+    PIN_SPREAD,
+    PIN_PHYSICAL
+};
+
+// Policy named by ZEN5_AFFINITY
+PinPolicy pin_policy();
+
+const char* pin_policy_name(PinPolicy policy);
+
+// Compute CPU order of a policy: the allowed CPUs of topology that are
+// not in exclude (indexed by CPU id, may be nullptr). Returns the count.
+int pin_order(const Topology* topology, PinPolicy policy, const bool* exclude,
+              int* order, int max);
+
+// Build the compute order and service set, pin the main thread and
+// log the plan. Called once from the library constructor.
+void thread_pinning_init();
+
+} // namespace zen5_turbo
+
+// C entry point of pin_order() for tests and tools (dlsym); policy by name
+extern "C" int zen5_pin_order(const zen5_turbo::Topology* topology, const char* policy,
+                              int* order, int max);
@@ -0,0 +1,460 @@
+/*
+ * topology.cpp
+ *
+ * CPU topology discovery from sysfs and CPUID.
+ *
+ * Cores are grouped by thread_siblings_list and CCDs by the CPUs sharing
+ * an L3 (cache/index3/shared_cpu_list); on Zen 5 every CCD is a single
+ * CCX, and where CPUID 0x80000026 reports more complexes per die the
+ * L3 groups are merged back into their CCD. Nothing but the files under
+ * the given root is read for a recorded tree, so a captured
+ * /sys/devices/system/{cpu,node} reproduces another machine exactly.
+ */
+
+#include "topology.h"
+#include "config.h"
+#include "env.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __x86_64__
+#include <cpuid.h>
+#endif
+
+namespace zen5_turbo {
+
+static Topology process_topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+// Read root/path into buf, stripping the trailing newline
+static bool read_sysfs(const char* root, const char* path, char* buf, size_t size) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE* f = fopen(full, "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fgets(buf, (int)size, f) != nullptr;
+    fclose(f);
+    if (ok) {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+    return ok;
+}
+
+int parse_cpulist(const char* list, bool* set, int max) {
+    memset(set, 0, max * sizeof(bool));
+    int count = 0;
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < max; cpu++) {
+            count += !set[cpu];
+            set[cpu] = true;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+// Lowest CPU of a cpulist, or -1
+static int first_cpu(const char* list) {
+    char* end;
+    long cpu = strtol(list, &end, 10);
+    return (end == list) ? -1 : (int)cpu;
+}
+
+// Cache size as sysfs prints it ("1024K", "32768K")
+static size_t parse_size(const char* text) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (*end == 'K') {
+        value *= 1024;
+    } else if (*end == 'M') {
+        value *= 1024 * 1024;
+    }
+    return (size_t)value;
+}
+
+// L3 complexes per die from CPUID 0x80000026, 1 if unknown
+static int cpuid_ccx_per_ccd() {
+#ifdef __x86_64__
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000026) {
+        return 1;
+    }
+
+    unsigned int complex_cpus = 0;
+    unsigned int die_cpus = 0;
+    for (unsigned int level = 0; level < 8; level++) {
+        __cpuid_count(0x80000026, level, eax, ebx, ecx, edx);
+        unsigned int type = (ecx >> 8) & 0xFF;
+        if (type == 0) {
+            break;
+        }
+        if (type == 2) {            // Complex (CCX)
+            complex_cpus = ebx & 0xFFFF;
+        } else if (type == 3) {     // Die (CCD)
+            die_cpus = ebx & 0xFFFF;
+        }
+    }
+    if (complex_cpus > 0 && die_cpus > complex_cpus) {
+        return (int)(die_cpus / complex_cpus);
+    }
+#endif
+    return 1;
+}
+
+// Threads per core from CPUID 0x8000001E, 0 if unknown
+static int cpuid_threads_per_core() {
+#ifdef __x86_64__
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x8000001E) {
+        return 0;
+    }
+    __cpuid(0x8000001E, eax, ebx, ecx, edx);
+    return (int)((ebx >> 8) & 0xFF) + 1;
+#else
+    return 0;
+#endif
+}
+
+// Mark the allowed CPUs: the cpus list, the affinity mask of a live
+// process, or everything online
+static bool load_allowed(Topology* t, const char* cpus, bool* online) {
+    static bool allowed[MAX_TOPOLOGY_CPUS];
+    if (cpus) {
+        if (parse_cpulist(cpus, allowed, MAX_TOPOLOGY_CPUS) <= 0) {
+            fprintf(stderr, "[%s] ERROR: Invalid CPU list '%s'\n", ZEN5_OPTIMIZER_NAME, cpus);
+            return false;
+        }
+    } else if (t->live) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+            return false;
+        }
+        for (int cpu = 0; cpu < MAX_TOPOLOGY_CPUS; cpu++) {
+            allowed[cpu] = cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask);
+        }
+    } else {
+        memcpy(allowed, online, sizeof(allowed));
+    }
+
+    t->allowed_count = 0;
+    for (int i = 0; i < t->cpu_count; i++) {
+        t->cpus[i].allowed = allowed[t->cpus[i].id];
+        t->allowed_count += t->cpus[i].allowed;
+    }
+    return t->allowed_count > 0;
+}
+
+// Assign every CPU to a NUMA node (node 0 if the tree has none)
+static void load_nodes(const char* root, Topology* t) {
+    static bool present[MAX_TOPOLOGY_CPUS];
+    static bool members[MAX_TOPOLOGY_CPUS];
+    char buf[4096];
+    char path[128];
+
+    t->node_count = 0;
+    if (read_sysfs(root, "devices/system/node/online", buf, sizeof(buf)) &&
+        parse_cpulist(buf, present, MAX_TOPOLOGY_CPUS) > 0) {
+        for (int node = 0; node < MAX_TOPOLOGY_CPUS && t->node_count < MAX_TOPOLOGY_NODES; node++) {
+            if (!present[node]) {
+                continue;
+            }
+            TopologyNode* n = &t->nodes[t->node_count];
+            memset(n, 0, sizeof(*n));
+            n->id = node;
+
+            snprintf(path, sizeof(path), "devices/system/node/node%d/meminfo", node);
+            char full[512];
+            snprintf(full, sizeof(full), "%s/%s", root, path);
+            FILE* f = fopen(full, "r");
+            if (f) {
+                unsigned long long kb;
+                while (fgets(buf, sizeof(buf), f)) {
+                    const char* field = strstr(buf, "MemTotal:");
+                    if (field && sscanf(field, "MemTotal: %llu kB", &kb) == 1) {
+                        n->memory = (size_t)kb * 1024;
+                        break;
+                    }
+                }
+                fclose(f);
+            }
+
+            snprintf(path, sizeof(path), "devices/system/node/node%d/cpulist", node);
+            if (read_sysfs(root, path, buf, sizeof(buf)) && buf[0] &&
+                parse_cpulist(buf, members, MAX_TOPOLOGY_CPUS) > 0) {
+                for (int i = 0; i < t->cpu_count; i++) {
+                    if (members[t->cpus[i].id]) {
+                        t->cpus[i].node = t->node_count;
+                    }
+                }
+            }
+            t->node_count++;
+        }
+    }
+
+    if (t->node_count == 0) {
+        memset(&t->nodes[0], 0, sizeof(t->nodes[0]));
+        t->node_count = 1;
+    }
+    for (int i = 0; i < t->cpu_count; i++) {
+        TopologyNode* n = &t->nodes[t->cpus[i].node];
+        n->cpus++;
+        n->allowed_cpus += t->cpus[i].allowed;
+    }
+}
+
+bool topology_load(const char* root, const char* cpus, Topology* out) {
+    static bool online[MAX_TOPOLOGY_CPUS];
+    static int core_of[MAX_TOPOLOGY_CPUS];      // Core index by first sibling
+    static int group_of[MAX_TOPOLOGY_CPUS];     // L3 group by first sharer
+    static size_t group_l3[MAX_TOPOLOGY_CPUS];
+    static int ccd_core_seen[MAX_TOPOLOGY_CPUS];
+    char buf[4096];
+    char path[128];
+
+    memset(out, 0, sizeof(*out));
+    out->live = strcmp(root, "/sys") == 0;
+    out->ccx_per_ccd = out->live ? cpuid_ccx_per_ccd() : 1;
+
+    if (!read_sysfs(root, "devices/system/cpu/online", buf, sizeof(buf)) ||
+        parse_cpulist(buf, online, MAX_TOPOLOGY_CPUS) <= 0) {
+        DEBUG_PRINT("No CPU list under %s/devices/system/cpu", root);
+        return false;
+    }
+
+    for (int cpu = 0; cpu < MAX_TOPOLOGY_CPUS; cpu++) {
+        core_of[cpu] = -1;
+        group_of[cpu] = -1;
+        if (online[cpu]) {
+            TopologyCpu* c = &out->cpus[out->cpu_count++];
+            c->id = cpu;
+        }
+    }
+
+    // Cores and SMT position from the sibling lists
+    for (int i = 0; i < out->cpu_count; i++) {
+        TopologyCpu* c = &out->cpus[i];
+        int leader = c->id;
+        int siblings = 1;
+        snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/topology/thread_siblings_list", c->id);
+        if (read_sysfs(root, path, buf, sizeof(buf)) && first_cpu(buf) >= 0) {
+            static bool set[MAX_TOPOLOGY_CPUS];
+            siblings = parse_cpulist(buf, set, MAX_TOPOLOGY_CPUS);
+            leader = first_cpu(buf);
+            for (int cpu = leader; cpu < c->id; cpu++) {
+                c->smt += set[cpu];
+            }
+        }
+        if (leader < 0 || leader >= MAX_TOPOLOGY_CPUS) {
+            leader = c->id;
+        }
+        if (core_of[leader] < 0) {
+            core_of[leader] = out->core_count++;
+        }
+        c->core = core_of[leader];
+        if (siblings > out->threads_per_core) {
+            out->threads_per_core = siblings;
+        }
+    }
+    if (out->live && out->threads_per_core <= 1) {
+        // SMT disabled or siblings not exported: report the hardware width
+        int threads = cpuid_threads_per_core();
+        if (threads > 1) {
+            DEBUG_PRINT("SMT siblings offline (hardware has %d threads per core)", threads);
+        }
+    }
+
+    // L1d and L2 sizes and L3 sharing groups from the cache indexes
+    int groups = 0;
+    for (int i = 0; i < out->cpu_count; i++) {
+        TopologyCpu* c = &out->cpus[i];
+        int leader = -1;
+        size_t l3 = 0;
+        for (int index = 0; index < 8; index++) {
+            snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index%d/level", c->id, index);
+            if (!read_sysfs(root, path, buf, sizeof(buf))) {
+                continue;   // Recorded trees may keep only some indexes
+            }
+            int level = atoi(buf);
+            snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index%d/size", c->id, index);
+            size_t size = read_sysfs(root, path, buf, sizeof(buf)) ? parse_size(buf) : 0;
+            if (level == 1 && out->l1d_size == 0) {
+                snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index%d/type", c->id, index);
+                if (read_sysfs(root, path, buf, sizeof(buf)) && strncmp(buf, "Data", 4) == 0) {
+                    out->l1d_size = size;
+                }
+            } else if (level == 2 && out->l2_size == 0) {
+                out->l2_size = size;
+            } else if (level == 3) {
+                snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+                         c->id, index);
+                if (read_sysfs(root, path, buf, sizeof(buf))) {
+                    leader = first_cpu(buf);
+                    l3 = size;
+                }
+            }
+        }
+        if (leader < 0 || leader >= MAX_TOPOLOGY_CPUS) {
+            leader = 0;     // No L3 information: one shared group
+        }
+        if (group_of[leader] < 0) {
+            group_l3[groups] = l3;
+            group_of[leader] = groups++;
+        }
+        c->ccd = group_of[leader] / out->ccx_per_ccd;
+    }
+
+    out->ccd_count = (groups + out->ccx_per_ccd - 1) / out->ccx_per_ccd;
+    if (out->ccd_count > MAX_TOPOLOGY_CCDS) {
+        DEBUG_PRINT("%d CCDs exceed the supported %d", out->ccd_count, MAX_TOPOLOGY_CCDS);
+        return false;
+    }
+    for (int g = 0; g < groups; g++) {
+        out->ccds[g / out->ccx_per_ccd].l3_size += group_l3[g];
+    }
+
+    if (!load_allowed(out, cpus, online)) {
+        return false;
+    }
+    load_nodes(root, out);
+
+    // Per-CCD counts
+    for (int d = 0; d < out->ccd_count; d++) {
+        out->ccds[d].first_cpu = -1;
+    }
+    for (int core = 0; core < out->core_count; core++) {
+        ccd_core_seen[core] = 0;
+    }
+    for (int i = 0; i < out->cpu_count; i++) {
+        const TopologyCpu* c = &out->cpus[i];
+        TopologyCcd* d = &out->ccds[c->ccd];
+        if (d->first_cpu < 0) {
+            d->first_cpu = c->id;
+            d->node = c->node;
+        }
+        d->cpus++;
+        d->allowed_cpus += c->allowed;
+        if (!(ccd_core_seen[c->core] & 1)) {
+            d->cores++;
+        }
+        if (c->allowed && !(ccd_core_seen[c->core] & 2)) {
+            d->allowed_cores++;
+        }
+        ccd_core_seen[c->core] |= 1 | (c->allowed ? 2 : 0);
+    }
+    return true;
+}
+
+// One CCD of every allowed CPU, each its own core
+static void fallback_topology(Topology* t) {
+    static bool online[MAX_TOPOLOGY_CPUS];
+    memset(t, 0, sizeof(*t));
+    t->live = true;
+    t->ccx_per_ccd = 1;
+    t->threads_per_core = 1;
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int cpu = 0; cpu < count && cpu < MAX_TOPOLOGY_CPUS; cpu++) {
+        online[cpu] = true;
+        t->cpus[t->cpu_count].id = cpu;
+        t->cpus[t->cpu_count].core = t->cpu_count;
+        t->cpu_count++;
+    }
+    t->core_count = t->cpu_count;
+    if (!load_allowed(t, nullptr, online)) {
+        for (int i = 0; i < t->cpu_count; i++) {
+            t->cpus[i].allowed = true;
+        }
+        t->allowed_count = t->cpu_count;
+    }
+    t->ccd_count = 1;
+    t->node_count = 1;
+    t->ccds[0].cores = t->ccds[0].cpus = t->cpu_count;
+    t->ccds[0].allowed_cores = t->ccds[0].allowed_cpus = t->allowed_count;
+    t->nodes[0].cpus = t->cpu_count;
+    t->nodes[0].allowed_cpus = t->allowed_count;
+}
+
+static void load_process_topology() {
+    const char* root = env_str("ZEN5_SYSFS_ROOT", "/sys");
+    const char* cpus = env_str("ZEN5_CPUS", nullptr);
+    if (!topology_load(root, cpus, &process_topology)) {
+        fprintf(stderr, "[%s] ERROR: Cannot read CPU topology from %s, assuming one CCD\n",
+                ZEN5_OPTIMIZER_NAME, root);
+        fallback_topology(&process_topology);
+    }
+}
+
+const Topology* topology_get() {
+    pthread_once(&topology_once, load_process_topology);
+    return &process_topology;
+}
+
+int topology_cpu_index(const Topology* topology, int id) {
+    int low = 0;
+    int high = topology->cpu_count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (topology->cpus[mid].id == id) {
+            return mid;
+        }
+        if (topology->cpus[mid].id < id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+void topology_log(const Topology* topology) {
+    int allowed_ccds = 0;
+    for (int d = 0; d < topology->ccd_count; d++) {
+        allowed_ccds += topology->ccds[d].allowed_cpus > 0;
+    }
+    fprintf(stderr, "[%s] Topology: %d CCDs, %d cores, %d threads, %d NUMA nodes; "
+            "%d CPUs allowed on %d CCDs\n",
+            ZEN5_OPTIMIZER_NAME, topology->ccd_count, topology->core_count,
+            topology->cpu_count, topology->node_count, topology->allowed_count, allowed_ccds);
+
+    DEBUG_PRINT("L1d %zu KB and L2 %zu KB per core, %d threads per core, %d CCX per CCD",
+                topology->l1d_size / 1024, topology->l2_size / 1024, topology->threads_per_core, topology->ccx_per_ccd);
+    for (int d = 0; d < topology->ccd_count; d++) {
+        const TopologyCcd* ccd = &topology->ccds[d];
+        DEBUG_PRINT("CCD %d (from CPU %d, node %d): L3 %zu MB, %d/%d cores and %d/%d CPUs allowed",
+                    d, ccd->first_cpu, topology->nodes[ccd->node].id, ccd->l3_size / (1024 * 1024),
+                    ccd->allowed_cores, ccd->cores, ccd->allowed_cpus, ccd->cpus);
+    }
+}
+
+} // namespace zen5_turbo
+
+extern "C" bool zen5_topology_load(const char* root, const char* cpus,
+                                   zen5_turbo::Topology* out) {
+    return zen5_turbo::topology_load(root, cpus, out);
+}
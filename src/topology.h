@@ -0,0 +1,88 @@
+/*
+ * topology.h
+ *
+ * CPU topology model: CCDs, cores, SMT siblings, cache sizes and NUMA
+ * nodes, intersected with the CPUs the process may run on. Built from
+ * sysfs (any root, so recorded trees can be loaded) and, on live
+ * hardware, CPUID leaves 0x8000001E / 0x80000026. Every placement
+ * decision in the library starts from this.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace zen5_turbo {
+
+const int MAX_TOPOLOGY_CPUS = 1024;
+const int MAX_TOPOLOGY_CCDS = 64;
+const int MAX_TOPOLOGY_NODES = 32;
+
+struct TopologyCpu {
+    int id;             // Logical CPU number
+    int core;           // Index of its core (see Topology::core_count)
+    int smt;            // 0 for the first thread of the core, 1 for its sibling
+    int ccd;            // Index into Topology::ccds
+    int node;           // Index into Topology::nodes
+    bool allowed;       // In the process cpuset (or ZEN5_CPUS)
+};
+
+struct TopologyCcd {
+    int first_cpu;      // Lowest CPU, identifies the CCD in logs
+    int node;
+    int cores;
+    int cpus;
+    int allowed_cpus;
+    int allowed_cores;  // Cores with at least one allowed thread
+    size_t l3_size;     // Bytes of L3 shared by the CCD
+};
+
+struct TopologyNode {
+    int id;             // Kernel node number
+    int cpus;
+    int allowed_cpus;
+    size_t memory;      // Bytes (0 if unknown)
+};
+
+struct Topology {
+    int cpu_count;
+    int core_count;
+    int ccd_count;
+    int node_count;
+    int allowed_count;
+    int threads_per_core;
+    int ccx_per_ccd;    // L3 complexes merged into one CCD (CPUID, live only)
+    size_t l1d_size;    // Bytes of L1 data cache per core
+    size_t l2_size;     // Bytes per core
+    bool live;          // Read from this machine (CPUID consulted)
+    TopologyCpu cpus[MAX_TOPOLOGY_CPUS];    // Sorted by id
+    TopologyCcd ccds[MAX_TOPOLOGY_CCDS];
+    TopologyNode nodes[MAX_TOPOLOGY_NODES];
+};
+
+// Build the model from the sysfs tree at root ("/sys" for this machine).
+// cpus is a cpulist ("0-11") restricting the allowed CPUs; nullptr uses
+// the process affinity mask (live) or every online CPU (recorded tree).
+// Uses static scratch space: callers serialize.
+bool topology_load(const char* root, const char* cpus, Topology* out);
+
+// Topology of this process, loaded once from ZEN5_SYSFS_ROOT (default
+// /sys) and ZEN5_CPUS. Never nullptr; a failed load yields one CCD
+// holding every allowed CPU.
+const Topology* topology_get();
+
+// Parse a cpulist ("0-5,12-17") into set (indexed by CPU id, max
+// entries); returns the number of CPUs or -1 if it is malformed
+int parse_cpulist(const char* list, bool* set, int max);
+
+// Index into topology->cpus of logical CPU id, or -1
+int topology_cpu_index(const Topology* topology, int id);
+
+// Print a one-line summary, and each CCD through DEBUG_PRINT
+void topology_log(const Topology* topology);
+
+} // namespace zen5_turbo
+
+// C entry point of topology_load() for tests and tools (dlsym)
+extern "C" bool zen5_topology_load(const char* root, const char* cpus,
+                                   zen5_turbo::Topology* out);
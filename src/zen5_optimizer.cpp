@@ -9,6 +9,16 @@
 #include <unistd.h>
 #include "config.h"
 #include "cpu_validator.h"
+#include "topology.h"
+#include "memory/hugepage_pool.h"
+#include "memory/numa_policy.h"
+#include "memory/hugepage_arena.h"
+#include "memory/text_remap.h"
+#include "memory/memcpy_interpose.h"
+#include "threads/thread_pinning.h"
+#include "blas/cblas_interpose.h"
+#include "blas/bf16.h"
+#include "quant/ggml_interpose.h"
 
 // Forward declare cleanup function
 namespace zen5_turbo {
@@ -24,9 +34,40 @@ static void zen5_optimizer_init() {
     // Validate CPU before doing anything else
     zen5_turbo::validate_zen5_or_exit();
 
+    // CCDs, caches and NUMA nodes within the process cpuset
+    zen5_turbo::topology_log(zen5_turbo::topology_get());
+
+    // Pin compute threads per ZEN5_AFFINITY
+    zen5_turbo::thread_pinning_init();
+
+    // Serve cblas_sgemm/sgemv with the in-tree kernels (ZEN5_BLAS)
+    zen5_turbo::blas_init();
+
+    // Serve ggml's Q8_0, IQ4_XS, Q4_K and Q5_K dot products with the
+    // VBMI/VNNI kernels (ZEN5_QUANT)
+    zen5_turbo::quant_init();
+
+    // Pick the BF16 kernel path (AVX512_BF16 or FMA)
+    zen5_turbo::bf16_init();
+
+    // Size-class memcpy/memmove thresholds (ZEN5_MEMCPY)
+    zen5_turbo::memcpy_init();
+
 #if ENABLE_HUGEPAGES
     fprintf(stderr, "[%s] Hugepage support: ON (threshold %.1f GB)\n",
             ZEN5_OPTIMIZER_NAME, MIN_SIZE_FOR_HUGEPAGES / (1024.0 * 1024.0 * 1024.0));
+
+    // Report the hugetlb pool and apply ZEN5_HUGEPAGE_RESERVE
+    zen5_turbo::hugepage_pool_init();
+
+    // Report where intercepted model memory will be placed (ZEN5_NUMA)
+    zen5_turbo::numa_policy_init();
+
+    // Serve large malloc() requests from the node-local 2MB arena
+    zen5_turbo::arena_init();
+
+    // Move hot code onto 2MB pages (ZEN5_TEXT_HUGEPAGES)
+    zen5_turbo::text_remap_init();
 #else
     fprintf(stderr, "[%s] Hugepage support: OFF\n", ZEN5_OPTIMIZER_NAME);
 #endif
@@ -0,0 +1,179 @@
+/*
+ * test_anon_mmap.cpp
+ *
+ * Test huge page backing of large private anonymous mappings (the KV
+ * cache and compute buffers). Run under LD_PRELOAD: a mapping above
+ * ZEN5_ANON_THRESHOLD must come back zeroed on 2MB pages, MAP_POPULATE
+ * must fault it in, and munmap, mremap and MADV_DONTNEED must keep the
+ * semantics of an anonymous mapping. Small mappings are left alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t MAP_SIZE = 64 * MB;
+const size_t PAGE = 4096;
+
+// Largest page size (kB) of the mapping holding addr, or 0
+size_t kernel_page_kb(const void* addr) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        return 0;
+    }
+    char line[256];
+    bool inside = false;
+    size_t page_kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' ')) {
+            if (inside) {
+                break;
+            }
+            inside = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+            continue;
+        }
+        size_t kb;
+        if (inside && sscanf(line, "KernelPageSize: %zu kB", &kb) == 1) {
+            page_kb = kb;
+        }
+        if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 && kb > 0 && page_kb < 2048) {
+            page_kb = 2048;
+        }
+    }
+    fclose(f);
+    return page_kb;
+}
+
+// Bytes of [addr, addr + len) that differ from value, sampled per page
+size_t count_not(const char* addr, size_t len, char value) {
+    size_t wrong = 0;
+    for (size_t i = 0; i < len; i += PAGE) {
+        wrong += (addr[i] != value) + (addr[i + PAGE - 1] != value);
+    }
+    return wrong;
+}
+
+char* map_anon(size_t len, int extra_flags) {
+    return (char*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+}
+
+int main() {
+    PRINT_TEST("Huge pages for large anonymous mappings");
+    printf("\n");
+
+    int failed = 0;
+    long free_before = hugepages_free();
+
+    PRINT_RUN("mmap(%zu MB, MAP_PRIVATE | MAP_ANONYMOUS)", MAP_SIZE / MB);
+    char* mem = map_anon(MAP_SIZE, 0);
+    if (mem == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        return 1;
+    }
+    size_t dirty = count_not(mem, MAP_SIZE, 0);
+    memset(mem, 0x3c, MAP_SIZE);
+    size_t kb = kernel_page_kb(mem);
+    if (dirty) {
+        PRINT_FAIL("%zu bytes not zero", dirty);
+        failed++;
+    } else if (kb < 2048) {
+        PRINT_WARN("Zeroed, but backed by %zu kB pages (no hugepages or THP)", kb);
+    } else {
+        PRINT_OK("Zeroed, %zu kB pages", kb);
+    }
+
+    PRINT_RUN("MADV_DONTNEED on an unaligned range");
+    char* from = mem + 3 * MB + PAGE;
+    size_t len = 6 * MB;
+    if (madvise(from, len, MADV_DONTNEED) != 0) {
+        PRINT_FAIL("madvise failed: %s", strerror(errno));
+        failed++;
+    } else if (count_not(from, len, 0) || count_not(mem, 3 * MB + PAGE, 0x3c) ||
+               count_not(from + len, MAP_SIZE - (3 * MB + PAGE) - len, 0x3c)) {
+        PRINT_FAIL("Discarded range not zero, or data outside it lost");
+        failed++;
+    } else {
+        PRINT_OK("Range reads as zeros, the rest is intact");
+    }
+    memset(mem, 0x3c, MAP_SIZE);
+
+    PRINT_RUN("mremap growth to %zu MB", 2 * MAP_SIZE / MB);
+    char* grown = (char*)mremap(mem, MAP_SIZE, 2 * MAP_SIZE, MREMAP_MAYMOVE);
+    if (grown == MAP_FAILED) {
+        PRINT_FAIL("mremap failed: %s", strerror(errno));
+        failed++;
+        munmap(mem, MAP_SIZE);
+    } else {
+        if (count_not(grown, MAP_SIZE, 0x3c) || count_not(grown + MAP_SIZE, MAP_SIZE, 0)) {
+            PRINT_FAIL("Data lost or new part not zero");
+            failed++;
+        } else {
+            PRINT_OK("Data kept, new part zero");
+        }
+
+        PRINT_RUN("Partial munmap, then the rest");
+        if (munmap(grown + MAP_SIZE + PAGE, MAP_SIZE - PAGE) != 0 ||
+            count_not(grown, MAP_SIZE, 0x3c) || munmap(grown, MAP_SIZE + PAGE) != 0) {
+            PRINT_FAIL("munmap failed: %s", strerror(errno));
+            failed++;
+        } else if (free_before >= 0 && hugepages_free() != free_before) {
+            PRINT_FAIL("%ld hugepages still held", free_before - hugepages_free());
+            failed++;
+        } else {
+            PRINT_OK("Unmapped, hugepages released");
+        }
+    }
+
+    PRINT_RUN("MAP_POPULATE");
+    free_before = hugepages_free();
+    char* populated = map_anon(MAP_SIZE, MAP_POPULATE);
+    long used = free_before - hugepages_free();
+    if (populated == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        failed++;
+    } else {
+        if (kernel_page_kb(populated) == 2048 && used < (long)(MAP_SIZE / (2 * MB))) {
+            PRINT_FAIL("Only %ld hugepages faulted in", used);
+            failed++;
+        } else if (count_not(populated, MAP_SIZE, 0)) {
+            PRINT_FAIL("Populated mapping not zero");
+            failed++;
+        } else {
+            PRINT_OK("Faulted in before mmap returned (%ld hugepages)", used);
+        }
+        munmap(populated, MAP_SIZE);
+    }
+
+    PRINT_RUN("Small and reserved mappings");
+    char* small = map_anon(4 * MB, 0);
+    char* reserved = (char*)mmap(NULL, MAP_SIZE, PROT_NONE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (small == MAP_FAILED || reserved == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        failed++;
+    } else {
+        if (kernel_page_kb(small) != 4 || kernel_page_kb(reserved) != 4) {
+            PRINT_FAIL("Small or PROT_NONE mapping intercepted");
+            failed++;
+        } else {
+            PRINT_OK("Left to the kernel");
+        }
+    }
+    if (small != MAP_FAILED) {
+        munmap(small, 4 * MB);
+    }
+    if (reserved != MAP_FAILED) {
+        munmap(reserved, MAP_SIZE);
+    }
+
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * test_arena.cpp
+ *
+ * Test the hugepage arena behind large heap allocations. Run under
+ * LD_PRELOAD: requests above ZEN5_ARENA_THRESHOLD must come back
+ * 2MB-aligned and backed by 2MB pages, freed blocks must be reused
+ * (split for smaller requests, merged again once the pieces are freed),
+ * calloc must zero reused blocks, and small requests must still come
+ * from the real allocator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <malloc.h>
+#include "../include/test_colors.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t LARGE = 64 * MB;
+const size_t ALIGN_2MB = 2 * MB;
+
+// Page size of the mapping holding addr from /proc/self/smaps, counting
+// THP-backed anonymous memory as 2MB; 0 if not found
+size_t backing_page_kb(const void* addr) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        return 0;
+    }
+    char line[256];
+    bool inside = false;
+    size_t page_kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' ')) {
+            if (inside) {
+                break;
+            }
+            inside = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+            continue;
+        }
+        size_t kb;
+        if (inside && sscanf(line, "KernelPageSize: %zu kB", &kb) == 1 && kb > page_kb) {
+            page_kb = kb;
+        }
+        if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 && kb > 0 && page_kb < 2048) {
+            page_kb = 2048;
+        }
+    }
+    fclose(f);
+    return page_kb;
+}
+
+bool is_aligned(const void* p) {
+    return ((uintptr_t)p & (ALIGN_2MB - 1)) == 0;
+}
+
+int main() {
+    PRINT_TEST("Hugepage arena for large allocations");
+    printf("\n");
+
+    int failed = 0;
+
+    PRINT_RUN("malloc(%zu MB)", LARGE / MB);
+    char* large = (char*)malloc(LARGE);
+    if (!large) {
+        PRINT_FAIL("malloc failed");
+        return 1;
+    }
+    memset(large, 0x5a, LARGE);
+    if (!is_aligned(large)) {
+        PRINT_FAIL("%p is not 2MB-aligned (arena not active?)", large);
+        failed++;
+    } else {
+        size_t kb = backing_page_kb(large);
+        if (kb >= 2048) {
+            PRINT_OK("2MB-aligned, %zu kB pages", kb);
+        } else {
+            PRINT_WARN("2MB-aligned but backed by %zu kB pages (no hugepages or THP)", kb);
+        }
+    }
+
+    PRINT_RUN("free + malloc of the same size");
+    free(large);
+    char* again = (char*)malloc(LARGE);
+    if (again != large) {
+        PRINT_FAIL("Freed block not reused (%p, then %p)", large, again);
+        failed++;
+    } else {
+        PRINT_OK("Freed block reused");
+    }
+
+    PRINT_RUN("calloc of a reused block");
+    free(again);
+    unsigned char* zeroed = (unsigned char*)calloc(LARGE / 4096, 4096);
+    size_t dirty = 0;
+    for (size_t i = 0; zeroed && i < LARGE; i += 4096) {
+        dirty += (zeroed[i] != 0) + (zeroed[i + 4095] != 0);
+    }
+    if (!zeroed || dirty) {
+        PRINT_FAIL("calloc returned %zu non-zero bytes", dirty);
+        failed++;
+    } else {
+        PRINT_OK("Reused block zeroed");
+    }
+
+    PRINT_RUN("realloc keeps the data");
+    memset(zeroed, 0xa5, LARGE);
+    unsigned char* grown = (unsigned char*)realloc(zeroed, 3 * LARGE);
+    size_t lost = 0;
+    for (size_t i = 0; grown && i < LARGE; i += 4096) {
+        lost += (grown[i] != 0xa5);
+    }
+    if (!grown || lost || !is_aligned(grown) || malloc_usable_size(grown) < 3 * LARGE) {
+        PRINT_FAIL("realloc lost %zu pages or left the arena", lost);
+        failed++;
+    } else {
+        PRINT_OK("Data moved into a %zu MB block", malloc_usable_size(grown) / MB);
+    }
+    free(grown);
+
+    PRINT_RUN("posix_memalign(64, %zu MB)", LARGE / MB);
+    void* aligned = nullptr;
+    if (posix_memalign(&aligned, 64, LARGE) != 0 || !is_aligned(aligned)) {
+        PRINT_FAIL("posix_memalign not served by the arena (%p)", aligned);
+        failed++;
+    } else {
+        PRINT_OK("Served by the arena at %p", aligned);
+    }
+    free(aligned);
+
+    PRINT_RUN("Two %zu MB requests split the freed %zu MB block", LARGE / 2 / MB, LARGE / MB);
+    char* first = (char*)malloc(LARGE / 2);
+    char* second = (char*)malloc(LARGE / 2);
+    if (first != aligned || second != (char*)aligned + LARGE / 2) {
+        PRINT_FAIL("Freed block not split (%p and %p from %p)", first, second, aligned);
+        failed++;
+    } else {
+        PRINT_OK("Both halves served from %p", aligned);
+    }
+    free(first);
+    free(second);
+
+    PRINT_RUN("The freed halves serve a %zu MB request again", LARGE / MB);
+    char* whole = (char*)malloc(LARGE);
+    if (whole != aligned) {
+        PRINT_FAIL("Halves not merged, arena grew (%p instead of %p)", whole, aligned);
+        failed++;
+    } else {
+        PRINT_OK("Served from %p without growing the arena", aligned);
+    }
+    free(whole);
+
+    PRINT_RUN("Small allocations");
+    size_t in_arena = 0;
+    void* small[64];
+    for (int i = 0; i < 64; i++) {
+        small[i] = malloc(4096 * (i + 1));
+        in_arena += (small[i] && malloc_usable_size(small[i]) >= ALIGN_2MB);
+    }
+    for (int i = 0; i < 64; i++) {
+        free(small[i]);
+    }
+    if (in_arena) {
+        PRINT_FAIL("%zu small allocations taken by the arena", in_arena);
+        failed++;
+    } else {
+        PRINT_OK("Small allocations left to the real allocator");
+    }
+
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * test_bf16.cpp
+ *
+ * Test the BF16 kernels: FP32 <-> BF16 conversion bit for bit against a
+ * scalar reference (nearest even, NaN quieted, denormals flushed), and
+ * zen5_bf16_gemv / zen5_bf16_gemm / zen5_f16_gemv against a double
+ * precision reference. Run under LD_PRELOAD with a 4-thread compute
+ * pool (the test re-executes itself); on CPUs with AVX512_BF16 the
+ * checks run a second time in a child with ZEN5_BF16_NATIVE=0 to cover
+ * the FMA path. Ends with FP32 / F16 / BF16 timings at equal parameter
+ * counts.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const int ROW_MAJOR = 101;
+const int NO_TRANS = 111;
+
+typedef int (*native_fn)();
+typedef void (*to_bf16_fn)(const float*, uint16_t*, size_t);
+typedef void (*to_fp32_fn)(const uint16_t*, float*, size_t);
+typedef void (*gemv_fn)(const uint16_t*, size_t, int, int, const float*, float*);
+typedef void (*gemm_fn)(const uint16_t*, size_t, int, int, const float*, size_t, int, float*, size_t);
+typedef void (*sgemv_fn)(int, int, int, int, float, const float*, int, const float*, int, float, float*, int);
+typedef void (*sgemm_fn)(int, int, int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+
+struct Kernels {
+    native_fn native;
+    to_bf16_fn to_bf16;
+    to_fp32_fn to_fp32;
+    gemv_fn bf16_gemv;
+    gemm_fn bf16_gemm;
+    gemv_fn f16_gemv;
+};
+
+uint32_t bits_of(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+float float_of(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+uint16_t reference_bf16(float f) {
+    uint32_t u = bits_of(f);
+    if ((u & 0x7FFFFFFF) > 0x7F800000) {
+        return (uint16_t)((u >> 16) | 0x40);
+    }
+    if ((u & 0x7F800000) == 0) {
+        return (uint16_t)((u >> 16) & 0x8000);
+    }
+    return (uint16_t)((u + 0x7FFF + ((u >> 16) & 1)) >> 16);
+}
+
+float bf16_value(uint16_t h) {
+    return float_of((uint32_t)h << 16);
+}
+
+float half_value(uint16_t h) {
+    int sign = h >> 15, exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+    float value = exponent == 0 ? ldexpf((float)mantissa, -24)
+                                : ldexpf((float)(mantissa | 0x400), exponent - 25);
+    return sign ? -value : value;
+}
+
+// Finite half in [-2, 2]
+uint16_t random_half() {
+    return (uint16_t)((rand() & 0x83ff) | ((rand() % 16) << 10));
+}
+
+float random_float() {
+    return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+// |got - exact| relative to the sum of |terms| of one dot product
+double dot_error(const std::vector<float>& w, size_t offset, const std::vector<float>& x,
+                 size_t x_offset, int cols, float got) {
+    double exact = 0.0, magnitude = 0.0;
+    for (int k = 0; k < cols; k++) {
+        double term = (double)w[offset + k] * x[x_offset + k];
+        exact += term;
+        magnitude += fabs(term);
+    }
+    return fabs(got - exact) / (magnitude > 0.0 ? magnitude : 1.0);
+}
+
+int check_conversion(const Kernels& k) {
+    PRINT_RUN("FP32 <-> BF16 conversion");
+    const float specials[] = {0.0f, -0.0f, 1.0f, -1.0f, INFINITY, -INFINITY, NAN,
+                              float_of(0x7F800001), float_of(0xFFC00001),          // sNaN, -qNaN
+                              float_of(0x00000001), float_of(0x807FFFFF),          // Denormals
+                              float_of(0x00800000), float_of(0x7F7FFFFF),          // Min normal, max
+                              float_of(0x3F808000), float_of(0x3F818000),          // Ties to even
+                              float_of(0x3F808001), float_of(0x3F807FFF)};
+    int bad = 0;
+    for (int n = 0; n <= 100 && bad < 5; n++) {
+        std::vector<float> x(n);
+        for (int i = 0; i < n; i++) {
+            x[i] = i < (int)(sizeof(specials) / sizeof(specials[0])) && n % 2 ? specials[i]
+                                                                             : random_float() * 1000.0f;
+        }
+        std::vector<uint16_t> y(n + 1, 0xBEEF);
+        k.to_bf16(x.data(), y.data(), n);
+        for (int i = 0; i < n; i++) {
+            if (y[i] != reference_bf16(x[i]) && bad++ < 5) {
+                PRINT_FAIL("n %d [%d]: %08x -> %04x, expected %04x", n, i, bits_of(x[i]), y[i],
+                           reference_bf16(x[i]));
+            }
+        }
+        if (y[n] != 0xBEEF && bad++ < 5) {
+            PRINT_FAIL("n %d: wrote past the end", n);
+        }
+    }
+
+    // Large enough to be split across the pool, and back
+    size_t n = 3 * 1024 * 1024 + 7;
+    std::vector<float> x(n), back(n);
+    std::vector<uint16_t> y(n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = float_of((uint32_t)rand() * 2654435761u);
+    }
+    k.to_bf16(x.data(), y.data(), n);
+    k.to_fp32(y.data(), back.data(), n);
+    for (size_t i = 0; i < n; i++) {
+        if (y[i] != reference_bf16(x[i]) && bad++ < 5) {
+            PRINT_FAIL("[%zu]: %08x -> %04x, expected %04x", i, bits_of(x[i]), y[i], reference_bf16(x[i]));
+        }
+        if (bits_of(back[i]) != (uint32_t)y[i] << 16 && bad++ < 5) {
+            PRINT_FAIL("[%zu]: %04x widened to %08x", i, y[i], bits_of(back[i]));
+        }
+    }
+    if (bad) {
+        return 1;
+    }
+    PRINT_OK("specials, 0-100 values and 3M random bit patterns match");
+    return 0;
+}
+
+int check_products(const Kernels& k) {
+    PRINT_RUN("bf16_gemm / bf16_gemv: shapes, tails, padding");
+    int bad = 0;
+    const int shapes[][4] = {{1, 1, 1, 0}, {3, 31, 2, 1}, {5, 33, 5, 0}, {17, 100, 9, 3},
+                             {64, 4096, 1, 0}, {300, 1000, 4, 8}, {1027, 1024, 7, 0}};
+    double worst = 0.0;
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        int rows = shapes[s][0], cols = shapes[s][1], n = shapes[s][2], pad = shapes[s][3];
+        size_t ldw = cols + pad, ldx = cols + pad, ldc = rows + pad;
+        std::vector<uint16_t> w(rows * ldw);
+        std::vector<float> wf(rows * ldw), x(n * ldx), xr(n * ldx);
+        for (size_t i = 0; i < w.size(); i++) {
+            w[i] = reference_bf16(random_float());
+            wf[i] = bf16_value(w[i]);
+        }
+        for (size_t i = 0; i < x.size(); i++) {
+            x[i] = random_float();
+            xr[i] = bf16_value(reference_bf16(x[i]));
+        }
+        std::vector<float> c(n * ldc, 12345.0f);
+        if (n == 1) {
+            k.bf16_gemv(w.data(), ldw, rows, cols, x.data(), c.data());
+        } else {
+            k.bf16_gemm(w.data(), ldw, rows, cols, x.data(), ldx, n, c.data(), ldc);
+        }
+        for (int t = 0; t < n; t++) {
+            for (size_t r = 0; r < ldc; r++) {
+                float got = c[t * ldc + r];
+                if (n == 1 && r >= (size_t)rows) {
+                    break;
+                }
+                if (r >= (size_t)rows) {
+                    if (got != 12345.0f && bad++ < 5) {
+                        PRINT_FAIL("%d x %d x %d: padding of C written", rows, cols, n);
+                    }
+                    continue;
+                }
+                double error = dot_error(wf, r * ldw, xr, t * ldx, cols, got);
+                worst = error > worst ? error : worst;
+                if (error > 1e-5 && bad++ < 5) {
+                    PRINT_FAIL("%d x %d x %d [%d][%zu]: error %.2e", rows, cols, n, t, r, error);
+                }
+            }
+        }
+    }
+    if (bad) {
+        return 1;
+    }
+    PRINT_OK("7 shapes within %.1e of the double reference", worst);
+
+    PRINT_RUN("f16_gemv");
+    worst = 0.0;
+    for (int s = 0; s < 3; s++) {
+        int rows = 7 + 300 * s, cols = 15 + 700 * s;
+        std::vector<uint16_t> w(rows * cols);
+        std::vector<float> wf(rows * cols), x(cols), y(rows + 1, 12345.0f);
+        for (size_t i = 0; i < w.size(); i++) {
+            w[i] = random_half();
+            wf[i] = half_value(w[i]);
+        }
+        for (int i = 0; i < cols; i++) {
+            x[i] = random_float();
+        }
+        k.f16_gemv(w.data(), cols, rows, cols, x.data(), y.data());
+        for (int r = 0; r < rows; r++) {
+            double error = dot_error(wf, (size_t)r * cols, x, 0, cols, y[r]);
+            worst = error > worst ? error : worst;
+        }
+        if (y[rows] != 12345.0f) {
+            bad++;
+        }
+    }
+    if (bad || worst > 1e-5) {
+        PRINT_FAIL("error %.2e%s", worst, bad ? ", wrote past the output" : "");
+        return 1;
+    }
+    PRINT_OK("3 shapes within %.1e of the double reference", worst);
+    return 0;
+}
+
+void benchmark(const Kernels& k) {
+    sgemv_fn sgemv = (sgemv_fn)dlsym(RTLD_DEFAULT, "cblas_sgemv");
+    sgemm_fn sgemm = (sgemm_fn)dlsym(RTLD_DEFAULT, "cblas_sgemm");
+
+    printf("\n%-22s %16s %16s %16s\n", "GEMV (decode)", "FP32", "F16", "BF16");
+    printf("%-22s %16s %16s %16s\n", "", "ms  GB/s", "ms  GB/s", "ms  GB/s");
+    const int gemv_shapes[][2] = {{4096, 4096}, {14336, 4096}, {4096, 14336}};
+    for (size_t s = 0; s < sizeof(gemv_shapes) / sizeof(gemv_shapes[0]); s++) {
+        int rows = gemv_shapes[s][0], cols = gemv_shapes[s][1];
+        size_t count = (size_t)rows * cols;
+        std::vector<float> wf(count), x(cols), y(rows);
+        std::vector<uint16_t> wb(count), wh(count);
+        for (size_t i = 0; i < count; i++) {
+            wf[i] = (float)((i * 7919) % 2001) / 1000.0f - 1.0f;
+            wh[i] = random_half();
+        }
+        k.to_bf16(wf.data(), wb.data(), count);
+        for (int i = 0; i < cols; i++) {
+            x[i] = random_float();
+        }
+
+        double fp32 = seconds_per_call([&] {
+            sgemv(ROW_MAJOR, NO_TRANS, rows, cols, 1.0f, wf.data(), cols, x.data(), 1, 0.0f, y.data(), 1);
+        });
+        double f16 = seconds_per_call([&] { k.f16_gemv(wh.data(), cols, rows, cols, x.data(), y.data()); });
+        double bf16 = seconds_per_call([&] { k.bf16_gemv(wb.data(), cols, rows, cols, x.data(), y.data()); });
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d x %d", rows, cols);
+        printf("%-22s %8.3f %7.1f %8.3f %7.1f %8.3f %7.1f\n", name,
+               fp32 * 1e3, 4.0 * count / fp32 / 1e9, f16 * 1e3, 2.0 * count / f16 / 1e9,
+               bf16 * 1e3, 2.0 * count / bf16 / 1e9);
+    }
+
+    printf("\n%-22s %16s %16s\n", "GEMM (prefill)", "FP32", "BF16");
+    printf("%-22s %16s %16s\n", "", "GFLOPS", "GFLOPS");
+    const int gemm_shapes[][3] = {{32, 4096, 4096}, {128, 4096, 4096}, {512, 4096, 4096}};
+    for (size_t s = 0; s < sizeof(gemm_shapes) / sizeof(gemm_shapes[0]); s++) {
+        int n = gemm_shapes[s][0], rows = gemm_shapes[s][1], cols = gemm_shapes[s][2];
+        std::vector<float> wf((size_t)rows * cols), x((size_t)n * cols), c((size_t)n * rows);
+        std::vector<uint16_t> wb((size_t)rows * cols);
+        for (size_t i = 0; i < wf.size(); i++) {
+            wf[i] = (float)((i * 7919) % 2001) / 1000.0f - 1.0f;
+        }
+        for (size_t i = 0; i < x.size(); i++) {
+            x[i] = random_float();
+        }
+        k.to_bf16(wf.data(), wb.data(), wf.size());
+        double flops = 2.0 * n * rows * cols;
+
+        double fp32 = seconds_per_call([&] {
+            sgemm(ROW_MAJOR, NO_TRANS, 112, n, rows, cols, 1.0f, x.data(), cols,
+                  wf.data(), cols, 0.0f, c.data(), rows);
+        });
+        double bf16 = seconds_per_call([&] {
+            k.bf16_gemm(wb.data(), cols, rows, cols, x.data(), cols, n, c.data(), rows);
+        });
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d x %d x %d", n, rows, cols);
+        printf("%-22s %16.1f %16.1f\n", name, flops / fp32 / 1e9, flops / bf16 / 1e9);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // ZEN5_COMPUTE_THREADS is read when the pool starts
+    if (!rerun_with_env(argv, "ZEN5_COMPUTE_THREADS", "4")) {
+        return 1;
+    }
+
+    Kernels k;
+    k.native = (native_fn)dlsym(RTLD_DEFAULT, "zen5_bf16_native");
+    k.to_bf16 = (to_bf16_fn)dlsym(RTLD_DEFAULT, "zen5_fp32_to_bf16");
+    k.to_fp32 = (to_fp32_fn)dlsym(RTLD_DEFAULT, "zen5_bf16_to_fp32");
+    k.bf16_gemv = (gemv_fn)dlsym(RTLD_DEFAULT, "zen5_bf16_gemv");
+    k.bf16_gemm = (gemm_fn)dlsym(RTLD_DEFAULT, "zen5_bf16_gemm");
+    k.f16_gemv = (gemv_fn)dlsym(RTLD_DEFAULT, "zen5_f16_gemv");
+    if (!k.native || !k.to_bf16 || !k.to_fp32 || !k.bf16_gemv || !k.bf16_gemm || !k.f16_gemv) {
+        PRINT_FAIL("BF16 kernels not found (library not preloaded?)");
+        return 1;
+    }
+
+    bool child = getenv("ZEN5_BF16_NATIVE") != NULL;
+    PRINT_TEST("BF16 kernels (%s path)", k.native() ? "AVX512_BF16" : "FMA");
+    printf("\n");
+
+    srand(42);
+    int failed = check_conversion(k) + check_products(k);
+    if (child) {
+        return failed ? 1 : 0;
+    }
+
+    if (k.native()) {
+        printf("\n");
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            setenv("ZEN5_BF16_NATIVE", "0", 1);
+            execv("/proc/self/exe", argv);
+            _exit(127);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            PRINT_FAIL("FMA path failed");
+            failed++;
+        }
+    }
+
+    benchmark(k);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * test_dedup.cpp
+ *
+ * Test in-process deduplication of repeated read-only mappings.
+ * A second mapping of the same file must reuse the loaded hugepages,
+ * each user's munmap must leave the other's view intact (including
+ * llama.cpp-style fragment unmapping), the pool must be restored after
+ * the last user, and writable or modified-file mappings get a new copy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t FILE_SIZE = 1088 * MB;   // Just over the 1GB threshold
+
+// mincore() fails with ENOMEM for pages that are not mapped
+bool page_mapped(const char* addr) {
+    unsigned char vec;
+    return mincore((void*)addr, BLOCK_SIZE, &vec) == 0;
+}
+
+char* map_file(const char* path, int prot) {
+    int fd = open(path, (prot & PROT_WRITE) ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return (char*)MAP_FAILED;
+    }
+    char* addr = (char*)mmap(NULL, FILE_SIZE, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return addr;
+}
+
+int main() {
+    PRINT_TEST("In-process mapping deduplication");
+    printf("\n");
+
+    // 2MB pages make every fragment in this test hugepage-aligned
+    setenv("ZEN5_PAGE_POLICY", "2m", 1);
+
+    const char* test_file = "/tmp/zen5_dedup.dat";
+    int failed = 0;
+
+    PRINT_RUN("Creating %.2f GB stamped test file", FILE_SIZE / (1024.0 * MB));
+    if (!create_stamped_file(test_file, FILE_SIZE)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    long free_before = hugepages_free();
+
+    PRINT_RUN("Mapping the file twice read-only");
+    char* a = map_file(test_file, PROT_READ);
+    long free_first = hugepages_free();
+    char* b = map_file(test_file, PROT_READ);
+    long free_second = hugepages_free();
+    if (a == MAP_FAILED || b == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        unlink(test_file);
+        return 1;
+    }
+    if (a != b) {
+        PRINT_FAIL("Second mapping got its own copy");
+        failed++;
+    } else if (free_second < free_first) {
+        PRINT_FAIL("Second mapping consumed %ld hugepages", free_first - free_second);
+        failed++;
+    } else {
+        PRINT_OK("Second mapping shares the loaded region");
+    }
+
+    PRINT_RUN("First user unmaps, second keeps reading");
+    if (munmap(a, FILE_SIZE) != 0) {
+        PRINT_FAIL("munmap failed: %s", strerror(errno));
+        failed++;
+    }
+    if (verify_range(b, 0, FILE_SIZE) != 0) {
+        PRINT_FAIL("Second user's data damaged");
+        failed++;
+    } else {
+        PRINT_OK("Second user's view intact");
+    }
+    munmap(b, FILE_SIZE);
+    if (hugepages_free() < free_before) {
+        PRINT_FAIL("%ld hugepages still held after the last user", free_before - hugepages_free());
+        failed++;
+    } else {
+        PRINT_OK("Hugepages released after the last user");
+    }
+
+    PRINT_RUN("Both users unmap the same fragment, then their remains");
+    const size_t frag_start = 256 * MB;
+    const size_t frag_end = 384 * MB + 3 * BLOCK_SIZE;
+    a = map_file(test_file, PROT_READ);
+    b = map_file(test_file, PROT_READ);
+    if (a == MAP_FAILED || b != a) {
+        PRINT_FAIL("Repeated mapping not shared");
+        failed++;
+    } else {
+        munmap(a + frag_start, frag_end - frag_start);
+        bool kept = page_mapped(b + frag_start) && verify_range(b, frag_start, frag_end) == 0;
+        munmap(b + frag_start, frag_end - frag_start);
+        bool gone = !page_mapped(b + frag_start) && !page_mapped(b + 382 * MB);
+        if (!kept) {
+            PRINT_FAIL("Fragment released while another user still maps it");
+            failed++;
+        } else if (!gone) {
+            PRINT_FAIL("Fragment kept after both users unmapped it");
+            failed++;
+        } else {
+            PRINT_OK("Fragment released only after both users unmapped it");
+        }
+
+        // The remains, as llama.cpp's destructor unmaps them
+        munmap(a, frag_start);
+        munmap(a + frag_end, FILE_SIZE - frag_end);
+        if (verify_range(b, 0, frag_start) + verify_range(b, frag_end, FILE_SIZE) != 0) {
+            PRINT_FAIL("Remaining data damaged by the first user's unmaps");
+            failed++;
+        }
+        munmap(b, frag_start);
+        munmap(b + frag_end, FILE_SIZE - frag_end);
+        if (page_mapped(b) || page_mapped(b + FILE_SIZE - BLOCK_SIZE)) {
+            PRINT_FAIL("Region still mapped after both users unmapped everything");
+            failed++;
+        } else if (hugepages_free() < free_before) {
+            PRINT_FAIL("%ld hugepages still held", free_before - hugepages_free());
+            failed++;
+        } else {
+            PRINT_OK("Region released after the last piece");
+        }
+    }
+
+    PRINT_RUN("Writable mappings are never shared");
+    a = map_file(test_file, PROT_READ);
+    b = map_file(test_file, PROT_READ | PROT_WRITE);
+    if (a == MAP_FAILED || b == MAP_FAILED || a == b) {
+        PRINT_FAIL("Writable mapping shared with a read-only one");
+        failed++;
+    } else {
+        PRINT_OK("Writable mapping got its own copy");
+    }
+    if (b != MAP_FAILED && b != a) {
+        munmap(b, FILE_SIZE);
+    }
+
+    PRINT_RUN("A modified file is not matched");
+    struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_NOW}};
+    utimensat(AT_FDCWD, test_file, times, 0);
+    b = map_file(test_file, PROT_READ);
+    if (b == MAP_FAILED || b == a) {
+        PRINT_FAIL("Mapping after modification reused the stale region");
+        failed++;
+    } else {
+        PRINT_OK("Mapping after modification loaded a new copy");
+        munmap(b, FILE_SIZE);
+    }
+    if (a != MAP_FAILED) {
+        munmap(a, FILE_SIZE);
+    }
+
+    unlink(test_file);
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * test_kquants.cpp
+ *
+ * Test the IQ4_XS / Q4_K / Q5_K x Q8_K kernels (zen5_*_dot,
+ * zen5_kquant_gemv and the exported ggml_vec_dot_*_q8_K). Results must
+ * match, bit for bit, a scalar reference that sums each super-block as
+ * integers and accumulates them in the documented order; that reference
+ * is in turn checked against a double precision dot of the weights
+ * dequantized the way ggml's dequantize_row_* does. Run under
+ * LD_PRELOAD; the test re-executes itself with a 4-thread compute
+ * pool. Ends with the weight bandwidth (GB/s) of each format's GEMV.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const int QK_K = 256;
+
+// ggml-common.h layouts
+struct block_q8_K {
+    float d;
+    int8_t qs[QK_K];
+    int16_t bsums[QK_K / 16];
+};
+
+struct block_q4_K {
+    uint16_t d;
+    uint16_t dmin;
+    uint8_t scales[12];
+    uint8_t qs[QK_K / 2];
+};
+
+struct block_q5_K {
+    uint16_t d;
+    uint16_t dmin;
+    uint8_t scales[12];
+    uint8_t qh[QK_K / 8];
+    uint8_t qs[QK_K / 2];
+};
+
+struct block_iq4_xs {
+    uint16_t d;
+    uint16_t scales_h;
+    uint8_t scales_l[QK_K / 64];
+    uint8_t qs[QK_K / 2];
+};
+
+const int8_t IQ4_VALUES[16] = {-127, -104, -83, -65, -49, -35, -22, -10, 1, 13, 25, 38, 53, 69, 89, 113};
+
+// ggml_type values
+const int TYPE_Q4_K = 12;
+const int TYPE_Q5_K = 13;
+const int TYPE_IQ4_XS = 23;
+
+typedef float (*dot_fn)(const void*, const void*, int);
+typedef int (*gemv_fn)(int, const void*, size_t, int, const void*, int, float*);
+typedef void (*vec_dot_fn)(int, float*, size_t, const void*, size_t, const void*, size_t, int);
+
+// Finite fp16 between about 2^-10 and 2^-1, either sign
+uint16_t random_half() {
+    return (uint16_t)((rand() & 0x83ff) | ((5 + rand() % 9) << 10));
+}
+
+void random_bytes(uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)rand();
+    }
+}
+
+void random_q8_K(block_q8_K* y, int nb) {
+    for (int i = 0; i < nb; i++) {
+        y[i].d = (float)(rand() % 1000 + 1) / 65536.0f;
+        for (int j = 0; j < QK_K; j++) {
+            y[i].qs[j] = (int8_t)(rand() % 13 == 0 ? -128 : rand() % 256 - 128);
+        }
+        for (int j = 0; j < QK_K / 16; j++) {
+            int sum = 0;
+            for (int l = 0; l < 16; l++) {
+                sum += y[i].qs[16 * j + l];
+            }
+            y[i].bsums[j] = (int16_t)sum;
+        }
+    }
+}
+
+template <typename Block>
+void random_kquant(Block* x, int nb) {
+    random_bytes((uint8_t*)x, sizeof(Block) * nb);
+    for (int i = 0; i < nb; i++) {
+        x[i].d = random_half();
+        x[i].dmin = random_half();
+    }
+}
+
+void random_iq4_xs(block_iq4_xs* x, int nb) {
+    random_bytes((uint8_t*)x, sizeof(block_iq4_xs) * nb);
+    for (int i = 0; i < nb; i++) {
+        x[i].d = random_half();
+    }
+}
+
+// ggml's get_scale_min_k4
+void scale_min(int j, const uint8_t* q, int* sc, int* m) {
+    if (j < 4) {
+        *sc = q[j] & 63;
+        *m = q[j + 4] & 63;
+    } else {
+        *sc = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+        *m = (q[j + 4] >> 4) | ((q[j] >> 6) << 4);
+    }
+}
+
+// Value i (0 .. 255) of a Q4_K / Q5_K super-block
+int kquant_value(const uint8_t* qs, const uint8_t* qh, int i) {
+    int chunk = i / 64, l = i % 32, high = i % 64 >= 32;
+    int q = high ? qs[32 * chunk + l] >> 4 : qs[32 * chunk + l] & 0xF;
+    if (qh && (qh[l] >> (2 * chunk + high)) & 1) {
+        q += 16;
+    }
+    return q;
+}
+
+int iq4_xs_scale(const block_iq4_xs* x, int ib) {
+    return ((x->scales_l[ib / 2] >> 4 * (ib % 2)) & 0xf) | (((x->scales_h >> 2 * ib) & 3) << 4);
+}
+
+int iq4_xs_value(const block_iq4_xs* x, int i) {
+    int ib = i / 32, l = i % 16;
+    uint8_t byte = x->qs[16 * ib + l];
+    return IQ4_VALUES[i % 32 < 16 ? byte & 0xF : byte >> 4];
+}
+
+// Documented order: integer isum / msum per super-block, then FMAs
+template <typename Block>
+float reference_kquant(const Block* x, const uint8_t* qh0, size_t qh_stride, const block_q8_K* y, int nb) {
+    float sum = 0.0f;
+    for (int i = 0; i < nb; i++) {
+        const uint8_t* qh = qh0 ? qh0 + i * qh_stride : NULL;
+        int isum = 0, msum = 0;
+        for (int j = 0; j < 8; j++) {
+            int sc, m, dot = 0, ysum = 0;
+            scale_min(j, x[i].scales, &sc, &m);
+            for (int l = 32 * j; l < 32 * j + 32; l++) {
+                dot += kquant_value(x[i].qs, qh, l) * y[i].qs[l];
+                ysum += y[i].qs[l];
+            }
+            isum += sc * dot;
+            msum += m * ysum;
+        }
+        sum = fmaf((float)isum, half_to_float(x[i].d) * y[i].d, sum);
+        sum = fmaf((float)-msum, half_to_float(x[i].dmin) * y[i].d, sum);
+    }
+    return sum;
+}
+
+float reference_q4_K(const block_q4_K* x, const block_q8_K* y, int nb) {
+    return reference_kquant(x, NULL, 0, y, nb);
+}
+
+float reference_q5_K(const block_q5_K* x, const block_q8_K* y, int nb) {
+    return reference_kquant(x, x[0].qh, sizeof(block_q5_K), y, nb);
+}
+
+float reference_iq4_xs(const block_iq4_xs* x, const block_q8_K* y, int nb) {
+    float sum = 0.0f;
+    for (int i = 0; i < nb; i++) {
+        int isum = 0;
+        for (int ib = 0; ib < 8; ib++) {
+            int dot = 0;
+            for (int l = 32 * ib; l < 32 * ib + 32; l++) {
+                dot += iq4_xs_value(&x[i], l) * y[i].qs[l];
+            }
+            isum += (iq4_xs_scale(&x[i], ib) - 32) * dot;
+        }
+        sum = fmaf((float)isum, half_to_float(x[i].d) * y[i].d, sum);
+    }
+    return sum;
+}
+
+// Weights dequantized as dequantize_row_q4_K / _q5_K / _iq4_xs do it
+template <typename Block>
+void dequantize_kquant(const Block* x, const uint8_t* qh, float* out) {
+    float d = half_to_float(x->d), dmin = half_to_float(x->dmin);
+    for (int j = 0; j < 8; j++) {
+        int sc, m;
+        scale_min(j, x->scales, &sc, &m);
+        for (int l = 32 * j; l < 32 * j + 32; l++) {
+            out[l] = d * sc * kquant_value(x->qs, qh, l) - dmin * m;
+        }
+    }
+}
+
+void dequantize_iq4_xs(const block_iq4_xs* x, float* out) {
+    float d = half_to_float(x->d);
+    for (int ib = 0; ib < 8; ib++) {
+        float dl = d * (iq4_xs_scale(x, ib) - 32);
+        for (int l = 32 * ib; l < 32 * ib + 32; l++) {
+            out[l] = dl * iq4_xs_value(x, l);
+        }
+    }
+}
+
+// |dot - exact| relative to the sum of |terms|
+double relative_error(const float* w, const block_q8_K* y, int nb, float dot) {
+    double exact = 0.0, magnitude = 0.0;
+    for (int i = 0; i < nb; i++) {
+        for (int l = 0; l < QK_K; l++) {
+            double term = (double)w[i * QK_K + l] * y[i].d * y[i].qs[l];
+            exact += term;
+            magnitude += fabs(term);
+        }
+    }
+    return fabs(dot - exact) / (magnitude > 0.0 ? magnitude : 1.0);
+}
+
+bool same_bits(float a, float b) {
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// GB/s of fn streaming bytes
+template <typename F>
+double measure(F fn, double bytes) {
+    return bytes / seconds_per_call(fn) / 1e9;
+}
+
+struct Format {
+    const char* name;
+    int type;
+    size_t block_bytes;
+    const char* dot_symbol;
+    const char* vec_dot_symbol;
+};
+
+const Format FORMATS[] = {
+    {"IQ4_XS", TYPE_IQ4_XS, sizeof(block_iq4_xs), "zen5_iq4_xs_dot", "ggml_vec_dot_iq4_xs_q8_K"},
+    {"Q4_K", TYPE_Q4_K, sizeof(block_q4_K), "zen5_q4_K_dot", "ggml_vec_dot_q4_K_q8_K"},
+    {"Q5_K", TYPE_Q5_K, sizeof(block_q5_K), "zen5_q5_K_dot", "ggml_vec_dot_q5_K_q8_K"},
+};
+
+void random_weights(const Format& f, uint8_t* w, int blocks) {
+    if (f.type == TYPE_IQ4_XS) {
+        random_iq4_xs((block_iq4_xs*)w, blocks);
+    } else if (f.type == TYPE_Q4_K) {
+        random_kquant((block_q4_K*)w, blocks);
+    } else {
+        random_kquant((block_q5_K*)w, blocks);
+    }
+}
+
+float reference(const Format& f, const uint8_t* w, const block_q8_K* y, int nb) {
+    if (f.type == TYPE_IQ4_XS) {
+        return reference_iq4_xs((const block_iq4_xs*)w, y, nb);
+    } else if (f.type == TYPE_Q4_K) {
+        return reference_q4_K((const block_q4_K*)w, y, nb);
+    }
+    return reference_q5_K((const block_q5_K*)w, y, nb);
+}
+
+void dequantize(const Format& f, const uint8_t* w, int nb, float* out) {
+    for (int i = 0; i < nb; i++) {
+        const uint8_t* block = w + i * f.block_bytes;
+        if (f.type == TYPE_IQ4_XS) {
+            dequantize_iq4_xs((const block_iq4_xs*)block, out + i * QK_K);
+        } else if (f.type == TYPE_Q4_K) {
+            dequantize_kquant((const block_q4_K*)block, NULL, out + i * QK_K);
+        } else {
+            const block_q5_K* x = (const block_q5_K*)block;
+            dequantize_kquant(x, x->qh, out + i * QK_K);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // ZEN5_COMPUTE_THREADS is read when the pool starts
+    if (!rerun_with_env(argv, "ZEN5_COMPUTE_THREADS", "4")) {
+        return 1;
+    }
+
+    PRINT_TEST("IQ4_XS / Q4_K / Q5_K kernels");
+    printf("\n");
+
+    gemv_fn gemv = (gemv_fn)dlsym(RTLD_DEFAULT, "zen5_kquant_gemv");
+    if (!gemv) {
+        PRINT_FAIL("zen5_kquant_gemv not found (library not preloaded?)");
+        return 1;
+    }
+
+    int failed = 0;
+    srand(1234);
+    for (size_t f = 0; f < sizeof(FORMATS) / sizeof(FORMATS[0]); f++) {
+        const Format& fmt = FORMATS[f];
+        dot_fn dot = (dot_fn)dlsym(RTLD_DEFAULT, fmt.dot_symbol);
+        vec_dot_fn vec_dot = (vec_dot_fn)dlsym(RTLD_DEFAULT, fmt.vec_dot_symbol);
+        if (!dot || !vec_dot) {
+            PRINT_FAIL("%s kernels not exported", fmt.name);
+            failed++;
+            continue;
+        }
+
+        PRINT_RUN("%s: dot over 1 to 20 super-blocks", fmt.name);
+        int bad = 0;
+        double worst = 0.0;
+        for (int nb = 1; nb <= 20; nb++) {
+            std::vector<uint8_t> w(nb * fmt.block_bytes);
+            std::vector<block_q8_K> y(nb);
+            std::vector<float> dequantized(nb * QK_K);
+            random_weights(fmt, w.data(), nb);
+            random_q8_K(y.data(), nb);
+
+            float expected = reference(fmt, w.data(), y.data(), nb);
+            float got = dot(w.data(), y.data(), nb);
+            float exported = 0.0f;
+            vec_dot(nb * QK_K, &exported, 0, w.data(), 0, y.data(), 0, 1);
+            if ((!same_bits(got, expected) || !same_bits(exported, expected)) && bad++ < 5) {
+                PRINT_FAIL("nb %d: %.9g / ggml %.9g, expected %.9g", nb, got, exported, expected);
+            }
+            dequantize(fmt, w.data(), nb, dequantized.data());
+            double error = relative_error(dequantized.data(), y.data(), nb, expected);
+            worst = error > worst ? error : worst;
+        }
+        if (worst > 1e-5 && bad++ < 5) {
+            PRINT_FAIL("reference differs from the dequantized dot by %.2e", worst);
+        }
+        if (bad) {
+            failed++;
+        } else {
+            PRINT_OK("bit-exact, ggml export agrees, %.1e from the dequantized dot", worst);
+        }
+
+        PRINT_RUN("%s: gemv with row tails and pool split", fmt.name);
+        bad = 0;
+        const int shapes[][3] = {{1, 1, 0}, {3, 2, 1}, {9, 5, 0}, {600, 16, 1}};
+        for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+            int rows = shapes[s][0], nb = shapes[s][1], pad = shapes[s][2];
+            size_t row_bytes = (nb + pad) * fmt.block_bytes;
+            std::vector<uint8_t> w(rows * row_bytes);
+            std::vector<block_q8_K> y(nb);
+            std::vector<float> out(rows + 1, 12345.0f);
+            random_weights(fmt, w.data(), rows * (nb + pad));
+            random_q8_K(y.data(), nb);
+            if (!gemv(fmt.type, w.data(), row_bytes, rows, y.data(), nb, out.data())) {
+                PRINT_FAIL("type %d rejected", fmt.type);
+                bad++;
+                break;
+            }
+            for (int r = 0; r < rows; r++) {
+                float expected = reference(fmt, &w[r * row_bytes], y.data(), nb);
+                if (!same_bits(out[r], expected) && bad++ < 5) {
+                    PRINT_FAIL("%d x %d row %d: %.9g, expected %.9g", rows, nb, r, out[r], expected);
+                }
+            }
+            if (out[rows] != 12345.0f && bad++ < 5) {
+                PRINT_FAIL("%d x %d: wrote past the output", rows, nb);
+            }
+        }
+        if (bad) {
+            failed++;
+        } else {
+            PRINT_OK("4 shapes match, output bounds respected");
+        }
+    }
+
+    PRINT_RUN("unsupported type rejected");
+    float unused;
+    if (gemv(8, NULL, 0, 1, NULL, 1, &unused)) {
+        PRINT_FAIL("type 8 (Q8_0) accepted");
+        failed++;
+    } else {
+        PRINT_OK("type 8 rejected");
+    }
+
+    printf("\n%-24s %10s %10s %10s\n", "Weights", "Scalar", "GEMV", "Speed-up");
+    printf("%-24s %10s %10s %10s\n", "", "GB/s", "GB/s", "");
+    const int bench_shapes[][2] = {{4096, 4096}, {14336, 4096}};
+    for (size_t f = 0; f < sizeof(FORMATS) / sizeof(FORMATS[0]); f++) {
+        const Format& fmt = FORMATS[f];
+        for (size_t s = 0; s < sizeof(bench_shapes) / sizeof(bench_shapes[0]); s++) {
+            int rows = bench_shapes[s][0], nb = bench_shapes[s][1] / QK_K;
+            size_t row_bytes = nb * fmt.block_bytes;
+            double bytes = (double)rows * row_bytes;
+            std::vector<uint8_t> w(rows * row_bytes);
+            std::vector<block_q8_K> y(nb);
+            std::vector<float> out(rows);
+            random_weights(fmt, w.data(), rows * nb);
+            random_q8_K(y.data(), nb);
+
+            double start = now();
+            for (int r = 0; r < rows; r++) {
+                out[r] = reference(fmt, &w[r * row_bytes], y.data(), nb);
+            }
+            double scalar = bytes / (now() - start) / 1e9;
+            double kernel = measure([&] {
+                gemv(fmt.type, w.data(), row_bytes, rows, y.data(), nb, out.data());
+            }, bytes);
+
+            char name[64];
+            snprintf(name, sizeof(name), "%s %d x %d", fmt.name, rows, nb * QK_K);
+            printf("%-24s %10.2f %10.2f %9.1fx\n", name, scalar, kernel, kernel / scalar);
+        }
+    }
+    printf("\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * test_lazy_load.cpp
+ *
+ * Test lazy (userfaultfd) population of intercepted mappings.
+ * Sets ZEN5_MAP_MODE=lazy so the preloaded library returns the
+ * mapping before it is loaded, then checks that data is correct
+ * when touched out of order, after the fd is closed, and that an
+ * early munmap while the streamer is running is handled cleanly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include "../include/test_colors.h"
+
+const size_t TEST_SIZE = 1280ULL * 1024 * 1024;  // 1.25 GB
+const size_t BLOCK_SIZE = 4096;
+
+// Write a file where each block starts with its block index
+bool create_stamped_file(const char* path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        PRINT_FAIL("Cannot create test file: %s", strerror(errno));
+        return false;
+    }
+
+    const size_t chunk = 16 * 1024 * 1024;
+    char* buffer = (char*)calloc(1, chunk);
+    if (!buffer) {
+        close(fd);
+        return false;
+    }
+
+    for (size_t written = 0; written < size; written += chunk) {
+        for (size_t off = 0; off < chunk; off += BLOCK_SIZE) {
+            uint64_t block = (written + off) / BLOCK_SIZE;
+            memcpy(buffer + off, &block, sizeof(block));
+        }
+        if (write(fd, buffer, chunk) != (ssize_t)chunk) {
+            PRINT_FAIL("Cannot write test data: %s", strerror(errno));
+            free(buffer);
+            close(fd);
+            return false;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return true;
+}
+
+bool block_ok(const char* data, size_t block) {
+    uint64_t stamp;
+    memcpy(&stamp, data + block * BLOCK_SIZE, sizeof(stamp));
+    return stamp == block;
+}
+
+int main() {
+    PRINT_TEST("Lazy mapping population");
+    printf("\n");
+
+    setenv("ZEN5_MAP_MODE", "lazy", 1);
+
+    const char* test_file = "/tmp/zen5_lazy_load.dat";
+    const size_t blocks = TEST_SIZE / BLOCK_SIZE;
+    int failed = 0;
+
+    PRINT_RUN("Creating %.2f GB stamped test file", TEST_SIZE / (1024.0 * 1024.0 * 1024.0));
+    if (!create_stamped_file(test_file, TEST_SIZE)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    // Test 1: out-of-order access with the fd already closed
+    PRINT_RUN("Test 1: Reverse-order access after close()");
+    {
+        int fd = open(test_file, O_RDONLY);
+        if (fd < 0) {
+            PRINT_FAIL("Cannot open file: %s", strerror(errno));
+            unlink(test_file);
+            return 1;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        void* addr = mmap(NULL, TEST_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        close(fd);
+
+        if (addr == MAP_FAILED) {
+            PRINT_FAIL("mmap failed: %s", strerror(errno));
+            unlink(test_file);
+            return 1;
+        }
+
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        PRINT_INFO("mmap returned in %.3f ms", elapsed * 1000);
+
+        // Last block first: served by the fault path, not the streamer
+        size_t mismatches = 0;
+        for (size_t block = blocks; block-- > 0;) {
+            if (!block_ok((const char*)addr, block)) {
+                mismatches++;
+            }
+        }
+
+        munmap(addr, TEST_SIZE);
+
+        if (mismatches == 0) {
+            PRINT_OK("All %zu blocks correct", blocks);
+        } else {
+            PRINT_FAIL("%zu blocks incorrect", mismatches);
+            failed++;
+        }
+        printf("\n");
+    }
+
+    // Test 2: unmap while background population may still be running
+    PRINT_RUN("Test 2: munmap during population");
+    {
+        int fd = open(test_file, O_RDONLY);
+        void* addr = (fd >= 0) ? mmap(NULL, TEST_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+
+        if (addr == MAP_FAILED) {
+            PRINT_FAIL("mmap failed: %s", strerror(errno));
+            failed++;
+        } else {
+            bool first_ok = block_ok((const char*)addr, 0);
+            if (munmap(addr, TEST_SIZE) == 0 && first_ok) {
+                PRINT_OK("Early munmap succeeded");
+            } else {
+                PRINT_FAIL("Early munmap or first block check failed");
+                failed++;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        printf("\n");
+    }
+
+    unlink(test_file);
+
+    if (failed > 0) {
+        PRINT_FAIL("%d lazy load test(s) failed", failed);
+        return 1;
+    }
+
+    PRINT_OK("Lazy load tests passed");
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * test_memcpy.cpp
+ *
+ * Test the exported memcpy / memmove against glibc's: every size up to
+ * 1100 bytes at varied alignments with guard bytes on both sides, the
+ * sizes around the rep movsb and non-temporal thresholds, and memmove
+ * (and overlapping memcpy) with source and destination shifted both
+ * ways. Run under LD_PRELOAD; re-runs itself with ZEN5_MEMCPY=1. Ends
+ * with a GB/s matrix of sizes x alignments for the preload and glibc.
+ */
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t GUARD = 64;
+const double CELL_SECONDS = 0.1;    // Per benchmark cell
+
+typedef void* (*copy_fn)(void*, const void*, size_t);
+typedef void (*thresholds_fn)(size_t*, size_t*);
+
+struct Impl {
+    copy_fn copy;
+    copy_fn move;
+};
+
+// Calls go through these so the compiler cannot expand them inline
+Impl zen5, libc;
+
+void fill_pattern(uint8_t* p, size_t n, unsigned seed) {
+    uint32_t x = seed * 2654435761u + 1;
+    for (size_t i = 0; i < n; i++) {
+        x = x * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(x >> 24);
+    }
+}
+
+// memcpy of n bytes to dst + dst_off and the same through glibc; whole
+// buffers compared, guards included
+bool check_one(uint8_t* dst, uint8_t* expect, const uint8_t* src, size_t dst_off, size_t n) {
+    size_t total = dst_off + n + GUARD;
+    memset(dst, 0xa5, total);
+    memset(expect, 0xa5, total);
+    void* ret = zen5.copy(dst + dst_off, src, n);
+    libc.copy(expect + dst_off, src, n);
+    if (ret != dst + dst_off) {
+        return false;
+    }
+    return memcmp(dst, expect, total) == 0;
+}
+
+// memmove (or memcpy) within one buffer from offset from to offset to
+bool check_move(copy_fn fn, uint8_t* buf, uint8_t* expect, size_t total,
+                size_t from, size_t to, size_t n) {
+    fill_pattern(buf, total, (unsigned)(from * 31 + to * 7 + n));
+    libc.copy(expect, buf, total);
+    fn(buf + to, buf + from, n);
+    libc.move(expect + to, expect + from, n);
+    return memcmp(buf, expect, total) == 0;
+}
+
+// GB/s of fn moving n bytes, in batches of about 1MB
+template <typename F>
+double measure(F fn, size_t n) {
+    size_t batch = n >= (1 << 20) ? 1 : (1 << 20) / n;
+    return (double)n / seconds_per_call(fn, CELL_SECONDS, batch) / 1e9;
+}
+
+void size_name(size_t n, char* out, size_t len) {
+    if (n >= (1 << 20)) {
+        snprintf(out, len, "%zu MB", n >> 20);
+    } else if (n >= 1024) {
+        snprintf(out, len, "%zu KB", n >> 10);
+    } else {
+        snprintf(out, len, "%zu B", n);
+    }
+}
+
+bool from_preload(void* fn) {
+    Dl_info info;
+    return fn && dladdr(fn, &info) && info.dli_fname && strstr(info.dli_fname, "zen5_optimizer");
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // The size classes are off by default
+    if (!rerun_with_env(argv, "ZEN5_MEMCPY", "1")) {
+        return 1;
+    }
+
+    PRINT_TEST("memcpy / memmove by size class");
+    printf("\n");
+
+    zen5.copy = (copy_fn)dlsym(RTLD_DEFAULT, "memcpy");
+    zen5.move = (copy_fn)dlsym(RTLD_DEFAULT, "memmove");
+    thresholds_fn thresholds = (thresholds_fn)dlsym(RTLD_DEFAULT, "zen5_memcpy_thresholds");
+    void* handle = dlopen("libc.so.6", RTLD_LAZY | RTLD_NOLOAD);
+    if (handle) {
+        libc.copy = (copy_fn)dlsym(handle, "memcpy");
+        libc.move = (copy_fn)dlsym(handle, "memmove");
+    }
+    if (!thresholds || !from_preload((void*)zen5.copy)) {
+        PRINT_FAIL("memcpy is not the preload's (library not preloaded?)");
+        return 1;
+    }
+    if (!libc.copy || !libc.move || libc.copy == zen5.copy) {
+        PRINT_FAIL("glibc's memcpy not found");
+        return 1;
+    }
+    int failed = 0;
+    if (from_preload(dlsym(RTLD_DEFAULT, "memset"))) {
+        PRINT_FAIL("memset is the preload's, expected glibc's");
+        failed++;
+    }
+    size_t rep_min = 0, stream_min = 0;
+    thresholds(&rep_min, &stream_min);
+    char rep_text[32] = "off", stream_text[32] = "off";
+    if (rep_min != SIZE_MAX) {
+        size_name(rep_min, rep_text, sizeof(rep_text));
+    }
+    if (stream_min != SIZE_MAX) {
+        size_name(stream_min, stream_text, sizeof(stream_text));
+    }
+    PRINT_INFO("rep movsb from %s, non-temporal stores from %s", rep_text, stream_text);
+
+    // Sizes where the paths change, checked at a few alignments
+    size_t fixed[] = {512, 513, 4096 + 1, (1 << 20) + 13};
+    std::vector<size_t> edges(fixed, fixed + 4);
+    if (rep_min != SIZE_MAX) {
+        edges.push_back(rep_min - 1);
+        edges.push_back(rep_min);
+        edges.push_back(rep_min + 1);
+    }
+    if (stream_min != SIZE_MAX && stream_min <= (512u << 20)) {
+        edges.push_back(stream_min - 1);
+        edges.push_back(stream_min);
+        edges.push_back(stream_min + 100);
+    }
+    size_t largest = 3 << 20;           // Room for the 1MB moves below
+    for (size_t i = 0; i < edges.size(); i++) {
+        largest = edges[i] > largest ? edges[i] : largest;
+    }
+    size_t total = largest + 16384;
+    std::vector<uint8_t> src_buf(total), dst_buf(total), expect_buf(total);
+    fill_pattern(&src_buf[0], total, 1);
+
+    PRINT_RUN("memcpy: every size to 1100 bytes, alignments 0-63");
+    int bad = 0;
+    for (size_t n = 0; n <= 1100 && bad < 5; n++) {
+        for (size_t src_off = 0; src_off < 64; src_off += 9) {
+            size_t dst_off = GUARD + (src_off * 7 + n) % 64;
+            if (!check_one(&dst_buf[0], &expect_buf[0], &src_buf[src_off], dst_off, n)) {
+                PRINT_FAIL("%zu bytes, src +%zu, dst +%zu", n, src_off, dst_off - GUARD);
+                bad++;
+                break;
+            }
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("1101 sizes x 8 alignments match glibc, guards untouched");
+    }
+
+    PRINT_RUN("memcpy: %zu sizes around the class thresholds", edges.size());
+    bad = 0;
+    size_t offsets[][2] = {{0, 0}, {1, 3}, {63, 17}, {32, 0}};
+    for (size_t i = 0; i < edges.size(); i++) {
+        for (int a = 0; a < 4; a++) {
+            size_t src_off = offsets[a][0], dst_off = GUARD + offsets[a][1];
+            if (!check_one(&dst_buf[0], &expect_buf[0], &src_buf[src_off], dst_off, edges[i])) {
+                PRINT_FAIL("%zu bytes, src +%zu, dst +%zu", edges[i], src_off, dst_off - GUARD);
+                bad++;
+            }
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("%zu sizes x 4 alignments match glibc", edges.size());
+    }
+
+    PRINT_RUN("memmove / overlapping memcpy: shifts both ways");
+    bad = 0;
+    size_t move_sizes[] = {1, 17, 64, 65, 100, 128, 200, 256, 300, 511, 512, 513, 700,
+                           1000, 2049, 5000, 20000, (1 << 20) + 5};
+    long shifts[] = {-300, -65, -64, -63, -1, 0, 1, 63, 64, 65, 300};
+    int moves = 0;
+    for (size_t i = 0; i < sizeof(move_sizes) / sizeof(move_sizes[0]); i++) {
+        size_t n = move_sizes[i];
+        long all[13];
+        int count = 0;
+        for (size_t s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++) {
+            all[count++] = shifts[s];
+        }
+        all[count++] = (long)(n / 2);
+        all[count++] = -(long)(n / 2);
+        for (int s = 0; s < count; s++) {
+            size_t from = n / 2 + 327, to = (size_t)((long)from + all[s]);
+            size_t len = (from > to ? from : to) + n + GUARD;
+            copy_fn fns[] = {zen5.move, zen5.copy};
+            for (int f = 0; f < 2; f++) {
+                if (!check_move(fns[f], &dst_buf[0], &expect_buf[0], len, from, to, n)) {
+                    PRINT_FAIL("%s of %zu bytes shifted by %ld", f ? "memcpy" : "memmove", n, all[s]);
+                    bad++;
+                }
+                moves++;
+            }
+        }
+    }
+    if (stream_min != SIZE_MAX && stream_min <= (512u << 20)) {
+        // Overlap never takes the streaming path
+        size_t n = stream_min + 100;
+        long big_shifts[] = {-1, 1, -4096, 4096};
+        for (int s = 0; s < 4; s++) {
+            size_t from = 4200, to = (size_t)((long)from + big_shifts[s]);
+            if (!check_move(zen5.move, &dst_buf[0], &expect_buf[0], n + 8400, from, to, n)) {
+                PRINT_FAIL("memmove of %zu bytes shifted by %ld", n, big_shifts[s]);
+                bad++;
+            }
+            moves++;
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("%d overlapping moves match glibc's memmove", moves);
+    }
+
+    printf("\n%-10s %27s %27s\n", "memcpy", "aligned", "dst +1, src +3");
+    printf("%-10s %9s %8s %8s %9s %8s %8s\n", "", "zen5 GB/s", "glibc", "ratio",
+           "zen5 GB/s", "glibc", "ratio");
+    size_t bench_sizes[] = {16, 64, 200, 512, 1024, 4096, 16384, 65536, 256 << 10,
+                            1 << 20, 4 << 20, 16 << 20, 64 << 20, 256 << 20};
+    const int BENCH_SIZES = sizeof(bench_sizes) / sizeof(bench_sizes[0]);
+    size_t bench_total = bench_sizes[BENCH_SIZES - 1] + 128;
+    uint8_t* a = (uint8_t*)aligned_alloc(4096, bench_total);
+    uint8_t* b = (uint8_t*)aligned_alloc(4096, bench_total);
+    if (!a || !b) {
+        PRINT_FAIL("cannot allocate benchmark buffers");
+        return 1;
+    }
+    memset(a, 1, bench_total);
+    memset(b, 2, bench_total);
+    for (int i = 0; i < BENCH_SIZES; i++) {
+        size_t n = bench_sizes[i];
+        double r[2][2];                  // alignment, impl
+        for (int al = 0; al < 2; al++) {
+            uint8_t* dst = a + (al ? 1 : 0);
+            const uint8_t* src = b + (al ? 3 : 0);
+            for (int impl = 0; impl < 2; impl++) {
+                const Impl* fns = impl ? &libc : &zen5;
+                r[al][impl] = measure([&]() { fns->copy(dst, src, n); }, n);
+            }
+        }
+        char name[32];
+        size_name(n, name, sizeof(name));
+        printf("%-10s %9.2f %8.2f %7.2fx %9.2f %8.2f %7.2fx\n", name,
+               r[0][0], r[0][1], r[0][0] / r[0][1], r[1][0], r[1][1], r[1][0] / r[1][1]);
+    }
+    free(a);
+    free(b);
+    printf("\n");
+
+    if (failed) {
+        PRINT_FAIL("%d memcpy check(s) failed", failed);
+        return 1;
+    }
+    PRINT_OK("memcpy / memmove match glibc");
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * test_numa_policy.cpp
+ *
+ * Test NUMA placement policies (ZEN5_NUMA) for intercepted mappings.
+ * Each policy maps the same file; data must be intact and move_pages()
+ * must find the pages on the nodes the policy names: any cpuset node for
+ * interleave (every one of them on multi-node hosts), the chosen node for
+ * bind, and the first and last node at the ends of a split region.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t FILE_SIZE = 1088 * MB;   // Just over the 1GB threshold
+const int MAX_NODES = 64;
+const int SAMPLES = 256;
+
+// Nodes with a CPU this process may run on, in ascending order
+int cpuset_nodes(int* nodes) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    sched_getaffinity(0, sizeof(mask), &mask);
+
+    int count = 0;
+    for (int node = 0; node < MAX_NODES; node++) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        char list[4096] = "";
+        char* line = fgets(list, sizeof(list), f);
+        fclose(f);
+
+        bool allowed = false;
+        for (char* p = line; p && *p && *p != '\n' && !allowed;) {
+            char* end;
+            long first = strtol(p, &end, 10);
+            long last = first;
+            if (*end == '-') {
+                last = strtol(end + 1, &end, 10);
+            }
+            for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                allowed |= CPU_ISSET(cpu, &mask);
+            }
+            p = (*end == ',') ? end + 1 : end;
+            if (end == p && *p != ',') {
+                break;
+            }
+        }
+        if (allowed) {
+            nodes[count++] = node;
+        }
+    }
+    if (count == 0) {
+        nodes[count++] = 0;     // No NUMA information: everything is node 0
+    }
+    return count;
+}
+
+// Node of each sampled page of [from, to), via move_pages() without targets
+bool page_nodes(const char* data, size_t from, size_t to, int* status) {
+    void* pages[SAMPLES];
+    size_t step = (to - from) / SAMPLES;
+    for (int i = 0; i < SAMPLES; i++) {
+        pages[i] = (void*)(data + from + i * step);
+    }
+    return syscall(SYS_move_pages, 0, SAMPLES, pages, NULL, status, 0) == 0;
+}
+
+// Samples of [from, to) on one of the nodes, or -1 on failure
+int count_on(const char* data, size_t from, size_t to, const int* nodes, int count) {
+    int status[SAMPLES];
+    if (!page_nodes(data, from, to, status)) {
+        return -1;
+    }
+    int on = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        for (int n = 0; n < count; n++) {
+            on += (status[i] == nodes[n]);
+        }
+    }
+    return on;
+}
+
+char* map_with_policy(const char* path, const char* policy) {
+    setenv("ZEN5_NUMA", policy, 1);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return (char*)MAP_FAILED;
+    }
+    char* addr = (char*)mmap(NULL, FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return addr;
+}
+
+int main() {
+    PRINT_TEST("NUMA placement policies");
+    printf("\n");
+
+    const char* test_file = "/tmp/zen5_numa.dat";
+    int failed = 0;
+
+    int nodes[MAX_NODES];
+    int node_count = cpuset_nodes(nodes);
+    PRINT_INFO("%d NUMA node(s) in the cpuset", node_count);
+
+    PRINT_RUN("Creating %.2f GB stamped test file", FILE_SIZE / (1024.0 * MB));
+    if (!create_stamped_file(test_file, FILE_SIZE)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    const char* policies[] = {"default", "interleave", "bind", "split"};
+    for (int p = 0; p < 4; p++) {
+        const char* policy = policies[p];
+        PRINT_RUN("ZEN5_NUMA=%s", policy);
+
+        char node_env[16];
+        snprintf(node_env, sizeof(node_env), "%d", nodes[node_count - 1]);
+        setenv("ZEN5_NUMA_NODE", node_env, 1);
+
+        char* data = map_with_policy(test_file, policy);
+        if (data == MAP_FAILED) {
+            PRINT_FAIL("mmap failed: %s", strerror(errno));
+            failed++;
+            continue;
+        }
+        if (verify_range(data, 0, FILE_SIZE) != 0) {
+            PRINT_FAIL("Data damaged under %s placement", policy);
+            failed++;
+            munmap(data, FILE_SIZE);
+            continue;
+        }
+
+        int in_cpuset = count_on(data, 0, FILE_SIZE, nodes, node_count);
+        if (in_cpuset < 0) {
+            PRINT_WARN("move_pages unavailable: %s", strerror(errno));
+        } else if (strcmp(policy, "bind") == 0) {
+            int on_target = count_on(data, 0, FILE_SIZE, &nodes[node_count - 1], 1);
+            if (on_target != SAMPLES) {
+                PRINT_FAIL("%d of %d sampled pages not on node %d", SAMPLES - on_target,
+                           SAMPLES, nodes[node_count - 1]);
+                failed++;
+            } else {
+                PRINT_OK("All sampled pages on node %d", nodes[node_count - 1]);
+            }
+        } else if (strcmp(policy, "interleave") == 0 && node_count > 1) {
+            int empty = 0;
+            for (int n = 0; n < node_count; n++) {
+                empty += count_on(data, 0, FILE_SIZE, &nodes[n], 1) == 0;
+            }
+            if (in_cpuset != SAMPLES || empty) {
+                PRINT_FAIL("Pages not interleaved over the cpuset nodes");
+                failed++;
+            } else {
+                PRINT_OK("Pages spread over all %d cpuset nodes", node_count);
+            }
+        } else if (strcmp(policy, "split") == 0 && node_count > 1) {
+            size_t quarter = FILE_SIZE / (4 * node_count);
+            int head = count_on(data, 0, quarter, &nodes[0], 1);
+            int tail = count_on(data, FILE_SIZE - quarter, FILE_SIZE, &nodes[node_count - 1], 1);
+            if (head != SAMPLES || tail != SAMPLES) {
+                PRINT_FAIL("Split slices not on their nodes (%d/%d head, %d/%d tail)",
+                           head, SAMPLES, tail, SAMPLES);
+                failed++;
+            } else {
+                PRINT_OK("First slice on node %d, last on node %d", nodes[0],
+                         nodes[node_count - 1]);
+            }
+        } else if (strcmp(policy, "default") != 0 && in_cpuset != SAMPLES) {
+            PRINT_FAIL("%d of %d sampled pages outside the cpuset nodes",
+                       SAMPLES - in_cpuset, SAMPLES);
+            failed++;
+        } else {
+            PRINT_OK("Data intact, %d of %d sampled pages on cpuset nodes", in_cpuset, SAMPLES);
+        }
+
+        munmap(data, FILE_SIZE);
+    }
+
+    unlink(test_file);
+    printf("\n");
+    return failed ? 1 : 0;
+}
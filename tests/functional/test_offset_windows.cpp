@@ -0,0 +1,161 @@
+/*
+ * test_offset_windows.cpp
+ *
+ * Test interception of (offset, length) windows.
+ * Maps two overlapping windows of one file - one in the middle and one
+ * running to an unaligned EOF - checks that each sees the right file
+ * data (and zeros past EOF), and unmaps them independently.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t FILE_SIZE = 2304 * MB + 1000;   // 2.25 GB, EOF not page aligned
+const size_t BLOCK_SIZE = 4096;
+
+// Write a file where each block starts with its block index
+bool create_stamped_file(const char* path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        PRINT_FAIL("Cannot create test file: %s", strerror(errno));
+        return false;
+    }
+
+    const size_t chunk = 4 * MB;
+    char* buffer = (char*)malloc(chunk);
+    if (!buffer) {
+        close(fd);
+        return false;
+    }
+
+    for (size_t written = 0; written < size; written += chunk) {
+        size_t to_write = (size - written < chunk) ? (size - written) : chunk;
+        memset(buffer, 0xA5, to_write);
+        for (size_t off = 0; off + sizeof(uint64_t) <= to_write; off += BLOCK_SIZE) {
+            uint64_t block = (written + off) / BLOCK_SIZE;
+            memcpy(buffer + off, &block, sizeof(block));
+        }
+        if (write(fd, buffer, to_write) != (ssize_t)to_write) {
+            PRINT_FAIL("Cannot write test data: %s", strerror(errno));
+            free(buffer);
+            close(fd);
+            return false;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return true;
+}
+
+// Check every block stamp of a window mapped at file offset `offset`
+size_t verify_window(const char* data, size_t offset, size_t length) {
+    size_t mismatches = 0;
+    for (size_t pos = 0; pos < length; pos += BLOCK_SIZE) {
+        size_t file_pos = offset + pos;
+        if (file_pos + sizeof(uint64_t) > FILE_SIZE) {
+            break;
+        }
+        uint64_t stamp;
+        memcpy(&stamp, data + pos, sizeof(stamp));
+        if (stamp != file_pos / BLOCK_SIZE) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    PRINT_TEST("Offset and sub-range mapping windows");
+    printf("\n");
+
+    const char* test_file = "/tmp/zen5_offset_windows.dat";
+    int failed = 0;
+
+    PRINT_RUN("Creating %.2f GB stamped test file", FILE_SIZE / (1024.0 * MB));
+    if (!create_stamped_file(test_file, FILE_SIZE)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    int fd = open(test_file, O_RDONLY);
+    if (fd < 0) {
+        PRINT_FAIL("Cannot open file: %s", strerror(errno));
+        unlink(test_file);
+        return 1;
+    }
+
+    // Window A: the middle of the file
+    const size_t a_offset = 128 * MB;
+    const size_t a_length = 1100 * MB;
+    // Window B: overlaps A and runs to EOF (length rounded up to a page)
+    const size_t b_offset = 1152 * MB;
+    const size_t b_length = ((FILE_SIZE - b_offset) + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+
+    PRINT_RUN("Mapping window A (offset %zu MB, %zu MB)", a_offset / MB, a_length / MB);
+    char* a = (char*)mmap(NULL, a_length, PROT_READ, MAP_PRIVATE, fd, a_offset);
+    PRINT_RUN("Mapping window B (offset %zu MB, to EOF)", b_offset / MB);
+    char* b = (char*)mmap(NULL, b_length, PROT_READ, MAP_PRIVATE, fd, b_offset);
+    close(fd);
+
+    if (a == MAP_FAILED || b == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        unlink(test_file);
+        return 1;
+    }
+
+    size_t bad = verify_window(a, a_offset, a_length);
+    if (bad) {
+        PRINT_FAIL("Window A: %zu blocks wrong", bad);
+        failed++;
+    } else {
+        PRINT_OK("Window A data correct");
+    }
+
+    bad = verify_window(b, b_offset, b_length);
+    size_t tail = FILE_SIZE - b_offset;
+    bool tail_ok = (unsigned char)b[tail - 1] == 0xA5;
+    for (size_t i = tail; i < b_length; i++) {
+        if (b[i] != 0) {
+            tail_ok = false;
+            break;
+        }
+    }
+    if (bad || !tail_ok) {
+        PRINT_FAIL("Window B: %zu blocks wrong%s", bad, tail_ok ? "" : ", bad bytes around EOF");
+        failed++;
+    } else {
+        PRINT_OK("Window B data correct, zeros past EOF");
+    }
+
+    PRINT_RUN("Unmapping window A, window B must stay intact");
+    if (munmap(a, a_length) != 0) {
+        PRINT_FAIL("munmap A failed: %s", strerror(errno));
+        failed++;
+    }
+    if (verify_window(b, b_offset, b_length) != 0) {
+        PRINT_FAIL("Window B damaged by unmapping A");
+        failed++;
+    } else {
+        PRINT_OK("Window B unaffected");
+    }
+    if (munmap(b, b_length) != 0) {
+        PRINT_FAIL("munmap B failed: %s", strerror(errno));
+        failed++;
+    } else {
+        PRINT_OK("Both windows unmapped");
+    }
+
+    unlink(test_file);
+    printf("\n");
+    return failed ? 1 : 0;
+}
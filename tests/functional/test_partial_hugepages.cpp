@@ -0,0 +1,105 @@
+/*
+ * test_partial_hugepages.cpp
+ *
+ * Test stitched hugetlb + THP backings.
+ * Maps a file slightly larger than the free hugetlb pool: the library
+ * should use every free hugepage for the start of the mapping, back the
+ * rest with THP/4KB pages, return correct data across the seam, and
+ * give all hugepages back on munmap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t HUGEPAGE = 2ULL * 1024 * 1024;
+const size_t MIN_FILE_SIZE = 1100ULL * 1024 * 1024;      // Above the 1GB threshold
+const size_t MAX_FILE_SIZE = 3ULL * 1024 * 1024 * 1024;  // Keep /tmp usage bounded
+
+int main() {
+    PRINT_TEST("Partial hugepage coverage (hugetlb + THP stitching)");
+    printf("\n");
+
+    long free_before = hugepages_free();
+    if (free_before <= 0) {
+        PRINT_WARN("No free hugepages, skipping");
+        return 0;
+    }
+
+    // Pool size plus 256MB that must come from somewhere else
+    size_t file_size = (size_t)free_before * HUGEPAGE + 256ULL * 1024 * 1024;
+    if (file_size < MIN_FILE_SIZE) {
+        file_size = MIN_FILE_SIZE;
+    }
+    if (file_size > MAX_FILE_SIZE) {
+        PRINT_WARN("%ld free hugepages is more than this test will exceed, skipping", free_before);
+        return 0;
+    }
+
+    const char* test_file = "/tmp/zen5_partial_hugepages.dat";
+    PRINT_RUN("Creating %.2f GB file (%ld hugepages free)",
+              file_size / (1024.0 * 1024.0 * 1024.0), free_before);
+    if (!create_stamped_file(test_file, file_size)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    int failed = 0;
+    int fd = open(test_file, O_RDONLY);
+    void* addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        unlink(test_file);
+        return 1;
+    }
+
+    PRINT_RUN("Checking the hugetlb pool was used");
+    long free_mapped = hugepages_free();
+    if (free_mapped == free_before) {
+        PRINT_FAIL("No hugepages used (all-or-nothing fallback?)");
+        failed++;
+    } else {
+        PRINT_OK("%ld of %ld free hugepages used", free_before - free_mapped, free_before);
+    }
+
+    PRINT_RUN("Verifying data across the hugetlb / THP seam");
+    const char* data = (const char*)addr;
+    size_t mismatches = 0;
+    for (size_t block = 0; block < file_size / BLOCK_SIZE; block++) {
+        uint64_t stamp;
+        memcpy(&stamp, data + block * BLOCK_SIZE, sizeof(stamp));
+        if (stamp != block) {
+            mismatches++;
+        }
+    }
+    if (mismatches) {
+        PRINT_FAIL("%zu blocks loaded incorrectly", mismatches);
+        failed++;
+    } else {
+        PRINT_OK("All %zu blocks correct", file_size / BLOCK_SIZE);
+    }
+
+    PRINT_RUN("Unmapping the composite region");
+    if (munmap(addr, file_size) != 0) {
+        PRINT_FAIL("munmap failed: %s", strerror(errno));
+        failed++;
+    } else if (hugepages_free() != free_before) {
+        PRINT_FAIL("%ld hugepages not returned", free_before - hugepages_free());
+        failed++;
+    } else {
+        PRINT_OK("All hugepages returned to the pool");
+    }
+
+    unlink(test_file);
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -65,6 +65,40 @@ bool create_test_file(const char* path, size_t size) {
     return true;
 }
 
+// Bytes of [addr, addr + size) mapped by huge pages, from /proc/self/smaps
+// (hugetlb, anonymous THP and file THP mappings)
+size_t huge_mapped_bytes(void* addr, size_t size) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        return 0;
+    }
+
+    unsigned long start = (unsigned long)addr;
+    unsigned long end = start + size;
+    bool inside = false;
+    size_t total = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long vma_start, vma_end;
+        if (sscanf(line, "%lx-%lx ", &vma_start, &vma_end) == 2) {
+            inside = vma_start < end && vma_end > start;
+            continue;
+        }
+        if (!inside) {
+            continue;
+        }
+        size_t kb;
+        if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 ||
+            sscanf(line, "FilePmdMapped: %zu kB", &kb) == 1 ||
+            sscanf(line, "Shared_Hugetlb: %zu kB", &kb) == 1 ||
+            sscanf(line, "Private_Hugetlb: %zu kB", &kb) == 1) {
+            total += kb * 1024;
+        }
+    }
+    fclose(f);
+    return total;
+}
+
 int main() {
     PRINT_TEST("Performance measurements");
     printf("\n");
@@ -376,12 +410,80 @@ int main() {
         printf("\n");
     }
 
+    // Test 5: Copy mode vs zero-copy file THP mode
+    PRINT_RUN("Test 5: Copy mode vs file THP mode (load time and TLB reach)");
+    {
+        const char* test_file = "/tmp/zen5_perf_filethp.dat";
+        const int NUM_ACCESSES = 1000000;
+        const char* modes[] = {"copy", "filethp"};
+
+        PRINT_INFO("Creating test file...");
+        if (!create_test_file(test_file, HUGE_SIZE)) {
+            return 1;
+        }
+
+        srand(42);
+        std::vector<size_t> offsets;
+        for (int i = 0; i < NUM_ACCESSES; i++) {
+            offsets.push_back(((size_t)rand() % (HUGE_SIZE / ACCESS_STRIDE)) * ACCESS_STRIDE);
+        }
+
+        for (const char* mode : modes) {
+            setenv("ZEN5_MAP_MODE", mode, 1);
+            int fd = open(test_file, O_RDONLY);
+            if (fd < 0) {
+                continue;
+            }
+
+            // Load time: mmap plus one touch per page, so lazily
+            // populated modes pay for their faults here too
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            void* addr = mmap(NULL, HUGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                PRINT_WARN("%s mode: mmap failed: %s", mode, strerror(errno));
+                close(fd);
+                continue;
+            }
+            volatile long sum = 0;
+            char* ptr = (char*)addr;
+            for (size_t i = 0; i < HUGE_SIZE; i += ACCESS_STRIDE) {
+                sum += ptr[i];
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double load_time = get_time_diff(start, end);
+
+            size_t huge_bytes = huge_mapped_bytes(addr, HUGE_SIZE);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (size_t offset : offsets) {
+                sum += ptr[offset];
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double access_time = get_time_diff(start, end);
+
+            printf("  %s mode:\n", mode);
+            PRINT_INFO("Load + first touch: %.3f s", load_time);
+            PRINT_INFO("Mapped by huge pages: %.1f%% (%.2f GB)",
+                      100.0 * huge_bytes / HUGE_SIZE, huge_bytes / (1024.0 * 1024.0 * 1024.0));
+            PRINT_INFO("Random access: %.3f ns per access", (access_time * 1e9) / NUM_ACCESSES);
+
+            munmap(addr, HUGE_SIZE);
+            close(fd);
+        }
+
+        unsetenv("ZEN5_MAP_MODE");
+        unlink(test_file);
+        printf("\n");
+    }
+
     // Summary with baseline metrics
     PRINT_INFO("Performance baseline established");
     printf("\nKey metrics for future comparison:\n");
     printf("  - Hugepage allocation: ~1-3 ms per GB\n");
     printf("  - Sequential throughput: >1 GB/s expected\n");
     printf("  - Random access: Hugepages should be faster\n");
+    printf("  - File THP mode: near-copy TLB reach without a private copy\n");
     printf("  - Library overhead: <100 microseconds per call\n");
     printf("\n");
 
@@ -0,0 +1,231 @@
+/*
+ * test_q8_0.cpp
+ *
+ * Test the Q8_0 x Q8_0 VNNI kernels (zen5_q8_0_dot / _gemv / _gemm and
+ * the exported ggml_vec_dot_q8_0_q8_0) bit for bit against a scalar
+ * reference that follows the documented order: block b's integer dot
+ * times dx * dy is FMA'd into lane b % 16, lanes are summed (i, i + 8),
+ * (i, i + 4), (i, i + 2), (0, 1). Run under LD_PRELOAD; the test
+ * re-executes itself with a 4-thread compute pool. Ends with the
+ * weight bandwidth (GB/s of Q8_0 rows streamed) of decode-sized GEMVs.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const int QK = 32;
+const int BLOCK_BYTES = 34;         // fp16 scale + 32 int8
+
+typedef float (*dot_fn)(const void*, const void*, int);
+typedef void (*gemv_fn)(const void*, size_t, int, const void*, int, float*);
+typedef void (*gemm_fn)(const void*, size_t, int, const void*, size_t, int, int, float*, int);
+typedef void (*vec_dot_fn)(int, float*, size_t, const void*, size_t, const void*, size_t, int);
+
+// Blocks with random quants (-128 included) and finite fp16 scales,
+// subnormals included
+std::vector<uint8_t> random_blocks(size_t blocks, unsigned seed) {
+    std::vector<uint8_t> data(blocks * BLOCK_BYTES);
+    srand(seed);
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t* block = &data[b * BLOCK_BYTES];
+        uint16_t d = (uint16_t)((rand() & 0x83ff) | ((rand() % 24) << 10));
+        memcpy(block, &d, 2);
+        for (int i = 0; i < QK; i++) {
+            block[2 + i] = (uint8_t)(rand() % 7 == 0 ? 0x80 : rand());
+        }
+    }
+    return data;
+}
+
+float reference_dot(const uint8_t* x, const uint8_t* y, int nb) {
+    float lane[16] = {0};
+    for (int b = 0; b < nb; b++) {
+        const uint8_t* xb = x + (size_t)b * BLOCK_BYTES;
+        const uint8_t* yb = y + (size_t)b * BLOCK_BYTES;
+        int sum = 0;
+        for (int i = 0; i < QK; i++) {
+            sum += (int8_t)xb[2 + i] * (int8_t)yb[2 + i];
+        }
+        uint16_t dx, dy;
+        memcpy(&dx, xb, 2);
+        memcpy(&dy, yb, 2);
+        float scale = half_to_float(dx) * half_to_float(dy);
+        lane[b % 16] = fmaf((float)sum, scale, lane[b % 16]);
+    }
+    for (int width = 8; width >= 1; width /= 2) {
+        for (int i = 0; i < width; i++) {
+            lane[i] += lane[i + width];
+        }
+    }
+    return lane[0];
+}
+
+bool same_bits(float a, float b) {
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// GB/s of fn streaming bytes
+template <typename F>
+double measure(F fn, double bytes) {
+    return bytes / seconds_per_call(fn) / 1e9;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // ZEN5_COMPUTE_THREADS is read when the pool starts
+    if (!rerun_with_env(argv, "ZEN5_COMPUTE_THREADS", "4")) {
+        return 1;
+    }
+
+    PRINT_TEST("Q8_0 VNNI kernels");
+    printf("\n");
+
+    dot_fn dot = (dot_fn)dlsym(RTLD_DEFAULT, "zen5_q8_0_dot");
+    gemv_fn gemv = (gemv_fn)dlsym(RTLD_DEFAULT, "zen5_q8_0_gemv");
+    gemm_fn gemm = (gemm_fn)dlsym(RTLD_DEFAULT, "zen5_q8_0_gemm");
+    vec_dot_fn vec_dot = (vec_dot_fn)dlsym(RTLD_DEFAULT, "ggml_vec_dot_q8_0_q8_0");
+    if (!dot || !gemv || !gemm || !vec_dot) {
+        PRINT_FAIL("Q8_0 kernels not found (library not preloaded?)");
+        return 1;
+    }
+    int failed = 0;
+
+    PRINT_RUN("dot: 1 to 70 blocks, bit-exact");
+    int bad = 0;
+    for (int nb = 1; nb <= 70; nb++) {
+        std::vector<uint8_t> x = random_blocks(nb, 100 + nb), y = random_blocks(nb, 200 + nb);
+        float expected = reference_dot(x.data(), y.data(), nb);
+        float got = dot(x.data(), y.data(), nb);
+        float exported = 0.0f;
+        vec_dot(nb * QK, &exported, 0, x.data(), 0, y.data(), 0, 1);
+        if (!same_bits(got, expected) || !same_bits(exported, expected)) {
+            if (bad++ < 5) {
+                PRINT_FAIL("nb %d: %.9g / ggml %.9g, expected %.9g", nb, got, exported, expected);
+            }
+        }
+    }
+    // All weights -128 against all activations -128: largest block dot
+    std::vector<uint8_t> extreme(48 * BLOCK_BYTES, 0x80);
+    for (int b = 0; b < 48; b++) {
+        extreme[b * BLOCK_BYTES] = 0x00;
+        extreme[b * BLOCK_BYTES + 1] = 0x3c;     // 1.0
+    }
+    if (dot(extreme.data(), extreme.data(), 48) != 48.0f * 32 * 128 * 128) {
+        PRINT_FAIL("-128 x -128 blocks: %g", dot(extreme.data(), extreme.data(), 48));
+        bad++;
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("70 lengths and the -128 extreme match, ggml export agrees");
+    }
+
+    PRINT_RUN("gemv: row tails, padded rows, pool split");
+    bad = 0;
+    const int gemv_shapes[][3] = {{1, 1, 0}, {3, 5, 0}, {7, 16, 1}, {13, 17, 0},
+                                  {64, 33, 2}, {1000, 128, 0}, {1003, 130, 1}};
+    for (size_t s = 0; s < sizeof(gemv_shapes) / sizeof(gemv_shapes[0]); s++) {
+        int rows = gemv_shapes[s][0], nb = gemv_shapes[s][1], pad = gemv_shapes[s][2];
+        size_t row_bytes = (size_t)(nb + pad) * BLOCK_BYTES;
+        std::vector<uint8_t> w = random_blocks((size_t)rows * (nb + pad), 300 + s);
+        std::vector<uint8_t> y = random_blocks(nb, 400 + s);
+        std::vector<float> out(rows + 1, 12345.0f);
+        gemv(w.data(), row_bytes, rows, y.data(), nb, out.data());
+        for (int r = 0; r < rows; r++) {
+            float expected = reference_dot(&w[r * row_bytes], y.data(), nb);
+            if (!same_bits(out[r], expected) && bad++ < 5) {
+                PRINT_FAIL("%d x %d row %d: %.9g, expected %.9g", rows, nb, r, out[r], expected);
+            }
+        }
+        if (out[rows] != 12345.0f && bad++ < 5) {
+            PRINT_FAIL("%d x %d: wrote past the output", rows, nb);
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("7 shapes match, output bounds respected");
+    }
+
+    PRINT_RUN("gemm: batch 1 to 9, column tails, ldo");
+    bad = 0;
+    for (int cols = 1; cols <= 9; cols++) {
+        int rows = cols * 37 + 3, nb = 20 + cols * 3, ldo = rows + 2;
+        size_t row_bytes = (size_t)nb * BLOCK_BYTES, y_bytes = (size_t)(nb + 1) * BLOCK_BYTES;
+        std::vector<uint8_t> w = random_blocks((size_t)rows * nb, 500 + cols);
+        std::vector<uint8_t> y = random_blocks((size_t)cols * (nb + 1), 600 + cols);
+        std::vector<float> out((size_t)cols * ldo, 12345.0f);
+        gemm(w.data(), row_bytes, rows, y.data(), y_bytes, cols, nb, out.data(), ldo);
+        for (int c = 0; c < cols; c++) {
+            for (int r = 0; r < ldo; r++) {
+                float got = out[(size_t)c * ldo + r];
+                float expected = r < rows ? reference_dot(&w[r * row_bytes], &y[c * y_bytes], nb)
+                                          : 12345.0f;
+                if (!same_bits(got, expected) && bad++ < 5) {
+                    PRINT_FAIL("batch %d col %d row %d: %.9g, expected %.9g", cols, c, r, got, expected);
+                }
+            }
+        }
+    }
+    // Large enough to be split across the pool
+    {
+        int rows = 2000, nb = 128, cols = 5;
+        size_t row_bytes = (size_t)nb * BLOCK_BYTES;
+        std::vector<uint8_t> w = random_blocks((size_t)rows * nb, 700);
+        std::vector<uint8_t> y = random_blocks((size_t)cols * nb, 701);
+        std::vector<float> out((size_t)cols * rows);
+        gemm(w.data(), row_bytes, rows, y.data(), row_bytes, cols, nb, out.data(), rows);
+        for (int c = 0; c < cols; c++) {
+            for (int r = 0; r < rows; r++) {
+                float expected = reference_dot(&w[r * row_bytes], &y[c * row_bytes], nb);
+                if (!same_bits(out[(size_t)c * rows + r], expected) && bad++ < 5) {
+                    PRINT_FAIL("2000 x 128 x 5 col %d row %d differs", c, r);
+                }
+            }
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("9 batch sizes and a pool-split 2000 x 128 x 5 match, padding untouched");
+    }
+
+    printf("\n%-24s %10s %10s %10s %10s\n", "Weights (Q8_0)", "Scalar", "GEMV", "GEMM x4", "Speed-up");
+    printf("%-24s %10s %10s %10s %10s\n", "", "GB/s", "GB/s", "GB/s", "");
+    const int bench_shapes[][2] = {{4096, 4096}, {14336, 4096}, {4096, 14336}};
+    for (size_t s = 0; s < sizeof(bench_shapes) / sizeof(bench_shapes[0]); s++) {
+        int rows = bench_shapes[s][0], nb = bench_shapes[s][1] / QK;
+        size_t row_bytes = (size_t)nb * BLOCK_BYTES;
+        double bytes = (double)rows * row_bytes;
+        std::vector<uint8_t> w = random_blocks((size_t)rows * nb, 800 + s);
+        std::vector<uint8_t> y = random_blocks((size_t)4 * nb, 900 + s);
+        std::vector<float> out((size_t)4 * rows);
+
+        double start = now();
+        for (int r = 0; r < rows; r++) {
+            out[r] = reference_dot(&w[r * row_bytes], y.data(), nb);
+        }
+        double scalar = bytes / (now() - start) / 1e9;
+        double vnni = measure([&] {
+            gemv(w.data(), row_bytes, rows, y.data(), nb, out.data());
+        }, bytes);
+        double batched = measure([&] {
+            gemm(w.data(), row_bytes, rows, y.data(), row_bytes, 4, nb, out.data(), rows);
+        }, bytes);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d x %d", rows, nb * QK);
+        printf("%-24s %10.2f %10.2f %10.2f %9.1fx\n", name, scalar, vnni, batched, vnni / scalar);
+    }
+    printf("\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * test_read_loader.cpp
+ *
+ * Test the --no-mmap loading path: large fread()/read() calls from a
+ * GGUF file served by the model loaders. Run under LD_PRELOAD. Data
+ * must land at the right place for any buffer and file alignment, the
+ * file position and stdio buffer must stay consistent with small reads
+ * around the large ones, and reads running past EOF must stop there.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t FILE_SIZE = 96 * MB + 1000;    // Unaligned EOF
+const size_t READ_SIZE = 40 * MB;
+
+// Write a GGUF-tagged file where each aligned 8-byte word holds its offset
+bool create_gguf_file(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        PRINT_FAIL("Cannot create test file: %s", strerror(errno));
+        return false;
+    }
+    const size_t chunk = 4 * MB;
+    uint64_t* buffer = (uint64_t*)malloc(chunk);
+    bool ok = buffer != NULL;
+    for (size_t written = 0; ok && written < FILE_SIZE; written += chunk) {
+        for (size_t i = 0; i < chunk / 8; i++) {
+            buffer[i] = written + i * 8;
+        }
+        if (written == 0) {
+            memcpy(buffer, "GGUF", 4);
+        }
+        size_t len = (FILE_SIZE - written < chunk) ? FILE_SIZE - written : chunk;
+        ok = write(fd, buffer, len) == (ssize_t)len;
+    }
+    free(buffer);
+    close(fd);
+    if (!ok) {
+        PRINT_FAIL("Cannot write test data");
+    }
+    return ok;
+}
+
+// Bytes of buf that differ from the file contents at offset
+size_t count_wrong(const char* buf, size_t len, size_t offset) {
+    size_t wrong = 0;
+    for (size_t i = 0; i < len; i++) {
+        size_t off = offset + i;
+        uint64_t word = off & ~(size_t)7;
+        char expected = (off < 4) ? "GGUF"[off] : ((const char*)&word)[off & 7];
+        wrong += (buf[i] != expected);
+    }
+    return wrong;
+}
+
+int main() {
+    PRINT_TEST("Large reads of GGUF files (--no-mmap)");
+    printf("\n");
+
+    char path[] = "/tmp/zen5_read_XXXXXX";
+    int tmp = mkstemp(path);
+    if (tmp < 0) {
+        PRINT_FAIL("Cannot create temporary file");
+        return 1;
+    }
+    close(tmp);
+    if (!create_gguf_file(path)) {
+        unlink(path);
+        return 1;
+    }
+
+    int failed = 0;
+    char* buffer = (char*)malloc(READ_SIZE + 4096);
+
+    PRINT_RUN("fread after a small header read");
+    FILE* f = fopen(path, "rb");
+    char header[100];
+    size_t got = f ? fread(header, 1, sizeof(header), f) : 0;
+    size_t items = f ? fread(buffer, 1024, READ_SIZE / 1024, f) : 0;
+    char after[16];
+    size_t small = f ? fread(after, 1, sizeof(after), f) : 0;
+    if (got != sizeof(header) || items != READ_SIZE / 1024 || small != sizeof(after) ||
+        count_wrong(buffer, READ_SIZE, 100) || count_wrong(after, sizeof(after), 100 + READ_SIZE) ||
+        ftell(f) != (long)(100 + READ_SIZE + sizeof(after))) {
+        PRINT_FAIL("Wrong data or stream position");
+        failed++;
+    } else {
+        PRINT_OK("Data and stream position correct");
+    }
+
+    PRINT_RUN("fread past EOF");
+    if (f) {
+        fseek(f, (long)(FILE_SIZE - READ_SIZE / 2), SEEK_SET);
+        items = fread(buffer, 1, READ_SIZE, f);
+        if (items != READ_SIZE / 2 || !feof(f) || count_wrong(buffer, READ_SIZE / 2, FILE_SIZE - READ_SIZE / 2)) {
+            PRINT_FAIL("Read %zu bytes, EOF %s", items, feof(f) ? "set" : "not set");
+            failed++;
+        } else {
+            PRINT_OK("Stopped at EOF with the EOF flag set");
+        }
+        fclose(f);
+    }
+
+    PRINT_RUN("read() into buffers of every alignment");
+    int fd = open(path, O_RDONLY);
+    size_t bad = 0;
+    const size_t shifts[] = {0, 1, 100, 4095};
+    for (size_t i = 0; i < sizeof(shifts) / sizeof(shifts[0]); i++) {
+        off_t start = (off_t)(4096 * i + 100);
+        lseek(fd, start, SEEK_SET);
+        ssize_t n = read(fd, buffer + shifts[i], READ_SIZE);
+        if (n != (ssize_t)READ_SIZE || count_wrong(buffer + shifts[i], READ_SIZE, (size_t)start) ||
+            lseek(fd, 0, SEEK_CUR) != start + (off_t)READ_SIZE) {
+            PRINT_FAIL("Buffer shift %zu: read %zd bytes", shifts[i], n);
+            bad++;
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("Data and file position correct");
+    }
+
+    PRINT_RUN("read() past EOF");
+    lseek(fd, (off_t)(FILE_SIZE - READ_SIZE / 2), SEEK_SET);
+    ssize_t n = read(fd, buffer, READ_SIZE);
+    ssize_t eof = read(fd, buffer, READ_SIZE);
+    if (n != (ssize_t)(READ_SIZE / 2) || eof != 0 ||
+        count_wrong(buffer, READ_SIZE / 2, FILE_SIZE - READ_SIZE / 2)) {
+        PRINT_FAIL("Read %zd bytes, then %zd", n, eof);
+        failed++;
+    } else {
+        PRINT_OK("Short read at EOF, then 0");
+    }
+    close(fd);
+
+    free(buffer);
+    unlink(path);
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * test_region_ops.cpp
+ *
+ * Test range operations on an intercepted mapping: madvise and
+ * posix_madvise hints, mprotect inside a hugepage, partial munmap of
+ * the head, an interior fragment and an unaligned tail (as llama.cpp
+ * does after loading), hugepages unmapped in cuts that each free none
+ * of them (from the edge, or starting in the middle), and mremap growth
+ * and shrink. Released hugepages must
+ * return to the pool.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t MB = 1024ULL * 1024;
+const size_t FILE_SIZE = 1280 * MB;
+
+// mincore() fails with ENOMEM for pages that are not mapped
+bool page_mapped(const char* addr) {
+    unsigned char vec;
+    return mincore((void*)addr, BLOCK_SIZE, &vec) == 0;
+}
+
+int main() {
+    PRINT_TEST("Range operations on intercepted mappings");
+    printf("\n");
+
+    // 2MB pages make every cut in this test hugepage-aligned
+    setenv("ZEN5_PAGE_POLICY", "2m", 1);
+
+    const char* test_file = "/tmp/zen5_region_ops.dat";
+    int failed = 0;
+
+    PRINT_RUN("Creating %.2f GB stamped test file", FILE_SIZE / (1024.0 * MB));
+    if (!create_stamped_file(test_file, FILE_SIZE)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    int fd = open(test_file, O_RDONLY);
+    if (fd < 0) {
+        PRINT_FAIL("Cannot open file: %s", strerror(errno));
+        unlink(test_file);
+        return 1;
+    }
+
+    long free_before = hugepages_free();
+    char* a = (char*)mmap(NULL, FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (a == MAP_FAILED) {
+        PRINT_FAIL("mmap failed: %s", strerror(errno));
+        close(fd);
+        unlink(test_file);
+        return 1;
+    }
+    size_t bad = verify_range(a, 0, FILE_SIZE);
+    if (bad) {
+        PRINT_FAIL("%zu blocks wrong after mmap", bad);
+        failed++;
+    }
+    long free_loaded = hugepages_free();
+
+    PRINT_RUN("Applying madvise / posix_madvise hints");
+    int ret_willneed = posix_madvise(a, FILE_SIZE, POSIX_MADV_WILLNEED);
+    int ret_random = posix_madvise(a, FILE_SIZE, POSIX_MADV_RANDOM);
+    if (ret_willneed != 0 || ret_random != 0) {
+        PRINT_FAIL("posix_madvise failed: WILLNEED %s, RANDOM %s",
+                   strerror(ret_willneed), strerror(ret_random));
+        failed++;
+    } else {
+        PRINT_OK("WILLNEED and RANDOM accepted");
+    }
+    if (madvise(a + 8 * MB + BLOCK_SIZE, MB, MADV_DONTNEED) != 0) {
+        PRINT_FAIL("madvise(MADV_DONTNEED) failed: %s", strerror(errno));
+        failed++;
+    } else if (verify_range(a, 8 * MB, 10 * MB) != 0) {
+        PRINT_FAIL("MADV_DONTNEED discarded model data");
+        failed++;
+    } else {
+        PRINT_OK("MADV_DONTNEED kept the data");
+    }
+
+    PRINT_RUN("mprotect on a single page inside a hugepage");
+    char* page = a + 64 * MB + BLOCK_SIZE;
+    if (mprotect(page, BLOCK_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        PRINT_FAIL("mprotect(PROT_READ | PROT_WRITE) failed: %s", strerror(errno));
+        failed++;
+    } else {
+        page[BLOCK_SIZE / 2] = 1;
+        if (mprotect(page, BLOCK_SIZE, PROT_READ) != 0) {
+            PRINT_FAIL("mprotect(PROT_READ) failed: %s", strerror(errno));
+            failed++;
+        } else {
+            PRINT_OK("Page made writable and read-only again");
+        }
+    }
+
+    PRINT_RUN("Unmapping head, interior fragment and unaligned tail");
+    const size_t head_end = 64 * MB;
+    const size_t hole_start = 512 * MB;
+    const size_t hole_end = 640 * MB;
+    const size_t tail_start = 1200 * MB + 3 * BLOCK_SIZE;
+    const size_t tail_cut = 1202 * MB;  // Next hugepage boundary
+    if (munmap(a, head_end) != 0 ||
+        munmap(a + hole_start, hole_end - hole_start) != 0 ||
+        munmap(a + tail_start, FILE_SIZE - tail_start) != 0) {
+        PRINT_FAIL("Partial munmap failed: %s", strerror(errno));
+        failed++;
+    }
+
+    bool gone = !page_mapped(a) && !page_mapped(a + head_end - BLOCK_SIZE) &&
+                !page_mapped(a + hole_start) && !page_mapped(a + hole_end - BLOCK_SIZE) &&
+                !page_mapped(a + tail_cut) && !page_mapped(a + FILE_SIZE - BLOCK_SIZE);
+    if (!gone) {
+        PRINT_FAIL("Unmapped fragments are still mapped");
+        failed++;
+    } else {
+        PRINT_OK("Fragments unmapped");
+    }
+
+    bad = verify_range(a, head_end, hole_start) + verify_range(a, hole_end, tail_start);
+    if (bad) {
+        PRINT_FAIL("%zu blocks wrong in the remaining pieces", bad);
+        failed++;
+    } else {
+        PRINT_OK("Remaining pieces intact");
+    }
+
+    long free_cut = hugepages_free();
+    if (free_loaded < free_before && free_cut <= free_loaded) {
+        PRINT_FAIL("Fragments did not return their hugepages");
+        failed++;
+    } else if (free_loaded < free_before) {
+        PRINT_OK("Fragments returned %ld hugepages", free_cut - free_loaded);
+    }
+
+    PRINT_RUN("Unmapping hugepages in cuts that each free none of them");
+    // The tail cut kept [1200MB, 1202MB) for the blocks up to tail_start.
+    // Its tail goes first, then its head; neither cut covers the page.
+    const size_t last_page = 1200 * MB;
+    const size_t first_page = hole_end;
+    bool cuts_ok = munmap(a + last_page + BLOCK_SIZE, tail_start - last_page - BLOCK_SIZE) == 0 &&
+                   page_mapped(a + last_page) &&
+                   munmap(a + last_page, BLOCK_SIZE) == 0;
+    // The piece's first page: head first, then the rest of the page
+    cuts_ok = cuts_ok && munmap(a + first_page, MB) == 0 && page_mapped(a + first_page + MB) &&
+              munmap(a + first_page + MB, MB) == 0;
+    // A page inside the piece: its middle, its first half and the rest
+    const size_t mid_page = first_page + 4 * MB;
+    cuts_ok = cuts_ok && munmap(a + mid_page + MB, MB / 2) == 0 &&
+              munmap(a + mid_page, MB) == 0 && page_mapped(a + mid_page + MB + MB / 2) &&
+              munmap(a + mid_page + MB + MB / 2, MB / 2) == 0;
+    if (!cuts_ok) {
+        PRINT_FAIL("Cuts inside a hugepage failed: %s", strerror(errno));
+        failed++;
+    } else if (page_mapped(a + last_page) || page_mapped(a + first_page) ||
+               page_mapped(a + mid_page)) {
+        PRINT_FAIL("A hugepage unmapped in cuts is still mapped");
+        failed++;
+    } else if (verify_range(a, first_page + 2 * MB, mid_page) != 0 ||
+               verify_range(a, mid_page + 2 * MB, last_page) != 0) {
+        PRINT_FAIL("Cuts inside a hugepage damaged the rest of the piece");
+        failed++;
+    } else if (free_loaded < free_before && hugepages_free() < free_cut + 3) {
+        PRINT_FAIL("Hugepages unmapped in cuts did not return to the pool");
+        failed++;
+    } else {
+        PRINT_OK("All three hugepages released once their last byte was unmapped");
+    }
+
+    if (munmap(a, FILE_SIZE) != 0) {
+        PRINT_FAIL("munmap of the remaining pieces failed: %s", strerror(errno));
+        failed++;
+    }
+
+    PRINT_RUN("Growing a mapping with mremap");
+    const size_t small = 1024 * MB;
+    char* b = (char*)mmap(NULL, small, PROT_READ, MAP_PRIVATE, fd, 0);
+    char* c = (b == MAP_FAILED) ? (char*)MAP_FAILED
+                                : (char*)mremap(b, small, FILE_SIZE, MREMAP_MAYMOVE);
+    if (c == MAP_FAILED) {
+        PRINT_FAIL("mremap growth failed: %s", strerror(errno));
+        failed++;
+        if (b != MAP_FAILED) {
+            munmap(b, small);
+        }
+    } else if ((bad = verify_range(c, 0, FILE_SIZE)) != 0) {
+        PRINT_FAIL("%zu blocks wrong after growth", bad);
+        failed++;
+    } else {
+        PRINT_OK("Grown mapping holds the whole file");
+    }
+
+    if (c != MAP_FAILED) {
+        PRINT_RUN("Shrinking it with mremap");
+        const size_t shrunk = 768 * MB;
+        char* d = (char*)mremap(c, FILE_SIZE, shrunk, 0);
+        if (d != c) {
+            PRINT_FAIL("mremap shrink failed: %s", strerror(errno));
+            failed++;
+            munmap(c, FILE_SIZE);
+        } else {
+            if (page_mapped(c + shrunk) || verify_range(c, 0, shrunk) != 0) {
+                PRINT_FAIL("Shrunk mapping has the wrong extent or data");
+                failed++;
+            } else {
+                PRINT_OK("Tail released, data intact");
+            }
+            munmap(c, shrunk);
+        }
+    }
+    close(fd);
+
+    PRINT_RUN("Checking hugepages are released");
+    long free_after = hugepages_free();
+    if (free_after < free_before) {
+        PRINT_FAIL("%ld hugepages still held", free_before - free_after);
+        failed++;
+    } else {
+        PRINT_OK("All hugepages returned to the pool");
+    }
+
+    unlink(test_file);
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * test_sgemm.cpp
+ *
+ * Test the exported cblas_sgemm / cblas_sgemv / cblas_sgemm_batch
+ * against a double precision reference. Run under LD_PRELOAD; the test
+ * re-executes itself with ZEN5_BLAS_MIN=0 (so even 1 x 1 products reach
+ * the in-tree kernels) and a 4-thread compute pool. Covers both layouts,
+ * every transpose combination, edge tiles, padded leading dimensions
+ * (padding must stay untouched), beta == 0 over NaN, and strided vectors.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "../include/test_colors.h"
+
+const int ROW_MAJOR = 101;
+const int COL_MAJOR = 102;
+const int NO_TRANS = 111;
+const int TRANS = 112;
+
+typedef void (*sgemm_fn)(int, int, int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+typedef void (*sgemv_fn)(int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+typedef void (*sgemm_batch_fn)(int, const int*, const int*, const int*, const int*, const int*,
+                               const float*, const float**, const int*, const float**, const int*,
+                               const float*, float**, const int*, int, const int*);
+
+const float SENTINEL = 12345.0f;
+
+void fill(std::vector<float>& v, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < v.size(); i++) {
+        v[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+}
+
+// Element (i, j) of a stored matrix, as CBLAS indexes it
+float at(const std::vector<float>& m, int layout, int ld, int i, int j) {
+    return layout == ROW_MAJOR ? m[(size_t)i * ld + j] : m[(size_t)j * ld + i];
+}
+
+// Run one cblas_sgemm case and compare with the reference; returns the
+// number of wrong elements (padding of C included)
+int check_sgemm(sgemm_fn sgemm, int layout, int ta, int tb, int m, int n, int k,
+                float alpha, float beta, int pad) {
+    bool row = layout == ROW_MAJOR;
+    // Stored shapes of A (m x k or k x m) and B (k x n or n x k)
+    int a_rows = ta == NO_TRANS ? m : k, a_cols = ta == NO_TRANS ? k : m;
+    int b_rows = tb == NO_TRANS ? k : n, b_cols = tb == NO_TRANS ? n : k;
+    int lda = (row ? a_cols : a_rows) + pad;
+    int ldb = (row ? b_cols : b_rows) + pad;
+    int ldc = (row ? n : m) + pad;
+
+    std::vector<float> a((size_t)lda * (row ? a_rows : a_cols) + 1);
+    std::vector<float> b((size_t)ldb * (row ? b_rows : b_cols) + 1);
+    std::vector<float> c((size_t)ldc * (row ? m : n) + 1, SENTINEL);
+    fill(a, 1 + m);
+    fill(b, 2 + n);
+    std::vector<float> c0(c.size());
+    fill(c0, 3 + k);
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            size_t idx = row ? (size_t)i * ldc + j : (size_t)j * ldc + i;
+            c[idx] = beta == 0.0f ? NAN : c0[idx];
+        }
+    }
+
+    sgemm(layout, ta, tb, m, n, k, alpha, a.data(), lda, b.data(), ldb, beta, c.data(), ldc);
+
+    int wrong = 0;
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double sum = 0.0, magnitude = 0.0;
+            for (int p = 0; p < k; p++) {
+                double av = ta == NO_TRANS ? at(a, layout, lda, i, p) : at(a, layout, lda, p, i);
+                double bv = tb == NO_TRANS ? at(b, layout, ldb, p, j) : at(b, layout, ldb, j, p);
+                sum += av * bv;
+                magnitude += fabs(av * bv);
+            }
+            size_t idx = row ? (size_t)i * ldc + j : (size_t)j * ldc + i;
+            double expected = alpha * sum + (beta == 0.0f ? 0.0 : beta * c0[idx]);
+            double tolerance = 1e-5 * (1.0 + fabs(alpha) * magnitude + fabs(beta * c0[idx]));
+            if (!(fabs(c[idx] - expected) <= tolerance)) {
+                wrong++;
+            }
+            c[idx] = SENTINEL;
+        }
+    }
+    for (size_t i = 0; i < c.size(); i++) {
+        wrong += (c[i] != SENTINEL);
+    }
+    return wrong;
+}
+
+int check_sgemv(sgemv_fn sgemv, int layout, int trans, int m, int n, int incx, int incy, float beta) {
+    bool row = layout == ROW_MAJOR;
+    int lda = (row ? n : m) + 3;
+    int len_x = trans == NO_TRANS ? n : m;
+    int len_y = trans == NO_TRANS ? m : n;
+    std::vector<float> a((size_t)lda * (row ? m : n));
+    std::vector<float> x((size_t)len_x * abs(incx));
+    std::vector<float> y0((size_t)len_y * abs(incy));
+    fill(a, 4 + m);
+    fill(x, 5 + n);
+    fill(y0, 6);
+    std::vector<float> y(y0);
+    if (beta == 0.0f) {
+        for (size_t i = 0; i < y.size(); i++) {
+            y[i] = NAN;
+        }
+    }
+
+    sgemv(layout, trans, m, n, 0.75f, a.data(), lda, x.data(), incx, beta, y.data(), incy);
+
+    int wrong = 0;
+    for (int o = 0; o < len_y; o++) {
+        double sum = 0.0, magnitude = 0.0;
+        for (int q = 0; q < len_x; q++) {
+            double av = trans == NO_TRANS ? at(a, layout, lda, o, q) : at(a, layout, lda, q, o);
+            double xv = x[incx > 0 ? (size_t)q * incx : (size_t)(len_x - 1 - q) * -incx];
+            sum += av * xv;
+            magnitude += fabs(av * xv);
+        }
+        size_t iy = incy > 0 ? (size_t)o * incy : (size_t)(len_y - 1 - o) * -incy;
+        double expected = 0.75 * sum + (beta == 0.0f ? 0.0 : beta * y0[iy]);
+        if (!(fabs(y[iy] - expected) <= 1e-5 * (1.0 + magnitude + fabs(beta * y0[iy])))) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // ZEN5_BLAS_MIN is read in the library constructor
+    if (!getenv("ZEN5_BLAS_MIN")) {
+        setenv("ZEN5_BLAS_MIN", "0", 1);
+        setenv("ZEN5_COMPUTE_THREADS", "4", 0);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    PRINT_TEST("cblas_sgemm / cblas_sgemv interposition");
+    printf("\n");
+
+    sgemm_fn sgemm = (sgemm_fn)dlsym(RTLD_DEFAULT, "cblas_sgemm");
+    sgemv_fn sgemv = (sgemv_fn)dlsym(RTLD_DEFAULT, "cblas_sgemv");
+    sgemm_batch_fn sgemm_batch = (sgemm_batch_fn)dlsym(RTLD_DEFAULT, "cblas_sgemm_batch");
+    if (!sgemm || !sgemv || !sgemm_batch) {
+        PRINT_FAIL("CBLAS functions not found (library not preloaded?)");
+        return 1;
+    }
+
+    int failed = 0;
+
+    PRINT_RUN("sgemm: layouts, transposes and edge tiles");
+    const int shapes[][3] = {{1, 1, 1}, {7, 13, 5}, {12, 32, 192}, {13, 33, 193},
+                             {37, 70, 300}, {100, 257, 129}, {25, 48, 517}};
+    int bad = 0;
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        for (int layout = ROW_MAJOR; layout <= COL_MAJOR; layout++) {
+            for (int ta = NO_TRANS; ta <= TRANS; ta++) {
+                for (int tb = NO_TRANS; tb <= TRANS; tb++) {
+                    int m = shapes[s][0], n = shapes[s][1], k = shapes[s][2];
+                    int wrong = check_sgemm(sgemm, layout, ta, tb, m, n, k, 1.5f, 0.5f, 3) +
+                                check_sgemm(sgemm, layout, ta, tb, m, n, k, -1.0f, 0.0f, 0);
+                    if (wrong) {
+                        PRINT_FAIL("%s %c%c %dx%dx%d: %d wrong elements",
+                                   layout == ROW_MAJOR ? "row" : "col", ta == TRANS ? 'T' : 'N',
+                                   tb == TRANS ? 'T' : 'N', m, n, k, wrong);
+                        bad++;
+                    }
+                }
+            }
+        }
+    }
+    if (bad) {
+        failed++;
+    } else {
+        PRINT_OK("%zu shapes x 8 variants, padding untouched, beta 0 ignores NaN",
+                 sizeof(shapes) / sizeof(shapes[0]));
+    }
+
+    PRINT_RUN("sgemm split across the compute pool");
+    int wrong = check_sgemm(sgemm, ROW_MAJOR, NO_TRANS, TRANS, 300, 1000, 700, 1.0f, 0.0f, 5) +
+                check_sgemm(sgemm, COL_MAJOR, TRANS, NO_TRANS, 517, 301, 400, 2.0f, 1.0f, 0);
+    if (wrong) {
+        PRINT_FAIL("%d wrong elements", wrong);
+        failed++;
+    } else {
+        PRINT_OK("300x1000x700 and 517x301x400 correct");
+    }
+
+    PRINT_RUN("sgemm with k == 0 scales C by beta");
+    float c[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    float unused = 0.0f;
+    sgemm(ROW_MAJOR, NO_TRANS, NO_TRANS, 2, 2, 0, 1.0f, &unused, 1, &unused, 2, 3.0f, c, 2);
+    if (c[0] != 3.0f || c[3] != 12.0f) {
+        PRINT_FAIL("C = {%g, %g, %g, %g}", c[0], c[1], c[2], c[3]);
+        failed++;
+    } else {
+        PRINT_OK("C scaled");
+    }
+
+    PRINT_RUN("sgemv: layouts, transposes and strides");
+    bad = 0;
+    for (int layout = ROW_MAJOR; layout <= COL_MAJOR; layout++) {
+        for (int trans = NO_TRANS; trans <= TRANS; trans++) {
+            bad += check_sgemv(sgemv, layout, trans, 1000, 37, 1, 1, 0.5f) != 0;
+            bad += check_sgemv(sgemv, layout, trans, 33, 2000, 1, 1, 0.0f) != 0;
+            bad += check_sgemv(sgemv, layout, trans, 1500, 1100, 1, 1, 1.0f) != 0;
+            bad += check_sgemv(sgemv, layout, trans, 50, 70, 2, -3, 0.5f) != 0;
+        }
+    }
+    if (bad) {
+        PRINT_FAIL("%d of 16 cases wrong", bad);
+        failed++;
+    } else {
+        PRINT_OK("16 cases correct");
+    }
+
+    PRINT_RUN("sgemm_batch: two groups");
+    const int count = 7;
+    int trans_a[2] = {NO_TRANS, TRANS}, trans_b[2] = {TRANS, NO_TRANS};
+    int m[2] = {20, 64}, n[2] = {30, 64}, k[2] = {40, 64};
+    int lda[2] = {40, 64}, ldb[2] = {40, 64}, ldc[2] = {30, 64};
+    float alpha[2] = {1.0f, 0.5f}, beta[2] = {0.0f, 0.0f};
+    int group_size[2] = {5, 2};
+    std::vector<float> storage_a[count], storage_b[count], storage_c[count];
+    const float* pa[count];
+    const float* pb[count];
+    float* pc[count];
+    for (int i = 0; i < count; i++) {
+        int g = i < 5 ? 0 : 1;
+        storage_a[i].resize((size_t)m[g] * k[g]);
+        storage_b[i].resize((size_t)k[g] * n[g]);
+        storage_c[i].assign((size_t)m[g] * n[g], NAN);
+        fill(storage_a[i], 10 + i);
+        fill(storage_b[i], 20 + i);
+        pa[i] = storage_a[i].data();
+        pb[i] = storage_b[i].data();
+        pc[i] = storage_c[i].data();
+    }
+    sgemm_batch(ROW_MAJOR, trans_a, trans_b, m, n, k, alpha, pa, lda, pb, ldb, beta, pc, ldc, 2, group_size);
+    bad = 0;
+    for (int i = 0; i < count; i++) {
+        int g = i < 5 ? 0 : 1;
+        for (int r = 0; r < m[g]; r++) {
+            for (int col = 0; col < n[g]; col++) {
+                double sum = 0.0;
+                for (int p = 0; p < k[g]; p++) {
+                    double av = g == 0 ? storage_a[i][(size_t)r * lda[g] + p] : storage_a[i][(size_t)p * lda[g] + r];
+                    double bv = g == 0 ? storage_b[i][(size_t)col * ldb[g] + p] : storage_b[i][(size_t)p * ldb[g] + col];
+                    sum += av * bv;
+                }
+                bad += !(fabs(storage_c[i][(size_t)r * ldc[g] + col] - alpha[g] * sum) <= 1e-4);
+            }
+        }
+    }
+    if (bad) {
+        PRINT_FAIL("%d wrong elements", bad);
+        failed++;
+    } else {
+        PRINT_OK("7 products correct");
+    }
+
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * test_sgemm_sweep.cpp
+ *
+ * Shape sweep of the in-tree cblas_sgemm / cblas_sgemv against the
+ * system BLAS. Run under LD_PRELOAD: the preloaded symbols are the
+ * in-tree kernels, the system library (ZEN5_SWEEP_BLAS, else the first
+ * of OpenBLAS, BLIS, MKL, reference CBLAS found) is opened privately so
+ * its own functions can be called. Square sizes, llama.cpp prefill
+ * shapes (tokens x weight rows x hidden size, weights transposed) and
+ * decode GEMVs are timed; results must agree, speed is reported only.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const int ROW_MAJOR = 101;
+const int NO_TRANS = 111;
+const int TRANS = 112;
+
+typedef void (*sgemm_fn)(int, int, int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+typedef void (*sgemv_fn)(int, int, int, int, float, const float*, int,
+                         const float*, int, float, float*, int);
+
+struct Shape {
+    const char* name;
+    int m;
+    int n;
+    int k;
+    int trans_b;
+};
+
+// GFLOPS of fn
+template <typename F>
+double measure(F fn, double flops) {
+    return flops / seconds_per_call(fn) / 1e9;
+}
+
+double max_difference(const std::vector<float>& x, const std::vector<float>& y) {
+    double worst = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        double scale = fabs(y[i]) > 1.0 ? fabs(y[i]) : 1.0;
+        double diff = fabs(x[i] - y[i]) / scale;
+        worst = diff > worst ? diff : worst;
+    }
+    return worst;
+}
+
+int main() {
+    PRINT_TEST("SGEMM / SGEMV shape sweep against the system BLAS");
+    printf("\n");
+
+    sgemm_fn own_sgemm = (sgemm_fn)dlsym(RTLD_DEFAULT, "cblas_sgemm");
+    sgemv_fn own_sgemv = (sgemv_fn)dlsym(RTLD_DEFAULT, "cblas_sgemv");
+    if (!own_sgemm || !own_sgemv) {
+        PRINT_FAIL("cblas_sgemm not found (library not preloaded?)");
+        return 1;
+    }
+
+    const char* candidates[] = {getenv("ZEN5_SWEEP_BLAS"), "libopenblas.so.0", "libblis.so.4",
+                                "libmkl_rt.so.2", "libcblas.so.3", "libblas.so.3"};
+    void* handle = NULL;
+    const char* library = NULL;
+    sgemm_fn sys_sgemm = NULL;
+    sgemv_fn sys_sgemv = NULL;
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]) && !sys_sgemm; i++) {
+        if (candidates[i] && (handle = dlopen(candidates[i], RTLD_NOW | RTLD_LOCAL))) {
+            sys_sgemm = (sgemm_fn)dlsym(handle, "cblas_sgemm");
+            sys_sgemv = (sgemv_fn)dlsym(handle, "cblas_sgemv");
+            library = candidates[i];
+        }
+    }
+    if (!sys_sgemm || !sys_sgemv || sys_sgemm == own_sgemm) {
+        PRINT_WARN("No system CBLAS found, sweep skipped (set ZEN5_SWEEP_BLAS)");
+        printf("\n");
+        return 0;
+    }
+    PRINT_INFO("System BLAS: %s", library);
+    printf("\n");
+
+    const Shape shapes[] = {
+        {"square 128", 128, 128, 128, NO_TRANS},
+        {"square 256", 256, 256, 256, NO_TRANS},
+        {"square 512", 512, 512, 512, NO_TRANS},
+        {"square 1024", 1024, 1024, 1024, NO_TRANS},
+        {"square 2048", 2048, 2048, 2048, NO_TRANS},
+        {"prefill 32 x 4096 x 4096", 32, 4096, 4096, TRANS},
+        {"prefill 128 x 4096 x 4096", 128, 4096, 4096, TRANS},
+        {"prefill 512 x 4096 x 4096", 512, 4096, 4096, TRANS},
+        {"prefill 512 x 14336 x 4096", 512, 14336, 4096, TRANS},
+        {"prefill 512 x 4096 x 14336", 512, 4096, 14336, TRANS},
+        {"prefill 512 x 1024 x 4096", 512, 1024, 4096, TRANS},
+    };
+
+    int failed = 0;
+    printf("%-30s %12s %12s %8s\n", "Shape", "In-tree", "System", "Ratio");
+    printf("%-30s %12s %12s %8s\n", "", "GFLOPS", "GFLOPS", "");
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        const Shape& sh = shapes[s];
+        std::vector<float> a((size_t)sh.m * sh.k), b((size_t)sh.k * sh.n);
+        std::vector<float> c_own((size_t)sh.m * sh.n), c_sys((size_t)sh.m * sh.n);
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = (float)((i * 7919) % 2001) / 1000.0f - 1.0f;
+        }
+        for (size_t i = 0; i < b.size(); i++) {
+            b[i] = (float)((i * 104729) % 2003) / 1000.0f - 1.0f;
+        }
+        int ldb = sh.trans_b == TRANS ? sh.k : sh.n;
+        double flops = 2.0 * sh.m * sh.n * sh.k;
+
+        double own = measure([&] {
+            own_sgemm(ROW_MAJOR, NO_TRANS, sh.trans_b, sh.m, sh.n, sh.k, 1.0f,
+                      a.data(), sh.k, b.data(), ldb, 0.0f, c_own.data(), sh.n);
+        }, flops);
+        double sys = measure([&] {
+            sys_sgemm(ROW_MAJOR, NO_TRANS, sh.trans_b, sh.m, sh.n, sh.k, 1.0f,
+                      a.data(), sh.k, b.data(), ldb, 0.0f, c_sys.data(), sh.n);
+        }, flops);
+
+        double diff = max_difference(c_own, c_sys);
+        printf("%-30s %12.1f %12.1f %7.2fx%s\n", sh.name, own, sys, own / sys,
+               diff > 1e-3 ? "  MISMATCH" : "");
+        failed += diff > 1e-3;
+    }
+
+    printf("\n%-30s %12s %12s %8s\n", "GEMV (decode)", "GB/s", "GB/s", "");
+    const int gemv_shapes[][3] = {{4096, 4096, NO_TRANS}, {14336, 4096, NO_TRANS},
+                                  {4096, 14336, NO_TRANS}, {4096, 4096, TRANS}};
+    for (size_t s = 0; s < sizeof(gemv_shapes) / sizeof(gemv_shapes[0]); s++) {
+        int m = gemv_shapes[s][0], n = gemv_shapes[s][1], trans = gemv_shapes[s][2];
+        std::vector<float> a((size_t)m * n), x(trans == NO_TRANS ? n : m);
+        std::vector<float> y_own(trans == NO_TRANS ? m : n), y_sys(y_own.size());
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = (float)((i * 7919) % 2001) / 1000.0f - 1.0f;
+        }
+        for (size_t i = 0; i < x.size(); i++) {
+            x[i] = (float)(i % 17) / 17.0f;
+        }
+        double bytes = 4.0 * m * n;
+
+        double own = measure([&] {
+            own_sgemv(ROW_MAJOR, trans, m, n, 1.0f, a.data(), n, x.data(), 1, 0.0f, y_own.data(), 1);
+        }, bytes);
+        double sys = measure([&] {
+            sys_sgemv(ROW_MAJOR, trans, m, n, 1.0f, a.data(), n, x.data(), 1, 0.0f, y_sys.data(), 1);
+        }, bytes);
+
+        double diff = max_difference(y_own, y_sys);
+        char name[64];
+        snprintf(name, sizeof(name), "%d x %d%s", m, n, trans == TRANS ? " (T)" : "");
+        printf("%-30s %12.1f %12.1f %7.2fx%s\n", name, own, sys, own / sys,
+               diff > 1e-3 ? "  MISMATCH" : "");
+        failed += diff > 1e-3;
+    }
+    printf("\n");
+
+    if (failed) {
+        PRINT_FAIL("%d shapes disagree with %s", failed, library);
+    } else {
+        PRINT_OK("All shapes agree with %s", library);
+    }
+    dlclose(handle);
+    return failed ? 1 : 0;
+}
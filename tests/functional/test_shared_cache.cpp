@@ -0,0 +1,275 @@
+/*
+ * test_shared_cache.cpp
+ *
+ * Test the cross-process hugepage cache (ZEN5_MAP_MODE=shared).
+ * A child process maps the model first; the parent then maps the same
+ * file and must attach to the child's hugepages rather than consume
+ * another copy from the pool. Once both unmap, the pages must be
+ * returned to the pool.
+ *
+ * With ZEN5_CACHE_PERSIST the entry must outlive the process that
+ * created it, be reused by the next one, and be replaced once the
+ * source file changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
+
+const size_t TEST_SIZE = 1100ULL * 1024 * 1024;  // Just over the 1GB threshold
+
+// Find the directory the library will use for cache entries
+bool find_hugetlbfs(char* dir, size_t size) {
+    if (getenv("ZEN5_HUGETLBFS_DIR")) {
+        snprintf(dir, size, "%s", getenv("ZEN5_HUGETLBFS_DIR"));
+        return true;
+    }
+    FILE* f = fopen("/proc/mounts", "r");
+    if (!f) {
+        return false;
+    }
+    char line[512];
+    char mount_dir[256], type[64];
+    bool found = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%*s %255s %63s", mount_dir, type) == 2 &&
+            strcmp(type, "hugetlbfs") == 0) {
+            snprintf(dir, size, "%s", mount_dir);
+            found = true;
+            break;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Delete persistent entries left by this test
+void remove_warm_entries(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, "zen5-warm-", 10) == 0) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+// Count lock files of transient entries (the persistent ones keep theirs)
+int count_lock_files(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "zen5-", 5) == 0 &&
+            strncmp(entry->d_name, "zen5-warm-", 10) != 0 &&
+            len > 5 && strcmp(entry->d_name + len - 5, ".lock") == 0) {
+            count++;
+        }
+    }
+    closedir(d);
+    return count;
+}
+
+// Map the file read-only and check every block stamp
+void* map_and_verify(const char* path, bool* ok) {
+    *ok = false;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return MAP_FAILED;
+    }
+    void* addr = mmap(NULL, TEST_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    const char* data = (const char*)addr;
+    for (size_t block = 0; block < TEST_SIZE / BLOCK_SIZE; block++) {
+        uint64_t stamp;
+        memcpy(&stamp, data + block * BLOCK_SIZE, sizeof(stamp));
+        if (stamp != block) {
+            return addr;
+        }
+    }
+    *ok = true;
+    return addr;
+}
+
+// Map and verify the file in a short-lived child process (a "restart")
+bool map_in_child(const char* path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        bool ok;
+        void* addr = map_and_verify(path, &ok);
+        _exit(addr != MAP_FAILED && ok ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main() {
+    PRINT_TEST("Cross-process shared hugepage cache");
+    printf("\n");
+
+    setenv("ZEN5_MAP_MODE", "shared", 1);
+
+    char hugetlbfs_dir[256];
+    if (!find_hugetlbfs(hugetlbfs_dir, sizeof(hugetlbfs_dir))) {
+        PRINT_WARN("No hugetlbfs mount (mount -t hugetlbfs none /dev/hugepages), skipping");
+        return 0;
+    }
+
+    const long pages_needed = (long)((TEST_SIZE + (2 << 20) - 1) / (2 << 20));
+    long free_before = hugepages_free();
+    if (free_before < pages_needed) {
+        PRINT_WARN("Only %ld free hugepages (need %ld), skipping", free_before, pages_needed);
+        return 0;
+    }
+
+    const char* test_file = "/tmp/zen5_shared_cache.dat";
+    PRINT_RUN("Creating %.2f GB stamped test file", TEST_SIZE / (1024.0 * 1024.0 * 1024.0));
+    if (!create_stamped_file(test_file, TEST_SIZE)) {
+        unlink(test_file);
+        return 1;
+    }
+
+    int to_parent[2], to_child[2];
+    if (pipe(to_parent) != 0 || pipe(to_child) != 0) {
+        PRINT_FAIL("pipe failed: %s", strerror(errno));
+        unlink(test_file);
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child: create the entry, then hold it until the parent is done
+        bool ok;
+        void* addr = map_and_verify(test_file, &ok);
+        char status = (addr != MAP_FAILED && ok) ? 'y' : 'n';
+        write(to_parent[1], &status, 1);
+        read(to_child[0], &status, 1);
+        if (addr != MAP_FAILED) {
+            munmap(addr, TEST_SIZE);
+        }
+        _exit(0);
+    }
+
+    int failed = 0;
+    char status = 'n';
+    read(to_parent[0], &status, 1);
+
+    PRINT_RUN("First process maps the file");
+    long free_after_first = hugepages_free();
+    if (status != 'y') {
+        PRINT_FAIL("Child mapping failed or returned wrong data");
+        failed++;
+    } else if (free_before - free_after_first < pages_needed) {
+        PRINT_WARN("Child mapping does not use the hugepage pool (shared cache unavailable?)");
+    } else {
+        PRINT_OK("Child loaded the model into %ld hugepages", free_before - free_after_first);
+    }
+
+    PRINT_RUN("Second process maps the same file");
+    bool ok;
+    void* addr = map_and_verify(test_file, &ok);
+    long free_after_second = hugepages_free();
+    if (addr == MAP_FAILED || !ok) {
+        PRINT_FAIL("Parent mapping failed or returned wrong data");
+        failed++;
+    } else if (free_after_second < free_after_first) {
+        PRINT_FAIL("Second mapping consumed %ld more hugepages",
+                   free_after_first - free_after_second);
+        failed++;
+    } else {
+        PRINT_OK("Second mapping attached without consuming hugepages");
+    }
+
+    if (addr != MAP_FAILED) {
+        munmap(addr, TEST_SIZE);
+    }
+    write(to_child[1], &status, 1);
+    waitpid(pid, NULL, 0);
+
+    PRINT_RUN("Checking hugepages are released after the last unmap");
+    long free_after = hugepages_free();
+    if (free_after < free_before) {
+        PRINT_FAIL("%ld hugepages still held", free_before - free_after);
+        failed++;
+    } else {
+        PRINT_OK("All hugepages returned to the pool");
+    }
+
+    PRINT_RUN("Checking lock files are removed with their entries");
+    int locks_left = count_lock_files(hugetlbfs_dir);
+    if (locks_left > 0) {
+        PRINT_FAIL("%d lock files left in %s", locks_left, hugetlbfs_dir);
+        failed++;
+    } else {
+        PRINT_OK("No lock files left");
+    }
+
+    PRINT_RUN("Persistent entry survives process exit");
+    setenv("ZEN5_CACHE_PERSIST", "1", 1);
+    if (!map_in_child(test_file)) {
+        PRINT_FAIL("Mapping in first process failed or returned wrong data");
+        failed++;
+    }
+    long free_warm = hugepages_free();
+    if (free_before - free_warm < pages_needed) {
+        PRINT_FAIL("Entry was not kept after its only user exited");
+        failed++;
+    } else {
+        PRINT_OK("Entry kept (%ld hugepages)", free_before - free_warm);
+    }
+
+    PRINT_RUN("Restarted process reuses the persistent entry");
+    if (!map_in_child(test_file)) {
+        PRINT_FAIL("Mapping in restarted process failed or returned wrong data");
+        failed++;
+    } else if (hugepages_free() != free_warm) {
+        PRINT_FAIL("Restarted process did not reuse the entry");
+        failed++;
+    } else {
+        PRINT_OK("Restarted process attached to the loaded hugepages");
+    }
+
+    PRINT_RUN("Modified source file replaces the persistent entry");
+    struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_NOW}};
+    utimensat(AT_FDCWD, test_file, times, 0);
+    if (!map_in_child(test_file)) {
+        PRINT_FAIL("Mapping after modification failed or returned wrong data");
+        failed++;
+    } else if (hugepages_free() != free_warm) {
+        PRINT_FAIL("Stale entry was not removed (%ld hugepages held)",
+                   free_before - hugepages_free());
+        failed++;
+    } else {
+        PRINT_OK("Stale entry removed, new entry created");
+    }
+
+    remove_warm_entries(hugetlbfs_dir);
+    unlink(test_file);
+    printf("\n");
+    return failed ? 1 : 0;
+}
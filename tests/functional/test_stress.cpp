@@ -3,7 +3,7 @@
  *
  * Stress testing for the zen5_optimizer library.
  * Tests reliability under heavy load, concurrent operations,
- * and memory pressure scenarios.
+ * memory pressure scenarios and concurrent region tracking.
  */
 
 #include <stdio.h>
@@ -21,6 +21,7 @@
 #include <vector>
 #include <string>
 #include "../include/test_colors.h"
+#include "../include/test_fixtures.h"
 
 // Test parameters
 const size_t LARGE_SIZE = 1536 * 1024 * 1024;  // 1.5 GB
@@ -97,6 +98,69 @@ void* stress_worker(void* arg) {
     return NULL;
 }
 
+// Test 5 workers: mappers intercept large files while churners hammer
+// munmap with small untracked mappings (the tracker's lock-free path)
+const int TRACKER_MAPPERS = 2;
+const int TRACKER_CHURNERS = 14;
+const int TRACKER_MAPS_PER_THREAD = 4;
+std::atomic<int> mappers_running(0);
+std::atomic<long> churn_ops(0);
+std::atomic<int> tracker_errors(0);
+
+void* tracker_mapper(void* arg) {
+    int id = *(int*)arg;
+    char filename[256];
+    snprintf(filename, sizeof(filename), "/tmp/zen5_tracker_%d.dat", id);
+
+    if (create_test_file(filename, MEDIUM_SIZE + 64 * 1024 * 1024)) {
+        size_t size = MEDIUM_SIZE + 64 * 1024 * 1024;
+        for (int i = 0; i < TRACKER_MAPS_PER_THREAD; i++) {
+            int fd = open(filename, O_RDONLY);
+            if (fd < 0) {
+                tracker_errors++;
+                break;
+            }
+            char* addr = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (addr == MAP_FAILED) {
+                tracker_errors++;
+                continue;
+            }
+            if (memcmp(addr, "STRESS_TEST", 11) != 0) {
+                tracker_errors++;
+            }
+            if (munmap(addr, size) != 0) {
+                tracker_errors++;
+            }
+        }
+        unlink(filename);
+    } else {
+        tracker_errors++;
+    }
+
+    mappers_running--;
+    return NULL;
+}
+
+void* tracker_churner(void*) {
+    const size_t size = 64 * 1024;
+    while (mappers_running > 0) {
+        char* addr = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            tracker_errors++;
+            continue;
+        }
+        addr[0] = 1;
+        addr[size - 1] = 2;
+        if (addr[0] != 1 || addr[size - 1] != 2 || munmap(addr, size) != 0) {
+            tracker_errors++;
+        }
+        churn_ops++;
+    }
+    return NULL;
+}
+
 int main() {
     PRINT_TEST("Stress testing");
     printf("\n");
@@ -329,6 +393,54 @@ int main() {
         printf("\n");
     }
 
+    // Test 5: Region tracker under concurrent mmap/munmap
+    PRINT_RUN("Test 5: Region tracker with %d mapping and %d munmap-heavy threads",
+              TRACKER_MAPPERS, TRACKER_CHURNERS);
+    {
+        pthread_t threads[TRACKER_MAPPERS + TRACKER_CHURNERS];
+        int ids[TRACKER_MAPPERS];
+        long free_before = hugepages_free();
+        int started = 0;
+
+        mappers_running = TRACKER_MAPPERS;
+        churn_ops = 0;
+        tracker_errors = 0;
+
+        for (int i = 0; i < TRACKER_MAPPERS; i++) {
+            ids[i] = i;
+            if (pthread_create(&threads[started], NULL, tracker_mapper, &ids[i]) == 0) {
+                started++;
+            } else {
+                mappers_running--;
+                tracker_errors++;
+            }
+        }
+        for (int i = 0; i < TRACKER_CHURNERS; i++) {
+            if (pthread_create(&threads[started], NULL, tracker_churner, NULL) == 0) {
+                started++;
+            }
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+
+        long free_after = hugepages_free();
+        PRINT_INFO("%ld untracked mmap/munmap cycles alongside %d intercepted maps",
+                   churn_ops.load(), TRACKER_MAPPERS * TRACKER_MAPS_PER_THREAD);
+
+        if (tracker_errors > 0) {
+            PRINT_FAIL("%d errors during concurrent mapping", tracker_errors.load());
+            total_failed++;
+        } else if (free_after != free_before) {
+            PRINT_FAIL("%ld hugepages leaked", free_before - free_after);
+            total_failed++;
+        } else {
+            PRINT_OK("Tracker consistent under concurrency, no hugepages leaked");
+            total_passed++;
+        }
+        printf("\n");
+    }
+
     // Summary
     printf("[test_stress] Summary:\n");
     printf("  Total tests: %d\n", total_passed + total_failed);
@@ -0,0 +1,136 @@
+/*
+ * test_text_remap.cpp
+ *
+ * Test moving text segments onto huge pages (ZEN5_TEXT_HUGEPAGES). Run
+ * under LD_PRELOAD; the test re-executes itself with the feature on.
+ * Its own text carries 6MB of int3 padding with a small function in
+ * the middle, so it always has whole 2MB pages to move: the function
+ * must end up on 2MB pages, still run, and the padding must be intact.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include "../include/test_colors.h"
+
+const size_t MB = 1024ULL * 1024;
+
+asm(".pushsection .text\n"
+    ".balign 4096\n"
+    ".globl text_pad_start\n"
+    "text_pad_start:\n"
+    ".skip 3145728, 0xcc\n"
+    ".globl remapped_probe\n"
+    ".type remapped_probe, @function\n"
+    "remapped_probe:\n"
+    "    movl $42, %eax\n"
+    "    ret\n"
+    ".skip 3145728, 0xcc\n"
+    ".globl text_pad_end\n"
+    "text_pad_end:\n"
+    ".popsection\n");
+
+extern "C" int remapped_probe();
+extern "C" const unsigned char text_pad_start[];
+extern "C" const unsigned char text_pad_end[];
+
+// smaps entry of the mapping holding addr: whether it is file-backed,
+// and its largest page size (kB, THP counted as 2MB)
+bool mapping_info(const void* addr, bool* file_backed, size_t* page_kb) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        return false;
+    }
+    char line[512];
+    bool inside = false;
+    bool found = false;
+    *page_kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end;
+        int path_at = 0;
+        if (sscanf(line, "%lx-%lx %*s %*s %*s %*s %n", &start, &end, &path_at) == 2 &&
+            strchr(line, '-') < strchr(line, ' ')) {
+            if (inside) {
+                break;
+            }
+            inside = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+            if (inside) {
+                found = true;
+                // hugetlb memory shows as "/anon_hugepage (deleted)"
+                *file_backed = path_at > 0 && line[path_at] == '/' &&
+                               strncmp(line + path_at, "/anon_hugepage", 14) != 0;
+            }
+            continue;
+        }
+        size_t kb;
+        if (inside && sscanf(line, "KernelPageSize: %zu kB", &kb) == 1) {
+            *page_kb = kb;
+        }
+        if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 && kb > 0 && *page_kb < 2048) {
+            *page_kb = 2048;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // The remap runs in the library constructor, so the setting has to
+    // be in place when the process starts
+    if (!getenv("ZEN5_TEXT_HUGEPAGES")) {
+        setenv("ZEN5_TEXT_HUGEPAGES", "1", 1);
+        setenv("ZEN5_TEXT_MATCH", "none", 1);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    PRINT_TEST("Text segments on huge pages");
+    printf("\n");
+
+    int failed = 0;
+
+    PRINT_RUN("Mapping of a function in the middle of the text");
+    bool file_backed = true;
+    size_t page_kb = 0;
+    if (!mapping_info((void*)&remapped_probe, &file_backed, &page_kb)) {
+        PRINT_FAIL("Function not found in /proc/self/smaps");
+        failed++;
+    } else if (file_backed) {
+        PRINT_FAIL("Text still file-backed (library not preloaded?)");
+        failed++;
+    } else if (page_kb < 2048) {
+        PRINT_WARN("Text moved, but onto %zu kB pages (no hugepages or THP)", page_kb);
+    } else {
+        PRINT_OK("On %zu kB pages", page_kb);
+    }
+
+    PRINT_RUN("Calling it");
+    if (remapped_probe() != 42) {
+        PRINT_FAIL("Wrong result");
+        failed++;
+    } else {
+        PRINT_OK("Runs from the new pages");
+    }
+
+    PRINT_RUN("Contents of the moved text");
+    size_t wrong = 0;
+    const unsigned char* probe = (const unsigned char*)&remapped_probe;
+    for (const unsigned char* p = text_pad_start; p < text_pad_end; p++) {
+        if (p < probe || p >= probe + 6) {
+            wrong += (*p != 0xcc);
+        }
+    }
+    if (wrong) {
+        PRINT_FAIL("%zu bytes of %.1f MB changed", wrong, (text_pad_end - text_pad_start) / (double)MB);
+        failed++;
+    } else {
+        PRINT_OK("%.1f MB intact", (text_pad_end - text_pad_start) / (double)MB);
+    }
+
+    printf("\n");
+    return failed ? 1 : 0;
+}
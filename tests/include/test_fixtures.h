@@ -0,0 +1,142 @@
+/*
+ * test_fixtures.h
+ *
+ * Helpers shared by the tests that map model-sized files: a file whose
+ * blocks carry their own index, the check for it, and the hugetlb pool
+ * counter used to see whether pages were taken or given back. Also the
+ * timing loop of the benchmarking tests and what the kernel tests need
+ * to build inputs and pick the library's settings.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "test_colors.h"
+
+// Size of a stamped block; each starts with its 64-bit block index
+const size_t BLOCK_SIZE = 4096;
+
+// Shortest time a benchmark is repeated for
+const double MIN_SECONDS = 0.2;
+
+inline double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Seconds per call of fn: one warm-up call (pool start, buffers, page
+// faults), then batches of calls until min_seconds have passed
+template <typename F>
+double seconds_per_call(F fn, double min_seconds = MIN_SECONDS, size_t batch = 1) {
+    fn();
+    size_t runs = 0;
+    double start = now(), elapsed = 0.0;
+    do {
+        for (size_t i = 0; i < batch; i++) {
+            fn();
+        }
+        runs += batch;
+        elapsed = now() - start;
+    } while (elapsed < min_seconds);
+    return elapsed / runs;
+}
+
+// Run the test again with name=value in the environment unless it is
+// already set, for settings the library reads once at startup. Returns
+// true when the variable was set, false when the exec failed.
+inline bool rerun_with_env(char** argv, const char* name, const char* value) {
+    if (getenv(name)) {
+        return true;
+    }
+    setenv(name, value, 1);
+    execv("/proc/self/exe", argv);
+    perror("execv");
+    return false;
+}
+
+// IEEE fp16 to float, independent of the library's conversions
+inline float half_to_float(uint16_t h) {
+    int sign = h >> 15, exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+    float value;
+    if (exponent == 0) {
+        value = ldexpf((float)mantissa, -24);
+    } else if (exponent == 31) {
+        value = mantissa ? NAN : INFINITY;
+    } else {
+        value = ldexpf((float)(mantissa | 0x400), exponent - 25);
+    }
+    return sign ? -value : value;
+}
+
+// Free 2MB hugepages from /proc/meminfo, -1 if unknown
+inline long hugepages_free() {
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (!f) {
+        return -1;
+    }
+    char line[256];
+    long value = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "HugePages_Free: %ld", &value) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+// Write a file where each block starts with its block index
+inline bool create_stamped_file(const char* path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        PRINT_FAIL("Cannot create test file: %s", strerror(errno));
+        return false;
+    }
+
+    const size_t chunk = 4 * 1024 * 1024;
+    char* buffer = (char*)calloc(1, chunk);
+    if (!buffer) {
+        close(fd);
+        return false;
+    }
+
+    for (size_t written = 0; written < size; written += chunk) {
+        size_t to_write = (size - written < chunk) ? (size - written) : chunk;
+        for (size_t off = 0; off < to_write; off += BLOCK_SIZE) {
+            uint64_t block = (written + off) / BLOCK_SIZE;
+            memcpy(buffer + off, &block, sizeof(block));
+        }
+        if (write(fd, buffer, to_write) != (ssize_t)to_write) {
+            PRINT_FAIL("Cannot write test data: %s", strerror(errno));
+            free(buffer);
+            close(fd);
+            return false;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return true;
+}
+
+// Count wrong block stamps in [from, to) of a mapping of the file
+inline size_t verify_range(const char* data, size_t from, size_t to) {
+    size_t mismatches = 0;
+    for (size_t pos = from; pos < to; pos += BLOCK_SIZE) {
+        uint64_t stamp;
+        memcpy(&stamp, data + pos, sizeof(stamp));
+        if (stamp != pos / BLOCK_SIZE) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
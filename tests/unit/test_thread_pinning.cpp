@@ -0,0 +1,155 @@
+/*
+ * test_thread_pinning.cpp
+ *
+ * Test the compute CPU order of each ZEN5_AFFINITY policy against a
+ * recorded Ryzen 9 9900X sysfs tree (CCD0 = cores 0-5, CCD1 = cores
+ * 6-11, SMT sibling of core n is CPU n+12), with all 24 CPUs and with
+ * the compose cpuset 0-11.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/test_colors.h"
+#include "../../src/topology.h"
+
+using zen5_turbo::Topology;
+
+typedef bool (*load_fn)(const char*, const char*, Topology*);
+typedef int (*order_fn)(const Topology*, const char*, int*, int);
+
+static char root[64];
+
+// Write text to root/path, creating the directories on the way
+static void put(const char* path, const char* text) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    for (char* p = full + strlen(root) + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(full, 0755);
+            *p = '/';
+        }
+    }
+    FILE* f = fopen(full, "w");
+    if (f) {
+        fprintf(f, "%s\n", text);
+        fclose(f);
+    }
+}
+
+static void record_9900x() {
+    put("devices/system/cpu/online", "0-23");
+    for (int cpu = 0; cpu < 24; cpu++) {
+        int core = cpu % 12;
+        char path[128];
+        char text[32];
+        snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        snprintf(text, sizeof(text), "%d,%d", core, core + 12);
+        put(path, text);
+        snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index3/level", cpu);
+        put(path, "3");
+        snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index3/size", cpu);
+        put(path, "32768K");
+        snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/cache/index3/shared_cpu_list", cpu);
+        put(path, core < 6 ? "0-5,12-17" : "6-11,18-23");
+    }
+}
+
+// Compare an order with the expected CPU list
+static bool expect_order(order_fn order, const Topology* t, const char* policy,
+                         const int* expected, int count, int* failed) {
+    int got[64];
+    int n = order(t, policy, got, 64);
+    bool match = (n == count);
+    for (int i = 0; match && i < count; i++) {
+        match = (got[i] == expected[i]);
+    }
+    if (!match) {
+        char line[256] = "";
+        size_t used = 0;
+        for (int i = 0; i < n && used < sizeof(line); i++) {
+            used += snprintf(line + used, sizeof(line) - used, i ? ",%d" : "%d", got[i]);
+        }
+        PRINT_FAIL("%s order: %s", policy, line);
+        (*failed)++;
+    }
+    return match;
+}
+
+int main() {
+    PRINT_TEST("Compute thread pinning order");
+    printf("\n");
+
+    void* handle = dlopen("./libzen5_optimizer.so", RTLD_NOW);
+    if (!handle) {
+        handle = dlopen("../build/libzen5_optimizer.so", RTLD_NOW);
+    }
+    if (!handle) {
+        PRINT_FAIL("%s", dlerror());
+        return 1;
+    }
+    load_fn load = (load_fn)dlsym(handle, "zen5_topology_load");
+    order_fn order = (order_fn)dlsym(handle, "zen5_pin_order");
+    if (!load || !order) {
+        PRINT_FAIL("zen5_topology_load / zen5_pin_order not exported");
+        return 1;
+    }
+
+    snprintf(root, sizeof(root), "/tmp/zen5_pinning_XXXXXX");
+    if (!mkdtemp(root)) {
+        PRINT_FAIL("Cannot create temporary directory");
+        return 1;
+    }
+    record_9900x();
+
+    static Topology t;
+    int failed = 0;
+
+    PRINT_RUN("All 24 CPUs");
+    if (!load(root, NULL, &t)) {
+        PRINT_FAIL("Recorded tree not loaded");
+        failed++;
+    } else {
+        const int compact[] = {0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 16, 17,
+                               6, 7, 8, 9, 10, 11, 18, 19, 20, 21, 22, 23};
+        const int spread[] = {0, 6, 1, 7, 2, 8, 3, 9, 4, 10, 5, 11,
+                              12, 18, 13, 19, 14, 20, 15, 21, 16, 22, 17, 23};
+        const int physical[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+                                12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23};
+        bool ok = expect_order(order, &t, "compact", compact, 24, &failed);
+        ok &= expect_order(order, &t, "spread", spread, 24, &failed);
+        ok &= expect_order(order, &t, "physical", physical, 24, &failed);
+        if (ok) {
+            PRINT_OK("compact fills CCD0 first, spread alternates CCDs, SMT siblings last");
+        }
+    }
+
+    PRINT_RUN("Compose cpuset 0-11");
+    if (!load(root, "0-11", &t)) {
+        PRINT_FAIL("Recorded tree with cpuset not loaded");
+        failed++;
+    } else {
+        const int compact[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+        const int spread[] = {0, 6, 1, 7, 2, 8, 3, 9, 4, 10, 5, 11};
+        bool ok = expect_order(order, &t, "compact", compact, 12, &failed);
+        ok &= expect_order(order, &t, "spread", spread, 12, &failed);
+        ok &= expect_order(order, &t, "physical", compact, 12, &failed);
+        if (ok) {
+            PRINT_OK("One core per thread, both CCDs used, no SMT siblings");
+        }
+    }
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    if (system(command) != 0) {
+        PRINT_WARN("Cannot remove %s", root);
+    }
+
+    dlclose(handle);
+    printf("\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * test_topology.cpp
+ *
+ * Test CPU topology discovery against recorded sysfs trees.
+ * Trees for a Ryzen 9 9900X (2 CCDs, SMT siblings at +12) and a
+ * two-node EPYC without SMT are written to a temporary directory and
+ * loaded through zen5_topology_load(), with and without a cpuset.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/test_colors.h"
+#include "../../src/topology.h"
+
+using zen5_turbo::Topology;
+
+typedef bool (*load_fn)(const char*, const char*, Topology*);
+
+static char root[64];
+
+// Write text to root/path, creating the directories on the way
+static void put(const char* path, const char* text) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    for (char* p = full + strlen(root) + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(full, 0755);
+            *p = '/';
+        }
+    }
+    FILE* f = fopen(full, "w");
+    if (f) {
+        fprintf(f, "%s\n", text);
+        fclose(f);
+    }
+}
+
+static void put_cpu(int cpu, const char* file, const char* text) {
+    char path[256];
+    snprintf(path, sizeof(path), "devices/system/cpu/cpu%d/%s", cpu, file);
+    put(path, text);
+}
+
+// Cache indexes as Zen 5 exports them: L1d, L1i, L2, L3
+static void put_caches(int cpu, const char* core_cpus, const char* l3_cpus) {
+    const char* levels[] = {"1", "1", "2", "3"};
+    const char* types[] = {"Data", "Instruction", "Unified", "Unified"};
+    const char* sizes[] = {"48K", "32K", "1024K", "32768K"};
+    for (int index = 0; index < 4; index++) {
+        char file[64];
+        snprintf(file, sizeof(file), "cache/index%d/level", index);
+        put_cpu(cpu, file, levels[index]);
+        snprintf(file, sizeof(file), "cache/index%d/type", index);
+        put_cpu(cpu, file, types[index]);
+        snprintf(file, sizeof(file), "cache/index%d/size", index);
+        put_cpu(cpu, file, sizes[index]);
+        snprintf(file, sizeof(file), "cache/index%d/shared_cpu_list", index);
+        put_cpu(cpu, file, index == 3 ? l3_cpus : core_cpus);
+    }
+}
+
+// Ryzen 9 9900X: cores 0-5 on CCD0, 6-11 on CCD1, thread 2 of core n is CPU n+12
+static void record_9900x() {
+    put("devices/system/cpu/online", "0-23");
+    for (int cpu = 0; cpu < 24; cpu++) {
+        int core = cpu % 12;
+        char siblings[32];
+        snprintf(siblings, sizeof(siblings), "%d,%d", core, core + 12);
+        put_cpu(cpu, "topology/thread_siblings_list", siblings);
+        put_caches(cpu, siblings, core < 6 ? "0-5,12-17" : "6-11,18-23");
+    }
+    put("devices/system/node/online", "0");
+    put("devices/system/node/node0/cpulist", "0-23");
+    put("devices/system/node/node0/meminfo", "Node 0 MemTotal:       65536000 kB");
+}
+
+// EPYC, SMT off: 4 CCDs of 8 cores, CCD0-1 on node 0 and CCD2-3 on node 1
+static void record_epyc() {
+    put("devices/system/cpu/online", "0-31");
+    for (int cpu = 0; cpu < 32; cpu++) {
+        char self[16];
+        char l3[16];
+        snprintf(self, sizeof(self), "%d", cpu);
+        snprintf(l3, sizeof(l3), "%d-%d", cpu / 8 * 8, cpu / 8 * 8 + 7);
+        put_cpu(cpu, "topology/thread_siblings_list", self);
+        put_caches(cpu, self, l3);
+    }
+    put("devices/system/node/online", "0-1");
+    put("devices/system/node/node0/cpulist", "0-15");
+    put("devices/system/node/node1/cpulist", "16-31");
+}
+
+static bool check(bool condition, const char* what, int* failed) {
+    if (!condition) {
+        PRINT_FAIL("%s", what);
+        (*failed)++;
+    }
+    return condition;
+}
+
+int main() {
+    PRINT_TEST("CPU topology discovery");
+    printf("\n");
+
+    void* handle = dlopen("./libzen5_optimizer.so", RTLD_NOW);
+    if (!handle) {
+        handle = dlopen("../build/libzen5_optimizer.so", RTLD_NOW);
+    }
+    if (!handle) {
+        PRINT_FAIL("%s", dlerror());
+        return 1;
+    }
+    load_fn load = (load_fn)dlsym(handle, "zen5_topology_load");
+    if (!load) {
+        PRINT_FAIL("zen5_topology_load not exported");
+        return 1;
+    }
+
+    static Topology t;
+    int failed = 0;
+    char command[128];
+
+    PRINT_RUN("Recorded Ryzen 9 9900X tree, all CPUs");
+    snprintf(root, sizeof(root), "/tmp/zen5_topology_XXXXXX");
+    if (!mkdtemp(root)) {
+        PRINT_FAIL("Cannot create temporary directory");
+        return 1;
+    }
+    record_9900x();
+    if (check(load(root, NULL, &t), "Recorded tree not loaded", &failed)) {
+        int before = failed;
+        check(t.cpu_count == 24 && t.core_count == 12, "Wrong CPU or core count", &failed);
+        check(t.ccd_count == 2 && t.threads_per_core == 2, "Wrong CCD or SMT count", &failed);
+        check(t.l1d_size == 48 * 1024, "Wrong L1d size", &failed);
+        check(t.l2_size == 1024 * 1024, "Wrong L2 size", &failed);
+        check(t.ccds[0].l3_size == 32 * 1024 * 1024, "Wrong L3 size", &failed);
+        check(t.ccds[0].cores == 6 && t.ccds[1].cores == 6, "Wrong cores per CCD", &failed);
+        check(t.cpus[17].ccd == 0 && t.cpus[18].ccd == 1, "SMT sibling on the wrong CCD", &failed);
+        check(t.cpus[12].core == t.cpus[0].core && t.cpus[12].smt == 1,
+              "CPU 12 not the sibling of CPU 0", &failed);
+        check(t.node_count == 1 && t.nodes[0].memory == 65536000ULL * 1024,
+              "Wrong NUMA node", &failed);
+        if (failed == before) {
+            PRINT_OK("2 CCDs x 6 cores x 2 threads, 48KB L1d, 1MB L2, 32MB L3");
+        }
+    }
+
+    PRINT_RUN("Same tree, compose cpuset 0-11");
+    if (check(load(root, "0-11", &t), "Tree with cpuset not loaded", &failed)) {
+        int before = failed;
+        check(t.allowed_count == 12, "Wrong allowed CPU count", &failed);
+        check(t.ccds[0].allowed_cores == 6 && t.ccds[1].allowed_cores == 6,
+              "Allowed cores not spread over both CCDs", &failed);
+        check(t.ccds[0].allowed_cpus == 6 && !t.cpus[12].allowed,
+              "SMT siblings allowed", &failed);
+        if (failed == before) {
+            PRINT_OK("12 CPUs allowed: one thread of every core on both CCDs");
+        }
+    }
+    check(!load(root, "0-x", &t), "Malformed cpuset accepted", &failed);
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    system(command);
+
+    PRINT_RUN("Recorded two-node EPYC tree without SMT");
+    snprintf(root, sizeof(root), "/tmp/zen5_topology_XXXXXX");
+    if (!mkdtemp(root)) {
+        PRINT_FAIL("Cannot create temporary directory");
+        return 1;
+    }
+    record_epyc();
+    if (check(load(root, "8-23", &t), "Recorded tree not loaded", &failed)) {
+        int before = failed;
+        check(t.ccd_count == 4 && t.core_count == 32 && t.threads_per_core == 1,
+              "Wrong CCD, core or SMT count", &failed);
+        check(t.node_count == 2 && t.ccds[1].node == 0 && t.ccds[2].node == 1,
+              "CCDs on the wrong node", &failed);
+        check(t.nodes[0].allowed_cpus == 8 && t.nodes[1].allowed_cpus == 8,
+              "Wrong allowed CPUs per node", &failed);
+        check(t.ccds[0].allowed_cpus == 0 && t.ccds[3].allowed_cpus == 0,
+              "CPUs outside the cpuset allowed", &failed);
+        if (failed == before) {
+            PRINT_OK("4 CCDs over 2 nodes, cpuset covers CCD1 and CCD2");
+        }
+    }
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    system(command);
+
+    PRINT_RUN("Live tree of this machine");
+    if (check(load("/sys", NULL, &t), "Live topology not loaded", &failed)) {
+        check(t.allowed_count > 0 && t.ccd_count > 0, "Live topology empty", &failed);
+        PRINT_INFO("%d CCDs, %d cores, %d threads, %d allowed", t.ccd_count, t.core_count,
+                   t.cpu_count, t.allowed_count);
+    }
+    check(!load("/nonexistent", NULL, &t), "Missing tree reported as loaded", &failed);
+
+    dlclose(handle);
+    printf("\n");
+    return failed ? 1 : 0;
+}